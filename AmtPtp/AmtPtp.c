@@ -0,0 +1,590 @@
+#include "AmtPtp.h"
+
+// HID short item tags (type and tag bits of the prefix byte)
+#define HID_TAG_MASK 0xFC
+#define HID_TAG_INPUT 0x80
+#define HID_TAG_COLLECTION 0xA0
+#define HID_TAG_END_COLLECTION 0xC0
+#define HID_TAG_USAGE_PAGE 0x04
+#define HID_TAG_LOGICAL_MIN 0x14
+#define HID_TAG_LOGICAL_MAX 0x24
+#define HID_TAG_REPORT_SIZE 0x74
+#define HID_TAG_REPORT_ID 0x84
+#define HID_TAG_REPORT_COUNT 0x94
+#define HID_TAG_USAGE 0x08
+#define HID_TAG_USAGE_MIN 0x18
+#define HID_TAG_USAGE_MAX 0x28
+#define HID_LONG_ITEM 0xFE
+
+#define HID_MAIN_CONSTANT 0x01
+#define HID_MAIN_VARIABLE 0x02
+#define HID_COLLECTION_LOGICAL 0x02
+
+// Usages the PTP report is built from (page << 16 | usage)
+#define HID_USAGE_X 0x00010030
+#define HID_USAGE_Y 0x00010031
+#define HID_USAGE_BUTTON1 0x00090001
+#define HID_USAGE_FINGER 0x000D0022
+#define HID_USAGE_TIP 0x000D0042
+#define HID_USAGE_CONFIDENCE 0x000D0047
+#define HID_USAGE_CONTACT_ID 0x000D0051
+#define HID_USAGE_CONTACT_COUNT 0x000D0054
+#define HID_USAGE_SCAN_TIME 0x000D0056
+
+// Most local usages kept per main item, and most report IDs tracked
+#define AMT_MAX_USAGES 16
+#define AMT_MAX_REPORTS 16
+
+// Magic Trackpad 2 finger record, as decoded by the Linux hid-magicmouse
+// driver: X in bits 0-12 and Y in bits 13-25 (both signed), the touch
+// state in bits 30-31 (2 while touching) and the finger id in byte 8.
+#define AMT_MT2_FINGER_SIZE 9
+#define AMT_MT2_FIELDS \
+	{ 0, 13, TRUE },        /* x */ \
+	{ 13, 13, TRUE },       /* y */ \
+	{ 64, 4, FALSE },       /* id */ \
+	{ 30, 2, FALSE },       /* state */ \
+	2,                      /* touchingState */ \
+	TRUE,                   /* negateY */ \
+	-3678, 3934, -2478, 2587
+
+const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Usb = {
+	0x02, 12, AMT_MT2_FINGER_SIZE, 1, AMT_MT2_FIELDS
+};
+
+const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Bluetooth = {
+	0x31, 4, AMT_MT2_FINGER_SIZE, 1, AMT_MT2_FIELDS
+};
+
+const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Vendor = {
+	0x44, 12, AMT_MT2_FINGER_SIZE, 1, AMT_MT2_FIELDS
+};
+
+typedef struct _AMT_REPORT_OFFSET {
+	UCHAR reportId;
+	ULONG bitOffset;
+} AMT_REPORT_OFFSET;
+
+typedef struct _AMT_FINGER {
+	UCHAR id;
+	BOOLEAN matched;
+	LONG x;
+	LONG y;
+} AMT_FINGER;
+
+static ULONG
+AmtItemUnsigned(
+	_In_reads_bytes_(size) const UCHAR *value,
+	_In_ int size)
+{
+	ULONG result = 0;
+
+	for (int i = size - 1; i >= 0; --i) {
+		result = (result << 8) | value[i];
+	}
+	return result;
+}
+
+static LONG
+AmtItemSigned(
+	_In_reads_bytes_(size) const UCHAR *value,
+	_In_ int size)
+{
+	ULONG result = AmtItemUnsigned(value, size);
+
+	if (size > 0 && size < 4 && (value[size - 1] & 0x80)) {
+		result |= ~0UL << (size * 8);
+	}
+	return (LONG)result;
+}
+
+static PAMT_PTP_FIELD
+AmtPtpFieldForUsage(
+	_Inout_ PAMT_PTP_LAYOUT layout,
+	_In_ ULONG usage,
+	_In_ BOOLEAN inFinger)
+{
+	ULONG slot = layout->contactSlots - 1;
+
+	if (inFinger) {
+		switch (usage) {
+		case HID_USAGE_CONFIDENCE:
+			return &layout->contacts[slot].confidence;
+		case HID_USAGE_TIP:
+			return &layout->contacts[slot].tip;
+		case HID_USAGE_CONTACT_ID:
+			return &layout->contacts[slot].contactId;
+		case HID_USAGE_X:
+			return &layout->contacts[slot].x;
+		case HID_USAGE_Y:
+			return &layout->contacts[slot].y;
+		}
+		return NULL;
+	}
+
+	switch (usage) {
+	case HID_USAGE_SCAN_TIME:
+		return &layout->scanTime;
+	case HID_USAGE_CONTACT_COUNT:
+		return &layout->contactCount;
+	case HID_USAGE_BUTTON1:
+		return &layout->button;
+	}
+	return NULL;
+}
+
+BOOLEAN
+AmtParsePtpLayout(
+	_In_reads_bytes_(descriptorLen) const UCHAR *descriptor,
+	_In_ size_t descriptorLen,
+	_Out_ PAMT_PTP_LAYOUT layout)
+{
+	// The same minimal HID parser as Pad2Screen's P2S_ParseContactLayout:
+	// no push/pop or delimiters. It is kept as a copy rather than shared
+	// because the two projects build on their own and fill different
+	// layouts; Pad2Screen only needs X and Y, while this one needs every
+	// PTP field with its logical range. Fields are taken from the first
+	// report that has a finger collection; inputs of other reports only
+	// move their own offsets.
+	ULONG usagePage = 0;
+	LONG logicalMin = 0;
+	LONG logicalMax = 0;
+	ULONG reportSize = 0;
+	ULONG reportCount = 0;
+	UCHAR reportId = 0;
+	ULONG usages[AMT_MAX_USAGES];
+	ULONG usageCount = 0;
+	ULONG usageMin = 0;
+	BOOLEAN haveUsageMin = FALSE;
+	AMT_REPORT_OFFSET offsets[AMT_MAX_REPORTS];
+	ULONG offsetCount = 0;
+	ULONG depth = 0;
+	ULONG fingerDepth = 0;
+	BOOLEAN haveReport = FALSE;
+
+	RtlZeroMemory(layout, sizeof(*layout));
+
+	for (size_t i = 0; i < descriptorLen;) {
+		UCHAR type = descriptor[i++];
+		const UCHAR *value = &descriptor[i];
+		int size = type & 3;
+		if (size == 3) {
+			size++;
+		}
+
+		if (type == HID_LONG_ITEM) {
+			// Long items: data size is in the next byte
+			if (i >= descriptorLen) {
+				break;
+			}
+			i += 2 + (size_t)descriptor[i];
+			continue;
+		}
+		if (i + size > descriptorLen) {
+			break;
+		}
+		i += size;
+
+		switch (type & HID_TAG_MASK) {
+		case HID_TAG_USAGE_PAGE:
+			usagePage = AmtItemUnsigned(value, size);
+			break;
+		case HID_TAG_LOGICAL_MIN:
+			logicalMin = AmtItemSigned(value, size);
+			break;
+		case HID_TAG_LOGICAL_MAX:
+			logicalMax = (logicalMin >= 0) ? (LONG)AmtItemUnsigned(value, size) : AmtItemSigned(value, size);
+			break;
+		case HID_TAG_REPORT_SIZE:
+			reportSize = AmtItemUnsigned(value, size);
+			break;
+		case HID_TAG_REPORT_ID:
+			reportId = (UCHAR)AmtItemUnsigned(value, size);
+			break;
+		case HID_TAG_REPORT_COUNT:
+			reportCount = AmtItemUnsigned(value, size);
+			break;
+		case HID_TAG_USAGE:
+			if (usageCount < AMT_MAX_USAGES) {
+				// 4 byte usages carry their own usage page
+				usages[usageCount++] = (size == 4) ? AmtItemUnsigned(value, size) : (usagePage << 16) | AmtItemUnsigned(value, size);
+			}
+			break;
+		case HID_TAG_USAGE_MIN:
+			usageMin = AmtItemUnsigned(value, size);
+			haveUsageMin = TRUE;
+			break;
+		case HID_TAG_USAGE_MAX:
+			if (haveUsageMin) {
+				for (ULONG usage = usageMin; usage <= AmtItemUnsigned(value, size) && usageCount < AMT_MAX_USAGES; ++usage) {
+					usages[usageCount++] = (usagePage << 16) | usage;
+				}
+				haveUsageMin = FALSE;
+			}
+			break;
+		case HID_TAG_COLLECTION:
+			depth++;
+			if (fingerDepth == 0 && AmtItemUnsigned(value, size) == HID_COLLECTION_LOGICAL &&
+				usageCount != 0 && usages[usageCount - 1] == HID_USAGE_FINGER &&
+				(!haveReport || layout->reportId == reportId) &&
+				layout->contactSlots < AMT_MAX_CONTACTS) {
+				layout->reportId = reportId;
+				layout->contactSlots++;
+				haveReport = TRUE;
+				fingerDepth = depth;
+			}
+			usageCount = 0;
+			haveUsageMin = FALSE;
+			break;
+		case HID_TAG_END_COLLECTION:
+			if (depth == fingerDepth) {
+				fingerDepth = 0;
+			}
+			if (depth != 0) {
+				depth--;
+			}
+			usageCount = 0;
+			haveUsageMin = FALSE;
+			break;
+		case HID_TAG_INPUT: {
+			ULONG data = AmtItemUnsigned(value, size);
+			AMT_REPORT_OFFSET *offset = NULL;
+
+			// Find the running bit offset of this report. Data starts
+			// after the report ID byte when report IDs are used.
+			for (ULONG r = 0; r < offsetCount; ++r) {
+				if (offsets[r].reportId == reportId) {
+					offset = &offsets[r];
+					break;
+				}
+			}
+			if (offset == NULL) {
+				if (offsetCount == AMT_MAX_REPORTS) {
+					return FALSE;
+				}
+				offset = &offsets[offsetCount++];
+				offset->reportId = reportId;
+				offset->bitOffset = (reportId != 0) ? 8 : 0;
+			}
+
+			if (!(data & HID_MAIN_CONSTANT) && (data & HID_MAIN_VARIABLE) &&
+				haveReport && layout->reportId == reportId) {
+				for (ULONG field = 0; field < reportCount && usageCount != 0; ++field) {
+					// The last usage applies to the remaining fields
+					ULONG usage = usages[(field < usageCount) ? field : usageCount - 1];
+					PAMT_PTP_FIELD ptpField = AmtPtpFieldForUsage(layout, usage, fingerDepth != 0);
+
+					if (ptpField != NULL && ptpField->bitSize == 0 && reportSize != 0 && reportSize <= 32) {
+						ptpField->bitOffset = offset->bitOffset + field * reportSize;
+						ptpField->bitSize = reportSize;
+						ptpField->logicalMin = logicalMin;
+						ptpField->logicalMax = logicalMax;
+					}
+				}
+			}
+			offset->bitOffset += reportSize * reportCount;
+			usageCount = 0;
+			haveUsageMin = FALSE;
+			break;
+		}
+		default:
+			if ((type & 0x0C) == 0) {
+				// Output, feature and other main items
+				usageCount = 0;
+				haveUsageMin = FALSE;
+			}
+			break;
+		}
+	}
+
+	if (!haveReport) {
+		return FALSE;
+	}
+
+	for (ULONG r = 0; r < offsetCount; ++r) {
+		if (offsets[r].reportId == layout->reportId) {
+			layout->reportSize = (offsets[r].bitOffset + 7) / 8;
+		}
+	}
+
+	// Every slot needs at least a tip switch and coordinates
+	for (ULONG slot = 0; slot < layout->contactSlots; ++slot) {
+		if (layout->contacts[slot].tip.bitSize == 0 ||
+			layout->contacts[slot].x.bitSize == 0 ||
+			layout->contacts[slot].y.bitSize == 0) {
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+static LONG64
+AmtBuildScale(
+	_In_ LONG vendorMin,
+	_In_ LONG vendorMax,
+	_In_ const AMT_PTP_FIELD *field)
+{
+	LONG64 inSpan = (LONG64)vendorMax - vendorMin;
+
+	if (inSpan <= 0) {
+		inSpan = 1;
+	}
+	return ((((LONG64)field->logicalMax - field->logicalMin) << AMT_FIXED_SHIFT) + inSpan / 2) / inSpan;
+}
+
+BOOLEAN
+AmtInitializeTranslator(
+	_In_ const AMT_REPORT_LAYOUT *vendor,
+	_In_ const AMT_PTP_LAYOUT *ptp,
+	_Out_ PAMT_TRANSLATOR translator)
+{
+	const AMT_PTP_FIELD *contactId = &ptp->contacts[0].contactId;
+	ULONG maxContacts = AMT_MAX_CONTACTS;
+
+	RtlZeroMemory(translator, sizeof(*translator));
+
+	if (ptp->contactSlots == 0 || ptp->reportSize == 0 || vendor->fingerSize == 0) {
+		return FALSE;
+	}
+
+	translator->vendor = vendor;
+	translator->ptp = *ptp;
+	translator->scaleX = AmtBuildScale(vendor->minX, vendor->maxX, &ptp->contacts[0].x);
+	translator->scaleY = AmtBuildScale(vendor->minY, vendor->maxY, &ptp->contacts[0].y);
+
+	// A contact needs an identifier of its own until the report after it lifts
+	if (contactId->bitSize != 0 && contactId->logicalMax >= contactId->logicalMin &&
+		(ULONG64)contactId->logicalMax - contactId->logicalMin + 1 < maxContacts) {
+		maxContacts = (ULONG)(contactId->logicalMax - contactId->logicalMin + 1);
+	}
+	if (ptp->contactCount.bitSize != 0 && ptp->contactCount.logicalMax >= 0 &&
+		(ULONG)ptp->contactCount.logicalMax < maxContacts) {
+		maxContacts = (ULONG)ptp->contactCount.logicalMax;
+	}
+	translator->maxContacts = maxContacts;
+
+	return maxContacts != 0;
+}
+
+static LONG
+AmtReadField(
+	_In_ const UCHAR *record,
+	_In_ const AMT_FIELD *field)
+{
+	ULONG first = field->bitOffset / 8;
+	ULONG shift = field->bitOffset % 8;
+	ULONG bytes = (shift + field->bitSize + 7) / 8;
+	ULONG64 bits = 0;
+
+	for (ULONG i = 0; i < bytes; ++i) {
+		bits |= (ULONG64)record[first + i] << (8 * i);
+	}
+	bits = (bits >> shift) & ((1ULL << field->bitSize) - 1);
+	if (field->isSigned && (bits >> (field->bitSize - 1)) & 1) {
+		bits |= ~0ULL << field->bitSize;
+	}
+	return (LONG)bits;
+}
+
+static void
+AmtWriteField(
+	_Inout_ UCHAR *report,
+	_In_ const AMT_PTP_FIELD *field,
+	_In_ LONG value)
+{
+	ULONG first = field->bitOffset / 8;
+	ULONG shift = field->bitOffset % 8;
+	ULONG bytes = (shift + field->bitSize + 7) / 8;
+	ULONG64 mask = ((1ULL << field->bitSize) - 1) << shift;
+	ULONG64 bits = ((ULONG64)(ULONG)value << shift) & mask;
+
+	if (field->bitSize == 0) {
+		return;
+	}
+
+	for (ULONG i = 0; i < bytes; ++i) {
+		report[first + i] = (UCHAR)((report[first + i] & ~(mask >> (8 * i))) | (bits >> (8 * i)));
+	}
+}
+
+static LONG
+AmtScale(
+	_In_ LONG value,
+	_In_ LONG vendorMin,
+	_In_ LONG vendorMax,
+	_In_ LONG64 scale,
+	_In_ const AMT_PTP_FIELD *field)
+{
+	if (value < vendorMin) {
+		value = vendorMin;
+	} else if (value > vendorMax) {
+		value = vendorMax;
+	}
+	// Rounded, so the far edge of the pad lands on logicalMax
+	value = field->logicalMin + (LONG)((((LONG64)value - vendorMin) * scale + (1 << (AMT_FIXED_SHIFT - 1))) >> AMT_FIXED_SHIFT);
+	return min(value, field->logicalMax);
+}
+
+static BOOLEAN
+AmtAllocateContactId(
+	_In_ const AMT_TRANSLATOR *translator,
+	_Out_ UCHAR *contactId)
+{
+	// Lowest identifier not held by a tracked contact, lifted ones included
+	LONG first = translator->ptp.contacts[0].contactId.logicalMin;
+
+	for (ULONG candidate = 0; candidate < translator->maxContacts; ++candidate) {
+		BOOLEAN used = FALSE;
+
+		for (ULONG c = 0; c < translator->contactCount; ++c) {
+			if (translator->contacts[c].contactId == (UCHAR)(first + candidate)) {
+				used = TRUE;
+				break;
+			}
+		}
+		if (!used) {
+			*contactId = (UCHAR)(first + candidate);
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+ULONG
+AmtTranslateReport(
+	_Inout_ PAMT_TRANSLATOR translator,
+	_In_reads_bytes_(reportLen) const UCHAR *report,
+	_In_ size_t reportLen,
+	_In_ USHORT scanTime,
+	_Out_writes_bytes_(outputLen) UCHAR *output,
+	_In_ size_t outputLen)
+{
+	const AMT_REPORT_LAYOUT *vendor = translator->vendor;
+	const AMT_PTP_LAYOUT *ptp = &translator->ptp;
+	AMT_FINGER fingers[AMT_MAX_FINGERS];
+	ULONG fingerCount = 0;
+	ULONG records;
+	ULONG kept = 0;
+	ULONG reportCount;
+	ULONG contactCount;
+	BOOLEAN button;
+
+	if (vendor == NULL || reportLen < vendor->headerSize || report[0] != vendor->reportId) {
+		return 0;
+	}
+
+	// Without room for one report the frame would be lost, so leave the
+	// contacts as they are for the caller to retry with a larger buffer
+	if (outputLen < ptp->reportSize) {
+		return 0;
+	}
+
+	// Collect the fingers that are on the surface, in PTP units
+	records = (ULONG)min((reportLen - vendor->headerSize) / vendor->fingerSize, AMT_MAX_FINGERS);
+	for (ULONG r = 0; r < records; ++r) {
+		const UCHAR *record = report + vendor->headerSize + r * vendor->fingerSize;
+		LONG y;
+
+		if ((ULONG)AmtReadField(record, &vendor->state) != vendor->touchingState) {
+			continue;
+		}
+
+		y = AmtReadField(record, &vendor->y);
+		if (vendor->negateY) {
+			y = -y;
+		}
+
+		fingers[fingerCount].id = (UCHAR)AmtReadField(record, &vendor->id);
+		fingers[fingerCount].matched = FALSE;
+		fingers[fingerCount].x = AmtScale(AmtReadField(record, &vendor->x),
+			vendor->minX, vendor->maxX, translator->scaleX, &ptp->contacts[0].x);
+		fingers[fingerCount].y = AmtScale(y,
+			vendor->minY, vendor->maxY, translator->scaleY, &ptp->contacts[0].y);
+		fingerCount++;
+	}
+	button = (vendor->buttonOffset < reportLen) && (report[vendor->buttonOffset] & 1);
+
+	// Contacts reported lifted last frame are gone now. The rest either
+	// move with their finger or are lifted at their last position.
+	for (ULONG c = 0; c < translator->contactCount; ++c) {
+		AMT_CONTACT contact = translator->contacts[c];
+
+		if (!contact.tip) {
+			continue;
+		}
+
+		contact.tip = FALSE;
+		for (ULONG f = 0; f < fingerCount; ++f) {
+			if (!fingers[f].matched && fingers[f].id == contact.fingerId) {
+				fingers[f].matched = TRUE;
+				contact.tip = TRUE;
+				contact.x = fingers[f].x;
+				contact.y = fingers[f].y;
+				break;
+			}
+		}
+		translator->contacts[kept++] = contact;
+	}
+	translator->contactCount = kept;
+
+	// New fingers get the lowest free contact identifier
+	for (ULONG f = 0; f < fingerCount && translator->contactCount < translator->maxContacts; ++f) {
+		PAMT_CONTACT contact = &translator->contacts[translator->contactCount];
+
+		if (fingers[f].matched || !AmtAllocateContactId(translator, &contact->contactId)) {
+			continue;
+		}
+		contact->fingerId = fingers[f].id;
+		contact->tip = TRUE;
+		contact->x = fingers[f].x;
+		contact->y = fingers[f].y;
+		translator->contactCount++;
+	}
+
+	// Nothing to tell when no finger is or just was down and the button
+	// hasn't changed
+	if (translator->contactCount == 0 && button == translator->button) {
+		return 0;
+	}
+	translator->button = button;
+
+	// Contacts beyond the first report's slots go in follow-up reports
+	// with a contact count of 0
+	contactCount = translator->contactCount;
+	reportCount = (contactCount + ptp->contactSlots - 1) / ptp->contactSlots;
+	if (reportCount == 0) {
+		reportCount = 1;
+	}
+	if (reportCount > outputLen / ptp->reportSize) {
+		reportCount = (ULONG)(outputLen / ptp->reportSize);
+		contactCount = min(contactCount, reportCount * ptp->contactSlots);
+	}
+
+	for (ULONG r = 0; r < reportCount; ++r) {
+		UCHAR *ptpReport = output + r * ptp->reportSize;
+
+		RtlZeroMemory(ptpReport, ptp->reportSize);
+		if (ptp->reportId != 0) {
+			ptpReport[0] = ptp->reportId;
+		}
+
+		for (ULONG slot = 0; slot < ptp->contactSlots; ++slot) {
+			ULONG c = r * ptp->contactSlots + slot;
+
+			if (c >= contactCount) {
+				break;
+			}
+			AmtWriteField(ptpReport, &ptp->contacts[slot].confidence, 1);
+			AmtWriteField(ptpReport, &ptp->contacts[slot].tip, translator->contacts[c].tip);
+			AmtWriteField(ptpReport, &ptp->contacts[slot].contactId, translator->contacts[c].contactId);
+			AmtWriteField(ptpReport, &ptp->contacts[slot].x, translator->contacts[c].x);
+			AmtWriteField(ptpReport, &ptp->contacts[slot].y, translator->contacts[c].y);
+		}
+
+		AmtWriteField(ptpReport, &ptp->scanTime, scanTime);
+		AmtWriteField(ptpReport, &ptp->contactCount, (r == 0) ? contactCount : 0);
+		AmtWriteField(ptpReport, &ptp->button, button);
+	}
+
+	return reportCount;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+// Translates Apple multi-touch trackpad reports into Windows precision
+// touchpad (PTP) input reports.
+//
+// The vendor report is read through a layout table (where the finger
+// records are and how their fields are packed) and the PTP report is
+// written through a layout parsed from the PTP report descriptor, so a
+// new trackpad or a different PTP descriptor only needs a new table.
+//
+// Nothing in here allocates memory or touches the OS beyond the basic
+// types, so it can run at any IRQL in a driver or in user mode.
+
+#ifdef _KERNEL_MODE
+#include <ntddk.h>
+#else
+#include <windows.h>
+#endif
+
+EXTERN_C_START
+
+// Most finger records read from one vendor report
+#define AMT_MAX_FINGERS 16
+
+// Most contacts tracked at once, and most finger collections in one PTP report
+#define AMT_MAX_CONTACTS 10
+
+// Fixed-point scale of the coordinate scaling factors (16.16)
+#define AMT_FIXED_SHIFT 16
+
+// One field of a finger record
+typedef struct _AMT_FIELD {
+	USHORT bitOffset;       // from the start of the record, LSB first
+	UCHAR bitSize;          // 1 to 32
+	BOOLEAN isSigned;
+} AMT_FIELD, *PAMT_FIELD;
+
+// Layout of a vendor multi-touch report
+typedef struct _AMT_REPORT_LAYOUT {
+	UCHAR reportId;
+	USHORT headerSize;      // bytes before the first finger record, report ID included
+	USHORT fingerSize;      // bytes per finger record
+	USHORT buttonOffset;    // byte holding the button state in bit 0
+	AMT_FIELD x;
+	AMT_FIELD y;
+	AMT_FIELD id;           // finger identifier, stable while it touches
+	AMT_FIELD state;
+	ULONG touchingState;    // value of state while the finger is on the surface
+	BOOLEAN negateY;        // the sensor's Y axis points up
+	LONG minX;              // coordinate range, after negating Y
+	LONG maxX;
+	LONG minY;
+	LONG maxY;
+} AMT_REPORT_LAYOUT, *PAMT_REPORT_LAYOUT;
+
+// Magic Trackpad 2 over USB (report 0x02) and Bluetooth (report 0x31).
+// Both carry 9-byte finger records after a 12 and a 4 byte header.
+extern const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Usb;
+extern const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Bluetooth;
+
+// Magic Trackpad 2 vendor collection report 0x44 (1387 bytes). Taken to
+// use the same finger records as the USB report; unused records are all
+// zero, which reads as a finger that isn't touching.
+extern const AMT_REPORT_LAYOUT AmtLayoutMagicTrackpad2Vendor;
+
+// One field of the PTP input report
+typedef struct _AMT_PTP_FIELD {
+	ULONG bitOffset;        // from the start of the report, report ID included
+	ULONG bitSize;          // 0 if the descriptor doesn't have the field
+	LONG logicalMin;
+	LONG logicalMax;
+} AMT_PTP_FIELD, *PAMT_PTP_FIELD;
+
+// Where the PTP fields live in the touchpad input report, found by
+// AmtParsePtpLayout from the report descriptor
+typedef struct _AMT_PTP_LAYOUT {
+	UCHAR reportId;
+	ULONG reportSize;       // bytes, report ID included
+	ULONG contactSlots;     // finger collections per report
+	struct {
+		AMT_PTP_FIELD confidence;
+		AMT_PTP_FIELD tip;
+		AMT_PTP_FIELD contactId;
+		AMT_PTP_FIELD x;
+		AMT_PTP_FIELD y;
+	} contacts[AMT_MAX_CONTACTS];
+	AMT_PTP_FIELD scanTime;
+	AMT_PTP_FIELD contactCount;
+	AMT_PTP_FIELD button;
+} AMT_PTP_LAYOUT, *PAMT_PTP_LAYOUT;
+
+// A contact being reported to the PTP side
+typedef struct _AMT_CONTACT {
+	UCHAR fingerId;         // id from the vendor report
+	UCHAR contactId;        // PTP contact identifier
+	BOOLEAN tip;            // FALSE for the one report after the finger lifts
+	LONG x;                 // PTP logical units
+	LONG y;
+} AMT_CONTACT, *PAMT_CONTACT;
+
+typedef struct _AMT_TRANSLATOR {
+	const AMT_REPORT_LAYOUT *vendor;
+	AMT_PTP_LAYOUT ptp;
+
+	// Vendor to PTP coordinates: x' = min + ((x - vendorMin) * scale >> AMT_FIXED_SHIFT)
+	LONG64 scaleX;
+	LONG64 scaleY;
+
+	// Contacts from the last frame, in the order they first touched
+	AMT_CONTACT contacts[AMT_MAX_CONTACTS];
+	ULONG contactCount;
+	ULONG maxContacts;      // limited by the PTP contact ID and count ranges
+	BOOLEAN button;
+} AMT_TRANSLATOR, *PAMT_TRANSLATOR;
+
+BOOLEAN
+AmtParsePtpLayout(
+	_In_reads_bytes_(descriptorLen) const UCHAR *descriptor,
+	_In_ size_t descriptorLen,
+	_Out_ PAMT_PTP_LAYOUT layout);
+
+BOOLEAN
+AmtInitializeTranslator(
+	_In_ const AMT_REPORT_LAYOUT *vendor,
+	_In_ const AMT_PTP_LAYOUT *ptp,
+	_Out_ PAMT_TRANSLATOR translator);
+
+// Converts one vendor report. Writes as many PTP reports as the frame
+// needs (several when there are more contacts than slots per report),
+// each ptp.reportSize bytes long, and returns how many; 0 when the
+// report isn't from this layout or nothing changed since an idle frame.
+// Output shorter than one report is rejected with 0 before the
+// translator's state changes.
+// Room for maxContacts / ptp.contactSlots reports (rounded up) is always
+// enough; contacts that don't fit are left out of the frame.
+// scanTime is in 100 microsecond units.
+ULONG
+AmtTranslateReport(
+	_Inout_ PAMT_TRANSLATOR translator,
+	_In_reads_bytes_(reportLen) const UCHAR *report,
+	_In_ size_t reportLen,
+	_In_ USHORT scanTime,
+	_Out_writes_bytes_(outputLen) UCHAR *output,
+	_In_ size_t outputLen);
+
+EXTERN_C_END
@@ -0,0 +1,110 @@
+// Throughput benchmark for the AmtPtp translator. Builds on a host with
+// the stub windows.h in this directory:
+//
+//   cc -O2 -Wall -Wextra -I . -I test test/AmtPtpBench.c AmtPtp.c -o AmtPtpBench
+//
+// Feeds Magic Trackpad 2 frames with 1 to 5 fingers moving across the pad
+// into a PTP layout of one contact per report (hybrid reporting), and
+// prints the time per vendor report and the PTP reports written per second.
+
+#include "AmtPtp.h"
+
+#include <stdio.h>
+#include <time.h>
+
+// Same layout as the golden test: report 5, one finger collection,
+// 12-bit X/Y, scan time, contact count and a button
+static const UCHAR PtpDescriptor[] = {
+	0x05, 0x0d, 0x09, 0x05, 0xa1, 0x01, 0x85, 0x05, 0x09, 0x22, 0xa1, 0x02, 0x15, 0x00, 0x25, 0x01,
+	0x09, 0x47, 0x09, 0x42, 0x95, 0x02, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x02, 0x25, 0x02,
+	0x09, 0x51, 0x81, 0x02, 0x75, 0x01, 0x95, 0x04, 0x81, 0x03, 0x05, 0x01, 0x15, 0x00, 0x26, 0xff,
+	0x0f, 0x75, 0x10, 0x55, 0x0e, 0x65, 0x13, 0x09, 0x30, 0x35, 0x00, 0x46, 0x90, 0x01, 0x95, 0x01,
+	0x81, 0x02, 0x46, 0x13, 0x01, 0x09, 0x31, 0x81, 0x02, 0xc0, 0x55, 0x0C, 0x66, 0x01, 0x10, 0x47,
+	0xff, 0xff, 0x00, 0x00, 0x27, 0xff, 0xff, 0x00, 0x00, 0x75, 0x10, 0x95, 0x01, 0x05, 0x0d, 0x09,
+	0x56, 0x81, 0x02, 0x09, 0x54, 0x25, 0x7f, 0x95, 0x01, 0x75, 0x08, 0x81, 0x02, 0x05, 0x09, 0x09,
+	0x01, 0x09, 0x02, 0x09, 0x03, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01, 0x81, 0x02, 0x95, 0x07, 0x81,
+	0x03, 0x05, 0x0d, 0x85, 0x06, 0x09, 0x55, 0x09, 0x59, 0x75, 0x04, 0x95, 0x02, 0x25, 0x0f, 0xb1,
+	0x02, 0xc0, 0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xa1, 0x00, 0x05, 0x09,
+	0x19, 0x01, 0x29, 0x02, 0x25, 0x01, 0x75, 0x01, 0x95, 0x02, 0x81, 0x02, 0xc0, 0xc0
+};
+
+#define MT2_STATE_TOUCHING 2
+#define MT2_HEADER_SIZE 12
+#define MT2_FINGER_SIZE 9
+
+#define BENCH_FRAMES 2000000
+
+static void
+PutFinger(
+	_Out_writes_bytes_(9) UCHAR *record,
+	_In_ LONG x,
+	_In_ LONG y,
+	_In_ UCHAR id,
+	_In_ ULONG state)
+{
+	ULONG word = ((ULONG)x & 0x1fff) | (((ULONG)-y & 0x1fff) << 13) | (state << 30);
+
+	memset(record, 0, 9);
+	record[0] = (UCHAR)word;
+	record[1] = (UCHAR)(word >> 8);
+	record[2] = (UCHAR)(word >> 16);
+	record[3] = (UCHAR)(word >> 24);
+	record[8] = id;
+}
+
+static double
+Seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+	static UCHAR report[MT2_HEADER_SIZE + 5 * MT2_FINGER_SIZE];
+	static UCHAR output[AMT_MAX_CONTACTS * 64];
+	AMT_PTP_LAYOUT ptp;
+	AMT_TRANSLATOR translator;
+
+	if (!AmtParsePtpLayout(PtpDescriptor, sizeof(PtpDescriptor), &ptp)) {
+		printf("FAIL AmtParsePtpLayout\n");
+		return 1;
+	}
+
+	// The descriptor caps contacts at 3, so frames with more fingers
+	// also measure the cost of the ones left out
+	for (ULONG fingers = 1; fingers <= 5; ++fingers) {
+		ULONG64 ptpReports = 0;
+		double start;
+		double elapsed;
+
+		if (!AmtInitializeTranslator(&AmtLayoutMagicTrackpad2Vendor, &ptp, &translator)) {
+			printf("FAIL AmtInitializeTranslator\n");
+			return 1;
+		}
+
+		memset(report, 0, sizeof(report));
+		report[0] = AmtLayoutMagicTrackpad2Vendor.reportId;
+
+		start = Seconds();
+		for (ULONG frame = 0; frame < BENCH_FRAMES; ++frame) {
+			for (ULONG f = 0; f < fingers; ++f) {
+				LONG x = -3678 + (LONG)((frame * 7 + f * 1500) % 7612);
+				LONG y = -2478 + (LONG)((frame * 5 + f * 1000) % 5065);
+
+				PutFinger(report + MT2_HEADER_SIZE + f * MT2_FINGER_SIZE, x, y, (UCHAR)(f + 1), MT2_STATE_TOUCHING);
+			}
+			ptpReports += AmtTranslateReport(&translator, report, MT2_HEADER_SIZE + fingers * MT2_FINGER_SIZE,
+				(USHORT)(frame * 110), output, sizeof(output));
+		}
+		elapsed = Seconds() - start;
+
+		printf("%u finger(s): %6.1f ns/frame, %5.1f M PTP reports/s\n",
+			fingers, elapsed * 1e9 / BENCH_FRAMES, ptpReports / elapsed / 1e6);
+	}
+
+	return 0;
+}
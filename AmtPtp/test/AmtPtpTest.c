@@ -0,0 +1,164 @@
+// Golden test for the AmtPtp translator. Builds on a host with the stub
+// windows.h in this directory:
+//
+//   cc -Wall -Wextra -I . -I test test/AmtPtpTest.c AmtPtp.c -o AmtPtpTest
+//
+// The PTP descriptor is the DefaultTouchpadReportDescriptor layout
+// (report 5, one finger collection per report, 12-bit X/Y).
+
+#include "AmtPtp.h"
+
+#include <stdio.h>
+
+static const UCHAR PtpDescriptor[] = {
+	0x05, 0x0d, 0x09, 0x05, 0xa1, 0x01, 0x85, 0x05, 0x09, 0x22, 0xa1, 0x02, 0x15, 0x00, 0x25, 0x01,
+	0x09, 0x47, 0x09, 0x42, 0x95, 0x02, 0x75, 0x01, 0x81, 0x02, 0x95, 0x01, 0x75, 0x02, 0x25, 0x02,
+	0x09, 0x51, 0x81, 0x02, 0x75, 0x01, 0x95, 0x04, 0x81, 0x03, 0x05, 0x01, 0x15, 0x00, 0x26, 0xff,
+	0x0f, 0x75, 0x10, 0x55, 0x0e, 0x65, 0x13, 0x09, 0x30, 0x35, 0x00, 0x46, 0x90, 0x01, 0x95, 0x01,
+	0x81, 0x02, 0x46, 0x13, 0x01, 0x09, 0x31, 0x81, 0x02, 0xc0, 0x55, 0x0C, 0x66, 0x01, 0x10, 0x47,
+	0xff, 0xff, 0x00, 0x00, 0x27, 0xff, 0xff, 0x00, 0x00, 0x75, 0x10, 0x95, 0x01, 0x05, 0x0d, 0x09,
+	0x56, 0x81, 0x02, 0x09, 0x54, 0x25, 0x7f, 0x95, 0x01, 0x75, 0x08, 0x81, 0x02, 0x05, 0x09, 0x09,
+	0x01, 0x09, 0x02, 0x09, 0x03, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01, 0x81, 0x02, 0x95, 0x07, 0x81,
+	0x03, 0x05, 0x0d, 0x85, 0x06, 0x09, 0x55, 0x09, 0x59, 0x75, 0x04, 0x95, 0x02, 0x25, 0x0f, 0xb1,
+	0x02, 0xc0, 0x05, 0x01, 0x09, 0x02, 0xa1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xa1, 0x00, 0x05, 0x09,
+	0x19, 0x01, 0x29, 0x02, 0x25, 0x01, 0x75, 0x01, 0x95, 0x02, 0x81, 0x02, 0xc0, 0xc0
+};
+
+#define MT2_STATE_TOUCHING 2
+
+static int failures;
+
+// Packs a Magic Trackpad 2 finger record the way hid-magicmouse reads it
+static void
+PutFinger(
+	_Out_writes_bytes_(9) UCHAR *record,
+	_In_ LONG x,
+	_In_ LONG y,
+	_In_ UCHAR id,
+	_In_ ULONG state)
+{
+	ULONG word = ((ULONG)x & 0x1fff) | (((ULONG)-y & 0x1fff) << 13) | (state << 30);
+
+	memset(record, 0, 9);
+	record[0] = (UCHAR)word;
+	record[1] = (UCHAR)(word >> 8);
+	record[2] = (UCHAR)(word >> 16);
+	record[3] = (UCHAR)(word >> 24);
+	record[8] = id;
+}
+
+static void
+Expect(
+	_In_ const char *name,
+	_In_reads_bytes_(length) const UCHAR *actual,
+	_In_reads_bytes_(length) const UCHAR *expected,
+	_In_ ULONG length)
+{
+	ULONG i;
+
+	if (memcmp(actual, expected, length) == 0) {
+		return;
+	}
+
+	failures++;
+	printf("FAIL %s:\n  got     ", name);
+	for (i = 0; i < length; i++) {
+		printf(" %02x", actual[i]);
+	}
+	printf("\n  expected");
+	for (i = 0; i < length; i++) {
+		printf(" %02x", expected[i]);
+	}
+	printf("\n");
+}
+
+static void
+ExpectCount(
+	_In_ const char *name,
+	_In_ ULONG actual,
+	_In_ ULONG expected)
+{
+	if (actual != expected) {
+		failures++;
+		printf("FAIL %s: got %u, expected %u\n", name, actual, expected);
+	}
+}
+
+int
+main(void)
+{
+	static UCHAR report[1387];
+	AMT_PTP_LAYOUT ptp;
+	AMT_TRANSLATOR translator;
+	UCHAR output[64];
+	ULONG reports;
+
+	// Two fingers at opposite corners: a hybrid pair of reports
+	static const UCHAR twoFingers[] = {
+		0x05, 0x03, 0x00, 0x00, 0xff, 0x0f, 0x0a, 0x00, 0x02, 0x00,
+		0x05, 0x07, 0xff, 0x0f, 0x00, 0x00, 0x0a, 0x00, 0x00, 0x00
+	};
+	// First finger lifted, reported once more with the tip clear
+	static const UCHAR lifted[] = {
+		0x05, 0x01, 0x00, 0x00, 0xff, 0x0f, 0x14, 0x00, 0x02, 0x00,
+		0x05, 0x07, 0xff, 0x0f, 0x00, 0x00, 0x14, 0x00, 0x00, 0x00
+	};
+	// A new finger takes the lowest free contact ID, after the finger
+	// that is still down
+	static const UCHAR newFinger[] = {
+		0x05, 0x07, 0xff, 0x0f, 0x00, 0x00, 0x1e, 0x00, 0x02, 0x00,
+		0x05, 0x03, 0xf0, 0x07, 0x24, 0x08, 0x1e, 0x00, 0x00, 0x00
+	};
+
+	if (!AmtParsePtpLayout(PtpDescriptor, sizeof(PtpDescriptor), &ptp)) {
+		printf("FAIL AmtParsePtpLayout\n");
+		return 1;
+	}
+	ExpectCount("report ID", ptp.reportId, 5);
+	ExpectCount("report size", ptp.reportSize, 10);
+	ExpectCount("contact slots", ptp.contactSlots, 1);
+
+	if (!AmtInitializeTranslator(&AmtLayoutMagicTrackpad2Vendor, &ptp, &translator)) {
+		printf("FAIL AmtInitializeTranslator\n");
+		return 1;
+	}
+	ExpectCount("max contacts", translator.maxContacts, 3);
+
+	report[0] = AmtLayoutMagicTrackpad2Vendor.reportId;
+
+	PutFinger(report + 12, -3678, 2587, 7, MT2_STATE_TOUCHING);
+	PutFinger(report + 21, 3934, -2478, 3, MT2_STATE_TOUCHING);
+
+	// Too little room for one report: rejected without tracking the
+	// fingers, so the retry below still sees them as new
+	reports = AmtTranslateReport(&translator, report, sizeof(report), 10, output, ptp.reportSize - 1);
+	ExpectCount("short output reports", reports, 0);
+	ExpectCount("short output contacts", translator.contactCount, 0);
+
+	reports = AmtTranslateReport(&translator, report, sizeof(report), 10, output, sizeof(output));
+	ExpectCount("two fingers reports", reports, 2);
+	Expect("two fingers", output, twoFingers, sizeof(twoFingers));
+
+	PutFinger(report + 12, 0, 0, 0, 0);
+	reports = AmtTranslateReport(&translator, report, sizeof(report), 20, output, sizeof(output));
+	ExpectCount("lifted reports", reports, 2);
+	Expect("lifted", output, lifted, sizeof(lifted));
+
+	PutFinger(report + 12, 100, 100, 9, MT2_STATE_TOUCHING);
+	reports = AmtTranslateReport(&translator, report, sizeof(report), 30, output, sizeof(output));
+	ExpectCount("new finger reports", reports, 2);
+	Expect("new finger", output, newFinger, sizeof(newFinger));
+
+	// Lift everything, then an idle frame produces nothing
+	memset(report + 12, 0, 18);
+	AmtTranslateReport(&translator, report, sizeof(report), 40, output, sizeof(output));
+	reports = AmtTranslateReport(&translator, report, sizeof(report), 50, output, sizeof(output));
+	ExpectCount("idle reports", reports, 0);
+
+	if (failures != 0) {
+		return 1;
+	}
+
+	printf("AmtPtp golden test passed\n");
+	return 0;
+}
@@ -0,0 +1,28 @@
+// Minimal stand-in for <windows.h>, enough to build AmtPtp.c and the
+// golden test on a host without the Windows SDK.
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned char UCHAR, BOOLEAN;
+typedef unsigned short USHORT;
+typedef uint32_t ULONG;
+typedef int32_t LONG;
+typedef int64_t LONG64;
+typedef uint64_t ULONG64;
+
+#define TRUE 1
+#define FALSE 0
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Out_writes_bytes_(size)
+
+#define EXTERN_C_START
+#define EXTERN_C_END
+
+#define RtlZeroMemory(destination, length) memset((destination), 0, (length))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
@@ -22,6 +22,9 @@
  BOOL StartInstallWDMDriver(LPCTSTR theInfName) ;
  
  BOOL FindExistingDevice(IN LPTSTR HardwareId);
+ int RemoveDevices(LPCTSTR *HardwareIds, DWORD Count);
+ DWORD FindExistingDevices(LPCTSTR *HardwareIds, DWORD Count, BOOL *Found);
+ VOID InvalidateDeviceInventory();
  
  VOID InitialGlobalVar();
  
@@ -157,182 +160,220 @@
      return !(CM_WaitNoPendingInstallEvents(0) == WAIT_OBJECT_0);
  }
  
- int RemoveDriver(_TCHAR *HardwareID)
- {
+ //////////////////////////////////////////////////////////////////////////////
+ // Device inventory
+ //
+ // Every removal and lookup used to enumerate all present devices and read
+ // their hardware IDs again, once per ID and per operation. The inventory
+ // does that once per run and indexes every hardware ID, upper-cased since
+ // PnP IDs are not case sensitive, in a hash table. Removals are recorded
+ // in the index. Installs drop it so that the next lookup enumerates again.
+ 
+ #include "InstallWDFDriverIndex.h"
+ 
+ typedef struct _DEVICE_INVENTORY {
      HDEVINFO DeviceInfoSet;
+     DWORD DeviceCount;
+     SP_DEVINFO_DATA *Devices;
+     INVENTORY_INDEX Index;
+ } DEVICE_INVENTORY, *PDEVICE_INVENTORY;
+ 
+ DEVICE_INVENTORY g_Inventory = {INVALID_HANDLE_VALUE};
+ 
+ VOID CloseDeviceInventory(PDEVICE_INVENTORY Inventory)
+ {
+     if (Inventory->DeviceInfoSet != INVALID_HANDLE_VALUE)
+         SetupDiDestroyDeviceInfoList(Inventory->DeviceInfoSet);
+     if (Inventory->Devices) LocalFree(Inventory->Devices);
+     FreeInventoryIndex(&Inventory->Index);
+ 
+     RtlZeroMemory(Inventory, sizeof(*Inventory));
+     Inventory->DeviceInfoSet = INVALID_HANDLE_VALUE;
+ }
+ 
+ BOOL OpenDeviceInventory(PDEVICE_INVENTORY Inventory)
+ {
+     PINVENTORY_INDEX Index = &Inventory->Index;
+     DWORD i, DataT, Needed;
+     DWORD IdUsed = 0;
      SP_DEVINFO_DATA DeviceInfoData;
-     DWORD i,err;
-     //GUID devGUID ={36fc9e60-c465-11cf-8056-444553540000};
  
-     DeviceInfoSet = SetupDiGetClassDevs(NULL, // All Classes
+     CloseDeviceInventory(Inventory);
+ 
+     Inventory->DeviceInfoSet = SetupDiGetClassDevs(NULL, // All Classes
          0,
          0,
          DIGCF_ALLCLASSES | DIGCF_PRESENT ); // All devices present on system
  
-     if (DeviceInfoSet == INVALID_HANDLE_VALUE)
+     if (Inventory->DeviceInfoSet == INVALID_HANDLE_VALUE)
      {
          printf("GetClassDevs(All Present Devices)\n");
-         return 1;
+         return FALSE;
      }
  
+     DeviceInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
+     for (i = 0; SetupDiEnumDeviceInfo(Inventory->DeviceInfoSet, i, &DeviceInfoData); i++)
+         ;
+     Inventory->DeviceCount = i;
+ 
+     Inventory->Devices = (SP_DEVINFO_DATA *)LocalAlloc(LPTR, (i + 1) * sizeof(SP_DEVINFO_DATA));
+     Index->Removed = (BOOL *)LocalAlloc(LPTR, (i + 1) * sizeof(BOOL));
+     if (!Inventory->Devices || !Index->Removed)
+         goto Fail;
+ 
      //
-     //  Enumerate through all Devices.
+     // One pass over the devices. The hardware IDs of all devices go into
+     // one buffer that only grows, instead of one allocation per device.
      //
-     DeviceInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
-     for (i=0;SetupDiEnumDeviceInfo(DeviceInfoSet,i,&DeviceInfoData);i++)
+     for (i = 0; i < Inventory->DeviceCount; i++)
      {
-         DWORD DataT;
-         LPTSTR p,buffer = NULL;
-         DWORD buffersize = 0;
+         Inventory->Devices[i].cbSize = sizeof(SP_DEVINFO_DATA);
+         if (!SetupDiEnumDeviceInfo(Inventory->DeviceInfoSet, i, &Inventory->Devices[i]))
+             break;
+ 
+         if (!GrowInventoryArray((PVOID *)&Index->IdData, &Index->IdCapacity, IdUsed + 256, sizeof(TCHAR)))
+             goto Fail;
  
-         //
-         // We won\'t know the size of the HardwareID buffer until we call
-         // this function. So call it with a null to begin with, and then
-         // use the required buffer size to Alloc the nessicary space.
-         // Keep calling we have success or an unknown failure.
-         //
          while (!SetupDiGetDeviceRegistryProperty(
-             DeviceInfoSet,
-             &DeviceInfoData,
+             Inventory->DeviceInfoSet,
+             &Inventory->Devices[i],
              SPDRP_HARDWAREID,
              &DataT,
-             (PBYTE)buffer,
-             buffersize,
-             &buffersize))
+             (PBYTE)&Index->IdData[IdUsed],
+             (Index->IdCapacity - IdUsed - 1) * sizeof(TCHAR),
+             &Needed))
          {
-             if (GetLastError() == ERROR_INVALID_DATA)
+             if (GetLastError() != ERROR_INSUFFICIENT_BUFFER)
              {
                  //
-                 // May be a Legacy Device with no HardwareID. Continue.
+                 // May be a Legacy Device with no HardwareID, or the
+                 // device went away. Continue.
                  //
+                 Needed = 0;
                  break;
              }
-             else if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
-             {
-                 //
-                 // We need to change the buffer size.
-                 //
-                 if (buffer)
-                     LocalFree(buffer);
-                 buffer = (LPTSTR)LocalAlloc(LPTR,buffersize);
-             }
-             else
-             {
-                 //
-                 // Unknown Failure.
-                 //
-                 printf("GetDeviceRegistryProperty");
-                 goto cleanup_DeviceInfo;
-             }
+ 
+             if (!GrowInventoryArray((PVOID *)&Index->IdData, &Index->IdCapacity, IdUsed + Needed / sizeof(TCHAR) + 2, sizeof(TCHAR)))
+                 goto Fail;
          }
  
-         if (GetLastError() == ERROR_INVALID_DATA)
+         if (Needed == 0)
              continue;
  
          //
-         // Compare each entry in the buffer multi-sz list with our HardwareID.
+         // Index each entry of the multi-sz list
+         //
+         IdUsed = AddInventoryIds(Index, i, IdUsed, Needed / sizeof(TCHAR));
+         if (!IdUsed)
+             goto Fail;
+     }
  
+     //
+     // Entries no longer move, so they can be chained now
+     //
+     if (!BuildInventoryBuckets(Index))
+         goto Fail;
  
-         //
-         for (p = buffer; *p && (p < &buffer[buffersize]);p+=lstrlen(p)*sizeof(TCHAR) + 2)
+     return TRUE;
  
+ Fail:
+     printf("OpenDeviceInventory is %d\n", GetLastError());
+     CloseDeviceInventory(Inventory);
+     return FALSE;
+ }
  
-         {
-             //_tprintf(TEXT("Compare device ID: [%s]/n"),p);
+ //
+ // The inventory for this run, enumerated on first use
+ //
+ PDEVICE_INVENTORY GetDeviceInventory()
+ {
+     if (g_Inventory.DeviceInfoSet == INVALID_HANDLE_VALUE && !OpenDeviceInventory(&g_Inventory))
+         return NULL;
  
-             if (!_tcscmp(HardwareID,p))
-             {
-                 //_tprintf(TEXT("Found! [%s]/n"),p);
+     return &g_Inventory;
+ }
  
-                 //
-                 // Worker function to remove device.
-                 //
-                 //if (SetupDiCallClassInstaller(DIF_REMOVE,
-                 //    DeviceInfoSet,
-                 //    &DeviceInfoData))
-                     
-                 if (SetupDiRemoveDevice(DeviceInfoSet, &DeviceInfoData))
-                 
-                 
-                 {
-                     printf("CallClassInstaller(REMOVE)\n");
-                 }
-                 else
-                     printf("Remove Driver Fail\n");
-                 break;
-             }
+ //
+ // Call after anything that adds devices
+ //
+ VOID InvalidateDeviceInventory()
+ {
+     CloseDeviceInventory(&g_Inventory);
+ }
  
-             //printf("TTTTTTTTTTTTTTTTT is %s\n",p);
-             //getch();
-         }
+ //
+ // Removes every present device that has one of the hardware IDs.
+ // Returns the number of devices removed, or -1 if the devices can't be
+ // enumerated.
+ //
+ int RemoveDevices(LPCTSTR *HardwareIds, DWORD Count)
+ {
+     PDEVICE_INVENTORY Inventory = GetDeviceInventory();
+     PINVENTORY_ENTRY Entry;
+     DWORD i;
+     int Removed = 0;
+ 
+     if (!Inventory)
+         return -1;
  
-         if (buffer) LocalFree(buffer);
+     for (i = 0; i < Count; i++)
+     {
+         for (Entry = FindInventoryEntry(&Inventory->Index, HardwareIds[i], NULL); Entry; Entry = FindInventoryEntry(&Inventory->Index, HardwareIds[i], Entry))
+         {
+             //
+             // Worker function to remove device.
+             //
+             if (SetupDiRemoveDevice(Inventory->DeviceInfoSet, &Inventory->Devices[Entry->Device]))
+             {
+                 printf("CallClassInstaller(REMOVE)\n");
+                 Inventory->Index.Removed[Entry->Device] = TRUE;
+                 Removed++;
+             }
+             else
+                 printf("Remove Driver Fail is %d\n", GetLastError());
+         }
      }
+     return Removed;
+ }
  
-     if ((GetLastError()!=NO_ERROR)&&(GetLastError()!=ERROR_NO_MORE_ITEMS))
+ //
+ // Sets Found[i] (if Found isn't NULL) for each hardware ID that a present
+ // device has. Returns the number of IDs found.
+ //
+ DWORD FindExistingDevices(LPCTSTR *HardwareIds, DWORD Count, BOOL *Found)
+ {
+     PDEVICE_INVENTORY Inventory = GetDeviceInventory();
+     DWORD i, FoundCount = 0;
+     BOOL IsFound;
+ 
+     for (i = 0; i < Count; i++)
      {
-         printf("EnumDeviceInfo\n");
+         IsFound = Inventory && FindInventoryEntry(&Inventory->Index, HardwareIds[i], NULL) != NULL;
+         if (Found)
+             Found[i] = IsFound;
+         if (IsFound)
+             FoundCount++;
      }
+     return FoundCount;
+ }
+ int RemoveDriver(_TCHAR *HardwareID)
+ {
+     LPCTSTR HardwareIds[1] = { HardwareID };
  
-     //
-     //  Cleanup.
-     //
- cleanup_DeviceInfo:
-     err = GetLastError();
-     SetupDiDestroyDeviceInfoList(DeviceInfoSet);
+     if (RemoveDevices(HardwareIds, 1) < 0)
+         return 1;
  
-     return err;
+     return NO_ERROR;
  }
  
  VOID UninstallWDMDriver(LPCTSTR theHardware) 
  {
- SP_DEVINFO_DATA spDevInfoData = {0};  
- HDEVINFO hDevInfo = 0L;  
- WORD wIdx, wCount = 0;  
- 
- //õ豸Ϣṹľ  
- hDevInfo = SetupDiGetClassDevs(0L, 0L, 0L, DIGCF_ALLCLASSES | DIGCF_PRESENT);  
- if (hDevInfo == INVALID_HANDLE_VALUE)  
- {  
-     printf("Fail!\n"); 
-     return;  
- }  
+ LPCTSTR HardwareIds[1] = { theHardware };
  
- wIdx = 0;  
- while (TRUE)  
- {  
-     spDevInfoData.cbSize = sizeof(SP_DEVINFO_DATA);  
-     //ҵеӲ豸,ҿԵõеӲ豸ϸϢ  
-     if (SetupDiEnumDeviceInfo(hDevInfo, wIdx, &spDevInfoData))  
-     {  
-         char Buffer[2048] = {0};  
- 
-         //ǰõָĳһ豸ϢϵָȡĳһϢ  
-         if (SetupDiGetDeviceRegistryProperty(hDevInfo, &spDevInfoData, SPDRP_HARDWAREID,  
-             0L, (PBYTE)Buffer, 2048, 0L))  
-         {  
-             if (!_tcscmp(theHardware, (LPTSTR)Buffer))  
-             {  
-                 //ϵͳɾһע豸ӿ  
-                 if (!SetupDiRemoveDevice(hDevInfo, &spDevInfoData))  
-                     printf("Remove Fail is %d!\n",GetLastError());            
-                 wCount++;  
-             }  
-         }  
-     }  
-     else  
-         break;  
-     wIdx++;  
- }  
- 
- if (wCount != 0)  
+ //ϵͳɾһע豸ӿ
+ if (RemoveDevices(HardwareIds, 1) > 0)  
  _tprintf(_T("UnInstall Successed...\n")); 
  
- 
- 
- 
- //һ豸Ϣ  
- SetupDiDestroyDeviceInfoList(hDevInfo);  
  //InitialGlobalVar();  
  return;  
  }
@@ -483,84 +524,13 @@
  
  BOOL IsInstalled()  
   {  
-      HDEVINFO hDevInfo = 0L;  
-      SP_DEVINFO_DATA spDevInfoData = {0L};  
-      WORD wIdx;  
-      BOOL bIsFound;  
- 
-      //õ豸Ϣṹľ  
-      hDevInfo = SetupDiGetClassDevs(0L, 0, 0, DIGCF_ALLCLASSES | DIGCF_PRESENT);  
-      if (hDevInfo == INVALID_HANDLE_VALUE)  
-      {  
-          printf("SetupDiGetClassDevs is %d",GetLastError());  
-          return FALSE;  
-      }  
- 
-      spDevInfoData.cbSize = sizeof(SP_DEVINFO_DATA);  
-      wIdx = 0;  
-      bIsFound = 0;  
-      while (++wIdx)  
-      {  
-          //ҵеӲ豸,ҿԵõеӲ豸ϸϢ  
-          if (SetupDiEnumDeviceInfo(hDevInfo, wIdx, &spDevInfoData))  
-          {  
-              LPTSTR ptr;  
-              LPBYTE pBuffer = NULL;  
-              DWORD dwData  = 0L;  
-              DWORD dwRetVal;  
-              DWORD dwBufSize = 0L;  
+      LPCTSTR HardwareIds[20];  
+      WORD wLoop;  
  
-              while (TRUE)  
-              {  
-                  //ǰõָĳһ豸ϢϵָȡĳһϢ  
-                  dwRetVal = SetupDiGetDeviceRegistryProperty(hDevInfo, &spDevInfoData, SPDRP_HARDWAREID,  
-                      &dwData, (PBYTE)pBuffer, dwBufSize, &dwBufSize);  
-                  if (!dwRetVal)  
-                      dwRetVal = GetLastError();  
-                  else  
-                      break;  
-                  if (dwRetVal == ERROR_INVALID_DATA)  
-                      break;  
-                  else if (dwRetVal == ERROR_INSUFFICIENT_BUFFER)  
-                  {  
-                      if (pBuffer)  
-                          LocalFree(pBuffer);  
-                      pBuffer = (LPBYTE)LocalAlloc(LPTR, dwBufSize);  
-                  }  
-                  else  
-                  {  
-                     printf("SetupDiGetDeviceRegistryProperty is %d",dwRetVal);  
-                      //һ豸Ϣ  
-                      SetupDiDestroyDeviceInfoList(hDevInfo);  
-                      return FALSE;  
-                  }  
-              }  
+      for (wLoop = 0; wLoop < g_wHardware; wLoop++)  
+          HardwareIds[wLoop] = g_strHardware[wLoop];  
  
-              if (dwRetVal == ERROR_INVALID_DATA)   
-                  continue;  
- 
-              for (ptr = (LPTSTR)pBuffer; *ptr && (ptr < (LPTSTR)&pBuffer[dwBufSize]); ptr += _tcslen(ptr) + sizeof(TCHAR))  
-              {  
-                  WORD wLoop;  
- 
-                  for (wLoop = 0; wLoop < g_wHardware; wLoop++)  
-                  {  
-                      if (!_tcscmp(g_strHardware[wLoop], ptr))  
-                      {  
-                          bIsFound = TRUE;  
-                          break;  
-                      }  
-                  }  
-              }  
-              if (pBuffer)  
-                  LocalFree(pBuffer);  
-              if (bIsFound)  
-                  break;  
-          }  
-      }  
-      //һ豸Ϣ  
-      SetupDiDestroyDeviceInfoList(hDevInfo);  
-      return bIsFound;  
+      return FindExistingDevices(HardwareIds, g_wHardware, NULL) != 0;  
   }  
  
   //ѰָĽ ҵTRUE ֮FALSE  
@@ -743,6 +713,9 @@
           }  
           LocalFree(pHID);  
           pHID = NULL;  
+ 
+          // The new device isn't in the inventory yet
+          InvalidateDeviceInventory();  
           
       //}  
       //һ豸Ϣ  
@@ -812,118 +785,7 @@
  
   BOOL FindExistingDevice(IN LPTSTR HardwareId)
   {
-      HDEVINFO DeviceInfoSet;
-      SP_DEVINFO_DATA DeviceInfoData;
-      DWORD i,err;
-      BOOL Found;
- 
-      //
-      // Create a Device Information Set with all present devices.
-      //
-      DeviceInfoSet = SetupDiGetClassDevs(NULL, // All Classes
-          0,
-          0,
-          DIGCF_ALLCLASSES | DIGCF_PRESENT ); // All devices present on system
- 
-      if (DeviceInfoSet == INVALID_HANDLE_VALUE)
-      {
-          return printf("GetClassDevs(All Present Devices)");
- 
- 
-      }
- 
-      //_tprintf(TEXT("Search for Device ID: [%s]/n"),HardwareId);
- 
-      //
-      //  Enumerate through all Devices.
-      //
-      Found = FALSE;
-      DeviceInfoData.cbSize = sizeof(SP_DEVINFO_DATA);
-      for (i=0;SetupDiEnumDeviceInfo(DeviceInfoSet,i,&DeviceInfoData);i++)
-      {
-          DWORD DataT;
-          LPTSTR p,buffer = NULL;
-          DWORD buffersize = 0;
- 
-          //
-          // We won\'t know the size of the HardwareID buffer until we call
-          // this function. So call it with a null to begin with, and then
-          // use the required buffer size to Alloc the nessicary space.
-          // Keep calling we have success or an unknown failure.
-          //
-          while (!SetupDiGetDeviceRegistryProperty(
-              DeviceInfoSet,
-              &DeviceInfoData,
-              SPDRP_HARDWAREID,
-              &DataT,
-              (PBYTE)buffer,
-              buffersize,
-              &buffersize))
-          {
-              if (GetLastError() == ERROR_INVALID_DATA)
-              {
-                  //
-                  // May be a Legacy Device with no HardwareID. Continue.
-                  //
-                  break;
-              }
-              else if (GetLastError() == ERROR_INSUFFICIENT_BUFFER)
-              {
-                  //
-                  // We need to change the buffer size.
-                  //
-                  if (buffer)
-                      LocalFree(buffer);
-                  buffer = (LPTSTR)LocalAlloc(LPTR,buffersize);
-              }
-              else
-              {
-                  //
-                  // Unknown Failure.
-                  //
-                 printf("GetDeviceRegistryProperty");
-                  goto cleanup_DeviceInfo;
-              }
-          }
- 
-          if (GetLastError() == ERROR_INVALID_DATA)
-              continue;
- 
-          //
-          // Compare each entry in the buffer multi-sz list with our HardwareID.
- 
- 
-          //
-          for (p=buffer;*p&&(p<&buffer[buffersize]);p+=lstrlen(p)+sizeof(TCHAR))
- 
- 
-          {
-              //_tprintf(TEXT("Compare device ID: [%s]/n"),p);
- 
-              if (!_tcscmp(HardwareId,p))
-              {
-                  //_tprintf(TEXT("Found! [%s]/n"),p);
-                  Found = TRUE;
-                  break;
-              }
-          }
- 
-          if (buffer) LocalFree(buffer);
-          if (Found) break;
-      }
- 
-      if (GetLastError() != NO_ERROR)
-      {
-          printf("EnumDeviceInfo");
-      }
- 
-      //
-      //  Cleanup.
-      //
- cleanup_DeviceInfo:
-      err = GetLastError();
-      SetupDiDestroyDeviceInfoList(DeviceInfoSet);
-      SetLastError(err);
- 
-      return err == NO_ERROR; //???
+      LPCTSTR HardwareIds[1] = { HardwareId };
+ 
+      return FindExistingDevices(HardwareIds, 1, NULL) != 0;
   }
\ No newline at end of file
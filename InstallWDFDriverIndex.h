@@ -0,0 +1,163 @@
+// InstallWDFDriverIndex.h : Hardware ID index of the device inventory.
+//
+// Every hardware ID of the present devices, upper-cased since PnP IDs are
+// not case sensitive, in a hash table. Nothing in here calls SetupAPI, so
+// the index also builds on a host for InstallWDFDriverTest/InventoryBench.cpp.
+//
+
+#pragma once
+
+#define INVENTORY_MIN_BUCKETS 64
+
+typedef struct _INVENTORY_ENTRY {
+    DWORD IdOffset;                    // normalized ID, in TCHARs into IdData
+    DWORD Hash;
+    DWORD Device;                      // index into Removed, and the caller's device array
+    struct _INVENTORY_ENTRY *Next;     // next entry in the same bucket
+} INVENTORY_ENTRY, *PINVENTORY_ENTRY;
+
+typedef struct _INVENTORY_INDEX {
+    BOOL *Removed;                     // one per device
+    LPTSTR IdData;                     // all hardware IDs, back to back
+    DWORD IdCapacity;
+    DWORD EntryCount;
+    DWORD EntryCapacity;
+    PINVENTORY_ENTRY Entries;
+    DWORD BucketMask;
+    PINVENTORY_ENTRY *Buckets;
+} INVENTORY_INDEX, *PINVENTORY_INDEX;
+
+static DWORD HashHardwareId(LPCTSTR HardwareId)
+{
+    DWORD Hash = 2166136261;           // FNV-1a
+
+    for (; *HardwareId; HardwareId++)
+    {
+        Hash = (Hash ^ (DWORD)*HardwareId) * 16777619;
+    }
+    return Hash;
+}
+
+//
+// Upper-cases Source into Destination. Returns FALSE if it doesn't fit.
+//
+static BOOL NormalizeHardwareId(LPCTSTR Source, LPTSTR Destination, DWORD Length)
+{
+    DWORD Len = (DWORD)_tcslen(Source);
+
+    if (Len >= Length)
+        return FALSE;
+
+    memcpy(Destination, Source, (Len + 1) * sizeof(TCHAR));
+    CharUpperBuff(Destination, Len);
+    return TRUE;
+}
+
+//
+// Grows a LocalAlloc'ed array so that it holds at least Count elements
+//
+static BOOL GrowInventoryArray(PVOID *Array, DWORD *Capacity, DWORD Count, DWORD ElementSize)
+{
+    DWORD NewCapacity = *Capacity ? *Capacity : 256;
+    PVOID NewArray;
+
+    if (Count <= *Capacity)
+        return TRUE;
+
+    while (NewCapacity < Count)
+        NewCapacity *= 2;
+
+    NewArray = *Array ? LocalReAlloc(*Array, NewCapacity * ElementSize, LMEM_MOVEABLE | LMEM_ZEROINIT)
+                      : LocalAlloc(LPTR, NewCapacity * ElementSize);
+    if (!NewArray)
+        return FALSE;
+
+    *Array = NewArray;
+    *Capacity = NewCapacity;
+    return TRUE;
+}
+
+static VOID FreeInventoryIndex(PINVENTORY_INDEX Index)
+{
+    if (Index->Removed) LocalFree(Index->Removed);
+    if (Index->IdData) LocalFree(Index->IdData);
+    if (Index->Entries) LocalFree(Index->Entries);
+    if (Index->Buckets) LocalFree(Index->Buckets);
+
+    RtlZeroMemory(Index, sizeof(*Index));
+}
+
+//
+// Indexes the multi-sz hardware ID list of Device that starts at IdOffset
+// in IdData. The list may not be terminated, Length TCHARs of it are used.
+// Returns the offset just past the list, or 0 when out of memory.
+//
+static DWORD AddInventoryIds(PINVENTORY_INDEX Index, DWORD Device, DWORD IdOffset, DWORD Length)
+{
+    LPTSTR p;
+
+    Index->IdData[IdOffset + Length] = 0;
+    for (p = &Index->IdData[IdOffset]; *p; p += _tcslen(p) + 1)
+    {
+        if (!GrowInventoryArray((PVOID *)&Index->Entries, &Index->EntryCapacity, Index->EntryCount + 1, sizeof(INVENTORY_ENTRY)))
+            return 0;
+
+        CharUpperBuff(p, (DWORD)_tcslen(p));
+        Index->Entries[Index->EntryCount].IdOffset = (DWORD)(p - Index->IdData);
+        Index->Entries[Index->EntryCount].Hash = HashHardwareId(p);
+        Index->Entries[Index->EntryCount].Device = Device;
+        Index->EntryCount++;
+    }
+    return (DWORD)(p - Index->IdData) + 1;
+}
+
+//
+// Chains the entries into the hash table. Call once all of them are added,
+// since adding more may move them.
+//
+static BOOL BuildInventoryBuckets(PINVENTORY_INDEX Index)
+{
+    DWORD i, Buckets;
+
+    for (Buckets = INVENTORY_MIN_BUCKETS; Buckets < Index->EntryCount; Buckets *= 2)
+        ;
+    Index->BucketMask = Buckets - 1;
+    Index->Buckets = (PINVENTORY_ENTRY *)LocalAlloc(LPTR, Buckets * sizeof(PINVENTORY_ENTRY));
+    if (!Index->Buckets)
+        return FALSE;
+
+    for (i = Index->EntryCount; i-- > 0; )
+    {
+        PINVENTORY_ENTRY Entry = &Index->Entries[i];
+
+        Entry->Next = Index->Buckets[Entry->Hash & Index->BucketMask];
+        Index->Buckets[Entry->Hash & Index->BucketMask] = Entry;
+    }
+    return TRUE;
+}
+
+//
+// Returns the first entry for HardwareId when Previous is NULL, and the
+// next one after Previous otherwise. Removed devices are skipped.
+//
+static PINVENTORY_ENTRY FindInventoryEntry(PINVENTORY_INDEX Index, LPCTSTR HardwareId, PINVENTORY_ENTRY Previous)
+{
+    TCHAR Id[MAX_DEVICE_ID_LEN];
+    DWORD Hash;
+    PINVENTORY_ENTRY Entry;
+
+    if (!NormalizeHardwareId(HardwareId, Id, MAX_DEVICE_ID_LEN))
+        return NULL;
+
+    Hash = HashHardwareId(Id);
+    Entry = Previous ? Previous->Next : Index->Buckets[Hash & Index->BucketMask];
+
+    for (; Entry; Entry = Entry->Next)
+    {
+        if (Entry->Hash == Hash &&
+            !Index->Removed[Entry->Device] &&
+            !_tcscmp(&Index->IdData[Entry->IdOffset], Id))
+            return Entry;
+    }
+    return NULL;
+}
@@ -0,0 +1,241 @@
+// InventoryBench.cpp : Host benchmark for the hardware ID index of the
+// device inventory. Builds with the stub windows.h in this directory:
+//
+//   c++ -O2 -Wall -Wextra -I InstallWDFDriverTest InstallWDFDriverTest/InventoryBench.cpp -o InventoryBench
+//
+// Builds inventories of 200, 2000 and 20000 synthetic USB devices the way
+// OpenDeviceInventory does, checks what FindInventoryEntry returns, and
+// times hits, misses and walking an ID that many devices share against a
+// case-insensitive scan of every device's hardware ID list, which is what
+// each lookup cost before the index (without the SetupAPI calls).
+//
+
+#include <windows.h>
+
+#include <stdio.h>
+#include <time.h>
+
+#include "../InstallWDFDriverIndex.h"
+
+#define SHARED_ID L"USB\\Class_03&SubClass_01&Prot_02"
+#define SHARED_EVERY 4
+
+static int Failures;
+static volatile DWORD Sink;                // keeps the timed lookups
+
+static void Check(const char *Name, unsigned long Actual, unsigned long Expected)
+{
+    if (Actual != Expected)
+    {
+        Failures++;
+        printf("FAIL %s: got %lu, expected %lu\n", Name, Actual, Expected);
+    }
+}
+
+static double Seconds()
+{
+    struct timespec Now;
+
+    clock_gettime(CLOCK_MONOTONIC, &Now);
+    return Now.tv_sec + Now.tv_nsec / 1e9;
+}
+
+//
+// Hardware IDs of device d, as a multi-sz list the way SPDRP_HARDWAREID
+// returns them, mixed case
+//
+static DWORD DeviceIds(DWORD Device, LPTSTR Buffer, DWORD Length)
+{
+    DWORD Used = 0;
+    unsigned Vid = 0x1000 + Device / 16, Pid = 0x2000 + Device, Rev = 0x0100 + Device % 7;
+
+    Used += swprintf(Buffer + Used, Length - Used, L"USB\\VID_%04X&PID_%04X&REV_%04X", Vid, Pid, Rev) + 1;
+    Used += swprintf(Buffer + Used, Length - Used, L"USB\\vid_%04x&pid_%04x", Vid, Pid) + 1;
+    if (Device % SHARED_EVERY == 0)
+        Used += swprintf(Buffer + Used, Length - Used, L"%ls", SHARED_ID) + 1;
+    Buffer[Used] = 0;
+    return Used;
+}
+
+static BOOL BuildIndex(PINVENTORY_INDEX Index, DWORD Devices)
+{
+    TCHAR Ids[512];
+    DWORD IdUsed = 0;
+
+    RtlZeroMemory(Index, sizeof(*Index));
+    Index->Removed = (BOOL *)LocalAlloc(LPTR, (Devices + 1) * sizeof(BOOL));
+    if (!Index->Removed)
+        return FALSE;
+
+    for (DWORD d = 0; d < Devices; d++)
+    {
+        DWORD Length = DeviceIds(d, Ids, 512);
+
+        if (!GrowInventoryArray((PVOID *)&Index->IdData, &Index->IdCapacity, IdUsed + Length + 2, sizeof(TCHAR)))
+            return FALSE;
+
+        memcpy(&Index->IdData[IdUsed], Ids, Length * sizeof(TCHAR));
+        IdUsed = AddInventoryIds(Index, d, IdUsed, Length);
+        if (!IdUsed)
+            return FALSE;
+    }
+    return BuildInventoryBuckets(Index);
+}
+
+//
+// The baseline: every device's list, compared ignoring case
+//
+static long LinearFind(LPCTSTR *Lists, DWORD Devices, LPCTSTR HardwareId, DWORD Start)
+{
+    for (DWORD d = Start; d < Devices; d++)
+    {
+        for (LPCTSTR p = Lists[d]; *p; p += _tcslen(p) + 1)
+        {
+            if (!wcscasecmp(p, HardwareId))
+                return (long)d;
+        }
+    }
+    return -1;
+}
+
+static void Run(DWORD Devices)
+{
+    INVENTORY_INDEX Index;
+    LPTSTR *Lists = (LPTSTR *)calloc(Devices, sizeof(LPTSTR));
+    TCHAR Id[MAX_DEVICE_ID_LEN];
+    DWORD Lookups = Devices < 20000 ? 200000 : 20000;
+    DWORD Found = 0, Sum = 0;
+    double Start, Build, Hit, Miss, Shared, LinearHit, LinearMiss;
+
+    Start = Seconds();
+    if (!BuildIndex(&Index, Devices))
+    {
+        Failures++;
+        printf("FAIL building the index of %lu devices\n", Devices);
+        return;
+    }
+    Build = Seconds() - Start;
+
+    for (DWORD d = 0; d < Devices; d++)
+    {
+        Lists[d] = (LPTSTR)malloc(512 * sizeof(TCHAR));
+        DeviceIds(d, Lists[d], 512);
+    }
+
+    //
+    // Correctness: every device is found by either of its IDs in any case,
+    // unknown and oversized IDs are not, and the shared ID lists exactly
+    // the devices that have it
+    //
+    for (DWORD d = 0; d < Devices; d++)
+    {
+        PINVENTORY_ENTRY Entry;
+
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"usb\\Vid_%04x&Pid_%04X", 0x1000 + d / 16, 0x2000 + d);
+        Entry = FindInventoryEntry(&Index, Id, NULL);
+        if (!Entry || Entry->Device != d || FindInventoryEntry(&Index, Id, Entry))
+            Check("hit", Entry ? Entry->Device : ~0UL, d);
+    }
+    Check("miss", FindInventoryEntry(&Index, L"USB\\VID_FFFF&PID_FFFF", NULL) != NULL, FALSE);
+
+    wmemset(Id, L'A', MAX_DEVICE_ID_LEN - 1);
+    Id[MAX_DEVICE_ID_LEN - 1] = 0;
+    Check("oversized", FindInventoryEntry(&Index, Id, NULL) != NULL, FALSE);
+
+    for (PINVENTORY_ENTRY Entry = FindInventoryEntry(&Index, SHARED_ID, NULL); Entry; Entry = FindInventoryEntry(&Index, SHARED_ID, Entry))
+    {
+        Check("shared device", Entry->Device % SHARED_EVERY, 0);
+        Check("shared order", Entry->Device, Found * SHARED_EVERY);
+        Found++;
+    }
+    Check("shared count", Found, (Devices + SHARED_EVERY - 1) / SHARED_EVERY);
+
+    //
+    // Timing, hits spread over every device
+    //
+    Start = Seconds();
+    for (DWORD i = 0; i < Lookups; i++)
+    {
+        DWORD d = (i * 7919) % Devices;
+
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"USB\\VID_%04X&PID_%04X", 0x1000 + d / 16, 0x2000 + d);
+        Sum += FindInventoryEntry(&Index, Id, NULL)->Device;
+    }
+    Hit = Seconds() - Start;
+
+    Start = Seconds();
+    for (DWORD i = 0; i < Lookups; i++)
+    {
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"PCI\\VEN_8086&DEV_%04X", i & 0xffff);
+        Sum += FindInventoryEntry(&Index, Id, NULL) != NULL;
+    }
+    Miss = Seconds() - Start;
+
+    Start = Seconds();
+    for (DWORD i = 0; i < Lookups / 100; i++)
+    {
+        for (PINVENTORY_ENTRY Entry = FindInventoryEntry(&Index, SHARED_ID, NULL); Entry; Entry = FindInventoryEntry(&Index, SHARED_ID, Entry))
+            Sum += Entry->Device;
+    }
+    Shared = Seconds() - Start;
+
+    Start = Seconds();
+    for (DWORD i = 0; i < Lookups / 100; i++)
+    {
+        DWORD d = (i * 7919) % Devices;
+
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"USB\\VID_%04X&PID_%04X", 0x1000 + d / 16, 0x2000 + d);
+        Sum += (DWORD)LinearFind((LPCTSTR *)Lists, Devices, Id, 0);
+    }
+    LinearHit = Seconds() - Start;
+
+    Start = Seconds();
+    for (DWORD i = 0; i < Lookups / 100; i++)
+    {
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"PCI\\VEN_8086&DEV_%04X", i & 0xffff);
+        Sum += LinearFind((LPCTSTR *)Lists, Devices, Id, 0) >= 0;
+    }
+    LinearMiss = Seconds() - Start;
+
+    //
+    // Removed devices are skipped, the rest still found
+    //
+    for (DWORD d = 0; d < Devices; d += 2)
+        Index.Removed[d] = TRUE;
+
+    Found = 0;
+    for (PINVENTORY_ENTRY Entry = FindInventoryEntry(&Index, SHARED_ID, NULL); Entry; Entry = FindInventoryEntry(&Index, SHARED_ID, Entry))
+        Found++;
+    Check("shared after removal", Found, 0);
+
+    for (DWORD d = 0; d < Devices && d < 64; d++)
+    {
+        swprintf(Id, MAX_DEVICE_ID_LEN, L"USB\\VID_%04X&PID_%04X&REV_%04X", 0x1000 + d / 16, 0x2000 + d, 0x0100 + d % 7);
+        Check("removed", FindInventoryEntry(&Index, Id, NULL) != NULL, d % 2);
+    }
+
+    printf("%6lu devices, %6lu IDs: build %7.1f us, hit %6.1f ns, miss %6.1f ns, shared walk %8.1f ns"
+           " | scan hit %9.1f ns, scan miss %9.1f ns\n",
+           Devices, Index.EntryCount, Build * 1e6,
+           Hit * 1e9 / Lookups, Miss * 1e9 / Lookups, Shared * 1e9 / (Lookups / 100),
+           LinearHit * 1e9 / (Lookups / 100), LinearMiss * 1e9 / (Lookups / 100));
+    Sink = Sum;
+
+    for (DWORD d = 0; d < Devices; d++)
+        free(Lists[d]);
+    free(Lists);
+    FreeInventoryIndex(&Index);
+}
+
+int main()
+{
+    Run(200);
+    Run(2000);
+    Run(20000);
+
+    if (Failures)
+        return 1;
+
+    printf("Inventory index benchmark passed\n");
+    return 0;
+}
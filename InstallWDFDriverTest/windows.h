@@ -0,0 +1,74 @@
+// windows.h : Just enough of windows.h and tchar.h for InventoryBench.cpp
+// to build InstallWDFDriverIndex.h on a host, as a UNICODE build.
+//
+
+#pragma once
+
+#include <stdlib.h>
+#include <string.h>
+#include <wchar.h>
+#include <wctype.h>
+
+typedef unsigned long DWORD;
+typedef int BOOL;
+typedef void VOID;
+typedef void *PVOID;
+typedef wchar_t TCHAR;
+typedef TCHAR *LPTSTR;
+typedef const TCHAR *LPCTSTR;
+
+#define TRUE 1
+#define FALSE 0
+
+#define TEXT(s) L##s
+#define _T(s) L##s
+#define _tcslen wcslen
+#define _tcscmp wcscmp
+
+#define MAX_DEVICE_ID_LEN 200
+
+#define LMEM_MOVEABLE 0x0002
+#define LMEM_ZEROINIT 0x0040
+#define LPTR LMEM_ZEROINIT
+
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+
+// Local allocations keep their size in front, so that LocalReAlloc can
+// zero what it adds
+static inline PVOID LocalAlloc(unsigned Flags, size_t Bytes)
+{
+    size_t *Block = (size_t *)((Flags & LMEM_ZEROINIT) ? calloc(1, sizeof(size_t) + Bytes) : malloc(sizeof(size_t) + Bytes));
+
+    if (!Block)
+        return NULL;
+    *Block = Bytes;
+    return Block + 1;
+}
+
+static inline PVOID LocalReAlloc(PVOID Memory, size_t Bytes, unsigned Flags)
+{
+    size_t *Block = (size_t *)Memory - 1;
+    size_t Old = *Block;
+
+    Block = (size_t *)realloc(Block, sizeof(size_t) + Bytes);
+    if (!Block)
+        return NULL;
+    if ((Flags & LMEM_ZEROINIT) && Bytes > Old)
+        memset((char *)(Block + 1) + Old, 0, Bytes - Old);
+    *Block = Bytes;
+    return Block + 1;
+}
+
+static inline PVOID LocalFree(PVOID Memory)
+{
+    if (Memory)
+        free((size_t *)Memory - 1);
+    return NULL;
+}
+
+static inline DWORD CharUpperBuff(LPTSTR String, DWORD Length)
+{
+    for (DWORD i = 0; i < Length; i++)
+        String[i] = (TCHAR)towupper(String[i]);
+    return Length;
+}
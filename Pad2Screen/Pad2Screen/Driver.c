@@ -2,13 +2,13 @@
 #include "driver.tmh"
 #include <hidport.h>
 
+// Internal ioctls (IOCTL_HID_READ_REPORT in particular) and their
+// completion routines can run at DISPATCH_LEVEL, so nothing on the
+// forwarding path is pageable.
 #ifdef ALLOC_PRAGMA
-#pragma alloc_text (PAGE, P2S_GetHidReportDescriptorInputMode)
-#pragma alloc_text (PAGE, P2S_PatchHidReportDescriptor)
-#pragma alloc_text (PAGE, P2S_IoctlHidSetFeatureCompletionRoutine)
-#pragma alloc_text (PAGE, P2S_SetToPrecisionTouchpadMode)
-#pragma alloc_text (PAGE, P2S_ForwardIoctlCompletionRoutine)
-#pragma alloc_text (PAGE, P2S_EvtIoDeviceControl)
+#pragma alloc_text (PAGE, P2S_ReadMappingConfig)
+#pragma alloc_text (PAGE, P2S_EvtMappingTimer)
+#pragma alloc_text (PAGE, P2S_EvtDeviceContextCleanup)
 #pragma alloc_text (PAGE, P2S_EvtDriverContextCleanup)
 #pragma alloc_text (PAGE, P2S_EvtDeviceAdd)
 #pragma alloc_text (INIT, DriverEntry)
@@ -136,52 +136,181 @@ P2S_PatchHidReportDescriptor(
 	return patched;
 }
 
-const char *
-P2S_IoctlCodeToString(
+// Flags for the ioctl dispatch table
+#define P2S_IOCTL_POST_PROCESS 0x1 // needs the completion routine
+#define P2S_IOCTL_MAP_INPUT 0x2 // needs the completion routine while mapping is enabled
+
+typedef struct _P2S_IOCTL_ENTRY {
+	unsigned long ioControlCode;
+	const char *name;
+	unsigned long flags;
+} P2S_IOCTL_ENTRY;
+
+// How each internal ioctl is forwarded. Everything is passed down
+// send-and-forget except the requests that we have to look at on the
+// way back up. The table is searched linearly, so the high-rate
+// requests come first.
+static const P2S_IOCTL_ENTRY P2S_IoctlTable[] = {
+	{ IOCTL_HID_READ_REPORT, "IOCTL_HID_READ_REPORT", P2S_IOCTL_MAP_INPUT },
+	{ IOCTL_HID_GET_INPUT_REPORT, "IOCTL_HID_GET_INPUT_REPORT", 0 },
+	{ IOCTL_HID_WRITE_REPORT, "IOCTL_HID_WRITE_REPORT", 0 },
+	{ IOCTL_HID_SET_OUTPUT_REPORT, "IOCTL_HID_SET_OUTPUT_REPORT", 0 },
+	{ IOCTL_HID_GET_FEATURE, "IOCTL_HID_GET_FEATURE", 0 },
+	{ IOCTL_HID_SET_FEATURE, "IOCTL_HID_SET_FEATURE", 0 },
+	{ IOCTL_UMDF_HID_GET_FEATURE, "IOCTL_UMDF_HID_GET_FEATURE", 0 },
+	{ IOCTL_UMDF_HID_SET_FEATURE, "IOCTL_UMDF_HID_SET_FEATURE", 0 },
+	{ IOCTL_UMDF_HID_GET_INPUT_REPORT, "IOCTL_UMDF_HID_GET_INPUT_REPORT", 0 },
+	{ IOCTL_UMDF_HID_SET_OUTPUT_REPORT, "IOCTL_UMDF_HID_SET_OUTPUT_REPORT", 0 },
+	{ IOCTL_HID_GET_REPORT_DESCRIPTOR, "IOCTL_HID_GET_REPORT_DESCRIPTOR", P2S_IOCTL_POST_PROCESS },
+	{ IOCTL_HID_GET_DEVICE_DESCRIPTOR, "IOCTL_HID_GET_DEVICE_DESCRIPTOR", 0 },
+	{ IOCTL_HID_GET_DEVICE_ATTRIBUTES, "IOCTL_HID_GET_DEVICE_ATTRIBUTES", 0 },
+	{ IOCTL_HID_GET_STRING, "IOCTL_HID_GET_STRING", 0 },
+	{ IOCTL_HID_GET_INDEXED_STRING, "IOCTL_HID_GET_INDEXED_STRING", 0 },
+	{ IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST, "IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST", 0 },
+	{ IOCTL_HID_ACTIVATE_DEVICE, "IOCTL_HID_ACTIVATE_DEVICE", 0 },
+	{ IOCTL_HID_DEACTIVATE_DEVICE, "IOCTL_HID_DEACTIVATE_DEVICE", 0 },
+	{ IOCTL_GET_PHYSICAL_DESCRIPTOR, "IOCTL_GET_PHYSICAL_DESCRIPTOR", 0 },
+};
+
+// The last stats slot is for ioctls that aren't in the table
+C_ASSERT(ARRAYSIZE(P2S_IoctlTable) + 1 == P2S_IOCTL_TABLE_SIZE);
+
+size_t
+P2S_LookupIoctl(
 	_In_ unsigned long ioControlCode)
 {
-	switch (ioControlCode) {
-	case IOCTL_HID_GET_DEVICE_DESCRIPTOR:
-		return "IOCTL_HID_GET_DEVICE_DESCRIPTOR";
-	case IOCTL_HID_GET_DEVICE_ATTRIBUTES:
-		return "IOCTL_HID_GET_DEVICE_ATTRIBUTES";
-	case IOCTL_HID_GET_REPORT_DESCRIPTOR:
-		return "IOCTL_HID_GET_REPORT_DESCRIPTOR";
-	case IOCTL_HID_READ_REPORT:
-		return "IOCTL_HID_READ_REPORT";
-	case IOCTL_HID_WRITE_REPORT:
-		return "IOCTL_HID_WRITE_REPORT";
-	case IOCTL_HID_GET_FEATURE:
-		return "IOCTL_HID_GET_FEATURE";
-	case IOCTL_HID_SET_FEATURE:
-		return "IOCTL_HID_SET_FEATURE";
-	case IOCTL_HID_GET_INPUT_REPORT:
-		return "IOCTL_HID_GET_INPUT_REPORT";
-	case IOCTL_HID_SET_OUTPUT_REPORT:
-		return "IOCTL_HID_SET_OUTPUT_REPORT";
-	case IOCTL_UMDF_HID_GET_FEATURE:
-		return "IOCTL_UMDF_HID_GET_FEATURE";
-	case IOCTL_UMDF_HID_SET_FEATURE:
-		return "IOCTL_UMDF_HID_SET_FEATURE";
-	case IOCTL_UMDF_HID_GET_INPUT_REPORT:
-		return "IOCTL_UMDF_HID_GET_INPUT_REPORT";
-	case IOCTL_UMDF_HID_SET_OUTPUT_REPORT:
-		return "IOCTL_UMDF_HID_SET_OUTPUT_REPORT";
-	case IOCTL_HID_GET_STRING:
-		return "IOCTL_HID_GET_STRING";
-	case IOCTL_HID_GET_INDEXED_STRING:
-		return "IOCTL_HID_GET_INDEXED_STRING";
-	case IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST:
-		return "IOCTL_HID_SEND_IDLE_NOTIFICATION_REQUEST";
-	case IOCTL_HID_ACTIVATE_DEVICE:
-		return "IOCTL_HID_ACTIVATE_DEVICE";
-	case IOCTL_HID_DEACTIVATE_DEVICE:
-		return "IOCTL_HID_DEACTIVATE_DEVICE";
-	case IOCTL_GET_PHYSICAL_DESCRIPTOR:
-		return "IOCTL_GET_PHYSICAL_DESCRIPTOR";
-	default:
-		return "<unknown ioctl>";
+	size_t i;
+
+	for (i = 0; i < ARRAYSIZE(P2S_IoctlTable); ++i) {
+		if (P2S_IoctlTable[i].ioControlCode == ioControlCode) {
+			break;
+		}
+	}
+
+	// ARRAYSIZE(P2S_IoctlTable) if not found
+	return i;
+}
+
+void
+P2S_RecordLatency(
+	_In_ PDEVICE_CONTEXT deviceContext,
+	_Inout_ PP2S_IOCTL_STATS stats,
+	_Inout_updates_(P2S_LATENCY_BUCKETS) LONG64 *histogram,
+	_In_ LONGLONG startTime)
+{
+	LONGLONG elapsed = KeQueryPerformanceCounter(NULL).QuadPart - startTime;
+	ULONGLONG micros = (ULONGLONG)elapsed * 1000000 / deviceContext->perfFrequency;
+	size_t bucket = 0;
+
+	while (micros != 0 && bucket < P2S_LATENCY_BUCKETS - 1) {
+		micros >>= 1;
+		bucket++;
 	}
+
+	InterlockedIncrement64(&stats->forwarded);
+	InterlockedIncrement64(&histogram[bucket]);
+}
+
+// How often the mapping settings are re-read from the registry
+#define P2S_MAPPING_POLL_MS 1000
+
+void
+P2S_ReadMappingConfig(
+	_In_ WDFDEVICE device,
+	_Out_ PP2S_MAPPING_CONFIG config)
+{
+	NTSTATUS status = STATUS_SUCCESS;
+	WDFKEY key = NULL;
+	DECLARE_CONST_UNICODE_STRING(enableName, L"MapEnable");
+	DECLARE_CONST_UNICODE_STRING(regionLeftName, L"MapRegionLeft");
+	DECLARE_CONST_UNICODE_STRING(regionTopName, L"MapRegionTop");
+	DECLARE_CONST_UNICODE_STRING(regionRightName, L"MapRegionRight");
+	DECLARE_CONST_UNICODE_STRING(regionBottomName, L"MapRegionBottom");
+	DECLARE_CONST_UNICODE_STRING(rotationName, L"MapRotation");
+	DECLARE_CONST_UNICODE_STRING(deadZoneName, L"MapDeadZone");
+	DECLARE_CONST_UNICODE_STRING(displayWidthName, L"MapDisplayWidth");
+	DECLARE_CONST_UNICODE_STRING(displayHeightName, L"MapDisplayHeight");
+
+	PAGED_CODE();
+
+	// Defaults: mapping off, whole display, no rotation, dead zone
+	// or aspect correction. Missing values keep their default.
+	RtlZeroMemory(config, sizeof(*config));
+	config->regionRight = P2S_MAP_SCALE;
+	config->regionBottom = P2S_MAP_SCALE;
+
+	status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &key);
+	if (!NT_SUCCESS(status)) {
+		return;
+	}
+
+	WdfRegistryQueryULong(key, &enableName, &config->enable);
+	WdfRegistryQueryULong(key, &regionLeftName, &config->regionLeft);
+	WdfRegistryQueryULong(key, &regionTopName, &config->regionTop);
+	WdfRegistryQueryULong(key, &regionRightName, &config->regionRight);
+	WdfRegistryQueryULong(key, &regionBottomName, &config->regionBottom);
+	WdfRegistryQueryULong(key, &rotationName, &config->rotation);
+	WdfRegistryQueryULong(key, &deadZoneName, &config->deadZone);
+	WdfRegistryQueryULong(key, &displayWidthName, &config->displayWidth);
+	WdfRegistryQueryULong(key, &displayHeightName, &config->displayHeight);
+
+	WdfRegistryClose(key);
+}
+
+void
+P2S_EvtMappingTimer(
+	_In_ WDFTIMER timer)
+{
+	WDFDEVICE device = WdfTimerGetParentObject(timer);
+	PDEVICE_CONTEXT deviceContext = DeviceGetContext(device);
+	P2S_MAPPING_CONFIG config;
+	P2S_TRANSFORM transform;
+
+	PAGED_CODE();
+
+	// Nothing to map until the report descriptor has been seen
+	if (ReadAcquire(&deviceContext->layoutState) != 2) {
+		return;
+	}
+
+	// The transform is only rebuilt when the settings change
+	P2S_ReadMappingConfig(device, &config);
+	if (RtlEqualMemory(&config, &deviceContext->mappingConfig, sizeof(config))) {
+		return;
+	}
+	deviceContext->mappingConfig = config;
+
+	// This timer is the only writer. Each increment moves the readers
+	// to the other copy before the one they left is overwritten, so a
+	// reader always has a copy that isn't being written, even if the
+	// timer is preempted in between.
+	P2S_BuildTransform(&deviceContext->layout, &config, &transform);
+	InterlockedIncrement(&deviceContext->transformSequence);
+	deviceContext->transforms[0] = transform;
+	InterlockedIncrement(&deviceContext->transformSequence);
+	deviceContext->transforms[1] = transform;
+	InterlockedExchange(&deviceContext->mappingEnabled, transform.enabled);
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "Mapping %s: region (%u,%u)-(%u,%u), rotation %u, dead zone %u",
+		transform.enabled ? "enabled" : "disabled", config.regionLeft, config.regionTop, config.regionRight, config.regionBottom, config.rotation, config.deadZone);
+}
+
+void
+P2S_ReadTransform(
+	_In_ PDEVICE_CONTEXT deviceContext,
+	_Out_ PP2S_TRANSFORM transform)
+{
+	LONG sequence;
+
+	// A retry means the timer finished a step during this copy. It
+	// makes two steps per settings change and runs once per
+	// P2S_MAPPING_POLL_MS, so the copy is retried at most twice per
+	// change and never waits for the timer to finish.
+	do {
+		sequence = ReadAcquire(&deviceContext->transformSequence);
+		*transform = deviceContext->transforms[sequence & 1];
+		KeMemoryBarrier();
+	} while (ReadNoFence(&deviceContext->transformSequence) != sequence);
 }
 
 void
@@ -196,7 +325,6 @@ P2S_IoctlHidSetFeatureCompletionRoutine(
 	UNREFERENCED_PARAMETER(target);
 	UNREFERENCED_PARAMETER(completionParams);
 	UNREFERENCED_PARAMETER(context);
-	PAGED_CODE();
 	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Enter %!FUNC!()");
 
 	// Log any errors that occurred
@@ -245,7 +373,7 @@ P2S_SetToPrecisionTouchpadMode(
 	}
 
 	// Allocate buffer for request
-	status = WdfMemoryCreate(NULL, PagedPool, 0, reportSize + 1, &inputMemory, &inputBuffer);
+	status = WdfMemoryCreate(NULL, NonPagedPoolNx, 0, reportSize + 1, &inputMemory, &inputBuffer);
 	if (!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfMemoryCreate() failed: %!STATUS!", status);
 		goto exit;
@@ -302,30 +430,48 @@ P2S_ForwardIoctlCompletionRoutine(
 {
 	NTSTATUS status = STATUS_SUCCESS;
 	WDFMEMORY outputBuffer = NULL;
+	PREQUEST_CONTEXT requestContext = NULL;
+	PDEVICE_CONTEXT deviceContext = NULL;
+	P2S_TRANSFORM transform;
 	byte *buf;
 	byte *descriptor;
 	size_t descriptorLen;
 
-	UNREFERENCED_PARAMETER(target);
 	UNREFERENCED_PARAMETER(context);
-	PAGED_CODE();
-	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Enter %!FUNC!(%s)", P2S_IoctlCodeToString(completionParams->Parameters.Ioctl.IoControlCode));
+
+	// Account for the round trip through the lower driver
+	deviceContext = DeviceGetContext(WdfIoTargetGetDevice(target));
+	requestContext = RequestGetContext(request);
+	P2S_RecordLatency(deviceContext, requestContext->stats, requestContext->stats->roundTrip, requestContext->startTime);
 
 	// If the real ioctl failed, don't try to patch
 	status = completionParams->IoStatus.Status;
 	if (!NT_SUCCESS(status)) {
+		InterlockedIncrement64(&requestContext->stats->failed);
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "Forwarded ioctl() failed: %!STATUS!", status);
 		goto exit;
 	}
 
+	// Input reports: move the contacts to the configured part of
+	// the display. This runs for every report, so it isn't traced.
+	outputBuffer = completionParams->Parameters.Ioctl.Output.Buffer;
+	if (completionParams->Parameters.Ioctl.IoControlCode == IOCTL_HID_READ_REPORT) {
+		P2S_ReadTransform(deviceContext, &transform);
+		if (transform.enabled && outputBuffer != NULL) {
+			buf = WdfMemoryGetBuffer(outputBuffer, NULL);
+			P2S_MapInputReport(&deviceContext->layout, &transform, buf + completionParams->Parameters.Ioctl.Output.Offset, completionParams->IoStatus.Information);
+		}
+		goto exit;
+	}
+
 	// Only patch requests for the HID report descriptor
 	if (completionParams->Parameters.Ioctl.IoControlCode != IOCTL_HID_GET_REPORT_DESCRIPTOR) {
 		goto exit;
 	}
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Enter %!FUNC!()");
 
 	// Get the buffer that the report descriptor
 	// was copied to
-	outputBuffer = completionParams->Parameters.Ioctl.Output.Buffer;
 	buf = WdfMemoryGetBuffer(outputBuffer, NULL);
 
 	// Descriptor starts at buf offset (or at least it should)
@@ -342,10 +488,23 @@ P2S_ForwardIoctlCompletionRoutine(
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "P2S_PatchHidReportDescriptor() did not find touchpad usage");
 	}
 
+	// Find the contact coordinates for the mapping stage, once per
+	// device, and have the timer build the transform right away
+	if (InterlockedCompareExchange(&deviceContext->layoutState, 1, 0) == 0) {
+		if (P2S_ParseContactLayout(descriptor, descriptorLen, &deviceContext->layout)) {
+			TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Found %u contacts in input report %u", deviceContext->layout.contactCount, deviceContext->layout.reportId);
+			InterlockedExchange(&deviceContext->layoutState, 2);
+			WdfTimerStart(deviceContext->mappingTimer, WDF_REL_TIMEOUT_IN_MS(1));
+		} else {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "P2S_ParseContactLayout() did not find contact coordinates");
+			InterlockedExchange(&deviceContext->layoutState, 0);
+		}
+	}
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Exit %!FUNC!() -> %!STATUS!", status);
+
 exit:
 	// Pass the results up to our caller
 	WdfRequestCompleteWithInformation(request, status, completionParams->IoStatus.Information);
-	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Exit %!FUNC!() -> %!STATUS!", status);
 }
 
 void
@@ -357,20 +516,31 @@ P2S_EvtIoDeviceControl(
 	_In_ unsigned long ioControlCode)
 {
 	NTSTATUS status = STATUS_SUCCESS;
+	LONGLONG startTime = KeQueryPerformanceCounter(NULL).QuadPart;
 	WDFDEVICE device = NULL;
+	PDEVICE_CONTEXT deviceContext = NULL;
+	PP2S_IOCTL_STATS stats = NULL;
 	WDFIOTARGET target = NULL;
 	WDFMEMORY inputMemory = NULL;
 	WDFMEMORY outputMemory = NULL;
+	WDF_OBJECT_ATTRIBUTES requestAttributes;
+	PREQUEST_CONTEXT requestContext = NULL;
+	WDF_REQUEST_SEND_OPTIONS sendOptions;
+	size_t index;
 
 	UNREFERENCED_PARAMETER(outputBufferLength);
 	UNREFERENCED_PARAMETER(inputBufferLength);
-	UNREFERENCED_PARAMETER(ioControlCode);
-	PAGED_CODE();
-	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Enter %!FUNC!(%s)", P2S_IoctlCodeToString(ioControlCode));
+
+	// This runs for every input report, so nothing is traced
+	// unless something goes wrong. Per-ioctl counters are traced
+	// when the device goes away.
+	device = WdfIoQueueGetDevice(queue);
+	deviceContext = DeviceGetContext(device);
+	index = P2S_LookupIoctl(ioControlCode);
+	stats = &deviceContext->ioctlStats[index];
 
 	// Get a reference to the real driver that will
 	// be handling the ioctl request.
-	device = WdfIoQueueGetDevice(queue);
 	target = WdfDeviceGetIoTarget(device);
 	if (target == NULL) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfDeviceGetIoTarget() == NULL");
@@ -378,6 +548,39 @@ P2S_EvtIoDeviceControl(
 		goto exit;
 	}
 
+	// Input reports only take the completion hop while the mapping
+	// stage is enabled
+	if (index == ARRAYSIZE(P2S_IoctlTable) ||
+		!((P2S_IoctlTable[index].flags & P2S_IOCTL_POST_PROCESS) ||
+		((P2S_IoctlTable[index].flags & P2S_IOCTL_MAP_INPUT) && ReadNoFence(&deviceContext->mappingEnabled)))) {
+		// Fast path: pass the request down unchanged, like the kbfiltr
+		// sample does for requests it doesn't care about. The lower
+		// driver completes it directly, without a completion hop
+		// through us.
+		WdfRequestFormatRequestUsingCurrentType(request);
+		WDF_REQUEST_SEND_OPTIONS_INIT(&sendOptions, WDF_REQUEST_SEND_OPTION_SEND_AND_FORGET);
+		if (!WdfRequestSend(request, target, &sendOptions)) {
+			status = WdfRequestGetStatus(request);
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfRequestSend() failed: %!STATUS!", status);
+			goto exit;
+		}
+
+		// Only the hand-off is timed, the completion never reaches us
+		P2S_RecordLatency(deviceContext, stats, stats->handOff, startTime);
+		return;
+	}
+
+	// Remember when the request arrived, the latency is recorded
+	// in the completion routine
+	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&requestAttributes, REQUEST_CONTEXT);
+	status = WdfObjectAllocateContext(request, &requestAttributes, &requestContext);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfObjectAllocateContext() failed: %!STATUS!", status);
+		goto exit;
+	}
+	requestContext->startTime = startTime;
+	requestContext->stats = stats;
+
 	// Format request. Apparently WdfRequestFormatRequestUsingCurrentType()
 	// is a big fat phony and doesn't actually work here. Following code is
 	// taken from the kbfiltr sample driver.
@@ -409,9 +612,56 @@ P2S_EvtIoDeviceControl(
 
 exit:
 	if (!NT_SUCCESS(status)) {
+		InterlockedIncrement64(&stats->failed);
 		WdfRequestComplete(request, status);
 	}
-	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DRIVER, "Exit %!FUNC!() -> %!STATUS!", status);
+}
+
+void
+P2S_TraceLatency(
+	_In_ const char *label,
+	_In_reads_(P2S_LATENCY_BUCKETS) const LONG64 *histogram)
+{
+	for (size_t bucket = 0; bucket < P2S_LATENCY_BUCKETS; ++bucket) {
+		if (histogram[bucket] == 0) {
+			continue;
+		}
+		if (bucket < P2S_LATENCY_BUCKETS - 1) {
+			TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "  %s < %u us: %I64d", label, 1u << bucket, histogram[bucket]);
+		} else {
+			TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "  %s >= %u us: %I64d", label, 1u << (bucket - 1), histogram[bucket]);
+		}
+	}
+}
+
+void
+P2S_EvtDeviceContextCleanup(
+	_In_ WDFOBJECT deviceObject)
+{
+	PDEVICE_CONTEXT deviceContext = DeviceGetContext(deviceObject);
+	PP2S_IOCTL_STATS stats;
+	const char *name;
+
+	PAGED_CODE();
+
+	// Stop re-reading the mapping settings
+	if (deviceContext->mappingTimer != NULL) {
+		WdfTimerStop(deviceContext->mappingTimer, TRUE);
+	}
+
+	// Dump the per-ioctl counters and latency histograms
+	for (size_t i = 0; i < P2S_IOCTL_TABLE_SIZE; ++i) {
+		stats = &deviceContext->ioctlStats[i];
+		if (stats->forwarded == 0 && stats->failed == 0) {
+			continue;
+		}
+
+		name = (i < ARRAYSIZE(P2S_IoctlTable)) ? P2S_IoctlTable[i].name : "<unknown ioctl>";
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%s: %I64d forwarded, %I64d failed", name, stats->forwarded, stats->failed);
+
+		P2S_TraceLatency("round trip", stats->roundTrip);
+		P2S_TraceLatency("hand-off", stats->handOff);
+	}
 }
 
 NTSTATUS
@@ -423,6 +673,9 @@ P2S_EvtDeviceAdd(
 	WDFDEVICE device = NULL;
 	WDF_OBJECT_ATTRIBUTES deviceAttributes;
 	WDF_IO_QUEUE_CONFIG queueConfig;
+	WDF_TIMER_CONFIG timerConfig;
+	WDF_OBJECT_ATTRIBUTES timerAttributes;
+	LARGE_INTEGER perfFrequency;
 
 	UNREFERENCED_PARAMETER(driver);
 	PAGED_CODE();
@@ -434,12 +687,32 @@ P2S_EvtDeviceAdd(
 
 	// Create device object
 	WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, DEVICE_CONTEXT);
+	deviceAttributes.EvtCleanupCallback = P2S_EvtDeviceContextCleanup;
 	status = WdfDeviceCreate(&deviceInit, &deviceAttributes, &device);
 	if (!NT_SUCCESS(status)) {
 		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfDeviceCreate() failed: %!STATUS!", status);
 		goto exit;
 	}
 
+	// Used to convert forwarding latencies to microseconds
+	KeQueryPerformanceCounter(&perfFrequency);
+	DeviceGetContext(device)->perfFrequency = perfFrequency.QuadPart;
+
+	// Mapping settings are polled so they can be changed without
+	// restarting the device. The timer is started once the report
+	// descriptor has been parsed, and reads the registry, so it runs
+	// at passive level.
+	WDF_TIMER_CONFIG_INIT_PERIODIC(&timerConfig, P2S_EvtMappingTimer, P2S_MAPPING_POLL_MS);
+	timerConfig.AutomaticSerialization = FALSE;
+	WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
+	timerAttributes.ParentObject = device;
+	timerAttributes.ExecutionLevel = WdfExecutionLevelPassive;
+	status = WdfTimerCreate(&timerConfig, &timerAttributes, &DeviceGetContext(device)->mappingTimer);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DRIVER, "WdfTimerCreate() failed: %!STATUS!", status);
+		goto exit;
+	}
+
 	// Create I/O queue in parallel mode since we don't
 	// have any global state to worry about
 	WDF_IO_QUEUE_CONFIG_INIT_DEFAULT_QUEUE(&queueConfig, WdfIoQueueDispatchParallel);
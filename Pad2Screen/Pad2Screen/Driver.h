@@ -3,15 +3,60 @@
 #include <initguid.h>
 
 #include "trace.h"
+#include "Mapping.h"
 
 EXTERN_C_START
 
+// Number of ioctl dispatch table entries, plus one slot that collects
+// ioctls missing from the table
+#define P2S_IOCTL_TABLE_SIZE 20
+
+// Latency histograms: bucket 0 counts requests under 1us, bucket n those
+// under 2^n us, the last bucket everything else. Requests that take the
+// completion hop record the round trip through the lower driver. Requests
+// sent send-and-forget never come back to us, so for them only the
+// hand-off to the lower driver is recorded.
+#define P2S_LATENCY_BUCKETS 16
+
+typedef struct _P2S_IOCTL_STATS {
+	LONG64 forwarded;
+	LONG64 failed;
+	LONG64 roundTrip[P2S_LATENCY_BUCKETS];
+	LONG64 handOff[P2S_LATENCY_BUCKETS];
+} P2S_IOCTL_STATS, *PP2S_IOCTL_STATS;
+
 typedef struct _DEVICE_CONTEXT {
 	ULONG PrivateDeviceData;
+	LONGLONG perfFrequency;
+	P2S_IOCTL_STATS ioctlStats[P2S_IOCTL_TABLE_SIZE];
+
+	// Touchpad-to-display mapping. The layout is parsed once from the
+	// first report descriptor (layoutState: 0 = not parsed, 1 = being
+	// parsed, 2 = ready). The transform is rebuilt by the timer when
+	// the registry settings change and published through a sequence
+	// latch: readers copy transforms[transformSequence & 1] and retry
+	// if the sequence moved meanwhile, so the read path takes no lock
+	// and always has a copy the timer isn't writing.
+	volatile LONG layoutState;
+	P2S_CONTACT_LAYOUT layout;
+	volatile LONG transformSequence;
+	P2S_TRANSFORM transforms[2];
+	volatile LONG mappingEnabled;
+	P2S_MAPPING_CONFIG mappingConfig;
+	WDFTIMER mappingTimer;
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(DEVICE_CONTEXT, DeviceGetContext)
 
+// Attached to requests that take the completion hop, so the round trip
+// can be added to the round trip histogram
+typedef struct _REQUEST_CONTEXT {
+	LONGLONG startTime;
+	PP2S_IOCTL_STATS stats;
+} REQUEST_CONTEXT, *PREQUEST_CONTEXT;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(REQUEST_CONTEXT, RequestGetContext)
+
 typedef unsigned char byte;
 typedef enum { false, true } bool;
 
@@ -39,6 +84,13 @@ EVT_WDF_REQUEST_COMPLETION_ROUTINE P2S_IoctlHidSetFeatureCompletionRoutine;
 P2S_SET_TO_PRECISION_TOUCHPAD_MODE P2S_SetToPrecisionTouchpadMode;
 EVT_WDF_REQUEST_COMPLETION_ROUTINE P2S_ForwardIoctlCompletionRoutine;
 EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL P2S_EvtIoDeviceControl;
+void
+P2S_ReadMappingConfig(
+	_In_ WDFDEVICE device,
+	_Out_ PP2S_MAPPING_CONFIG config);
+
+EVT_WDF_TIMER P2S_EvtMappingTimer;
+EVT_WDF_OBJECT_CONTEXT_CLEANUP P2S_EvtDeviceContextCleanup;
 EVT_WDF_OBJECT_CONTEXT_CLEANUP P2S_EvtDriverContextCleanup;
 EVT_WDF_DRIVER_DEVICE_ADD P2S_EvtDeviceAdd;
 DRIVER_INITIALIZE DriverEntry;
@@ -0,0 +1,454 @@
+#include "Mapping.h"
+
+// Nothing in here touches WDF or allocates memory, so it can run at
+// any IRQL: the report descriptor is parsed and the input reports are
+// mapped in completion routines.
+
+// HID short item tags (type and tag bits of the prefix byte)
+#define HID_TAG_MASK 0xFC
+#define HID_TAG_INPUT 0x80
+#define HID_TAG_COLLECTION 0xA0
+#define HID_TAG_END_COLLECTION 0xC0
+#define HID_TAG_USAGE_PAGE 0x04
+#define HID_TAG_LOGICAL_MIN 0x14
+#define HID_TAG_LOGICAL_MAX 0x24
+#define HID_TAG_PHYSICAL_MIN 0x34
+#define HID_TAG_PHYSICAL_MAX 0x44
+#define HID_TAG_REPORT_SIZE 0x74
+#define HID_TAG_REPORT_ID 0x84
+#define HID_TAG_REPORT_COUNT 0x94
+#define HID_TAG_USAGE 0x08
+#define HID_TAG_USAGE_MIN 0x18
+#define HID_TAG_USAGE_MAX 0x28
+#define HID_LONG_ITEM 0xFE
+
+#define HID_MAIN_CONSTANT 0x01
+#define HID_MAIN_VARIABLE 0x02
+
+#define HID_USAGE_PAGE_GENERIC 0x01
+#define HID_USAGE_X 0x30
+#define HID_USAGE_Y 0x31
+
+// Most local usages kept per main item, and most report IDs tracked
+#define P2S_MAX_USAGES 16
+#define P2S_MAX_REPORTS 16
+
+typedef struct _P2S_REPORT_OFFSET {
+	UCHAR reportId;
+	ULONG bitOffset;
+} P2S_REPORT_OFFSET;
+
+static ULONG
+P2S_ItemUnsigned(
+	_In_reads_bytes_(size) const UCHAR *value,
+	_In_ int size)
+{
+	ULONG result = 0;
+
+	for (int i = size - 1; i >= 0; --i) {
+		result = (result << 8) | value[i];
+	}
+	return result;
+}
+
+static LONG
+P2S_ItemSigned(
+	_In_reads_bytes_(size) const UCHAR *value,
+	_In_ int size)
+{
+	ULONG result = P2S_ItemUnsigned(value, size);
+
+	if (size > 0 && size < 4 && (value[size - 1] & 0x80)) {
+		result |= ~0UL << (size * 8);
+	}
+	return (LONG)result;
+}
+
+BOOLEAN
+P2S_ParseContactLayout(
+	_In_reads_bytes_(descriptorLen) const UCHAR *descriptor,
+	_In_ size_t descriptorLen,
+	_Out_ PP2S_CONTACT_LAYOUT layout)
+{
+	// A minimal HID parser: it follows the global and local items that
+	// matter for locating fields, but (like the rest of this driver)
+	// doesn't support push/pop or delimiters.
+	ULONG usagePage = 0;
+	LONG logicalMin = 0;
+	LONG logicalMax = 0;
+	LONG physicalMin = 0;
+	LONG physicalMax = 0;
+	ULONG reportSize = 0;
+	ULONG reportCount = 0;
+	UCHAR reportId = 0;
+	ULONG usages[P2S_MAX_USAGES];
+	ULONG usageCount = 0;
+	ULONG usageMin = 0;
+	BOOLEAN haveUsageMin = FALSE;
+	P2S_REPORT_OFFSET offsets[P2S_MAX_REPORTS];
+	ULONG offsetCount = 0;
+	BOOLEAN layoutLocked = FALSE;
+
+	RtlZeroMemory(layout, sizeof(*layout));
+
+	for (size_t i = 0; i < descriptorLen;) {
+		UCHAR type = descriptor[i++];
+		const UCHAR *value = &descriptor[i];
+		int size = type & 3;
+		if (size == 3) {
+			size++;
+		}
+
+		if (type == HID_LONG_ITEM) {
+			// Long items: data size is in the next byte
+			if (i >= descriptorLen) {
+				break;
+			}
+			i += 2 + (size_t)descriptor[i];
+			continue;
+		}
+		if (i + size > descriptorLen) {
+			break;
+		}
+		i += size;
+
+		switch (type & HID_TAG_MASK) {
+		case HID_TAG_USAGE_PAGE:
+			usagePage = P2S_ItemUnsigned(value, size);
+			break;
+		case HID_TAG_LOGICAL_MIN:
+			logicalMin = P2S_ItemSigned(value, size);
+			break;
+		case HID_TAG_LOGICAL_MAX:
+			logicalMax = (logicalMin >= 0) ? (LONG)P2S_ItemUnsigned(value, size) : P2S_ItemSigned(value, size);
+			break;
+		case HID_TAG_PHYSICAL_MIN:
+			physicalMin = P2S_ItemSigned(value, size);
+			break;
+		case HID_TAG_PHYSICAL_MAX:
+			physicalMax = (physicalMin >= 0) ? (LONG)P2S_ItemUnsigned(value, size) : P2S_ItemSigned(value, size);
+			break;
+		case HID_TAG_REPORT_SIZE:
+			reportSize = P2S_ItemUnsigned(value, size);
+			break;
+		case HID_TAG_REPORT_ID:
+			reportId = (UCHAR)P2S_ItemUnsigned(value, size);
+			break;
+		case HID_TAG_REPORT_COUNT:
+			reportCount = P2S_ItemUnsigned(value, size);
+			break;
+		case HID_TAG_USAGE:
+			if (usageCount < P2S_MAX_USAGES) {
+				// 4 byte usages carry their own usage page
+				usages[usageCount++] = (size == 4) ? P2S_ItemUnsigned(value, size) : (usagePage << 16) | P2S_ItemUnsigned(value, size);
+			}
+			break;
+		case HID_TAG_USAGE_MIN:
+			usageMin = P2S_ItemUnsigned(value, size);
+			haveUsageMin = TRUE;
+			break;
+		case HID_TAG_USAGE_MAX:
+			if (haveUsageMin) {
+				for (ULONG usage = usageMin; usage <= P2S_ItemUnsigned(value, size) && usageCount < P2S_MAX_USAGES; ++usage) {
+					usages[usageCount++] = (usagePage << 16) | usage;
+				}
+				haveUsageMin = FALSE;
+			}
+			break;
+		case HID_TAG_INPUT: {
+			ULONG data = P2S_ItemUnsigned(value, size);
+			P2S_REPORT_OFFSET *offset = NULL;
+
+			// Find the running bit offset of this report. Data starts
+			// after the report ID byte when report IDs are used.
+			for (ULONG r = 0; r < offsetCount; ++r) {
+				if (offsets[r].reportId == reportId) {
+					offset = &offsets[r];
+					break;
+				}
+			}
+			if (offset == NULL) {
+				if (offsetCount == P2S_MAX_REPORTS) {
+					return layout->contactCount != 0;
+				}
+				offset = &offsets[offsetCount++];
+				offset->reportId = reportId;
+				offset->bitOffset = (reportId != 0) ? 8 : 0;
+			}
+
+			if (!(data & HID_MAIN_CONSTANT) && (data & HID_MAIN_VARIABLE) && !layoutLocked) {
+				for (ULONG field = 0; field < reportCount; ++field) {
+					ULONG usage;
+					P2S_AXIS_FIELD *axis = NULL;
+
+					if (usageCount == 0) {
+						break;
+					}
+					// The last usage applies to the remaining fields
+					usage = usages[(field < usageCount) ? field : usageCount - 1];
+					if ((usage >> 16) != HID_USAGE_PAGE_GENERIC) {
+						continue;
+					}
+
+					// Only the first report with coordinates is mapped
+					if (layout->contactCount != 0 && layout->reportId != reportId) {
+						layoutLocked = TRUE;
+						break;
+					}
+
+					if ((usage & 0xFFFF) == HID_USAGE_X) {
+						// X starts a new contact
+						if (layout->contactCount == P2S_MAX_CONTACTS) {
+							continue;
+						}
+						layout->reportId = reportId;
+						axis = &layout->contacts[layout->contactCount++].x;
+					} else if ((usage & 0xFFFF) == HID_USAGE_Y && layout->contactCount != 0) {
+						axis = &layout->contacts[layout->contactCount - 1].y;
+					}
+
+					if (axis != NULL && reportSize != 0 && reportSize <= 32) {
+						axis->bitOffset = offset->bitOffset + field * reportSize;
+						axis->bitSize = reportSize;
+						axis->logicalMin = logicalMin;
+						axis->logicalMax = logicalMax;
+						axis->physicalMin = physicalMin;
+						axis->physicalMax = physicalMax;
+					}
+				}
+			}
+			offset->bitOffset += reportSize * reportCount;
+		}
+			// Fall through: main items clear the local items
+		case HID_TAG_COLLECTION:
+		case HID_TAG_END_COLLECTION:
+			usageCount = 0;
+			haveUsageMin = FALSE;
+			break;
+		default:
+			if ((type & 0x0C) == 0) {
+				// Output, feature and other main items
+				usageCount = 0;
+				haveUsageMin = FALSE;
+			}
+			break;
+		}
+	}
+
+	// Drop a trailing contact without a Y field
+	if (layout->contactCount != 0 && layout->contacts[layout->contactCount - 1].y.bitSize == 0) {
+		layout->contactCount--;
+	}
+
+	return layout->contactCount != 0;
+}
+
+static void
+P2S_BuildAxis(
+	_In_ LONG inMin,
+	_In_ LONG inMax,
+	_In_ LONG outMin,
+	_In_ LONG outMax,
+	_In_ ULONG regionLo,
+	_In_ ULONG regionHi,
+	_In_ BOOLEAN flip,
+	_Out_ LONG64 *scale,
+	_Out_ LONG64 *offset,
+	_Out_ LONG *clampMin,
+	_Out_ LONG *clampMax)
+{
+	// Maps [inMin, inMax] onto [regionLo, regionHi] (in 1/10000ths) of
+	// [outMin, outMax], reversed if flip is set:
+	//   out = (scale * in + offset) >> P2S_FIXED_SHIFT
+	LONG64 inSpan = (LONG64)inMax - inMin;
+	LONG64 outSpan = (LONG64)outMax - outMin;
+	LONG64 lo = (LONG64)outMin * P2S_MAP_SCALE + outSpan * regionLo;
+	LONG64 hi = (LONG64)outMin * P2S_MAP_SCALE + outSpan * regionHi;
+
+	if (inSpan <= 0) {
+		inSpan = 1;
+	}
+
+	*scale = ((outSpan * (LONG64)(regionHi - regionLo)) << P2S_FIXED_SHIFT) / (P2S_MAP_SCALE * inSpan);
+	if (flip) {
+		*scale = -*scale;
+		*offset = (hi << P2S_FIXED_SHIFT) / P2S_MAP_SCALE - *scale * inMin;
+	} else {
+		*offset = (lo << P2S_FIXED_SHIFT) / P2S_MAP_SCALE - *scale * inMin;
+	}
+	// Round to the nearest output value rather than down, or the far
+	// end of the range can fall one short of the region's edge
+	*offset += 1LL << (P2S_FIXED_SHIFT - 1);
+	*clampMin = (LONG)(lo / P2S_MAP_SCALE);
+	*clampMax = (LONG)(hi / P2S_MAP_SCALE);
+}
+
+void
+P2S_BuildTransform(
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_MAPPING_CONFIG *config,
+	_Out_ PP2S_TRANSFORM transform)
+{
+	const P2S_AXIS_FIELD *x = &layout->contacts[0].x;
+	const P2S_AXIS_FIELD *y = &layout->contacts[0].y;
+	ULONG left = min(config->regionLeft, P2S_MAP_SCALE);
+	ULONG right = min(config->regionRight, P2S_MAP_SCALE);
+	ULONG top = min(config->regionTop, P2S_MAP_SCALE);
+	ULONG bottom = min(config->regionBottom, P2S_MAP_SCALE);
+	ULONG deadZone = min(config->deadZone, P2S_MAP_SCALE / 2 - 1);
+	BOOLEAN swapAxes = (config->rotation == 90 || config->rotation == 270);
+	LONG64 deadX = ((LONG64)x->logicalMax - x->logicalMin) * deadZone / P2S_MAP_SCALE;
+	LONG64 deadY = ((LONG64)y->logicalMax - y->logicalMin) * deadZone / P2S_MAP_SCALE;
+	LONG inMinX = (LONG)(x->logicalMin + deadX);
+	LONG inMaxX = (LONG)(x->logicalMax - deadX);
+	LONG inMinY = (LONG)(y->logicalMin + deadY);
+	LONG inMaxY = (LONG)(y->logicalMax - deadY);
+
+	RtlZeroMemory(transform, sizeof(*transform));
+
+	if (!config->enable || layout->contactCount == 0) {
+		return;
+	}
+
+	if (right <= left) {
+		left = 0;
+		right = P2S_MAP_SCALE;
+	}
+	if (bottom <= top) {
+		top = 0;
+		bottom = P2S_MAP_SCALE;
+	}
+
+	// Aspect correction: shrink the region around its center until it
+	// has the same shape on the display as the (rotated) pad
+	if (config->displayWidth != 0 && config->displayHeight != 0) {
+		LONG64 padWidth = (x->physicalMax > x->physicalMin) ? (LONG64)x->physicalMax - x->physicalMin : (LONG64)x->logicalMax - x->logicalMin;
+		LONG64 padHeight = (y->physicalMax > y->physicalMin) ? (LONG64)y->physicalMax - y->physicalMin : (LONG64)y->logicalMax - y->logicalMin;
+		LONG64 regionWidth = (LONG64)(right - left) * config->displayWidth;
+		LONG64 regionHeight = (LONG64)(bottom - top) * config->displayHeight;
+
+		if (swapAxes) {
+			LONG64 t = padWidth;
+			padWidth = padHeight;
+			padHeight = t;
+		}
+
+		if (padWidth > 0 && padHeight > 0) {
+			if (regionWidth * padHeight > regionHeight * padWidth) {
+				ULONG width = (ULONG)(regionHeight * padWidth / padHeight / config->displayWidth);
+				left += (right - left - width) / 2;
+				right = left + width;
+			} else {
+				ULONG height = (ULONG)(regionWidth * padHeight / padWidth / config->displayHeight);
+				top += (bottom - top - height) / 2;
+				bottom = top + height;
+			}
+		}
+	}
+
+	// Rotations are multiples of 90 degrees, so each output axis comes
+	// from exactly one input axis, possibly reversed
+	switch (config->rotation) {
+	case 90:
+		P2S_BuildAxis(inMinY, inMaxY, x->logicalMin, x->logicalMax, left, right, TRUE, &transform->m[1], &transform->m[2], &transform->minX, &transform->maxX);
+		P2S_BuildAxis(inMinX, inMaxX, y->logicalMin, y->logicalMax, top, bottom, FALSE, &transform->m[3], &transform->m[5], &transform->minY, &transform->maxY);
+		break;
+	case 180:
+		P2S_BuildAxis(inMinX, inMaxX, x->logicalMin, x->logicalMax, left, right, TRUE, &transform->m[0], &transform->m[2], &transform->minX, &transform->maxX);
+		P2S_BuildAxis(inMinY, inMaxY, y->logicalMin, y->logicalMax, top, bottom, TRUE, &transform->m[4], &transform->m[5], &transform->minY, &transform->maxY);
+		break;
+	case 270:
+		P2S_BuildAxis(inMinY, inMaxY, x->logicalMin, x->logicalMax, left, right, FALSE, &transform->m[1], &transform->m[2], &transform->minX, &transform->maxX);
+		P2S_BuildAxis(inMinX, inMaxX, y->logicalMin, y->logicalMax, top, bottom, TRUE, &transform->m[3], &transform->m[5], &transform->minY, &transform->maxY);
+		break;
+	default:
+		P2S_BuildAxis(inMinX, inMaxX, x->logicalMin, x->logicalMax, left, right, FALSE, &transform->m[0], &transform->m[2], &transform->minX, &transform->maxX);
+		P2S_BuildAxis(inMinY, inMaxY, y->logicalMin, y->logicalMax, top, bottom, FALSE, &transform->m[4], &transform->m[5], &transform->minY, &transform->maxY);
+		break;
+	}
+
+	transform->enabled = TRUE;
+}
+
+static LONG
+P2S_GetField(
+	_In_ const UCHAR *report,
+	_In_ const P2S_AXIS_FIELD *field)
+{
+	ULONG64 bits = 0;
+	ULONG firstByte = field->bitOffset / 8;
+	ULONG lastByte = (field->bitOffset + field->bitSize - 1) / 8;
+	ULONG shift = field->bitOffset % 8;
+	ULONG64 value;
+
+	for (ULONG i = lastByte + 1; i-- > firstByte;) {
+		bits = (bits << 8) | report[i];
+	}
+	value = (bits >> shift) & ((1ULL << field->bitSize) - 1);
+
+	// Sign extend fields that can hold negative values
+	if (field->logicalMin < 0 && (value & (1ULL << (field->bitSize - 1)))) {
+		value |= ~0ULL << field->bitSize;
+	}
+	return (LONG)value;
+}
+
+static void
+P2S_SetField(
+	_Inout_ UCHAR *report,
+	_In_ const P2S_AXIS_FIELD *field,
+	_In_ LONG value)
+{
+	ULONG64 mask = ((1ULL << field->bitSize) - 1) << (field->bitOffset % 8);
+	ULONG64 bits = ((ULONG64)(ULONG)value << (field->bitOffset % 8)) & mask;
+	ULONG firstByte = field->bitOffset / 8;
+	ULONG lastByte = (field->bitOffset + field->bitSize - 1) / 8;
+
+	for (ULONG i = firstByte; i <= lastByte; ++i) {
+		report[i] = (UCHAR)((report[i] & ~mask) | bits);
+		mask >>= 8;
+		bits >>= 8;
+	}
+}
+
+void
+P2S_MapInputReport(
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_TRANSFORM *transform,
+	_Inout_updates_bytes_(reportLen) UCHAR *report,
+	_In_ size_t reportLen)
+{
+	if (!transform->enabled || reportLen == 0) {
+		return;
+	}
+	if (layout->reportId != 0 && report[0] != layout->reportId) {
+		return;
+	}
+
+	for (ULONG i = 0; i < layout->contactCount; ++i) {
+		const P2S_AXIS_FIELD *xField = &layout->contacts[i].x;
+		const P2S_AXIS_FIELD *yField = &layout->contacts[i].y;
+		LONG64 x;
+		LONG64 y;
+		LONG64 outX;
+		LONG64 outY;
+
+		if ((size_t)xField->bitOffset + xField->bitSize > reportLen * 8 ||
+			(size_t)yField->bitOffset + yField->bitSize > reportLen * 8) {
+			continue;
+		}
+
+		x = P2S_GetField(report, xField);
+		y = P2S_GetField(report, yField);
+
+		outX = (transform->m[0] * x + transform->m[1] * y + transform->m[2]) >> P2S_FIXED_SHIFT;
+		outY = (transform->m[3] * x + transform->m[4] * y + transform->m[5]) >> P2S_FIXED_SHIFT;
+
+		// Contacts in the dead zones land on the edge of the region
+		outX = max(transform->minX, min(transform->maxX, outX));
+		outY = max(transform->minY, min(transform->maxY, outY));
+
+		P2S_SetField(report, xField, (LONG)outX);
+		P2S_SetField(report, yField, (LONG)outY);
+	}
+}
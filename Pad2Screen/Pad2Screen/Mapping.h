@@ -0,0 +1,81 @@
+#pragma once
+
+#include <ntddk.h>
+
+EXTERN_C_START
+
+// Most contacts a touchpad input report can carry
+#define P2S_MAX_CONTACTS 10
+
+// Fixed-point scale of the transform coefficients (16.16)
+#define P2S_FIXED_SHIFT 16
+
+// Registry values are given in 1/10000ths of the display or the pad
+#define P2S_MAP_SCALE 10000
+
+// Location of one X or Y field in the input report
+typedef struct _P2S_AXIS_FIELD {
+	ULONG bitOffset;
+	ULONG bitSize;
+	LONG logicalMin;
+	LONG logicalMax;
+	LONG physicalMin;
+	LONG physicalMax;
+} P2S_AXIS_FIELD, *PP2S_AXIS_FIELD;
+
+// Where the contact coordinates live in the touchpad's input report,
+// found by P2S_ParseContactLayout from the report descriptor
+typedef struct _P2S_CONTACT_LAYOUT {
+	UCHAR reportId;
+	ULONG contactCount;
+	struct {
+		P2S_AXIS_FIELD x;
+		P2S_AXIS_FIELD y;
+	} contacts[P2S_MAX_CONTACTS];
+} P2S_CONTACT_LAYOUT, *PP2S_CONTACT_LAYOUT;
+
+// Mapping settings, read from the device's hardware key
+typedef struct _P2S_MAPPING_CONFIG {
+	ULONG enable;           // MapEnable: 0 passes coordinates through
+	ULONG regionLeft;       // MapRegionLeft/Top/Right/Bottom: part of the
+	ULONG regionTop;        // display the pad is mapped to
+	ULONG regionRight;
+	ULONG regionBottom;
+	ULONG rotation;         // MapRotation: 0, 90, 180 or 270 degrees clockwise
+	ULONG deadZone;         // MapDeadZone: ignored band along each pad edge
+	ULONG displayWidth;     // MapDisplayWidth/Height: display aspect ratio,
+	ULONG displayHeight;    // the region is shrunk to the pad's aspect if set
+} P2S_MAPPING_CONFIG, *PP2S_MAPPING_CONFIG;
+
+// Precomputed transform applied to every contact:
+//   x' = clamp((m[0] * x + m[1] * y + m[2]) >> P2S_FIXED_SHIFT)
+//   y' = clamp((m[3] * x + m[4] * y + m[5]) >> P2S_FIXED_SHIFT)
+typedef struct _P2S_TRANSFORM {
+	BOOLEAN enabled;
+	LONG64 m[6];
+	LONG minX;
+	LONG maxX;
+	LONG minY;
+	LONG maxY;
+} P2S_TRANSFORM, *PP2S_TRANSFORM;
+
+BOOLEAN
+P2S_ParseContactLayout(
+	_In_reads_bytes_(descriptorLen) const UCHAR *descriptor,
+	_In_ size_t descriptorLen,
+	_Out_ PP2S_CONTACT_LAYOUT layout);
+
+void
+P2S_BuildTransform(
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_MAPPING_CONFIG *config,
+	_Out_ PP2S_TRANSFORM transform);
+
+void
+P2S_MapInputReport(
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_TRANSFORM *transform,
+	_Inout_updates_bytes_(reportLen) UCHAR *report,
+	_In_ size_t reportLen);
+
+EXTERN_C_END
@@ -0,0 +1,85 @@
+// Report descriptors shared by MappingTest.c and MappingBench.c
+
+#pragma once
+
+// One digitizer finger: tip switch, 7 bits of padding, an 8-bit contact
+// ID, then 16-bit X (0-4095, 100.0mm) and Y (0-2047, 50.0mm)
+static const UCHAR P2S_TestFinger[] = {
+	0x05, 0x0D, 0x09, 0x22, 0xA1, 0x02,
+	0x09, 0x42, 0x15, 0x00, 0x25, 0x01, 0x75, 0x01, 0x95, 0x01, 0x81, 0x02,
+	0x95, 0x07, 0x81, 0x03,
+	0x09, 0x51, 0x25, 0x0F, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+	0x05, 0x01, 0x15, 0x00, 0x26, 0xFF, 0x0F, 0x35, 0x00, 0x46, 0xE8, 0x03,
+	0x75, 0x10, 0x95, 0x01, 0x09, 0x30, 0x81, 0x02,
+	0x26, 0xFF, 0x07, 0x46, 0xF4, 0x01, 0x09, 0x31, 0x81, 0x02,
+	0xC0,
+};
+
+// Bits per finger in the input report
+#define P2S_TEST_FINGER_BITS 48
+
+// Touchpad top-level collection, report ID 1, before the fingers
+static const UCHAR P2S_TestHeader[] = {
+	0x05, 0x0D, 0x09, 0x05, 0xA1, 0x01, 0x85, 0x01,
+};
+
+// Contact count, then the end of the touchpad collection, followed by
+// a mouse with relative X/Y in report 2 that must not be mapped
+static const UCHAR P2S_TestTrailer[] = {
+	0x05, 0x0D, 0x09, 0x54, 0x15, 0x00, 0x25, 0x05, 0x75, 0x08, 0x95, 0x01, 0x81, 0x02,
+	0xC0,
+	0x05, 0x01, 0x09, 0x02, 0xA1, 0x01, 0x85, 0x02, 0x09, 0x01, 0xA1, 0x00,
+	0x09, 0x30, 0x09, 0x31, 0x15, 0x81, 0x25, 0x7F, 0x75, 0x08, 0x95, 0x02, 0x81, 0x06,
+	0xC0, 0xC0,
+};
+
+// Builds a touchpad descriptor with the given number of fingers and
+// returns its length. The input report is 2 + fingers * 6 bytes.
+static inline size_t
+P2S_TestBuildDescriptor(
+	_Out_ UCHAR *descriptor,
+	_In_ ULONG fingers)
+{
+	size_t length = 0;
+
+	memcpy(descriptor + length, P2S_TestHeader, sizeof(P2S_TestHeader));
+	length += sizeof(P2S_TestHeader);
+	for (ULONG i = 0; i < fingers; ++i) {
+		memcpy(descriptor + length, P2S_TestFinger, sizeof(P2S_TestFinger));
+		length += sizeof(P2S_TestFinger);
+	}
+	memcpy(descriptor + length, P2S_TestTrailer, sizeof(P2S_TestTrailer));
+	length += sizeof(P2S_TestTrailer);
+	return length;
+}
+
+// Room for the largest descriptor P2S_TestBuildDescriptor makes
+#define P2S_TEST_DESCRIPTOR_MAX (sizeof(P2S_TestHeader) + (P2S_MAX_CONTACTS + 2) * sizeof(P2S_TestFinger) + sizeof(P2S_TestTrailer))
+
+static inline void
+P2S_TestPutContact(
+	_Inout_ UCHAR *report,
+	_In_ ULONG finger,
+	_In_ ULONG x,
+	_In_ ULONG y)
+{
+	UCHAR *contact = report + 1 + finger * (P2S_TEST_FINGER_BITS / 8);
+
+	contact[0] = 1;
+	contact[1] = (UCHAR)finger;
+	contact[2] = (UCHAR)x;
+	contact[3] = (UCHAR)(x >> 8);
+	contact[4] = (UCHAR)y;
+	contact[5] = (UCHAR)(y >> 8);
+}
+
+static inline ULONG
+P2S_TestGetAxis(
+	_In_ const UCHAR *report,
+	_In_ ULONG finger,
+	_In_ ULONG axis)
+{
+	const UCHAR *value = report + 1 + finger * (P2S_TEST_FINGER_BITS / 8) + 2 + axis * 2;
+
+	return value[0] | (value[1] << 8);
+}
@@ -0,0 +1,91 @@
+// Benchmark for the touchpad-to-display mapping. Builds with the stub
+// ntddk.h in this directory:
+//
+//   cc -O2 -Wall -Wextra -Wno-implicit-fallthrough -I test test/MappingBench.c Mapping.c -o MappingBench
+//
+// Times P2S_ParseContactLayout on touchpad descriptors with 1 to 10
+// fingers, P2S_BuildTransform, and P2S_MapInputReport on input reports
+// with every finger down, rotated by 90 degrees with aspect correction.
+
+#include "../Mapping.h"
+#include "Descriptors.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#define BENCH_PARSES 200000
+#define BENCH_REPORTS 5000000
+
+static double
+Seconds(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return now.tv_sec + now.tv_nsec / 1e9;
+}
+
+int
+main(void)
+{
+	static const ULONG fingerCounts[] = { 1, 2, 5, 10 };
+	UCHAR descriptor[P2S_TEST_DESCRIPTOR_MAX];
+	UCHAR report[2 + P2S_MAX_CONTACTS * 6];
+	P2S_CONTACT_LAYOUT layout;
+	P2S_MAPPING_CONFIG config;
+	P2S_TRANSFORM transform;
+	ULONG checksum = 0;
+
+	memset(&config, 0, sizeof(config));
+	config.enable = 1;
+	config.regionLeft = 1000;
+	config.regionTop = 1000;
+	config.regionRight = 9000;
+	config.regionBottom = 9000;
+	config.rotation = 90;
+	config.deadZone = 200;
+	config.displayWidth = 16;
+	config.displayHeight = 9;
+
+	for (ULONG f = 0; f < sizeof(fingerCounts) / sizeof(fingerCounts[0]); ++f) {
+		ULONG fingers = fingerCounts[f];
+		size_t length = P2S_TestBuildDescriptor(descriptor, fingers);
+		size_t reportLen = 2 + fingers * 6;
+		double start;
+		double parse;
+		double build;
+		double map;
+
+		start = Seconds();
+		for (ULONG i = 0; i < BENCH_PARSES; ++i) {
+			checksum += P2S_ParseContactLayout(descriptor, length, &layout);
+		}
+		parse = Seconds() - start;
+
+		start = Seconds();
+		for (ULONG i = 0; i < BENCH_PARSES; ++i) {
+			config.deadZone = 200 + (i & 1);
+			P2S_BuildTransform(&layout, &config, &transform);
+			checksum += (ULONG)transform.m[2];
+		}
+		build = Seconds() - start;
+
+		memset(report, 0, sizeof(report));
+		report[0] = 1;
+		start = Seconds();
+		for (ULONG i = 0; i < BENCH_REPORTS; ++i) {
+			for (ULONG c = 0; c < fingers; ++c) {
+				P2S_TestPutContact(report, c, (i * 7 + c * 400) % 4096, (i * 3 + c * 200) % 2048);
+			}
+			P2S_MapInputReport(&layout, &transform, report, reportLen);
+			checksum += report[3];
+		}
+		map = Seconds() - start;
+
+		printf("%2u finger(s), %3zu byte descriptor: parse %7.1f ns, build %5.1f ns, map %6.1f ns/report (%5.1f ns/contact)\n",
+			fingers, length, parse * 1e9 / BENCH_PARSES, build * 1e9 / BENCH_PARSES,
+			map * 1e9 / BENCH_REPORTS, map * 1e9 / BENCH_REPORTS / fingers);
+	}
+
+	return checksum == 0;
+}
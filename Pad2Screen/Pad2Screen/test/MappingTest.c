@@ -0,0 +1,254 @@
+// Host test for the touchpad-to-display mapping. Builds with the stub
+// ntddk.h in this directory:
+//
+//   cc -O2 -Wall -Wextra -Wno-implicit-fallthrough -I test test/MappingTest.c Mapping.c -o MappingTest
+//
+// Parses touchpad descriptors into contact layouts, then checks the
+// 16.16 transform: pass-through, regions, every rotation, dead zones,
+// aspect correction, reports it must leave alone, and every X value
+// against the exact mapping.
+
+#include "../Mapping.h"
+#include "Descriptors.h"
+
+#include <stdio.h>
+
+static int failures;
+
+static void
+Check(
+	_In_ const char *name,
+	_In_ LONG64 actual,
+	_In_ LONG64 expected)
+{
+	if (actual != expected) {
+		failures++;
+		printf("FAIL %s: got %lld, expected %lld\n", name, (long long)actual, (long long)expected);
+	}
+}
+
+static void
+TestParse(void)
+{
+	UCHAR descriptor[P2S_TEST_DESCRIPTOR_MAX];
+	P2S_CONTACT_LAYOUT layout;
+	size_t length;
+
+	length = P2S_TestBuildDescriptor(descriptor, 2);
+	Check("parse 2 fingers", P2S_ParseContactLayout(descriptor, length, &layout), TRUE);
+	Check("report id", layout.reportId, 1);
+	Check("contact count", layout.contactCount, 2);
+	Check("x offset", layout.contacts[0].x.bitOffset, 8 + 16);
+	Check("y offset", layout.contacts[0].y.bitOffset, 8 + 32);
+	Check("second x offset", layout.contacts[1].x.bitOffset, 8 + P2S_TEST_FINGER_BITS + 16);
+	Check("x size", layout.contacts[0].x.bitSize, 16);
+	Check("x logical max", layout.contacts[0].x.logicalMax, 4095);
+	Check("y logical max", layout.contacts[0].y.logicalMax, 2047);
+	Check("x physical max", layout.contacts[0].x.physicalMax, 1000);
+	Check("y physical max", layout.contacts[0].y.physicalMax, 500);
+
+	// More fingers than the layout holds: the first P2S_MAX_CONTACTS
+	length = P2S_TestBuildDescriptor(descriptor, P2S_MAX_CONTACTS + 2);
+	Check("parse too many fingers", P2S_ParseContactLayout(descriptor, length, &layout), TRUE);
+	Check("contact count capped", layout.contactCount, P2S_MAX_CONTACTS);
+
+	// A descriptor cut off after the first X has no complete contact
+	length = sizeof(P2S_TestHeader) + 52;
+	Check("truncated", P2S_ParseContactLayout(descriptor, length, &layout), FALSE);
+
+	// Only the mouse: relative X/Y are mapped like any other report
+	Check("mouse only", P2S_ParseContactLayout(P2S_TestTrailer + 15, sizeof(P2S_TestTrailer) - 15, &layout), TRUE);
+	Check("mouse report id", layout.reportId, 2);
+	Check("mouse x signed", layout.contacts[0].x.logicalMin, -127);
+
+	// A long item before the touchpad is skipped
+	descriptor[0] = 0xFE;
+	descriptor[1] = 2;
+	descriptor[2] = 0x10;
+	descriptor[3] = 0xAA;
+	descriptor[4] = 0xBB;
+	length = 5 + P2S_TestBuildDescriptor(descriptor + 5, 1);
+	Check("long item", P2S_ParseContactLayout(descriptor, length, &layout), TRUE);
+	Check("long item contacts", layout.contactCount, 1);
+}
+
+// Maps one contact and returns its new X and Y
+static void
+MapPoint(
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_TRANSFORM *transform,
+	_In_ ULONG x,
+	_In_ ULONG y,
+	_Out_ ULONG *outX,
+	_Out_ ULONG *outY)
+{
+	UCHAR report[2 + 2 * 6] = { 1 };
+
+	P2S_TestPutContact(report, 0, x, y);
+	P2S_MapInputReport(layout, transform, report, sizeof(report));
+	*outX = P2S_TestGetAxis(report, 0, 0);
+	*outY = P2S_TestGetAxis(report, 0, 1);
+}
+
+static void
+CheckPoint(
+	_In_ const char *name,
+	_In_ const P2S_CONTACT_LAYOUT *layout,
+	_In_ const P2S_MAPPING_CONFIG *config,
+	_In_ ULONG x,
+	_In_ ULONG y,
+	_In_ ULONG expectedX,
+	_In_ ULONG expectedY)
+{
+	P2S_TRANSFORM transform;
+	ULONG outX;
+	ULONG outY;
+	char label[128];
+
+	P2S_BuildTransform(layout, config, &transform);
+	MapPoint(layout, &transform, x, y, &outX, &outY);
+
+	snprintf(label, sizeof(label), "%s x", name);
+	Check(label, outX, expectedX);
+	snprintf(label, sizeof(label), "%s y", name);
+	Check(label, outY, expectedY);
+}
+
+static void
+DefaultConfig(
+	_Out_ P2S_MAPPING_CONFIG *config)
+{
+	memset(config, 0, sizeof(*config));
+	config->enable = 1;
+	config->regionRight = P2S_MAP_SCALE;
+	config->regionBottom = P2S_MAP_SCALE;
+}
+
+static void
+TestTransform(void)
+{
+	UCHAR descriptor[P2S_TEST_DESCRIPTOR_MAX];
+	P2S_CONTACT_LAYOUT layout;
+	P2S_MAPPING_CONFIG config;
+	P2S_TRANSFORM transform;
+	UCHAR report[2 + 2 * 6] = { 1 };
+	UCHAR before[sizeof(report)];
+
+	P2S_ParseContactLayout(descriptor, P2S_TestBuildDescriptor(descriptor, 2), &layout);
+
+	// Disabled: nothing to do
+	DefaultConfig(&config);
+	config.enable = 0;
+	P2S_BuildTransform(&layout, &config, &transform);
+	Check("disabled", transform.enabled, FALSE);
+
+	// Whole display: coordinates unchanged
+	DefaultConfig(&config);
+	CheckPoint("identity min", &layout, &config, 0, 0, 0, 0);
+	CheckPoint("identity mid", &layout, &config, 1234, 567, 1234, 567);
+	CheckPoint("identity max", &layout, &config, 4095, 2047, 4095, 2047);
+
+	// Left half of the display
+	config.regionRight = P2S_MAP_SCALE / 2;
+	CheckPoint("left half max", &layout, &config, 4095, 2047, 2047, 2047);
+	CheckPoint("left half mid", &layout, &config, 2048, 0, 1024, 0);
+
+	// Rotations, corners of the pad
+	DefaultConfig(&config);
+	config.rotation = 90;
+	CheckPoint("90 origin", &layout, &config, 0, 0, 4095, 0);
+	CheckPoint("90 far", &layout, &config, 4095, 2047, 0, 2047);
+	config.rotation = 180;
+	CheckPoint("180 origin", &layout, &config, 0, 0, 4095, 2047);
+	CheckPoint("180 far", &layout, &config, 4095, 2047, 0, 0);
+	config.rotation = 270;
+	CheckPoint("270 origin", &layout, &config, 0, 0, 0, 2047);
+	CheckPoint("270 far", &layout, &config, 4095, 2047, 4095, 0);
+
+	// 10% dead zone: the band along each edge lands on the edge
+	DefaultConfig(&config);
+	config.deadZone = 1000;
+	CheckPoint("dead zone edge", &layout, &config, 0, 0, 0, 0);
+	CheckPoint("dead zone inside", &layout, &config, 409, 204, 0, 0);
+	CheckPoint("dead zone far", &layout, &config, 4095, 2047, 4095, 2047);
+	CheckPoint("dead zone mid", &layout, &config, 2048, 1024, 2048, 1024);
+
+	// A 2:1 pad on a 16:9 display: full width, the height shrunk to
+	// 8888/10000 around the middle
+	DefaultConfig(&config);
+	config.displayWidth = 16;
+	config.displayHeight = 9;
+	P2S_BuildTransform(&layout, &config, &transform);
+	Check("aspect min x", transform.minX, 0);
+	Check("aspect max x", transform.maxX, 4095);
+	Check("aspect min y", transform.minY, 2047 * 556 / 10000);
+	Check("aspect max y", transform.maxY, 2047 * 9444 / 10000);
+
+	// Other reports and reports too short for a contact are left alone
+	DefaultConfig(&config);
+	config.rotation = 180;
+	P2S_BuildTransform(&layout, &config, &transform);
+	P2S_TestPutContact(report, 0, 100, 200);
+	P2S_TestPutContact(report, 1, 300, 400);
+	report[0] = 2;
+	memcpy(before, report, sizeof(report));
+	P2S_MapInputReport(&layout, &transform, report, sizeof(report));
+	Check("other report", memcmp(report, before, sizeof(report)), 0);
+
+	report[0] = 1;
+	P2S_MapInputReport(&layout, &transform, report, 1 + 6);
+	Check("short report first contact", P2S_TestGetAxis(report, 0, 0), 4095 - 100);
+	Check("short report second contact", P2S_TestGetAxis(report, 1, 0), 300);
+}
+
+static void
+TestAccuracy(void)
+{
+	UCHAR descriptor[P2S_TEST_DESCRIPTOR_MAX];
+	P2S_CONTACT_LAYOUT layout;
+	P2S_MAPPING_CONFIG config;
+	P2S_TRANSFORM transform;
+	ULONG outX;
+	ULONG outY;
+	ULONG last = 0;
+	LONG64 worst = 0;
+
+	P2S_ParseContactLayout(descriptor, P2S_TestBuildDescriptor(descriptor, 1), &layout);
+
+	// Middle third of the display: every X against the exact value
+	DefaultConfig(&config);
+	config.regionLeft = 3333;
+	config.regionRight = 6667;
+	P2S_BuildTransform(&layout, &config, &transform);
+
+	for (ULONG x = 0; x <= 4095; ++x) {
+		double exact = 4095.0 * 3333 / 10000 + x * (4095.0 * 3334 / 10000) / 4095;
+		LONG64 error;
+
+		MapPoint(&layout, &transform, x, 0, &outX, &outY);
+		error = (LONG64)outX - (LONG64)exact;
+		error = error < 0 ? -error : error;
+		worst = error > worst ? error : worst;
+		if (outX < last) {
+			failures++;
+			printf("FAIL accuracy: x %u maps below x %u\n", x, x - 1);
+		}
+		last = outX;
+	}
+	Check("accuracy worst error", worst <= 1, TRUE);
+}
+
+int
+main(void)
+{
+	TestParse();
+	TestTransform();
+	TestAccuracy();
+
+	if (failures != 0) {
+		return 1;
+	}
+
+	printf("Mapping test passed\n");
+	return 0;
+}
@@ -0,0 +1,36 @@
+// Stand-in for the kernel headers with just what Mapping.c uses, so
+// that MappingTest.c and MappingBench.c build on a host.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef unsigned char UCHAR;
+typedef unsigned char BOOLEAN;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef int64_t LONG64;
+typedef uint64_t ULONG64;
+
+#define TRUE 1
+#define FALSE 0
+
+#define EXTERN_C_START
+#define EXTERN_C_END
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Inout_updates_bytes_(size)
+
+#define RtlZeroMemory(destination, length) memset((destination), 0, (length))
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#endif
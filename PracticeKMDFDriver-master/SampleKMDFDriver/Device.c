@@ -44,12 +44,19 @@ Return Value:
 --*/
 {
     WDF_OBJECT_ATTRIBUTES deviceAttributes;
+    WDF_OBJECT_ATTRIBUTES memoryAttributes;
     PDEVICE_CONTEXT deviceContext;
     WDFDEVICE device;
+    WDFMEMORY ringMemory;
+    PVOID ringStorage;
     NTSTATUS status;
 
     PAGED_CODE();
 
+	// Let reads and writes use the application's pages directly instead of
+	// having the I/O manager copy them through a system buffer
+	WdfDeviceInitSetIoType(DeviceInit, WdfDeviceIoDirect);
+
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, DEVICE_CONTEXT);
 
     status = WdfDeviceCreate(&DeviceInit, &deviceAttributes, &device);
@@ -69,7 +76,21 @@ Return Value:
         //
         // Initialize the context.
         //
-		deviceContext->dwStringLength = 0;
+		// The ring storage is allocated once and freed along with the device
+		WDF_OBJECT_ATTRIBUTES_INIT(&memoryAttributes);
+		memoryAttributes.ParentObject = device;
+
+		status = WdfMemoryCreate(&memoryAttributes,
+								 NonPagedPoolNx,
+								 'gniR',
+								 RING_BUFFER_SIZE,
+								 &ringMemory,
+								 &ringStorage);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+
+		RingInitialize(&deviceContext->Ring, ringStorage, RING_BUFFER_SIZE);
 
 		// Initializing the symbolic name
 		// No need to delete the symbolic link myself, the framework will take care of it. Difference b/w KMDF and WDM
@@ -15,6 +15,7 @@ Environment:
 --*/
 
 #include "public.h"
+#include "ring.h"
 
 EXTERN_C_START
 
@@ -28,11 +29,11 @@ EXTERN_C_START
 //
 typedef struct _DEVICE_CONTEXT
 {
-	// Buffer to temporarily store the string sent from the application
-	PVOID pInternalStringBuffer;
+	// Bytes written by the application, waiting to be read back
+	BYTE_RING Ring;
 
-	// Size of the string sent by the application
-	SIZE_T dwStringLength;
+	// Reads that arrived while the ring was empty
+	WDFQUEUE PendingReadQueue;
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 //
@@ -23,6 +23,7 @@ Environment:
 
 VOID SampleKMDFDriverEvtWrite(_In_ WDFQUEUE Queue, _In_ WDFREQUEST Request, _In_ size_t Length);
 VOID SampleKMDFDriverEvtRead(_In_ WDFQUEUE Queue, _In_ WDFREQUEST Request, _In_ size_t Length);
+static VOID SampleKMDFDriverServicePendingReads(_In_ PDEVICE_CONTEXT DeviceContext);
 
 NTSTATUS
 SampleKMDFDriverQueueInitialize(
@@ -35,9 +36,10 @@ Routine Description:
      The I/O dispatch callbacks for the frameworks device object
      are configured in this function.
 
-     A single default I/O Queue is configured for parallel request
-     processing, and a driver context memory allocation is created
-     to hold our structure QUEUE_CONTEXT.
+     A default I/O Queue is configured for parallel request processing
+     and takes the reads. Writes go through their own sequential queue,
+     since the ring only allows one producer at a time, and reads that
+     find the ring empty wait in a manual queue until data arrives.
 
 Arguments:
 
@@ -52,6 +54,7 @@ Return Value:
     WDFQUEUE queue;
     NTSTATUS status;
     WDF_IO_QUEUE_CONFIG queueConfig;
+    PDEVICE_CONTEXT deviceContext = DeviceGetContext(Device);
 
     PAGED_CODE();
 
@@ -65,9 +68,8 @@ Return Value:
         WdfIoQueueDispatchParallel
         );
 
-	// Assign callback functions, read and write
+	// Assign callback functions, writes are dispatched to their own queue below
 	queueConfig.EvtIoRead = SampleKMDFDriverEvtRead;
-	queueConfig.EvtIoWrite = SampleKMDFDriverEvtWrite;
 
     queueConfig.EvtIoDeviceControl = SampleKMDFDriverEvtIoDeviceControl;
     queueConfig.EvtIoStop = SampleKMDFDriverEvtIoStop;
@@ -84,9 +86,71 @@ Return Value:
         return status;
     }
 
+	// One write at a time keeps the ring single-producer
+	WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchSequential);
+	queueConfig.EvtIoWrite = SampleKMDFDriverEvtWrite;
+
+	status = WdfIoQueueCreate(Device, &queueConfig, WDF_NO_OBJECT_ATTRIBUTES, &queue);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_QUEUE, "WdfIoQueueCreate for writes failed %!STATUS!", status);
+		return status;
+	}
+
+	status = WdfDeviceConfigureRequestDispatching(Device, queue, WdfRequestTypeWrite);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_QUEUE, "WdfDeviceConfigureRequestDispatching failed %!STATUS!", status);
+		return status;
+	}
+
+	// Reads are parked here while the ring is empty. The framework cancels
+	// them if the application gives up waiting.
+	WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
+
+	status = WdfIoQueueCreate(Device, &queueConfig, WDF_NO_OBJECT_ATTRIBUTES, &deviceContext->PendingReadQueue);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_QUEUE, "WdfIoQueueCreate for pending reads failed %!STATUS!", status);
+		return status;
+	}
+
     return status;
 }
 
+static VOID
+SampleKMDFDriverServicePendingReads(
+	_In_ PDEVICE_CONTEXT DeviceContext
+) {
+	NTSTATUS ntStatus;
+	WDFREQUEST request;
+	PVOID buffer;
+	SIZE_T dwBufferSize;
+	SIZE_T dwReturnSize;
+
+	// Hand out data to waiting reads until one side runs dry
+	while (!RingIsEmpty(&DeviceContext->Ring)) {
+		ntStatus = WdfIoQueueRetrieveNextRequest(DeviceContext->PendingReadQueue, &request);
+		if (!NT_SUCCESS(ntStatus)) {
+			break;
+		}
+
+		ntStatus = WdfRequestRetrieveOutputBuffer(request, 1, &buffer, &dwBufferSize);
+		if (!NT_SUCCESS(ntStatus)) {
+			WdfRequestComplete(request, ntStatus);
+			continue;
+		}
+
+		dwReturnSize = RingRead(&DeviceContext->Ring, buffer, dwBufferSize);
+		if (dwReturnSize == 0) {
+			// Another reader took the data first, put the request back. The
+			// loop checks the ring again so a write that raced with this
+			// still gets to it.
+			WdfRequestRequeue(request);
+			continue;
+		}
+
+		WdfRequestCompleteWithInformation(request, STATUS_SUCCESS, dwReturnSize);
+	}
+}
+
 VOID
 SampleKMDFDriverEvtWrite(
 	_In_ WDFQUEUE Queue,
@@ -94,31 +158,27 @@ SampleKMDFDriverEvtWrite(
 	_In_ size_t Length
 ) {
 	NTSTATUS ntStatus = STATUS_SUCCESS;
-	WDFMEMORY memory;
+	PVOID buffer;
 	PDEVICE_CONTEXT deviceContext;
 	SIZE_T dwReturnSize = 0;
 
 	deviceContext = DeviceGetContext(WdfIoQueueGetDevice(Queue));
 
-	// Gains a handle to a framework memory object that represents an I/O request's input buffer
-	ntStatus = WdfRequestRetrieveInputMemory(Request, &memory);
+	if (Length == 0) {
+		WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, 0);
+		return;
+	}
+
+	// With direct I/O this maps the application's buffer, nothing is copied twice
+	ntStatus = WdfRequestRetrieveInputBuffer(Request, 1, &buffer, NULL);
 	if (NT_SUCCESS(ntStatus)) {
-		// If the device buffer exists, reset the buffer
-		if (deviceContext->pInternalStringBuffer) {
-			ExFreePool(deviceContext->pInternalStringBuffer);
-			deviceContext->pInternalStringBuffer = NULL;
-			deviceContext->dwStringLength = 0;
+		// Takes as much as fits, the application writes the rest again
+		dwReturnSize = RingWrite(&deviceContext->Ring, buffer, Length);
+		if (dwReturnSize == 0) {
+			ntStatus = STATUS_DEVICE_BUSY;
 		}
 
-		deviceContext->dwStringLength = Length;
-
-		// If the new string length is greater than 0
-		if (deviceContext->dwStringLength) {
-			deviceContext->pInternalStringBuffer = ExAllocatePool(NonPagedPool, deviceContext->dwStringLength);
-
-			dwReturnSize = deviceContext->dwStringLength;
-			WdfMemoryCopyToBuffer(memory, 0, deviceContext->pInternalStringBuffer, deviceContext->dwStringLength);
-		}
+		SampleKMDFDriverServicePendingReads(deviceContext);
 	}
 
 	WdfRequestCompleteWithInformation(Request, ntStatus, dwReturnSize);
@@ -131,24 +191,39 @@ SampleKMDFDriverEvtRead(
 	_In_ size_t Length
 ) {
 	NTSTATUS ntStatus = STATUS_SUCCESS;
-	WDFMEMORY memory;
+	PVOID buffer;
 	PDEVICE_CONTEXT deviceContext;
 	SIZE_T dwReturnSize = 0;
 
 	deviceContext = DeviceGetContext(WdfIoQueueGetDevice(Queue));
 
-	// Gains a handle to a framework memory object that represents an I/O request's input buffer
-	ntStatus = WdfRequestRetrieveInputMemory(Request, &memory);
-	if (NT_SUCCESS(ntStatus)) {
-		// dwReturnSize is the lesser of the two
-		dwReturnSize = (deviceContext->dwStringLength > Length) ? Length : deviceContext->dwStringLength;
+	if (Length == 0) {
+		WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, 0);
+		return;
+	}
 
-		if (dwReturnSize) {
-			WdfMemoryCopyFromBuffer(memory, 0, deviceContext->pInternalStringBuffer, deviceContext->dwStringLength);
-		}
+	// Gains the request's output buffer, the data goes straight into it
+	ntStatus = WdfRequestRetrieveOutputBuffer(Request, 1, &buffer, NULL);
+	if (!NT_SUCCESS(ntStatus)) {
+		WdfRequestComplete(Request, ntStatus);
+		return;
 	}
 
-	WdfRequestCompleteWithInformation(Request, ntStatus, dwReturnSize);
+	dwReturnSize = RingRead(&deviceContext->Ring, buffer, Length);
+	if (dwReturnSize) {
+		WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, dwReturnSize);
+		return;
+	}
+
+	// Nothing to read yet, wait for the next write
+	ntStatus = WdfRequestForwardToIoQueue(Request, deviceContext->PendingReadQueue);
+	if (!NT_SUCCESS(ntStatus)) {
+		WdfRequestComplete(Request, ntStatus);
+		return;
+	}
+
+	// A write may have come in before the request was queued and missed it
+	SampleKMDFDriverServicePendingReads(deviceContext);
 }
 
 VOID
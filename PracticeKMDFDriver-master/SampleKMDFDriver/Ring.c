@@ -0,0 +1,115 @@
+/*++
+
+Module Name:
+
+    ring.c
+
+Abstract:
+
+    This file contains the byte stream ring shared by the read and
+    write callbacks. It can be called at any IRQL as long as the
+    storage is nonpaged.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+#include "driver.h"
+
+VOID
+RingInitialize(
+	_Out_ PBYTE_RING Ring,
+	_In_ PVOID Storage,
+	_In_ ULONG Size
+	)
+{
+	NT_ASSERT(Size != 0 && (Size & (Size - 1)) == 0);
+
+	Ring->Storage = Storage;
+	Ring->Size = Size;
+	Ring->Head = 0;
+	Ring->Tail = 0;
+}
+
+BOOLEAN
+RingIsEmpty(
+	_In_ PBYTE_RING Ring
+	)
+{
+	return ReadAcquire64(&Ring->Head) == ReadAcquire64(&Ring->Tail);
+}
+
+SIZE_T
+RingWrite(
+	_Inout_ PBYTE_RING Ring,
+	_In_reads_bytes_(Length) const VOID *Buffer,
+	_In_ SIZE_T Length
+	)
+{
+	LONG64 head = Ring->Head;
+	LONG64 tail = ReadAcquire64(&Ring->Tail);
+	SIZE_T bytes = Ring->Size - (SIZE_T)(head - tail);
+	SIZE_T offset = (SIZE_T)head & (Ring->Size - 1);
+	SIZE_T first;
+
+	if (bytes > Length) {
+		bytes = Length;
+	}
+
+	// Copy in up to two pieces when the data wraps around
+	first = min(bytes, Ring->Size - offset);
+	RtlCopyMemory(Ring->Storage + offset, Buffer, first);
+	RtlCopyMemory(Ring->Storage, (const UCHAR *)Buffer + first, bytes - first);
+
+	// Publish the bytes to the consumers
+	InterlockedExchange64(&Ring->Head, head + bytes);
+
+	return bytes;
+}
+
+SIZE_T
+RingRead(
+	_Inout_ PBYTE_RING Ring,
+	_Out_writes_bytes_to_(Length, return) PVOID Buffer,
+	_In_ SIZE_T Length
+	)
+{
+	LONG64 head;
+	LONG64 tail;
+	SIZE_T bytes;
+	SIZE_T offset;
+	SIZE_T first;
+
+	for (;;) {
+		tail = ReadAcquire64(&Ring->Tail);
+		head = ReadAcquire64(&Ring->Head);
+
+		// Other consumers and the producer may have moved on between
+		// the two reads, in which case tail is more than a ring behind
+		// head and the storage no longer holds those bytes
+		if ((ULONG64)(head - tail) > Ring->Size) {
+			continue;
+		}
+
+		bytes = (SIZE_T)(head - tail);
+		if (bytes == 0) {
+			return 0;
+		}
+		if (bytes > Length) {
+			bytes = Length;
+		}
+
+		offset = (SIZE_T)tail & (Ring->Size - 1);
+		first = min(bytes, Ring->Size - offset);
+		RtlCopyMemory(Buffer, Ring->Storage + offset, first);
+		RtlCopyMemory((PUCHAR)Buffer + first, Ring->Storage, bytes - first);
+
+		// The producer can't reuse these bytes until Tail moves past
+		// them, so the copy is good if nobody else claimed them first
+		if (InterlockedCompareExchange64(&Ring->Tail, tail + bytes, tail) == tail) {
+			return bytes;
+		}
+	}
+}
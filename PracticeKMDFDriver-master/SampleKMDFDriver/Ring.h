@@ -0,0 +1,77 @@
+/*++
+
+Module Name:
+
+    ring.h
+
+Abstract:
+
+    This file contains the byte stream ring definitions.
+
+    The ring has one producer and any number of consumers. The producer
+    only moves Head and the consumers only move Tail, so no lock is
+    needed: a consumer copies the bytes out first and then claims them
+    by advancing Tail with a compare-exchange, retrying if another
+    consumer got there first.
+
+Environment:
+
+    Kernel-mode Driver Framework
+
+--*/
+
+EXTERN_C_START
+
+//
+// Size of the ring storage in bytes, must be a power of two
+//
+#define RING_BUFFER_SIZE (64 * 1024)
+
+typedef struct _BYTE_RING
+{
+	// Preallocated storage, owned by the caller
+	PUCHAR Storage;
+
+	// Size of Storage in bytes, a power of two
+	ULONG Size;
+
+	// Total bytes ever written and read. The bytes in the ring are
+	// [Tail, Head), taken modulo Size.
+	volatile LONG64 Head;
+	volatile LONG64 Tail;
+} BYTE_RING, *PBYTE_RING;
+
+VOID
+RingInitialize(
+	_Out_ PBYTE_RING Ring,
+	_In_ PVOID Storage,
+	_In_ ULONG Size
+	);
+
+BOOLEAN
+RingIsEmpty(
+	_In_ PBYTE_RING Ring
+	);
+
+//
+// Copies as much of Buffer as fits. Must not be called concurrently
+// with itself.
+//
+SIZE_T
+RingWrite(
+	_Inout_ PBYTE_RING Ring,
+	_In_reads_bytes_(Length) const VOID *Buffer,
+	_In_ SIZE_T Length
+	);
+
+//
+// Takes up to Length bytes. Safe to call from any number of threads.
+//
+SIZE_T
+RingRead(
+	_Inout_ PBYTE_RING Ring,
+	_Out_writes_bytes_to_(Length, return) PVOID Buffer,
+	_In_ SIZE_T Length
+	);
+
+EXTERN_C_END
@@ -0,0 +1,217 @@
+// Stress test and benchmark for the byte ring. Builds on a Linux host
+// with the stub driver.h in this directory:
+//
+//   cc -O2 -Wall -Wextra -pthread -I test test/RingTest.c Ring.c -o RingTest
+//
+// One producer writes a byte stream where byte i is i % 251 into a
+// ring of RING_BUFFER_SIZE bytes while 1, 2 and 4 consumers read it.
+// Every chunk a consumer gets must continue the pattern byte by byte,
+// and together the consumers must get every byte exactly once. The
+// ring size is not a multiple of 251, so bytes overwritten by a later
+// lap of the producer break the pattern.
+//
+// Prints the throughput of each run and the hand-off latency from a
+// write of one byte to its read by a single consumer. Threads that find
+// nothing to do yield, so the test also completes on one processor.
+
+#include "driver.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define PATTERN 251
+#define CHUNK 4096
+#define STREAM_BYTES (64ull * 1024 * 1024)
+#define LATENCY_SAMPLES 10000
+
+static UCHAR Storage[RING_BUFFER_SIZE];
+static BYTE_RING Ring;
+static volatile int ProducerDone;
+
+typedef struct _CONSUMER {
+	pthread_t thread;
+	ULONG64 bytes;
+	ULONG64 errors;
+} CONSUMER;
+
+static ULONG64
+NowNs(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	return (ULONG64)now.tv_sec * 1000000000ull + (ULONG64)now.tv_nsec;
+}
+
+static void *
+Producer(void *context)
+{
+	UCHAR chunk[CHUNK + PATTERN];
+	ULONG64 written = 0;
+	SIZE_T bytes;
+	SIZE_T i;
+
+	(void)context;
+
+	for (i = 0; i < sizeof(chunk); i++) {
+		chunk[i] = (UCHAR)(i % PATTERN);
+	}
+
+	while (written < STREAM_BYTES) {
+		SIZE_T length = (SIZE_T)min((ULONG64)CHUNK, STREAM_BYTES - written);
+
+		bytes = RingWrite(&Ring, chunk + written % PATTERN, length);
+		if (bytes == 0) {
+			sched_yield();
+		}
+		written += bytes;
+	}
+
+	__atomic_store_n(&ProducerDone, 1, __ATOMIC_RELEASE);
+	return NULL;
+}
+
+static void *
+Consumer(void *context)
+{
+	CONSUMER *consumer = context;
+	UCHAR buffer[CHUNK];
+	SIZE_T bytes;
+	SIZE_T i;
+
+	for (;;) {
+		bytes = RingRead(&Ring, buffer, sizeof(buffer));
+		if (bytes == 0) {
+			if (__atomic_load_n(&ProducerDone, __ATOMIC_ACQUIRE) && RingIsEmpty(&Ring)) {
+				break;
+			}
+			sched_yield();
+			continue;
+		}
+
+		for (i = 1; i < bytes; i++) {
+			if (buffer[i] != (buffer[i - 1] + 1) % PATTERN) {
+				consumer->errors++;
+				break;
+			}
+		}
+		consumer->bytes += bytes;
+	}
+
+	return NULL;
+}
+
+static int
+RunThroughput(int consumerCount)
+{
+	CONSUMER consumers[4] = { 0 };
+	pthread_t producer;
+	ULONG64 bytes = 0;
+	ULONG64 errors = 0;
+	ULONG64 start;
+	ULONG64 elapsed;
+	int i;
+
+	RingInitialize(&Ring, Storage, sizeof(Storage));
+	ProducerDone = 0;
+
+	start = NowNs();
+	for (i = 0; i < consumerCount; i++) {
+		pthread_create(&consumers[i].thread, NULL, Consumer, &consumers[i]);
+	}
+	pthread_create(&producer, NULL, Producer, NULL);
+
+	pthread_join(producer, NULL);
+	for (i = 0; i < consumerCount; i++) {
+		pthread_join(consumers[i].thread, NULL);
+		bytes += consumers[i].bytes;
+		errors += consumers[i].errors;
+	}
+	elapsed = NowNs() - start;
+
+	printf("%d consumer(s): %8.1f MB/s", consumerCount, (double)bytes / 1048576.0 / ((double)elapsed / 1e9));
+	if (bytes != STREAM_BYTES || errors != 0) {
+		printf("  FAIL: %llu of %llu bytes, %llu torn chunks\n",
+			(unsigned long long)bytes, (unsigned long long)STREAM_BYTES, (unsigned long long)errors);
+		return 1;
+	}
+	printf("\n");
+	return 0;
+}
+
+static void *
+Echo(void *context)
+{
+	UCHAR byte;
+
+	(void)context;
+
+	while (!__atomic_load_n(&ProducerDone, __ATOMIC_ACQUIRE)) {
+		if (RingRead(&Ring, &byte, 1) == 0) {
+			sched_yield();
+		}
+	}
+	return NULL;
+}
+
+static int
+CompareSamples(const void *a, const void *b)
+{
+	ULONG64 left = *(const ULONG64 *)a;
+	ULONG64 right = *(const ULONG64 *)b;
+
+	return (left > right) - (left < right);
+}
+
+static void
+RunLatency(void)
+{
+	static ULONG64 samples[LATENCY_SAMPLES];
+	pthread_t consumer;
+	UCHAR byte = 0;
+	ULONG64 start;
+	int i;
+
+	RingInitialize(&Ring, Storage, sizeof(Storage));
+	ProducerDone = 0;
+	pthread_create(&consumer, NULL, Echo, NULL);
+
+	for (i = 0; i < LATENCY_SAMPLES; i++) {
+		start = NowNs();
+		RingWrite(&Ring, &byte, 1);
+		while (!RingIsEmpty(&Ring)) {
+			sched_yield();
+		}
+		samples[i] = NowNs() - start;
+	}
+
+	__atomic_store_n(&ProducerDone, 1, __ATOMIC_RELEASE);
+	pthread_join(consumer, NULL);
+
+	qsort(samples, LATENCY_SAMPLES, sizeof(samples[0]), CompareSamples);
+	printf("hand-off latency: p50 %llu ns, p99 %llu ns, max %llu ns\n",
+		(unsigned long long)samples[LATENCY_SAMPLES / 2],
+		(unsigned long long)samples[LATENCY_SAMPLES * 99 / 100],
+		(unsigned long long)samples[LATENCY_SAMPLES - 1]);
+}
+
+int
+main(void)
+{
+	int failures = 0;
+
+	failures += RunThroughput(1);
+	failures += RunThroughput(2);
+	failures += RunThroughput(4);
+	RunLatency();
+
+	if (failures != 0) {
+		return 1;
+	}
+
+	printf("Ring test passed\n");
+	return 0;
+}
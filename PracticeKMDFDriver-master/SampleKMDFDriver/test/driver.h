@@ -0,0 +1,41 @@
+// Minimal stand-in for the driver headers, enough to build Ring.c and
+// the ring test on a Linux host. Ring.c includes "driver.h", which on a
+// case-sensitive file system resolves to this file and not Driver.h.
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+typedef void VOID, *PVOID;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN;
+typedef uint32_t ULONG;
+typedef int64_t LONG64;
+typedef uint64_t ULONG64;
+typedef size_t SIZE_T;
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Out_writes_bytes_to_(size, count)
+
+#define EXTERN_C_START
+#define EXTERN_C_END
+
+#define NT_ASSERT(expression) assert(expression)
+#define RtlCopyMemory(destination, source, length) memcpy((destination), (source), (length))
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+
+#define ReadAcquire64(source) __atomic_load_n((source), __ATOMIC_ACQUIRE)
+#define InterlockedExchange64(target, value) __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+
+static inline LONG64
+InterlockedCompareExchange64(volatile LONG64 *destination, LONG64 exchange, LONG64 comparand)
+{
+	__atomic_compare_exchange_n(destination, &comparand, exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return comparand;
+}
+
+#include "../Ring.h"
@@ -48,12 +48,34 @@ ControllerInitialize(
                         
     NT_ASSERT(pDevice != NULL);
 
-    // TODO: Initialize controller hardware via the
-    //       pDevice->pRegisters->* register interface.
+    // TODO: Initialize any other controller hardware via 
+    //       the pDevice->pRegisters->* register interface.
     //       Work may include configuring operating modes,
-    //       FIFOs, clock, interrupts, etc.
+    //       clock, etc.
 
-    UNREFERENCED_PARAMETER(pDevice);
+    //
+    // Disable the controller and its interrupts, clear any
+    // latched status, flush both FIFOs and program the 
+    // watermark thresholds used for burst transfers.
+    //
+
+    pDevice->pRegisters->Control.Write(0);
+    pDevice->pRegisters->InterruptEnable.Write(0);
+    pDevice->pRegisters->InterruptStatus.Write(SI2C_STATUS_LATCHED_MASK);
+
+    pDevice->pRegisters->FifoControl.Write(
+        SI2C_FIFO_CONTROL_FLUSH_TX |
+        SI2C_FIFO_CONTROL_FLUSH_RX |
+        SI2C_FIFO_CONTROL_THRESHOLDS(
+            SI2C_FIFO_TX_WATERMARK,
+            SI2C_FIFO_RX_WATERMARK));
+
+    pDevice->pRegisters->Control.Write(SI2C_CONTROL_ENABLE);
+
+    pDevice->InterruptCount = 0;
+    pDevice->DpcCount = 0;
+    pDevice->BurstCount = 0;
+    pDevice->BytesTransferred = 0;
 
     FuncExit(TRACE_FLAG_PBCLOADING);
 }
@@ -76,16 +98,113 @@ ControllerUninitialize(
 
     NT_ASSERT(pDevice != NULL);
 
-    // TODO: Uninitialize controller hardware via the
-    //       pDevice->pRegisters->* register interface
-    //       if necessary.  Work may include disabling
-    //       interrupts, etc.
+    // TODO: Uninitialize any other controller hardware via
+    //       the pDevice->pRegisters->* register interface
+    //       if necessary.
+
+    pDevice->pRegisters->InterruptEnable.Write(0);
+    pDevice->pRegisters->Control.Write(0);
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_PBCLOADING,
+        "Transferred %I64u bytes in %lu bursts with %lu interrupts "
+        "and %lu DPCs (WDFDEVICE %p)",
+        pDevice->BytesTransferred,
+        pDevice->BurstCount,
+        pDevice->InterruptCount,
+        pDevice->DpcCount,
+        pDevice->FxDevice);
+
+    FuncExit(TRACE_FLAG_PBCLOADING);
+}
+
+VOID
+ControllerConfigureTarget(
+    _In_  PPBC_DEVICE   pDevice,
+    _In_  PPBC_TARGET   pTarget
+    )
+/*++
+ 
+  Routine Description:
+    This routine resolves the target's settings into the
+    register values used for every transfer to the target.
+    It is called once when the target is connected.
+  Arguments:
+    pDevice - a pointer to the PBC device context
+    pTarget - a pointer to the PBC target context
+  Return Value:
+    None.
+--*/
+{
+    FuncEntry(TRACE_FLAG_PBCLOADING);
+
+    NT_ASSERT(pDevice != NULL);
+    NT_ASSERT(pTarget != NULL);
 
     UNREFERENCED_PARAMETER(pDevice);
 
+    // TODO: Derive any other register values from the
+    //       target settings (i.e. clock dividers for
+    //       pTarget->Settings.ConnectionSpeed).
+
+    pTarget->Descriptor.Address = pTarget->Settings.Address;
+    pTarget->Descriptor.Control = SI2C_CONTROL_ENABLE;
+
+    if (pTarget->Settings.AddressMode == AddressMode10Bit)
+    {
+        pTarget->Descriptor.Control |= SI2C_CONTROL_10BIT_ADDRESS;
+    }
+
     FuncExit(TRACE_FLAG_PBCLOADING);
 }
 
+ULONG
+ControllerGetTransferControl(
+    _In_  PPBC_TARGET                    pTarget,
+    _In_  SPB_REQUEST_SEQUENCE_POSITION  SequencePosition,
+    _In_  SPB_TRANSFER_DIRECTION         Direction,
+    _In_  BOOLEAN                        bRepeatedStart
+    )
+/*++
+ 
+  Routine Description:
+    This routine computes the control register value
+    for a transfer to the target.
+  Arguments:
+    pTarget - a pointer to the PBC target context
+    SequencePosition - position of the transfer
+    Direction - direction of the transfer
+    bRepeatedStart - whether the transfer must begin with
+        a repeated start even if its position does not
+        call for a start (i.e. the direction changed)
+  Return Value:
+    The control register value.
+--*/
+{
+    const PBC_TRANSFER_SETTINGS* pSettings;
+    ULONG control = pTarget->Descriptor.Control;
+
+    pSettings = &g_TransferSettings[SequencePosition];
+
+    if (pSettings->IsStart || bRepeatedStart)
+    {
+        control |= SI2C_CONTROL_START;
+    }
+
+    if (pSettings->IsEnd)
+    {
+        control |= SI2C_CONTROL_STOP;
+    }
+
+    if (Direction == SpbTransferDirectionFromDevice)
+    {
+        control |= SI2C_CONTROL_READ;
+    }
+
+    return control;
+}
+
 VOID
 ControllerConfigureForTransfer(
     _In_  PPBC_DEVICE   pDevice,
@@ -105,6 +224,10 @@ ControllerConfigureForTransfer(
 {
     FuncEntry(TRACE_FLAG_TRANSFER);
 
+    NTSTATUS status;
+    ULONG mask = SI2C_STATUS_TRANSFER_COMPLETE | SI2C_STATUS_ERROR_MASK;
+    PPBC_TARGET_DESCRIPTOR pDescriptor;
+
     NT_ASSERT(pDevice  != NULL);
     NT_ASSERT(pRequest != NULL);
     
@@ -116,49 +239,78 @@ ControllerConfigureForTransfer(
     pRequest->Status = STATUS_SUCCESS;
 
     //
-    // Configure hardware for transfer.
+    // Configure hardware for transfer. The register values
+    // were resolved when the target was connected and when
+    // the request was compiled.
     //
 
-    // TODO: Initialize controller hardware for a general
-    //       transfer via the pDevice->pRegisters->* register 
-    //       interface.  Work may include setting up transfer, 
-    //       configuring  FIFOs, selecting address, etc.
+    // TODO: Program the connection speed and any other
+    //       target specific settings.
 
-    if (pRequest->Settings.IsStart)
-    {
-        // TODO: Perform any action to program a start bit.
-    }
-    else if (pRequest->Settings.IsEnd)
-    {
-        // TODO: Perform any action to program a stop bit.
-    }
+    pDescriptor = &pDevice->pCurrentTarget->Descriptor;
+
+    pDevice->pRegisters->FifoControl.Write(
+        SI2C_FIFO_CONTROL_FLUSH_TX |
+        SI2C_FIFO_CONTROL_FLUSH_RX |
+        SI2C_FIFO_CONTROL_THRESHOLDS(
+            SI2C_FIFO_TX_WATERMARK,
+            SI2C_FIFO_RX_WATERMARK));
+
+    pDevice->pRegisters->TargetAddress.Write(pDescriptor->Address);
+    pDevice->pRegisters->TransferLength.Write((ULONG)pRequest->Length);
 
     if (pRequest->Direction == SpbTransferDirectionToDevice)
     {
-        // TODO: Perform write-specific configuration,
-        //       i.e. pRequest->DataReadyFlag = ...
+        pRequest->DataReadyFlag = SI2C_STATUS_TX_WATERMARK;
+
+        //
+        // Prime the empty TX FIFO before starting so that
+        // short writes need no data ready interrupt at all.
+        //
+
+        status = ControllerTransferData(pDevice, pRequest);
+
+        if (!NT_SUCCESS(status))
+        {
+            pRequest->Status = status;
+
+            Trace(
+                TRACE_LEVEL_ERROR, 
+                TRACE_FLAG_TRANSFER,
+                "Failed to fill TX FIFO for address 0x%lx, "
+                "completing transfer (WDFDEVICE %p) - %!STATUS!",
+                pDescriptor->Address,
+                pDevice->FxDevice,
+                pRequest->Status);
+
+            ControllerCompleteTransfer(pDevice, pRequest, TRUE);
+            goto exit;
+        }
     }
     else if (pRequest->Direction == SpbTransferDirectionFromDevice)
     {
-        // TODO: Perform read-specific configuration,
-        //       i.e. pRequest->DataReadyFlag = ...
+        pRequest->DataReadyFlag = SI2C_STATUS_RX_WATERMARK;
+    }
+
+    if (PbcRequestGetInfoRemaining(pRequest) > 0)
+    {
+        mask |= pRequest->DataReadyFlag;
     }
 
     //
     // Synchronize access to device context with ISR.
     //
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptAcquireLock(pDevice->InterruptObject);
+    WdfInterruptAcquireLock(pDevice->InterruptObject);
 
     //
     // Set interrupt mask and clear current status.
     //
 
-    // TODO: Save desired interrupt mask.
-    //       PbcDeviceSetInterruptMask(pDevice, mask)
+    PbcDeviceSetInterruptMask(pDevice, mask);
 
     pDevice->InterruptStatus = 0;
+    pDevice->InterruptsDeferred = 0;
 
     Trace(
         TRACE_LEVEL_VERBOSE,
@@ -167,23 +319,24 @@ ControllerConfigureForTransfer(
         "(SPBREQUEST %p, WDFDEVICE %p)",
         pRequest->Direction == SpbTransferDirectionFromDevice ? "read" : "write",
         pRequest->Length,
-        pDevice->pCurrentTarget->Settings.Address,
+        pDescriptor->Address,
         pRequest->SpbRequest,
         pDevice->FxDevice);
 
-    // TODO: Perform necessary action to begin transfer.
+    //
+    // Clear stale status and begin transfer.
+    //
+
+    pDevice->pRegisters->InterruptStatus.Write(SI2C_STATUS_LATCHED_MASK);
+    pDevice->pRegisters->Control.Write(pRequest->Control | SI2C_CONTROL_GO);
 
     ControllerEnableInterrupts(
         pDevice, 
         PbcDeviceGetInterruptMask(pDevice));
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptReleaseLock(pDevice->InterruptObject);
+    WdfInterruptReleaseLock(pDevice->InterruptObject);
 
-    // TODO: For the purpose of this skeleton sample,
-    //       simply complete the request synchronously.
-
-    ControllerCompleteTransfer(pDevice, pRequest, FALSE);
+exit:
 
     FuncExit(TRACE_FLAG_TRANSFER);
 }
@@ -226,7 +379,7 @@ ControllerProcessInterrupts(
     // Check for address NACK.
     //
 
-    if (TestAnyBits(InterruptStatus, SI2C_STATUS_ADDRESS_NACK /*update with nack flag*/))
+    if (TestAnyBits(InterruptStatus, SI2C_STATUS_ADDRESS_NACK))
     {        
         //
         // An address NACK indicates that a device is
@@ -260,7 +413,7 @@ ControllerProcessInterrupts(
     // Check for data NACK.
     //
 
-    if (TestAnyBits(InterruptStatus, SI2C_STATUS_DATA_NACK /*update with nack flag*/))
+    if (TestAnyBits(InterruptStatus, SI2C_STATUS_DATA_NACK))
     {        
         //
         // A data NACK is not necessarily an error.
@@ -273,10 +426,18 @@ ControllerProcessInterrupts(
         
         pRequest->Status = STATUS_SUCCESS;
         
-        // TODO: Assuming this info is available, set
-        //       information to the actual number of
-        //       bytes successfully transferred.
-        //pRequest->Information = 0;
+        //
+        // Bytes still sitting in the TX FIFO never
+        // made it onto the bus.
+        //
+
+        if (pRequest->Direction == SpbTransferDirectionToDevice)
+        {
+            size_t unsent = SI2C_FIFO_STATUS_TX_LEVEL(
+                pDevice->pRegisters->FifoStatus.Read());
+
+            pRequest->Information -= min(unsent, pRequest->Information);
+        }
         
         // TODO: Perform any additional action needed to handle NACK.
 
@@ -301,7 +462,7 @@ ControllerProcessInterrupts(
 
     // TODO: Check for other errors.  
 
-    if (TestAnyBits(InterruptStatus, SI2C_STATUS_GENERIC_ERROR /*update with error flag*/))
+    if (TestAnyBits(InterruptStatus, SI2C_STATUS_GENERIC_ERROR))
     {
         // TODO: Perform any action needed to handle error,
         //       i.e. set status or bytes transferred accordingly.
@@ -384,7 +545,7 @@ ControllerProcessInterrupts(
     // Check if transfer is complete.
     //
 
-    if (TestAnyBits(InterruptStatus, 0 /*update with transfer complete flag*/))
+    if (TestAnyBits(InterruptStatus, SI2C_STATUS_TRANSFER_COMPLETE))
     {
         Trace(
             TRACE_LEVEL_INFORMATION,
@@ -448,27 +609,38 @@ ControllerTransferData(
 /*++
  
   Routine Description:
-    This routine transfers data to or from the device.
+    This routine transfers data to or from the device. As
+    many bytes as the FIFO can accept (write) or holds (read)
+    are moved in a single burst, staged through a local
+    buffer so the request's MDL chain is walked once per
+    burst rather than once per byte.
   Arguments:
     pDevice - a pointer to the PBC device context
     pRequest - a pointer to the PBC request context
   Return Value:
-    None.
+    STATUS_SUCCESS, or the failure returned while accessing
+    the transfer descriptor buffer.
 --*/
 {
     FuncEntry(TRACE_FLAG_TRANSFER);
 
-    UNREFERENCED_PARAMETER(pDevice);
-
-    size_t bytesToTransfer = 0;
+    UCHAR burst[SI2C_FIFO_DEPTH];
+    size_t bytesToTransfer;
+    ULONG fifoStatus;
     NTSTATUS status = STATUS_SUCCESS;
 
+    fifoStatus = pDevice->pRegisters->FifoStatus.Read();
+
     //
     // Write
     //
 
     if (pRequest->Direction == SpbTransferDirectionToDevice)
     {
+        bytesToTransfer = min(
+            PbcRequestGetInfoRemaining(pRequest),
+            SI2C_FIFO_DEPTH - SI2C_FIFO_STATUS_TX_LEVEL(fifoStatus));
+
         Trace(
             TRACE_LEVEL_INFORMATION, 
             TRACE_FLAG_TRANSFER,
@@ -476,8 +648,23 @@ ControllerTransferData(
             bytesToTransfer,
             pDevice->pCurrentTarget->Settings.Address);
 
-        // TODO: Perform write. May need to use 
-        //       PbcRequestGetByte() or some variation.
+        if (bytesToTransfer > 0)
+        {
+            status = PbcRequestGetBytes(
+                pRequest,
+                pRequest->Information,
+                burst,
+                bytesToTransfer);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+
+            pDevice->pRegisters->TxFifo.WriteBuffer(
+                (ULONG)bytesToTransfer,
+                burst);
+        }
     }
 
     //
@@ -486,6 +673,9 @@ ControllerTransferData(
 
     else
     {
+        bytesToTransfer = min(
+            PbcRequestGetInfoRemaining(pRequest),
+            SI2C_FIFO_STATUS_RX_LEVEL(fifoStatus));
 
         Trace(
             TRACE_LEVEL_INFORMATION, 
@@ -494,8 +684,23 @@ ControllerTransferData(
             bytesToTransfer,
             pDevice->pCurrentTarget->Settings.Address);
 
-        // TODO: Perform read. May need to use 
-        //       PbcRequestSetByte() or some variation.
+        if (bytesToTransfer > 0)
+        {
+            pDevice->pRegisters->RxFifo.ReadBuffer(
+                (ULONG)bytesToTransfer,
+                burst);
+
+            status = PbcRequestSetBytes(
+                pRequest,
+                pRequest->Information,
+                burst,
+                bytesToTransfer);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+        }
     }
 
     //
@@ -504,6 +709,14 @@ ControllerTransferData(
 
     pRequest->Information += bytesToTransfer;
 
+    if (bytesToTransfer > 0)
+    {
+        pDevice->BurstCount++;
+        pDevice->BytesTransferred += bytesToTransfer;
+    }
+
+exit:
+
     FuncExit(TRACE_FLAG_TRANSFER);
     
     return status;
@@ -547,9 +760,13 @@ ControllerCompleteTransfer(
         pRequest->SpbRequest);
 
     //
-    // Update request context with information from this transfer.
+    // Update request and target contexts with information 
+    // from this transfer.
     //
 
+    pDevice->pCurrentTarget->TransferCount++;
+    pDevice->pCurrentTarget->BytesTransferred += pRequest->Information;
+
     pRequest->TotalInformation += pRequest->Information;
     pRequest->Information = 0;
 
@@ -686,9 +903,34 @@ ControllerEnableInterrupts(
         InterruptMask,
         pDevice->FxDevice);
 
-    // TODO: Enable interrupts as requested.
+    pDevice->pRegisters->InterruptEnable.Write(InterruptMask);
 
-    UNREFERENCED_PARAMETER(pDevice);
+    FuncExit(TRACE_FLAG_TRANSFER);
+}
+
+VOID
+ControllerMaskInterrupts(
+    _In_  PPBC_DEVICE   pDevice,
+    _In_  ULONG         InterruptMask
+    )
+/*++
+ 
+  Routine Description:
+    This routine disables the hardware interrupts for the
+    specificed mask and leaves all others enabled.
+  Arguments:
+    pDevice - a pointer to the PBC device context
+    InterruptMask - interrupt bits to disable
+  Return Value:
+    None.
+--*/
+{
+    FuncEntry(TRACE_FLAG_TRANSFER);
+
+    NT_ASSERT(pDevice != NULL);
+
+    pDevice->pRegisters->InterruptEnable.Write(
+        pDevice->pRegisters->InterruptEnable.Read() & ~InterruptMask);
 
     FuncExit(TRACE_FLAG_TRANSFER);
 }
@@ -711,9 +953,7 @@ ControllerDisableInterrupts(
 
     NT_ASSERT(pDevice != NULL);
 
-    // TODO: Disable all interrupts.
-
-    UNREFERENCED_PARAMETER(pDevice);
+    pDevice->pRegisters->InterruptEnable.Write(0);
 
     FuncExit(TRACE_FLAG_TRANSFER);
 }
@@ -727,7 +967,9 @@ ControllerGetInterruptStatus(
  
   Routine Description:
     This routine gets the interrupt status of the
-    specificed interrupt bits.
+    specificed interrupt bits. The status is reported
+    whether or not the interrupt is currently enabled,
+    so the DPC can poll for events it has deferred.
   Arguments:
     pDevice - a pointer to the PBC device context
     InterruptMask - interrupt bits to check
@@ -737,15 +979,12 @@ ControllerGetInterruptStatus(
 {
     FuncEntry(TRACE_FLAG_TRANSFER);
 
-    ULONG interruptStatus = 0;
+    ULONG interruptStatus;
 
     NT_ASSERT(pDevice != NULL);
 
-    // TODO: Check if any of the interrupt mask
-    //       bits have triggered an interrupt.
-    
-    UNREFERENCED_PARAMETER(pDevice);
-    UNREFERENCED_PARAMETER(InterruptMask);
+    interruptStatus = 
+        pDevice->pRegisters->InterruptStatus.Read() & InterruptMask;
 
     FuncExit(TRACE_FLAG_TRANSFER);
 
@@ -761,7 +1000,8 @@ ControllerAcknowledgeInterrupts(
  
   Routine Description:
     This routine acknowledges the
-    specificed interrupt bits.
+    specificed interrupt bits. Watermark bits reflect
+    the FIFO levels and are cleared by servicing the FIFO.
   Arguments:
     pDevice - a pointer to the PBC device context
     InterruptMask - interrupt bits to acknowledge
@@ -773,10 +1013,12 @@ ControllerAcknowledgeInterrupts(
 
     NT_ASSERT(pDevice != NULL);
 
-    // TODO: Acknowledge requested interrupts.
-    
-    UNREFERENCED_PARAMETER(pDevice);
-    UNREFERENCED_PARAMETER(InterruptMask);
+    InterruptMask &= SI2C_STATUS_LATCHED_MASK;
+
+    if (InterruptMask != 0)
+    {
+        pDevice->pRegisters->InterruptStatus.Write(InterruptMask);
+    }
 
     FuncExit(TRACE_FLAG_TRANSFER);
 }
\ No newline at end of file
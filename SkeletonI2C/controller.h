@@ -23,6 +23,18 @@ VOID ControllerInitialize(
 VOID ControllerUninitialize(
     _In_  PPBC_DEVICE   pDevice);
 
+VOID
+ControllerConfigureTarget(
+    _In_  PPBC_DEVICE   pDevice,
+    _In_  PPBC_TARGET   pTarget);
+
+ULONG
+ControllerGetTransferControl(
+    _In_  PPBC_TARGET                    pTarget,
+    _In_  SPB_REQUEST_SEQUENCE_POSITION  SequencePosition,
+    _In_  SPB_TRANSFER_DIRECTION         Direction,
+    _In_  BOOLEAN                        bRepeatedStart);
+
 VOID
 ControllerConfigureForTransfer(
     _In_  PPBC_DEVICE   pDevice,
@@ -44,6 +56,11 @@ ControllerEnableInterrupts(
     _In_  PPBC_DEVICE   pDevice,
     _In_  ULONG         InterruptMask);
 
+VOID
+ControllerMaskInterrupts(
+    _In_  PPBC_DEVICE   pDevice,
+    _In_  ULONG         InterruptMask);
+
 VOID
 ControllerDisableInterrupts(
     _In_  PPBC_DEVICE   pDevice);
@@ -439,7 +439,8 @@ OnTargetConnect(
   Routine Description:
     This routine is invoked whenever a peripheral driver opens
     a target.  It retrieves target-specific settings from the
-    Resource Hub and saves them in the target's context.
+    Resource Hub, resolves them into the controller descriptor
+    and saves both in the target's context.
   Arguments:
     SpbController - a handle to the framework device object
         representing an SPB controller
@@ -484,6 +485,13 @@ OnTargetConnect(
     {
         pTarget->SpbTarget = SpbTarget;
         pTarget->pCurrentRequest = NULL;
+        pTarget->LastDirection = SpbTransferDirectionNone;
+        pTarget->RequestCount = 0;
+        pTarget->TransferCount = 0;
+        pTarget->BytesTransferred = 0;
+        pTarget->SetupTicks = 0;
+
+        ControllerConfigureTarget(pDevice, pTarget);
 
         Trace(
             TRACE_LEVEL_INFORMATION,
@@ -499,6 +507,57 @@ OnTargetConnect(
     return status;
 }
 
+VOID
+OnTargetDisconnect(
+    _In_  WDFDEVICE  SpbController,
+    _In_  SPBTARGET  SpbTarget
+    )
+/*++
+ 
+  Routine Description:
+    This routine is invoked whenever a peripheral driver closes
+    a target.  It traces the target's transfer counters.
+  Arguments:
+    SpbController - a handle to the framework device object
+        representing an SPB controller
+    SpbTarget - a handle to the SPBTARGET object
+  Return Value:
+    None.
+--*/
+{
+    FuncEntry(TRACE_FLAG_SPBDDI);
+
+    PPBC_DEVICE pDevice  = GetDeviceContext(SpbController);
+    PPBC_TARGET pTarget  = GetTargetContext(SpbTarget);
+    ULONGLONG setupUs = 0;
+    
+    NT_ASSERT(pDevice != NULL);
+    NT_ASSERT(pTarget != NULL);
+
+    if (pTarget->RequestCount > 0)
+    {
+        setupUs = pTarget->SetupTicks * 1000000 / 
+            ((ULONGLONG)pDevice->PerformanceFrequency.QuadPart * 
+                pTarget->RequestCount);
+    }
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_SPBDDI,
+        "Disconnected from SPBTARGET %p at address 0x%lx after %lu requests, "
+        "%lu transfers and %I64u bytes, average setup %I64u us "
+        "(WDFDEVICE %p)",
+        pTarget->SpbTarget,
+        pTarget->Settings.Address,
+        pTarget->RequestCount,
+        pTarget->TransferCount,
+        pTarget->BytesTransferred,
+        setupUs,
+        pDevice->FxDevice);
+
+    FuncExit(TRACE_FLAG_SPBDDI);
+}
+
 VOID
 OnControllerLock(
     _In_  WDFDEVICE   SpbController,
@@ -744,6 +803,7 @@ OnSequence(
     PPBC_TARGET  pTarget  = GetTargetContext(SpbTarget);
     PPBC_REQUEST pRequest = GetRequestContext(SpbRequest);
     BOOLEAN completeRequest = FALSE;
+    LARGE_INTEGER setupStart = KeQueryPerformanceCounter(NULL);
     
     NT_ASSERT(pDevice  != NULL);
     NT_ASSERT(pTarget  != NULL);
@@ -772,6 +832,8 @@ OnSequence(
     pRequest->TransferCount = TransferCount;
     pRequest->TransferIndex = 0;
     pRequest->bIoComplete = FALSE;
+    pRequest->DelayCount = 0;
+    pRequest->DelayMaxErrorInUs = 0;
 
     Trace(
         TRACE_LEVEL_INFORMATION,
@@ -784,10 +846,11 @@ OnSequence(
         SpbController);
 
     //
-    // Validate the request before beginning the transfer.
+    // Validate the request and compile its transfers
+    // before beginning the transfer.
     //
     
-    status = PbcRequestValidate(pRequest);
+    status = PbcRequestCompile(pRequest, pTarget);
 
     if (!NT_SUCCESS(status))
     {
@@ -814,6 +877,10 @@ OnSequence(
         goto exit;
     }
 
+    pTarget->RequestCount++;
+    pTarget->SetupTicks += 
+        KeQueryPerformanceCounter(NULL).QuadPart - setupStart.QuadPart;
+
     //
     // Acquire the device lock.
     //
@@ -866,10 +933,11 @@ OnSequence(
     
     PbcRequestDoTransfer(pDevice, pRequest);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (pRequest->bIoComplete)
     {
         completeRequest = TRUE;
@@ -877,10 +945,11 @@ OnSequence(
     
     WdfSpinLockRelease(pDevice->Lock);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (completeRequest)
     {
         PbcRequestComplete(pRequest);
@@ -1089,6 +1158,7 @@ OnCancel(
     PPBC_DEVICE pDevice;
     PPBC_TARGET pTarget;
     PPBC_REQUEST pRequest;
+    BOOLEAN bTimerStopped;
     BOOLEAN bTransferCompleted = FALSE;
 
     //
@@ -1152,7 +1222,10 @@ OnCancel(
     // Stop delay timer.
     //
 
-    if(WdfTimerStop(pDevice->DelayTimer, FALSE))
+    bTimerStopped = WdfTimerStop(pDevice->DelayTimer, FALSE);
+    bTimerStopped |= WdfTimerStop(pDevice->HighResolutionDelayTimer, FALSE);
+
+    if(bTimerStopped)
     {
         Trace(
             TRACE_LEVEL_INFORMATION,
@@ -1167,11 +1240,11 @@ OnCancel(
 
     NT_ASSERT(pDevice->InterruptObject != NULL);
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptAcquireLock(pDevice->InterruptObject);
+    WdfInterruptAcquireLock(pDevice->InterruptObject);
 
     ControllerDisableInterrupts(pDevice);
     pDevice->InterruptStatus = 0;
+    pDevice->InterruptsDeferred = 0;
     
     //
     // TODO: Implement any necessary logic to abort the
@@ -1179,8 +1252,7 @@ OnCancel(
     //       driving a stop bit on the bus.
     //
     
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptReleaseLock(pDevice->InterruptObject);
+    WdfInterruptReleaseLock(pDevice->InterruptObject);
 
     //
     // Mark request as cancelled and complete.
@@ -1230,8 +1302,8 @@ OnInterruptIsr(
   Routine Description:
     This routine responds to interrupts generated by the
     controller. If one is recognized, it queues a DPC for 
-    processing. The interrupt is acknowledged and subsequent
-    interrupts are temporarily disabled.
+    processing. The interrupt is acknowledged and the sources
+    that fired are masked until the DPC has serviced them.
   Arguments:
     Interrupt - a handle to a framework interrupt object
     MessageID - message number identifying the device's
@@ -1258,7 +1330,7 @@ OnInterruptIsr(
 
     stat = ControllerGetInterruptStatus(
         pDevice,
-        PbcDeviceGetInterruptMask(pDevice));
+        PbcDeviceGetInterruptMask(pDevice) & ~pDevice->InterruptsDeferred);
 
     if (stat > 0)
     {
@@ -1270,15 +1342,20 @@ OnInterruptIsr(
             pDevice->FxDevice);
 
         //
-        // Save the interrupt status and disable all other
-        // interrupts for now.  They will be re-enabled
-        // in OnInterruptDpc.  Queue the DPC.
+        // Save and acknowledge the interrupt status and mask
+        // the sources that fired.  Other sources stay enabled
+        // and their status accumulates for the same DPC.
+        // Masked sources will be re-enabled in OnInterruptDpc.
+        // Queue the DPC.
         //
 
         interruptRecognized = TRUE;
+        pDevice->InterruptCount++;
         
         pDevice->InterruptStatus |= (stat);
-        ControllerDisableInterrupts(pDevice);
+        pDevice->InterruptsDeferred |= (stat);
+        ControllerAcknowledgeInterrupts(pDevice, stat);
+        ControllerMaskInterrupts(pDevice, stat);
         
         if(!WdfInterruptQueueDpcForIsr(Interrupt))
         {
@@ -1306,7 +1383,9 @@ OnInterruptDpc(
  
   Routine Description:
     This routine processes interrupts from the controller.
-    When finished it reenables interrupts as appropriate.
+    Events that become pending while it runs are processed
+    in the same DPC, up to SI2C_MAX_DPC_PASSES times. When
+    finished it reenables interrupts as appropriate.
   Arguments:
     Interrupt - a handle to a framework interrupt object
     WdfDevice - a handle to the framework device object
@@ -1320,11 +1399,10 @@ OnInterruptDpc(
     PPBC_TARGET pTarget;
     PPBC_REQUEST pRequest = NULL;
     ULONG stat;
+    ULONG pass;
     BOOLEAN bInterruptsProcessed = FALSE;
     BOOLEAN completeRequest = FALSE;
 
-    UNREFERENCED_PARAMETER(Interrupt);
-
     pDevice = GetDeviceContext(WdfDevice);
     NT_ASSERT(pDevice != NULL);
 
@@ -1369,6 +1447,8 @@ OnInterruptDpc(
 
     NT_ASSERT(pRequest->SpbRequest != NULL);
 
+    pDevice->DpcCount++;
+
     //
     // Synchronize shared data buffers with ISR.
     // Copy interrupt status and clear shared buffer.
@@ -1376,49 +1456,86 @@ OnInterruptDpc(
     // a DPC should never occur with interrupt status 0.
     //
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptAcquireLock(Interrupt);
+    WdfInterruptAcquireLock(Interrupt);
 
     stat = pDevice->InterruptStatus;
     pDevice->InterruptStatus = 0;
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptReleaseLock(Interrupt);
+    WdfInterruptReleaseLock(Interrupt);
 
     if (stat == 0)
     {
         goto exit;
     }
 
-    Trace(
-        TRACE_LEVEL_VERBOSE,
-        TRACE_FLAG_TRANSFER,
-        "DPC for interrupt with status 0x%lx for WDFDEVICE %p",
-        stat,
-        pDevice->FxDevice);
-
     //
-    // Acknowledge and process interrupts.
+    // Process interrupts. The ISR has already acknowledged
+    // them. Before returning, poll the controller for events
+    // that became pending while data was being moved (e.g.
+    // the FIFO passing its watermark again) so that they do
+    // not cost another interrupt and DPC.
     //
 
-    ControllerAcknowledgeInterrupts(pDevice, stat);
-
-    ControllerProcessInterrupts(pDevice, pRequest, stat);
-    bInterruptsProcessed = TRUE;
-    if (pRequest->bIoComplete)
+    for (pass = 0; pass < SI2C_MAX_DPC_PASSES; pass++)
     {
-        completeRequest = TRUE;
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_FLAG_TRANSFER,
+            "DPC pass %lu for interrupt with status 0x%lx for WDFDEVICE %p",
+            pass,
+            stat,
+            pDevice->FxDevice);
+
+        ControllerProcessInterrupts(pDevice, pRequest, stat);
+        bInterruptsProcessed = TRUE;
+
+        if (pRequest->bIoComplete)
+        {
+            completeRequest = TRUE;
+            break;
+        }
+
+        //
+        // Don't poll on the last pass, status that is acknowledged
+        // here would never be processed.
+        //
+
+        if (pass == SI2C_MAX_DPC_PASSES - 1)
+        {
+            break;
+        }
+
+        WdfInterruptAcquireLock(Interrupt);
+
+        stat = pDevice->InterruptStatus | 
+            ControllerGetInterruptStatus(
+                pDevice, 
+                PbcDeviceGetInterruptMask(pDevice));
+
+        pDevice->InterruptStatus = 0;
+        ControllerAcknowledgeInterrupts(pDevice, stat);
+
+        WdfInterruptReleaseLock(Interrupt);
+
+        if (stat == 0)
+        {
+            break;
+        }
     }
 
     //
     // Re-enable interrupts if necessary. Synchronize with ISR.
+    // Events still pending after the last pass were neither
+    // polled nor acknowledged, so they interrupt again once
+    // re-enabled.
     //
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptAcquireLock(Interrupt);
+    WdfInterruptAcquireLock(Interrupt);
 
     ULONG mask = PbcDeviceGetInterruptMask(pDevice);
 
+    pDevice->InterruptsDeferred = 0;
+
     if (mask > 0)
     {
         Trace(
@@ -1431,8 +1548,7 @@ OnInterruptDpc(
         ControllerEnableInterrupts(pDevice, mask);
     }
 
-    // TODO: Uncomment when using interrupts.
-    //WdfInterruptReleaseLock(Interrupt);
+    WdfInterruptReleaseLock(Interrupt);
 
 exit:
 
@@ -1556,55 +1672,59 @@ PbcTargetGetSettings(
 }
 
 NTSTATUS
-PbcRequestValidate(
-    _In_  PPBC_REQUEST               pRequest)
+PbcRequestCompile(
+    _Inout_  PPBC_REQUEST            pRequest,
+    _Inout_  PPBC_TARGET             pTarget
+    )
+/*++
+ 
+  Routine Description:
+    This routine validates each transfer of the request and
+    compiles the first SI2C_MAX_SEGMENTS transfers into the
+    request's segment array in the same pass.
+  Arguments:
+    pRequest - a pointer to the PBC request context
+    pTarget - a pointer to the PBC target context
+  Return Value:
+    STATUS
+--*/
 {
     FuncEntry(TRACE_FLAG_TRANSFER);
 
-    SPB_TRANSFER_DESCRIPTOR descriptor;
+    PBC_SEGMENT segment;
+    PPBC_SEGMENT pSegment;
+    SPB_TRANSFER_DIRECTION direction = pTarget->LastDirection;
     NTSTATUS status = STATUS_SUCCESS;
 
-    //
-    // Validate each transfer descriptor.
-    //
+    pRequest->SegmentCount = 0;
 
     for (ULONG i = 0; i < pRequest->TransferCount; i++)
     {
         //
-        // Get transfer parameters for index.
+        // Transfers past the segment array are only
+        // validated here and compiled again when reached.
         //
 
-        SPB_TRANSFER_DESCRIPTOR_INIT(&descriptor);
+        pSegment = (i < SI2C_MAX_SEGMENTS) ? 
+            &pRequest->Segments[i] : &segment;
 
-        SpbRequestGetTransferParameters(
-            pRequest->SpbRequest, 
+        status = PbcRequestCompileSegment(
+            pRequest, 
+            pTarget, 
             i, 
-            &descriptor, 
-            nullptr);
+            direction, 
+            pSegment);
 
-        //
-        // Validate the transfer length.
-        //
-    
-        if (descriptor.TransferLength > SI2C_MAX_TRANSFER_LENGTH)
+        if (!NT_SUCCESS(status))
         {
-            status = STATUS_INVALID_PARAMETER;
-
-            Trace(
-                TRACE_LEVEL_ERROR, 
-                TRACE_FLAG_TRANSFER, 
-                "Transfer length %Iu is too large for controller driver, "
-                "max supported is %d (SPBREQUEST %p, index %lu) - %!STATUS!",
-                descriptor.TransferLength,
-                SI2C_MAX_TRANSFER_LENGTH,
-                pRequest->SpbRequest,
-                i,
-                status);
-
             goto exit;
         }
+
+        direction = pSegment->Direction;
     }
 
+    pRequest->SegmentCount = min(pRequest->TransferCount, SI2C_MAX_SEGMENTS);
+
 exit:
 
     FuncExit(TRACE_FLAG_TRANSFER);
@@ -1612,6 +1732,117 @@ exit:
     return status;
 }
 
+NTSTATUS
+PbcRequestCompileSegment(
+    _In_     PPBC_REQUEST            pRequest,
+    _In_     PPBC_TARGET             pTarget,
+    _In_     ULONG                   Index,
+    _In_     SPB_TRANSFER_DIRECTION  PreviousDirection,
+    _Out_    PPBC_SEGMENT            pSegment
+    )
+/*++
+ 
+  Routine Description:
+    This routine validates one transfer of the request and
+    compiles it into a segment. A transfer whose direction
+    differs from the previous one is marked for a repeated
+    start.
+  Arguments:
+    pRequest - a pointer to the PBC request context
+    pTarget - a pointer to the PBC target context
+    Index - index of the transfer within the request
+    PreviousDirection - direction of the preceding transfer
+        to the target
+    pSegment - receives the compiled segment
+  Return Value:
+    STATUS
+--*/
+{
+    SPB_TRANSFER_DESCRIPTOR descriptor;
+    PMDL pMdl;
+    NTSTATUS status = STATUS_SUCCESS;
+
+    //
+    // Get transfer parameters for index.
+    //
+
+    SPB_TRANSFER_DESCRIPTOR_INIT(&descriptor);
+
+    SpbRequestGetTransferParameters(
+        pRequest->SpbRequest, 
+        Index, 
+        &descriptor, 
+        &pMdl);
+
+    //
+    // Validate the transfer length.
+    //
+
+    if (descriptor.TransferLength > SI2C_MAX_TRANSFER_LENGTH)
+    {
+        status = STATUS_INVALID_PARAMETER;
+
+        Trace(
+            TRACE_LEVEL_ERROR, 
+            TRACE_FLAG_TRANSFER, 
+            "Transfer length %Iu is too large for controller driver, "
+            "max supported is %d (SPBREQUEST %p, index %lu) - %!STATUS!",
+            descriptor.TransferLength,
+            SI2C_MAX_TRANSFER_LENGTH,
+            pRequest->SpbRequest,
+            Index,
+            status);
+
+        goto exit;
+    }
+
+    NT_ASSERT(pMdl != NULL);
+
+    pSegment->pMdlChain = pMdl;
+    pSegment->Length = descriptor.TransferLength;
+    pSegment->Direction = descriptor.Direction;
+    pSegment->DelayInUs = descriptor.DelayInUs;
+
+    //
+    // Determine the sequence position. Non-sequence requests
+    // keep the position they were received with.
+    //
+
+    if (pRequest->Type == SpbRequestTypeSequence)
+    {
+        if   (pRequest->TransferCount == 1)
+        {
+            pSegment->SequencePosition = SpbRequestSequencePositionSingle;
+        }
+        else if (Index == 0)
+        {
+            pSegment->SequencePosition = SpbRequestSequencePositionFirst;
+        }
+        else if (Index == (pRequest->TransferCount - 1))
+        {
+            pSegment->SequencePosition = SpbRequestSequencePositionLast;
+        }
+        else
+        {
+            pSegment->SequencePosition = SpbRequestSequencePositionContinue;
+        }
+    }
+    else
+    {
+        pSegment->SequencePosition = pRequest->SequencePosition;
+    }
+
+    pSegment->Control = ControllerGetTransferControl(
+        pTarget,
+        pSegment->SequencePosition,
+        pSegment->Direction,
+        (pSegment->Direction != PreviousDirection));
+
+exit:
+
+    return status;
+}
+
 VOID
 PbcRequestConfigureForNonSequence(
     _In_  WDFDEVICE                  SpbController,
@@ -1642,6 +1873,7 @@ PbcRequestConfigureForNonSequence(
     PPBC_TARGET  pTarget  = GetTargetContext(SpbTarget);
     PPBC_REQUEST pRequest = GetRequestContext(SpbRequest);
     BOOLEAN completeRequest = FALSE;
+    LARGE_INTEGER setupStart = KeQueryPerformanceCounter(NULL);
     
     NT_ASSERT(pDevice  != NULL);
     NT_ASSERT(pTarget  != NULL);
@@ -1670,12 +1902,15 @@ PbcRequestConfigureForNonSequence(
     pRequest->TransferCount = 1;
     pRequest->TransferIndex = 0;
     pRequest->bIoComplete = FALSE;
+    pRequest->DelayCount = 0;
+    pRequest->DelayMaxErrorInUs = 0;
 
     //
-    // Validate the request before beginning the transfer.
+    // Validate the request and compile its transfers
+    // before beginning the transfer.
     //
     
-    status = PbcRequestValidate(pRequest);
+    status = PbcRequestCompile(pRequest, pTarget);
 
     if (!NT_SUCCESS(status))
     {
@@ -1704,6 +1939,10 @@ PbcRequestConfigureForNonSequence(
         goto exit;
     }
 
+    pTarget->RequestCount++;
+    pTarget->SetupTicks += 
+        KeQueryPerformanceCounter(NULL).QuadPart - setupStart.QuadPart;
+
     //
     // Acquire the device lock.
     //
@@ -1779,10 +2018,11 @@ PbcRequestConfigureForNonSequence(
     
     PbcRequestDoTransfer(pDevice, pRequest);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (pRequest->bIoComplete)
     {
         completeRequest = TRUE;
@@ -1790,10 +2030,11 @@ PbcRequestConfigureForNonSequence(
 
     WdfSpinLockRelease(pDevice->Lock);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (completeRequest)
     {
         PbcRequestComplete(pRequest);
@@ -1819,8 +2060,8 @@ PbcRequestConfigureForIndex(
   Routine Description:
     This is a helper routine used to configure the request
     context and controller hardware for a transfer within a 
-    sequence. It validates parameters and retrieves
-    the transfer buffer as necessary.
+    sequence. The transfer is normally taken from the
+    segments compiled when the request arrived.
   Arguments:
     pRequest - a pointer to the PBC request context
     Index - index of the transfer within the sequence
@@ -1833,70 +2074,64 @@ PbcRequestConfigureForIndex(
     NT_ASSERT(pRequest != NULL);
  
     NTSTATUS status = STATUS_SUCCESS;
+    PBC_SEGMENT segment;
+    PPBC_SEGMENT pSegment;
 
     //
-    // Get transfer parameters for index.
+    // Use the segment compiled when the request arrived.
+    // Transfers past the segment array are compiled now.
     //
 
-    SPB_TRANSFER_DESCRIPTOR descriptor;
-    PMDL pMdl;
-    
-    SPB_TRANSFER_DESCRIPTOR_INIT(&descriptor);
-
-    SpbRequestGetTransferParameters(
-        pRequest->SpbRequest, 
-        Index, 
-        &descriptor, 
-        &pMdl);
-       
-    NT_ASSERT(pMdl != NULL);
-    
-    //
-    // Configure request context.
-    //
+    if (Index < pRequest->SegmentCount)
+    {
+        pSegment = &pRequest->Segments[Index];
+    }
+    else
+    {
+        PPBC_TARGET pTarget = GetTargetContext(
+            SpbRequestGetTarget(pRequest->SpbRequest));
 
-    pRequest->pMdlChain = pMdl;
-    pRequest->Length = descriptor.TransferLength;
-    pRequest->Information = 0;
-    pRequest->Direction = descriptor.Direction;
-    pRequest->DelayInUs = descriptor.DelayInUs;
+        NT_ASSERT(pTarget != NULL);
 
-    //
-    // Update sequence position if request is type sequence.
-    //
+        status = PbcRequestCompileSegment(
+            pRequest,
+            pTarget,
+            Index,
+            pRequest->Direction,
+            &segment);
 
-    if (pRequest->Type == SpbRequestTypeSequence)
-    {
-        if   (pRequest->TransferCount == 1)
-        {
-            pRequest->SequencePosition = SpbRequestSequencePositionSingle;
-        }
-        else if (Index == 0)
-        {
-            pRequest->SequencePosition = SpbRequestSequencePositionFirst;
-        }
-        else if (Index == (pRequest->TransferCount - 1))
-        {
-            pRequest->SequencePosition = SpbRequestSequencePositionLast;
-        }
-        else
+        if (!NT_SUCCESS(status))
         {
-            pRequest->SequencePosition = SpbRequestSequencePositionContinue;
+            goto exit;
         }
+
+        pSegment = &segment;
     }
+    
+    //
+    // Configure request context.
+    //
 
-    PPBC_TARGET pTarget = GetTargetContext(SpbRequestGetTarget(pRequest->SpbRequest));
-    NT_ASSERT(pTarget != NULL);
+    pRequest->pMdlChain = pSegment->pMdlChain;
+    pRequest->Length = pSegment->Length;
+    pRequest->Information = 0;
+    pRequest->Direction = pSegment->Direction;
+    pRequest->DelayInUs = pSegment->DelayInUs;
+    pRequest->SequencePosition = pSegment->SequencePosition;
+    pRequest->Control = pSegment->Control;
 
     Trace(
         TRACE_LEVEL_INFORMATION,
         TRACE_FLAG_TRANSFER,
-        "Request context configured for %s (index %lu) "
-        "to address 0x%lx (SPBTARGET %p)",
+        "Request context configured for %s (index %lu) of %Iu bytes "
+        "with control 0x%lx (SPBREQUEST %p)",
         pRequest->Direction == SpbTransferDirectionFromDevice ? "read" : "write",
         Index,
-        pTarget->Settings.Address,
-        pTarget->SpbTarget);
+        pRequest->Length,
+        pRequest->Control,
+        pRequest->SpbRequest);
+
+exit:
 
     FuncExit(TRACE_FLAG_TRANSFER);
 
@@ -1927,41 +2162,77 @@ PbcRequestDoTransfer(
     NT_ASSERT(pRequest != NULL);
 
     //
-    // Start delay timer if necessary for this request,
-    // otherwise continue transfer. 
+    // Delay if necessary for this request, otherwise
+    // continue transfer. The mechanism depends on the
+    // length of the delay:
     //
-    // NOTE: Note using a timer to implement IO delay is only 
-    //       applicable for sufficiently long delays (> 15ms).
-    //       For shorter delays, especially on the order of
-    //       microseconds, consider using a different mechanism.
+    //   - short delays are busy-waited on the performance
+    //     counter, a timer would add at least one timer tick
+    //   - medium delays use a high resolution timer
+    //   - long delays (> 15ms) use the default timer
     //
 
     if (pRequest->DelayInUs > 0)
     {
-        Trace(
-            TRACE_LEVEL_INFORMATION,
-            TRACE_FLAG_TRANSFER,
-            "Delaying %lu us before configuring transfer for WDFDEVICE %p",
-            pRequest->DelayInUs,
-            pDevice->FxDevice);
+        pRequest->DelayStart = KeQueryPerformanceCounter(NULL);
 
-        BOOLEAN bTimerAlreadyStarted;
+        if (pRequest->DelayInUs <= SI2C_DELAY_STALL_MAX_US)
+        {
+            LONGLONG deadline;
 
-        bTimerAlreadyStarted = WdfTimerStart(
-            pDevice->DelayTimer, 
-            WDF_REL_TIMEOUT_IN_US(pRequest->DelayInUs));
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_FLAG_TRANSFER,
+                "Stalling %lu us before configuring transfer for WDFDEVICE %p",
+                pRequest->DelayInUs,
+                pDevice->FxDevice);
 
-        //
-        // There should never be another request
-        // scheduled for delay.
-        //
+            deadline = pRequest->DelayStart.QuadPart +
+                ((LONGLONG)pRequest->DelayInUs * 
+                    pDevice->PerformanceFrequency.QuadPart) / 1000000 -
+                pDevice->StallOverheadTicks;
 
-        if (bTimerAlreadyStarted == TRUE)
+            while (KeQueryPerformanceCounter(NULL).QuadPart < deadline)
+            {
+                YieldProcessor();
+            }
+
+            PbcRequestRecordDelay(pDevice, pRequest);
+            ControllerConfigureForTransfer(pDevice, pRequest);
+        }
+        else
         {
+            WDFTIMER timer = pDevice->DelayTimer;
+            BOOLEAN bTimerAlreadyStarted;
+
+            if (pRequest->DelayInUs <= SI2C_DELAY_HIGH_RESOLUTION_MAX_US)
+            {
+                timer = pDevice->HighResolutionDelayTimer;
+            }
+
             Trace(
-                TRACE_LEVEL_ERROR,
+                TRACE_LEVEL_INFORMATION,
                 TRACE_FLAG_TRANSFER,
-                "The delay timer should not be started");
+                "Delaying %lu us before configuring transfer for WDFDEVICE %p",
+                pRequest->DelayInUs,
+                pDevice->FxDevice);
+
+            bTimerAlreadyStarted = WdfTimerStart(
+                timer, 
+                WDF_REL_TIMEOUT_IN_US(pRequest->DelayInUs));
+
+            //
+            // There should never be another request
+            // scheduled for delay.
+            //
+
+            if (bTimerAlreadyStarted == TRUE)
+            {
+                Trace(
+                    TRACE_LEVEL_ERROR,
+                    TRACE_FLAG_TRANSFER,
+                    "The delay timer should not be started");
+            }
         }
     }
     else
@@ -2047,12 +2318,14 @@ OnDelayTimerExpired(
         "Delay timer expired, ready to configure transfer for WDFDEVICE %p",
         pDevice->FxDevice);
 
+    PbcRequestRecordDelay(pDevice, pRequest);
     ControllerConfigureForTransfer(pDevice, pRequest);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (pRequest->bIoComplete)
     {
         completeRequest = TRUE;
@@ -2066,10 +2339,11 @@ exit:
 
     WdfSpinLockRelease(pDevice->Lock);
     
-    // TODO: Remove this block. For the purpose of this 
-    //       skeleton sample, simply complete the request 
-    //       synchronously. This must be done outside of 
-    //       the locked code.
+    //
+    // The request completes synchronously if the transfer
+    // could not be started. This must be done outside of 
+    // the locked code.
+    //
     if (completeRequest)
     {
         PbcRequestComplete(pRequest);
@@ -2105,6 +2379,31 @@ PbcRequestComplete(
         pRequest->Status,
         pRequest->TotalInformation);
 
+    if (pRequest->DelayCount > 0)
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_FLAG_TRANSFER,
+            "SPBREQUEST %p delayed %lu time(s) with maximum error %lu us",
+            pRequest->SpbRequest,
+            pRequest->DelayCount,
+            pRequest->DelayMaxErrorInUs);
+    }
+
+    //
+    // Remember the direction of the target's last transfer.
+    // After a failure or cancellation the bus state is not
+    // known, so the next transfer begins with a start.
+    //
+
+    PPBC_TARGET pTarget = GetTargetContext(
+        SpbRequestGetTarget(pRequest->SpbRequest));
+
+    NT_ASSERT(pTarget != NULL);
+
+    pTarget->LastDirection = NT_SUCCESS(pRequest->Status) ?
+        pRequest->Direction : SpbTransferDirectionNone;
+
     WdfRequestSetInformation(
         pRequest->SpbRequest,
         pRequest->TotalInformation);
@@ -2113,5 +2412,114 @@ PbcRequestComplete(
         pRequest->SpbRequest, 
         pRequest->Status);
 
+    FuncExit(TRACE_FLAG_TRANSFER);
+}
+
+VOID
+PbcDeviceCalibrateDelay(
+    _In_     PPBC_DEVICE             pDevice
+    )
+/*++
+ 
+  Routine Description:
+    This routine measures the performance counter frequency
+    and the cost of reading the counter. The busy-wait used
+    for short delays stops that much early to compensate for
+    its final read.
+  Arguments:
+    pDevice - a pointer to the PBC device context
+  Return Value:
+    None.
+--*/
+{
+    FuncEntry(TRACE_FLAG_WDFLOADING);
+
+    LARGE_INTEGER start;
+    LARGE_INTEGER end;
+    ULONG i;
+
+    NT_ASSERT(pDevice != NULL);
+
+    start = KeQueryPerformanceCounter(&pDevice->PerformanceFrequency);
+    end = start;
+
+    for (i = 0; i < SI2C_DELAY_CALIBRATION_READS; i++)
+    {
+        end = KeQueryPerformanceCounter(NULL);
+    }
+
+    pDevice->StallOverheadTicks = 
+        (end.QuadPart - start.QuadPart) / SI2C_DELAY_CALIBRATION_READS;
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_FLAG_WDFLOADING,
+        "Performance counter frequency %I64d Hz, read cost %I64d ticks "
+        "(WDFDEVICE %p)",
+        pDevice->PerformanceFrequency.QuadPart,
+        pDevice->StallOverheadTicks,
+        pDevice->FxDevice);
+
+    FuncExit(TRACE_FLAG_WDFLOADING);
+}
+
+VOID
+PbcRequestRecordDelay(
+    _In_     PPBC_DEVICE             pDevice,
+    _Inout_  PPBC_REQUEST            pRequest
+    )
+/*++
+ 
+  Routine Description:
+    This routine records the achieved delay for the
+    current transfer and its error against the delay
+    requested by the transfer descriptor.
+  Arguments:
+    pDevice - a pointer to the PBC device context
+    pRequest - a pointer to the PBC request context
+  Return Value:
+    None.
+--*/
+{
+    FuncEntry(TRACE_FLAG_TRANSFER);
+
+    LARGE_INTEGER now;
+    ULONGLONG elapsedUs;
+    ULONG errorUs;
+
+    NT_ASSERT(pDevice  != NULL);
+    NT_ASSERT(pRequest != NULL);
+
+    now = KeQueryPerformanceCounter(NULL);
+
+    elapsedUs = 
+        (ULONGLONG)(now.QuadPart - pRequest->DelayStart.QuadPart) * 1000000 /
+        (ULONGLONG)pDevice->PerformanceFrequency.QuadPart;
+
+    pRequest->DelayAchievedInUs = (ULONG)min(elapsedUs, MAXLONG);
+    pRequest->DelayErrorInUs = 
+        (LONG)pRequest->DelayAchievedInUs - (LONG)pRequest->DelayInUs;
+
+    errorUs = (pRequest->DelayErrorInUs < 0) ? 
+        (ULONG)(-pRequest->DelayErrorInUs) : 
+        (ULONG)pRequest->DelayErrorInUs;
+
+    pRequest->DelayCount++;
+
+    if (errorUs > pRequest->DelayMaxErrorInUs)
+    {
+        pRequest->DelayMaxErrorInUs = errorUs;
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_FLAG_TRANSFER,
+        "Delayed %lu us for %lu us requested (error %ld us) "
+        "for SPBREQUEST %p",
+        pRequest->DelayAchievedInUs,
+        pRequest->DelayInUs,
+        pRequest->DelayErrorInUs,
+        pRequest->SpbRequest);
+
     FuncExit(TRACE_FLAG_TRANSFER);
 }
\ No newline at end of file
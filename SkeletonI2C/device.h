@@ -48,6 +48,7 @@ OnMonitorPowerSettingCallback(
 //
 
 EVT_SPB_TARGET_CONNECT               OnTargetConnect;
+EVT_SPB_TARGET_DISCONNECT            OnTargetDisconnect;
 EVT_SPB_CONTROLLER_LOCK              OnControllerLock;
 EVT_SPB_CONTROLLER_UNLOCK            OnControllerUnlock;
 EVT_SPB_CONTROLLER_READ              OnRead;
@@ -68,8 +69,17 @@ PbcTargetGetSettings(
     _Out_    PPBC_TARGET_SETTINGS    pSettings);
 
 NTSTATUS
-PbcRequestValidate(
-    _In_     PPBC_REQUEST            pRequest);
+PbcRequestCompile(
+    _Inout_  PPBC_REQUEST            pRequest,
+    _Inout_  PPBC_TARGET             pTarget);
+
+NTSTATUS
+PbcRequestCompileSegment(
+    _In_     PPBC_REQUEST            pRequest,
+    _In_     PPBC_TARGET             pTarget,
+    _In_     ULONG                   Index,
+    _In_     SPB_TRANSFER_DIRECTION  PreviousDirection,
+    _Out_    PPBC_SEGMENT            pSegment);
 
 VOID
 PbcRequestConfigureForNonSequence(
@@ -92,6 +102,15 @@ VOID
 PbcRequestComplete(
     _In_     PPBC_REQUEST            pRequest);
 
+VOID
+PbcDeviceCalibrateDelay(
+    _In_     PPBC_DEVICE             pDevice);
+
+VOID
+PbcRequestRecordDelay(
+    _In_     PPBC_DEVICE             pDevice,
+    _Inout_  PPBC_REQUEST            pRequest);
+
 EVT_WDF_TIMER                        OnDelayTimerExpired;
 
 ULONG
@@ -310,4 +329,145 @@ PbcRequestSetByte(
     return status;
 }
 
+NTSTATUS
+FORCEINLINE
+PbcRequestCopyBytes(
+   _In_                    PPBC_REQUEST  pRequest,
+   _In_                    size_t        Index,
+   _Inout_updates_(Length) UCHAR*        pBuffer,
+   _In_                    size_t        Length,
+   _In_                    BOOLEAN       bToRequest
+   )
+/*++
+  Routine Description:
+    This is a helper routine used to copy a range of
+    bytes between the current transfer descriptor buffer
+    and a local buffer. The MDL chain is walked once for
+    the whole range and each MDL is copied in one block.
+  Arguments:
+    pRequest - a pointer to the PBC request context
+    Index - index of the first byte in the current transfer
+        descriptor buffer
+    pBuffer - the local buffer
+    Length - number of bytes to copy
+    bToRequest - TRUE to copy from pBuffer into the transfer
+        descriptor buffer, FALSE to copy the other way
+  Return Value:
+    STATUS_INFO_LENGTH_MISMATCH if the range is out of bounds,
+    STATUS_INSUFFICIENT_RESOURCES if an MDL cannot be mapped,
+    otherwise STATUS_SUCCESS
+--*/
+{
+    PMDL mdl = pRequest->pMdlChain;
+    size_t mdlByteCount;
+    size_t currentOffset = Index;
+    size_t chunk;
+    PUCHAR pMdlBuffer;
+
+    //
+    // Check for out-of-bounds range
+    //
+
+    if ((Index > pRequest->Length) ||
+        (Length > pRequest->Length - Index))
+    {
+        return STATUS_INFO_LENGTH_MISMATCH;
+    }
+
+    while ((Length > 0) && (mdl != NULL))
+    {
+        mdlByteCount = MmGetMdlByteCount(mdl);
+
+        if (currentOffset < mdlByteCount)
+        {
+            pMdlBuffer = (PUCHAR) MmGetSystemAddressForMdlSafe(
+                mdl,
+                NormalPagePriority | MdlMappingNoExecute);
+
+            if (pMdlBuffer == NULL)
+            {
+                return STATUS_INSUFFICIENT_RESOURCES;
+            }
+
+            chunk = min(Length, mdlByteCount - currentOffset);
+
+            if (bToRequest)
+            {
+                RtlCopyMemory(pMdlBuffer + currentOffset, pBuffer, chunk);
+            }
+            else
+            {
+                RtlCopyMemory(pBuffer, pMdlBuffer + currentOffset, chunk);
+            }
+
+            pBuffer += chunk;
+            Length -= chunk;
+            currentOffset = 0;
+        }
+        else
+        {
+            currentOffset -= mdlByteCount;
+        }
+
+        mdl = mdl->Next;
+    }
+
+    //
+    // If the MDL chain ended before the range was copied,
+    // the descriptor length did not match the chain
+    //
+
+    return (Length == 0) ? STATUS_SUCCESS : STATUS_INFO_LENGTH_MISMATCH;
+}
+
+NTSTATUS
+FORCEINLINE
+PbcRequestGetBytes(
+   _In_                 PPBC_REQUEST  pRequest,
+   _In_                 size_t        Index,
+   _Out_writes_(Length) UCHAR*        pBuffer,
+   _In_                 size_t        Length
+   )
+/*++
+  Routine Description:
+    This is a helper routine used to retrieve a range
+    of bytes from the current transfer descriptor buffer.
+  Arguments:
+    pRequest - a pointer to the PBC request context
+    Index - index of the first byte in the current transfer
+        descriptor buffer
+    pBuffer - pointer to the location for the bytes
+    Length - number of bytes to retrieve
+  Return Value:
+    See PbcRequestCopyBytes
+--*/
+{
+    return PbcRequestCopyBytes(pRequest, Index, pBuffer, Length, FALSE);
+}
+
+NTSTATUS
+FORCEINLINE
+PbcRequestSetBytes(
+   _In_                PPBC_REQUEST  pRequest,
+   _In_                size_t        Index,
+   _In_reads_(Length)  UCHAR*        pBuffer,
+   _In_                size_t        Length
+   )
+/*++
+  Routine Description:
+    This is a helper routine used to set a range
+    of bytes in the current transfer descriptor buffer.
+  Arguments:
+    pRequest - a pointer to the PBC request context
+    Index - index of the first byte in the current transfer
+        descriptor buffer
+    pBuffer - the bytes
+    Length - number of bytes to set
+  Return Value:
+    See PbcRequestCopyBytes
+--*/
+{
+    return PbcRequestCopyBytes(pRequest, Index, pBuffer, Length, TRUE);
+}
+
 #endif
\ No newline at end of file
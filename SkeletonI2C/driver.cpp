@@ -206,11 +206,13 @@ OnDeviceAdd(
         SPB_CONTROLLER_CONFIG_INIT(&spbConfig);
 
         //
-        // Register for target connect callback.  The driver
-        // does not need to respond to target disconnect.
+        // Register for target connect and disconnect callbacks.
+        // The driver only traces the target's counters on
+        // disconnect.
         //
 
         spbConfig.EvtSpbTargetConnect    = OnTargetConnect;
+        spbConfig.EvtSpbTargetDisconnect = OnTargetDisconnect;
 
         //
         // Register for IO callbacks.
@@ -372,6 +374,46 @@ OnDeviceAdd(
         }
     }
 
+    //
+    // Create the high resolution delay timer used for
+    // delays shorter than the default timer resolution.
+    //
+    {    
+        WDF_TIMER_CONFIG      wdfTimerConfig;
+        WDF_OBJECT_ATTRIBUTES timerAttributes;
+
+        WDF_TIMER_CONFIG_INIT(&wdfTimerConfig, OnDelayTimerExpired);
+        wdfTimerConfig.UseHighResolutionTimer = WdfTrue;
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&timerAttributes);
+        timerAttributes.ParentObject = pDevice->FxDevice;
+
+        status = WdfTimerCreate(
+            &wdfTimerConfig,
+            &timerAttributes,
+            &(pDevice->HighResolutionDelayTimer)
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR, 
+                TRACE_FLAG_WDFLOADING, 
+                "Failed to create high resolution delay timer for "
+                "WDFDEVICE %p - %!STATUS!", 
+                pDevice->FxDevice,
+                status);
+
+            goto exit;
+        }
+    }
+
+    //
+    // Calibrate the busy-wait used for short delays.
+    //
+
+    PbcDeviceCalibrateDelay(pDevice);
+
     //
     // Create the spin lock to synchronize access
     // to the controller driver.
@@ -86,6 +86,44 @@ typedef struct _PNP_I2C_SERIAL_BUS_DESCRIPTOR {
 #define IDLE_TIMEOUT_MONITOR_ON  1000
 #define IDLE_TIMEOUT_MONITOR_OFF 100
 
+//
+// Interrupt settings.
+//
+
+// Number of times the DPC re-checks the controller for
+// pending events before re-enabling interrupts and
+// returning. Events that become pending while a burst is
+// being moved are then handled without another interrupt.
+#define SI2C_MAX_DPC_PASSES      4
+
+//
+// Delay settings.
+//
+
+// Delays up to this length are busy-waited on the
+// performance counter. A timer cannot expire sooner
+// than the next timer interrupt. The wait runs at
+// DISPATCH_LEVEL with the device lock held, so it is
+// kept within the 50 us allowed for a stall.
+#define SI2C_DELAY_STALL_MAX_US            50
+
+// Delays up to this length use a high resolution timer.
+// Longer delays use the default timer resolution.
+#define SI2C_DELAY_HIGH_RESOLUTION_MAX_US  15000
+
+// Number of performance counter reads averaged to
+// measure the cost of a read.
+#define SI2C_DELAY_CALIBRATION_READS       32
+
+//
+// Request settings.
+//
+
+// Number of transfers compiled into segments when a
+// request arrives. Transfers of longer sequences are
+// compiled one at a time as they are reached.
+#define SI2C_MAX_SEGMENTS                  8
+
 //
 // Target settings.
 //
@@ -110,6 +148,26 @@ typedef struct PBC_TARGET_SETTINGS
 }
 PBC_TARGET_SETTINGS, *PPBC_TARGET_SETTINGS;
 
+//
+// Target descriptor. Resolved from the target settings
+// once when the target is connected.
+//
+
+typedef struct PBC_TARGET_DESCRIPTOR
+{
+    // TODO: Update this structure to include other
+    //       register values derived from the target
+    //       settings (i.e. clock dividers).
+
+    // Value programmed into the TargetAddress register.
+    ULONG                         Address;
+
+    // Control register bits common to every transfer
+    // to the target (i.e. address mode).
+    ULONG                         Control;
+}
+PBC_TARGET_DESCRIPTOR, *PPBC_TARGET_DESCRIPTOR;
+
 
 //
 // Transfer settings. 
@@ -135,6 +193,27 @@ typedef struct PBC_TRANSFER_SETTINGS
 }
 PBC_TRANSFER_SETTINGS, *PPBC_TRANSFER_SETTINGS;
 
+//
+// Transfer segment. Each transfer of a request is compiled
+// into a segment holding what is needed to program the
+// controller for it, so moving to the next transfer only
+// requires indexing the request's segment array.
+//
+
+typedef struct PBC_SEGMENT
+{
+    PMDL                           pMdlChain;
+    size_t                         Length;
+    SPB_TRANSFER_DIRECTION         Direction;
+    SPB_REQUEST_SEQUENCE_POSITION  SequencePosition;
+    ULONG                          DelayInUs;
+
+    // Control register value, including the start (or
+    // repeated start), stop and direction bits.
+    ULONG                          Control;
+}
+PBC_SEGMENT, *PPBC_SEGMENT;
+
 /////////////////////////////////////////////////
 //
 // Context definitions.
@@ -176,12 +255,33 @@ struct PBC_DEVICE
     ULONG                          InterruptMask;
     ULONG                          InterruptStatus;
 
+    // Interrupt sources masked by the ISR until the DPC
+    // has serviced them. Only the sources that fired are
+    // masked, the others stay enabled.
+    ULONG                          InterruptsDeferred;
+
+    // Transfer engine counters, used to evaluate the
+    // interrupts taken per KB and the bytes moved per DPC.
+    ULONG                          InterruptCount;
+    ULONG                          DpcCount;
+    ULONG                          BurstCount;
+    ULONGLONG                      BytesTransferred;
+
     // Controller driver spinlock.
     WDFSPINLOCK                    Lock;
 
     // Delay timer used to stall between transfers.
     WDFTIMER                       DelayTimer;
 
+    // High resolution timer used for delays too long
+    // to busy-wait but too short for DelayTimer.
+    WDFTIMER                       HighResolutionDelayTimer;
+
+    // Performance counter frequency and the cost of one
+    // counter read, measured once to calibrate busy-waits.
+    LARGE_INTEGER                  PerformanceFrequency;
+    LONGLONG                       StallOverheadTicks;
+
     // The power setting callback handle
     PVOID                          pMonitorPowerSettingHandle;
 };
@@ -200,6 +300,22 @@ struct PBC_TARGET
 
     // Target specific settings.
     PBC_TARGET_SETTINGS            Settings;
+
+    // Controller configuration derived from the settings.
+    PBC_TARGET_DESCRIPTOR          Descriptor;
+
+    // Direction of the last transfer completed for the
+    // target. A transfer in the other direction that does
+    // not begin with a start gets a repeated start.
+    SPB_TRANSFER_DIRECTION         LastDirection;
+
+    // Requests, transfers and bytes handled for the target,
+    // and the performance counter ticks spent setting up
+    // requests before the first transfer.
+    ULONG                          RequestCount;
+    ULONG                          TransferCount;
+    ULONGLONG                      BytesTransferred;
+    ULONGLONG                      SetupTicks;
     
     // Current request associated with the 
     // target. This value should only be non-null
@@ -241,6 +357,15 @@ struct PBC_REQUEST
     NTSTATUS                       Status;
     BOOLEAN                        bIoComplete;
 
+    // Number of delays and largest absolute delay
+    // error across the transfers of the request.
+    ULONG                          DelayCount;
+    ULONG                          DelayMaxErrorInUs;
+
+    // Transfers compiled when the request arrived.
+    PBC_SEGMENT                    Segments[SI2C_MAX_SEGMENTS];
+    ULONG                          SegmentCount;
+
 
     //
     // Variables that are reused for each transfer within
@@ -260,9 +385,18 @@ struct PBC_REQUEST
     // Direction of the current transfer.
     SPB_TRANSFER_DIRECTION         Direction;
 
+    // Control register value for the current transfer.
+    ULONG                          Control;
+
     // Time to delay before starting transfer.
     ULONG                          DelayInUs;
 
+    // Performance counter when the delay began, and the
+    // achieved delay and its error in microseconds.
+    LARGE_INTEGER                  DelayStart;
+    ULONG                          DelayAchievedInUs;
+    LONG                           DelayErrorInUs;
+
     // Interrupt flag indicating data is ready to
     // be transferred.
     ULONG                          DataReadyFlag; 
@@ -22,14 +22,28 @@ Revision History:
 //
 // Skeleton I2C controller registers.
 //
+// The layout below describes a typical FIFO based I2C
+// controller: the driver programs the target address and
+// transfer length, starts the transfer and then moves data
+// through byte-wide TX/RX FIFO ports. The controller raises
+// a watermark interrupt when the TX FIFO drains to (or the
+// RX FIFO fills to) a programmable threshold.
+//
 
 typedef struct SKELETONI2C_REGISTERS
 {
     // TODO: Update this register structure to match the
     //       register mapping of the controller hardware.
 
-    __declspec(align(4)) HWREG<ULONG>  Reg0;
-    __declspec(align(4)) HWREG<ULONG>  Reg1;
+    __declspec(align(4)) HWREG<ULONG>  Control;
+    __declspec(align(4)) HWREG<ULONG>  TargetAddress;
+    __declspec(align(4)) HWREG<ULONG>  TransferLength;
+    __declspec(align(4)) HWREG<ULONG>  InterruptEnable;
+    __declspec(align(4)) HWREG<ULONG>  InterruptStatus;
+    __declspec(align(4)) HWREG<ULONG>  FifoControl;
+    __declspec(align(4)) HWREG<ULONG>  FifoStatus;
+    __declspec(align(4)) HWREG<UCHAR>  TxFifo;
+    __declspec(align(4)) HWREG<UCHAR>  RxFifo;
 }
 SKELETONI2C_REGISTERS, *PSKELETONI2C_REGISTERS;
 
@@ -37,27 +51,71 @@ SKELETONI2C_REGISTERS, *PSKELETONI2C_REGISTERS;
 //       functionalities of each register.
 
 //
-// Reg0 register bits.
+// Control register bits.
+//
+
+#define SI2C_CONTROL_ENABLE                 0x00000001
+#define SI2C_CONTROL_START                  0x00000002
+#define SI2C_CONTROL_STOP                   0x00000004
+#define SI2C_CONTROL_READ                   0x00000008
+#define SI2C_CONTROL_10BIT_ADDRESS          0x00000010
+#define SI2C_CONTROL_GO                     0x80000000
+
+//
+// InterruptEnable and InterruptStatus register bits. The
+// watermark bits are level triggered and remain set while
+// the FIFO is past its threshold, all other bits are latched
+// and cleared by writing 1.
+//
+
+#define SI2C_STATUS_TX_WATERMARK            0x00000001
+#define SI2C_STATUS_RX_WATERMARK            0x00000002
+#define SI2C_STATUS_TRANSFER_COMPLETE       0x00000004
+#define SI2C_STATUS_ADDRESS_NACK            0x00000008
+#define SI2C_STATUS_DATA_NACK               0x00000010
+#define SI2C_STATUS_GENERIC_ERROR           0x00000020
+
+#define SI2C_STATUS_ERROR_MASK              (SI2C_STATUS_ADDRESS_NACK |  \
+                                             SI2C_STATUS_DATA_NACK |     \
+                                             SI2C_STATUS_GENERIC_ERROR)
+
+#define SI2C_STATUS_LATCHED_MASK            (SI2C_STATUS_TRANSFER_COMPLETE | \
+                                             SI2C_STATUS_ERROR_MASK)
+
+//
+// FifoControl register bits. Bits 7:0 hold the TX threshold
+// and bits 15:8 the RX threshold.
 //
 
-#define SI2C_REG_0_BITS_31_28               0xF0000000
+#define SI2C_FIFO_CONTROL_THRESHOLDS(Tx, Rx) \
+    ((ULONG)(((Tx) & 0xFF) | (((Rx) & 0xFF) << 8)))
+
+#define SI2C_FIFO_CONTROL_FLUSH_TX          0x00010000
+#define SI2C_FIFO_CONTROL_FLUSH_RX          0x00020000
 
 //
-// Reg1 register bits.
+// FifoStatus register bits. Bits 7:0 hold the number of bytes
+// in the TX FIFO and bits 15:8 the number in the RX FIFO.
 //
 
-#define SI2C_REG_1_BITS_31_28               0xF0000000
+#define SI2C_FIFO_STATUS_TX_LEVEL(Status)   ((ULONG)((Status) & 0xFF))
+#define SI2C_FIFO_STATUS_RX_LEVEL(Status)   ((ULONG)(((Status) >> 8) & 0xFF))
 
 // TODO: Define other controller-specific values.
 
 #define SI2C_MAX_TRANSFER_LENGTH            0x00001000
 
-// TODO: Remove these generic error defines in favor
-//       of real register bit mappings defined above.
+//
+// FIFO geometry. The TX watermark interrupt fires once the
+// TX FIFO has drained to SI2C_FIFO_TX_WATERMARK bytes, leaving
+// room to refill (depth - watermark) bytes in one burst. The
+// RX watermark interrupt fires once SI2C_FIFO_RX_WATERMARK
+// bytes can be drained in one burst.
+//
 
-#define SI2C_STATUS_ADDRESS_NACK            0x00000000
-#define SI2C_STATUS_DATA_NACK               0x00000000
-#define SI2C_STATUS_GENERIC_ERROR           0x00000000
+#define SI2C_FIFO_DEPTH                     32
+#define SI2C_FIFO_TX_WATERMARK              8
+#define SI2C_FIFO_RX_WATERMARK              24
 
 
 //
@@ -19,6 +19,10 @@ Abstract:
     the requests with and without a completion routine. To forward with a completion routine
     set the define FORWARD_REQUEST_WITH_COMPLETION to 1. 
 
+    Requests forwarded with the completion routine are timed, and the
+    per-IOCTL profile can be read back with IOCTL_FILTER_PROFILE_QUERY,
+    see profile.h.
+
 Environment:
 
     User mode
@@ -126,6 +130,7 @@ Return Value:
 --*/
 {
     WDF_OBJECT_ATTRIBUTES   deviceAttributes;
+    WDF_OBJECT_ATTRIBUTES   requestAttributes;
     PFILTER_EXTENSION       filterExt;
     NTSTATUS                status;
     WDFDEVICE               device;    
@@ -148,6 +153,12 @@ Return Value:
     //
 
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&deviceAttributes, FILTER_EXTENSION);
+
+    //
+    // Every request gets room for its dispatch timestamp
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&requestAttributes, FILTER_REQUEST_CONTEXT);
+    WdfDeviceInitSetRequestAttributes(DeviceInit, &requestAttributes);
     
     //
     // Create a framework device object.This call will inturn create
@@ -162,6 +173,9 @@ Return Value:
 
     filterExt = FilterGetData(device);
 
+    filterExt->WdfDevice = device;
+    FilterProfileInitialize(&filterExt->Profile);
+
     //
     // Configure the default queue to be Parallel. 
     //
@@ -173,6 +187,8 @@ Return Value:
     // filter drivers.
     //
     ioQueueConfig.EvtIoDeviceControl = FilterEvtIoDeviceControl;
+    ioQueueConfig.EvtIoRead = FilterEvtIoRead;
+    ioQueueConfig.EvtIoWrite = FilterEvtIoWrite;
 
     status = WdfIoQueueCreate(device,
                             &ioQueueConfig,
@@ -224,8 +240,9 @@ Return Value:
     PFILTER_EXTENSION               filterExt;
     NTSTATUS                        status = STATUS_SUCCESS;
     WDFDEVICE                       device;
+    PVOID                           buffer;
+    SIZE_T                          bytesWritten = 0;
 
-    UNREFERENCED_PARAMETER(OutputBufferLength);
     UNREFERENCED_PARAMETER(InputBufferLength);
 
     KdPrint(("Entered FilterEvtIoDeviceControl\n"));
@@ -239,6 +256,25 @@ Return Value:
     //
     // Put your cases for handling IOCTLs here
     //
+
+    case IOCTL_FILTER_PROFILE_QUERY:
+        status = WdfRequestRetrieveOutputBuffer(Request,
+                                                sizeof(FILTER_PROFILE_EXPORT),
+                                                &buffer,
+                                                NULL);
+        if (NT_SUCCESS(status)) {
+            status = FilterProfileExport(&filterExt->Profile,
+                                         buffer,
+                                         OutputBufferLength,
+                                         &bytesWritten);
+        }
+        WdfRequestCompleteWithInformation(Request, status, bytesWritten);
+        return;
+
+    case IOCTL_FILTER_PROFILE_RESET:
+        FilterProfileReset(&filterExt->Profile);
+        WdfRequestComplete(Request, STATUS_SUCCESS);
+        return;
     
     default:
         status = STATUS_SUCCESS;
@@ -268,6 +304,52 @@ Return Value:
     return;
 }
 
+VOID
+FilterEvtIoRead(
+    IN WDFQUEUE      Queue,
+    IN WDFREQUEST    Request,
+    IN size_t        Length
+    )
+/*++
+
+Routine Description:
+
+    Reads and writes are passed down like IOCTLs so they show up in the
+    profile too.
+
+--*/
+{
+    UNREFERENCED_PARAMETER(Length);
+
+#if FORWARD_REQUEST_WITH_COMPLETION
+    FilterForwardRequestWithCompletionRoutine(Request,
+                                           WdfDeviceGetIoTarget(WdfIoQueueGetDevice(Queue)));
+#else
+    FilterForwardRequest(Request, WdfDeviceGetIoTarget(WdfIoQueueGetDevice(Queue)));
+#endif
+
+    return;
+}
+
+VOID
+FilterEvtIoWrite(
+    IN WDFQUEUE      Queue,
+    IN WDFREQUEST    Request,
+    IN size_t        Length
+    )
+{
+    UNREFERENCED_PARAMETER(Length);
+
+#if FORWARD_REQUEST_WITH_COMPLETION
+    FilterForwardRequestWithCompletionRoutine(Request,
+                                           WdfDeviceGetIoTarget(WdfIoQueueGetDevice(Queue)));
+#else
+    FilterForwardRequest(Request, WdfDeviceGetIoTarget(WdfIoQueueGetDevice(Queue)));
+#endif
+
+    return;
+}
+
 VOID
 FilterForwardRequest(
     IN WDFREQUEST Request,
@@ -321,6 +403,43 @@ Routine Description:
 {
     BOOLEAN ret;
     NTSTATUS status;
+    WDF_REQUEST_PARAMETERS params;
+    PFILTER_REQUEST_CONTEXT requestContext;
+    LARGE_INTEGER now;
+
+    //
+    // Note what the request is before it goes down, the completion
+    // routine only gets the result
+    //
+    requestContext = FilterGetRequestData(Request);
+
+    WDF_REQUEST_PARAMETERS_INIT(&params);
+    WdfRequestGetParameters(Request, &params);
+
+    switch (params.Type) {
+
+    case WdfRequestTypeRead:
+        requestContext->RequestType = FilterProfileRead;
+        requestContext->IoControlCode = 0;
+        requestContext->BytesIn = 0;
+        break;
+
+    case WdfRequestTypeWrite:
+        requestContext->RequestType = FilterProfileWrite;
+        requestContext->IoControlCode = 0;
+        requestContext->BytesIn = params.Parameters.Write.Length;
+        break;
+
+    case WdfRequestTypeDeviceControl:
+        requestContext->RequestType = FilterProfileDeviceControl;
+        requestContext->IoControlCode = params.Parameters.DeviceIoControl.IoControlCode;
+        requestContext->BytesIn = params.Parameters.DeviceIoControl.InputBufferLength;
+        break;
+
+    default:
+        requestContext->RequestType = 0;
+        break;
+    }
 
     //
     // The following funciton essentially copies the content of
@@ -330,7 +449,13 @@ Routine Description:
 
     WdfRequestSetCompletionRoutine(Request,
                                 FilterRequestCompletionRoutine,
-                                WDF_NO_CONTEXT);
+                                FilterGetData(WdfIoQueueGetDevice(WdfRequestGetIoQueue(Request))));
+
+    //
+    // Stamp as late as possible so only the lower stack is measured
+    //
+    QueryPerformanceCounter(&now);
+    requestContext->StartTicks = now.QuadPart;
 
     ret = WdfRequestSend(Request,
                          Target,
@@ -372,10 +497,31 @@ Return Value:
 
 --*/
 {
+    PFILTER_EXTENSION       filterExt = (PFILTER_EXTENSION)Context;
+    PFILTER_REQUEST_CONTEXT requestContext = FilterGetRequestData(Request);
+    LARGE_INTEGER           now;
+
     UNREFERENCED_PARAMETER(Target);
-    UNREFERENCED_PARAMETER(Context);
 
-    WdfRequestComplete(Request, CompletionParams->IoStatus.Status);
+    QueryPerformanceCounter(&now);
+
+    if (requestContext->RequestType != 0) {
+        FilterProfileRecord(&filterExt->Profile,
+                            requestContext->RequestType,
+                            requestContext->IoControlCode,
+                            requestContext->StartTicks,
+                            now.QuadPart,
+                            requestContext->BytesIn,
+                            CompletionParams->IoStatus.Information,
+                            !NT_SUCCESS(CompletionParams->IoStatus.Status));
+    }
+
+    //
+    // Pass the byte count up, the caller needs it as much as the status
+    //
+    WdfRequestCompleteWithInformation(Request,
+                                      CompletionParams->IoStatus.Status,
+                                      CompletionParams->IoStatus.Information);
 
     return;
 }
@@ -35,17 +35,24 @@ Environment:
 
 #define DRIVERNAME "Generic.sys: "
 
+#include "profile.h"
+
 //
-// Change the following define to 1 if you want to forward
-// the request with a completion routine.
+// Change the following define to 0 if you want to forward
+// the request without a completion routine. Requests are only
+// profiled when they come back through the completion routine.
 //
-#define FORWARD_REQUEST_WITH_COMPLETION 0
+#define FORWARD_REQUEST_WITH_COMPLETION 1
 
 
 typedef struct _FILTER_EXTENSION
 {
     WDFDEVICE WdfDevice;
-    // More context data here
+
+    //
+    // Latency and byte counters for the requests passing through
+    //
+    FILTER_PROFILE Profile;
 
 }FILTER_EXTENSION, *PFILTER_EXTENSION;
 
@@ -53,9 +60,27 @@ typedef struct _FILTER_EXTENSION
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(FILTER_EXTENSION,
                                         FilterGetData)
 
+//
+// Filled in at dispatch, read back in the completion routine
+//
+typedef struct _FILTER_REQUEST_CONTEXT
+{
+    LONGLONG    StartTicks;
+    ULONG       RequestType;    // FILTER_PROFILE_REQUEST_TYPE, 0 if not profiled
+    ULONG       IoControlCode;
+    SIZE_T      BytesIn;
+
+}FILTER_REQUEST_CONTEXT, *PFILTER_REQUEST_CONTEXT;
+
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(FILTER_REQUEST_CONTEXT,
+                                        FilterGetRequestData)
+
 DRIVER_INITIALIZE DriverEntry;
 EVT_WDF_DRIVER_DEVICE_ADD FilterEvtDeviceAdd;
 EVT_WDF_IO_QUEUE_IO_DEVICE_CONTROL FilterEvtIoDeviceControl;
+EVT_WDF_IO_QUEUE_IO_READ FilterEvtIoRead;
+EVT_WDF_IO_QUEUE_IO_WRITE FilterEvtIoWrite;
 
 VOID
 FilterForwardRequest(
@@ -0,0 +1,248 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+Module Name:
+
+    profile.c
+
+Abstract:
+
+    Per-IOCTL latency histograms and byte counters for the generic
+    filter. Nothing in here calls the framework, the filter passes in
+    the timestamps and sizes.
+
+Environment:
+
+    User mode
+
+--*/
+
+#include "filter.h"
+
+
+VOID
+FilterProfileInitialize(
+    OUT PFILTER_PROFILE Profile
+    )
+{
+    LARGE_INTEGER frequency;
+
+    ZeroMemory(Profile, sizeof(*Profile));
+
+    QueryPerformanceFrequency(&frequency);
+    Profile->TicksPerSecond = frequency.QuadPart;
+}
+
+VOID
+FilterProfileReset(
+    IN OUT PFILTER_PROFILE Profile
+    )
+/*++
+Routine Description:
+
+    Zeroes the counters but keeps the slots claimed. Requests completing
+    while this runs may be half counted, which is fine for a profile.
+
+--*/
+{
+    ULONG i;
+    ULONG j;
+    PFILTER_PROFILE_ENTRY entry;
+
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+
+        entry = &Profile->Slots[i].Entry;
+
+        InterlockedExchange64(&entry->Count, 0);
+        InterlockedExchange64(&entry->Failures, 0);
+        InterlockedExchange64(&entry->BytesIn, 0);
+        InterlockedExchange64(&entry->BytesOut, 0);
+        InterlockedExchange64(&entry->TotalMicroseconds, 0);
+        InterlockedExchange64(&entry->MaxMicroseconds, 0);
+
+        for (j = 0; j < FILTER_PROFILE_BUCKETS; j++) {
+            InterlockedExchange64(&entry->Buckets[j], 0);
+        }
+    }
+
+    InterlockedExchange64(&Profile->Overflows, 0);
+}
+
+ULONG
+FilterProfileBucket(
+    IN ULONGLONG Microseconds
+    )
+{
+    ULONG bucket = 0;
+
+    while (Microseconds != 0 && bucket < FILTER_PROFILE_BUCKETS - 1) {
+        Microseconds >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+static PFILTER_PROFILE_ENTRY
+FilterProfileLookup(
+    IN OUT PFILTER_PROFILE Profile,
+    IN ULONG RequestType,
+    IN ULONG IoControlCode
+    )
+/*++
+Routine Description:
+
+    Finds the entry for a request type and code, claiming a free slot
+    the first time the pair is seen. Returns NULL once the table is full.
+
+--*/
+{
+    LONGLONG key = ((LONGLONG)RequestType << 32) | IoControlCode;
+    LONGLONG current;
+    ULONG start;
+    ULONG i;
+    PFILTER_PROFILE_SLOT slot;
+
+    //
+    // Start from a hash of the code so the common ones are found on the
+    // first probe
+    //
+    start = ((IoControlCode >> 2) ^ (IoControlCode >> 16) ^ RequestType) % FILTER_PROFILE_MAX_ENTRIES;
+
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+
+        slot = &Profile->Slots[(start + i) % FILTER_PROFILE_MAX_ENTRIES];
+
+        current = slot->Key;
+        if (current == 0) {
+            current = InterlockedCompareExchange64(&slot->Key, key, 0);
+            if (current == 0) {
+                //
+                // Claimed it. Counters may start moving before these are
+                // set, so they are only read by the export.
+                //
+                slot->Entry.RequestType = RequestType;
+                slot->Entry.IoControlCode = IoControlCode;
+                return &slot->Entry;
+            }
+        }
+
+        if (current == key) {
+            return &slot->Entry;
+        }
+    }
+
+    return NULL;
+}
+
+VOID
+FilterProfileRecord(
+    IN OUT PFILTER_PROFILE Profile,
+    IN ULONG RequestType,
+    IN ULONG IoControlCode,
+    IN LONGLONG StartTicks,
+    IN LONGLONG EndTicks,
+    IN SIZE_T BytesIn,
+    IN SIZE_T BytesOut,
+    IN BOOLEAN Failed
+    )
+{
+    PFILTER_PROFILE_ENTRY entry;
+    LONGLONG microseconds;
+    LONGLONG max;
+
+    entry = FilterProfileLookup(Profile, RequestType, IoControlCode);
+    if (entry == NULL) {
+        InterlockedIncrement64(&Profile->Overflows);
+        return;
+    }
+
+    microseconds = 0;
+    if (EndTicks > StartTicks && Profile->TicksPerSecond != 0) {
+        microseconds = (EndTicks - StartTicks) * 1000000 / Profile->TicksPerSecond;
+    }
+
+    InterlockedIncrement64(&entry->Count);
+    if (Failed) {
+        InterlockedIncrement64(&entry->Failures);
+    }
+    InterlockedExchangeAdd64(&entry->BytesIn, (LONGLONG)BytesIn);
+    InterlockedExchangeAdd64(&entry->BytesOut, (LONGLONG)BytesOut);
+    InterlockedExchangeAdd64(&entry->TotalMicroseconds, microseconds);
+    InterlockedIncrement64(&entry->Buckets[FilterProfileBucket((ULONGLONG)microseconds)]);
+
+    max = entry->MaxMicroseconds;
+    while (microseconds > max) {
+        max = InterlockedCompareExchange64(&entry->MaxMicroseconds, microseconds, max);
+    }
+}
+
+NTSTATUS
+FilterProfileExport(
+    IN PFILTER_PROFILE Profile,
+    OUT PVOID Buffer,
+    IN SIZE_T Length,
+    OUT SIZE_T *BytesWritten
+    )
+/*++
+Routine Description:
+
+    Fills Buffer with a FILTER_PROFILE_EXPORT header and as many entries
+    as fit. The counters keep moving while they are copied, so the
+    entries are a snapshot of each counter rather than of the table.
+
+--*/
+{
+    PFILTER_PROFILE_EXPORT header;
+    PFILTER_PROFILE_ENTRY entries;
+    ULONG room;
+    ULONG i;
+
+    *BytesWritten = 0;
+
+    if (Length < sizeof(FILTER_PROFILE_EXPORT)) {
+        return STATUS_BUFFER_TOO_SMALL;
+    }
+
+    header = (PFILTER_PROFILE_EXPORT)Buffer;
+    entries = (PFILTER_PROFILE_ENTRY)(header + 1);
+    room = (ULONG)((Length - sizeof(*header)) / sizeof(FILTER_PROFILE_ENTRY));
+
+    header->Version = FILTER_PROFILE_VERSION;
+    header->BucketCount = FILTER_PROFILE_BUCKETS;
+    header->EntryCount = 0;
+    header->EntriesReturned = 0;
+    header->Overflows = Profile->Overflows;
+
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+
+        if (Profile->Slots[i].Key == 0) {
+            continue;
+        }
+
+        if (header->EntriesReturned < room) {
+            entries[header->EntriesReturned] = Profile->Slots[i].Entry;
+
+            //
+            // The slot's key is authoritative, the entry fields may not
+            // have been written yet by the thread that claimed it
+            //
+            entries[header->EntriesReturned].RequestType = (ULONG)(Profile->Slots[i].Key >> 32);
+            entries[header->EntriesReturned].IoControlCode = (ULONG)Profile->Slots[i].Key;
+            header->EntriesReturned++;
+        }
+
+        header->EntryCount++;
+    }
+
+    *BytesWritten = sizeof(*header) + header->EntriesReturned * sizeof(FILTER_PROFILE_ENTRY);
+
+    return STATUS_SUCCESS;
+}
+
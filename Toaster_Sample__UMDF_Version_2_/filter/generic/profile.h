@@ -0,0 +1,145 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+Module Name:
+
+    profile.h
+
+Abstract:
+
+    Latency profiling for the generic filter. The filter times every
+    request it forwards, from dispatch to completion, and keeps a
+    latency histogram and byte counters per request type and IOCTL code.
+
+    The private IOCTLs and the export format are shared with user
+    applications, the rest is only used by the filter.
+
+Environment:
+
+    User mode
+
+--*/
+
+#if !defined(_PROFILE_H_)
+#define _PROFILE_H_
+
+//
+// Private IOCTLs, handled by the filter and never forwarded. The
+// function codes are picked from the top of the range so they don't
+// collide with those of the driver below.
+//
+#define IOCTL_FILTER_PROFILE_QUERY \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0xFF0, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+#define IOCTL_FILTER_PROFILE_RESET \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0xFF1, METHOD_BUFFERED, FILE_WRITE_ACCESS)
+
+#define FILTER_PROFILE_VERSION      1
+
+//
+// Bucket 0 counts requests that took less than 1us, bucket n those that
+// took [2^(n-1), 2^n) us. The last bucket takes everything slower.
+//
+#define FILTER_PROFILE_BUCKETS      24
+
+//
+// Distinct request type and IOCTL code pairs tracked per device
+//
+#define FILTER_PROFILE_MAX_ENTRIES  64
+
+typedef enum _FILTER_PROFILE_REQUEST_TYPE {
+    FilterProfileRead = 1,
+    FilterProfileWrite,
+    FilterProfileDeviceControl
+} FILTER_PROFILE_REQUEST_TYPE;
+
+typedef struct _FILTER_PROFILE_ENTRY {
+    ULONG       RequestType;    // FILTER_PROFILE_REQUEST_TYPE
+    ULONG       IoControlCode;  // 0 for reads and writes
+    LONGLONG    Count;
+    LONGLONG    Failures;       // completed with an error status
+    LONGLONG    BytesIn;        // write length or IOCTL input length
+    LONGLONG    BytesOut;       // bytes the lower driver returned
+    LONGLONG    TotalMicroseconds;
+    LONGLONG    MaxMicroseconds;
+    LONGLONG    Buckets[FILTER_PROFILE_BUCKETS];
+} FILTER_PROFILE_ENTRY, *PFILTER_PROFILE_ENTRY;
+
+//
+// IOCTL_FILTER_PROFILE_QUERY returns this header followed by
+// EntriesReturned entries. EntryCount tells how many there are, so a
+// caller whose buffer was too small can retry with a bigger one.
+//
+typedef struct _FILTER_PROFILE_EXPORT {
+    ULONG       Version;        // FILTER_PROFILE_VERSION
+    ULONG       BucketCount;    // FILTER_PROFILE_BUCKETS
+    ULONG       EntryCount;
+    ULONG       EntriesReturned;
+    LONGLONG    Overflows;      // requests not counted, the table was full
+} FILTER_PROFILE_EXPORT, *PFILTER_PROFILE_EXPORT;
+
+#if defined(_FILTER_H_)
+
+//
+// The rest is only for the filter itself.
+//
+// Table slots are claimed with a compare-exchange on Key and never
+// released, the counters are updated with interlocked adds. Nothing
+// takes a lock, so the filter does not serialize the stack it profiles.
+//
+typedef struct _FILTER_PROFILE_SLOT {
+    volatile LONGLONG       Key;        // 0 while free
+    FILTER_PROFILE_ENTRY    Entry;
+} FILTER_PROFILE_SLOT, *PFILTER_PROFILE_SLOT;
+
+typedef struct _FILTER_PROFILE {
+    LONGLONG            TicksPerSecond;
+    volatile LONGLONG   Overflows;
+    FILTER_PROFILE_SLOT Slots[FILTER_PROFILE_MAX_ENTRIES];
+} FILTER_PROFILE, *PFILTER_PROFILE;
+
+VOID
+FilterProfileInitialize(
+    OUT PFILTER_PROFILE Profile
+    );
+
+VOID
+FilterProfileReset(
+    IN OUT PFILTER_PROFILE Profile
+    );
+
+ULONG
+FilterProfileBucket(
+    IN ULONGLONG Microseconds
+    );
+
+VOID
+FilterProfileRecord(
+    IN OUT PFILTER_PROFILE Profile,
+    IN ULONG RequestType,
+    IN ULONG IoControlCode,
+    IN LONGLONG StartTicks,
+    IN LONGLONG EndTicks,
+    IN SIZE_T BytesIn,
+    IN SIZE_T BytesOut,
+    IN BOOLEAN Failed
+    );
+
+NTSTATUS
+FilterProfileExport(
+    IN PFILTER_PROFILE Profile,
+    OUT PVOID Buffer,
+    IN SIZE_T Length,
+    OUT SIZE_T *BytesWritten
+    );
+
+#endif //_FILTER_H_
+
+#endif //_PROFILE_H_
+
@@ -0,0 +1,310 @@
+/*++
+
+Module Name:
+
+    profiletest.c
+
+Abstract:
+
+    Host test for the filter's latency profile: the histogram buckets,
+    what FilterProfileRecord counts, the table filling up, and the
+    layout FilterProfileExport writes, including buffers too small for
+    the header or for every entry. Ends with threads recording into the
+    same entries to check that no update is lost.
+
+    Builds with the stub headers in this directory:
+
+        cc -O2 -Wall -Wextra -Wno-unknown-pragmas -pthread -I test test/profiletest.c profile.c -o profiletest
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include <windows.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_TICKS_PER_US           10
+#define TEST_THREADS                4
+#define TEST_RECORDS_PER_THREAD     200000
+
+static int failures;
+
+static VOID
+Check(
+    IN const char *Name,
+    IN LONGLONG Actual,
+    IN LONGLONG Expected
+    )
+{
+    if (Actual != Expected) {
+        failures++;
+        printf("FAIL %s: got %lld, expected %lld\n", Name, (long long)Actual, (long long)Expected);
+    }
+}
+
+static VOID
+TestBucket(
+    VOID
+    )
+{
+    Check("bucket 0us", FilterProfileBucket(0), 0);
+    Check("bucket 1us", FilterProfileBucket(1), 1);
+    Check("bucket 2us", FilterProfileBucket(2), 2);
+    Check("bucket 3us", FilterProfileBucket(3), 2);
+    Check("bucket 4us", FilterProfileBucket(4), 3);
+    Check("bucket 1023us", FilterProfileBucket(1023), 10);
+    Check("bucket 1024us", FilterProfileBucket(1024), 11);
+    Check("bucket below last", FilterProfileBucket((1ULL << (FILTER_PROFILE_BUCKETS - 2)) - 1), FILTER_PROFILE_BUCKETS - 2);
+    Check("bucket last", FilterProfileBucket(1ULL << (FILTER_PROFILE_BUCKETS - 2)), FILTER_PROFILE_BUCKETS - 1);
+    Check("bucket huge", FilterProfileBucket(~0ULL), FILTER_PROFILE_BUCKETS - 1);
+}
+
+static VOID
+TestRecord(
+    IN OUT PFILTER_PROFILE Profile
+    )
+{
+    FILTER_PROFILE_ENTRY *entry;
+    ULONG i;
+
+    FilterProfileInitialize(Profile);
+    Profile->TicksPerSecond = TEST_TICKS_PER_US * 1000000LL;
+
+    // 5us and 300us, one of them failed
+    FilterProfileRecord(Profile, FilterProfileDeviceControl, 0x222003, 100, 150, 16, 32, FALSE);
+    FilterProfileRecord(Profile, FilterProfileDeviceControl, 0x222003, 1000, 4000, 8, 0, TRUE);
+
+    // A clock that went backwards counts as 0us
+    FilterProfileRecord(Profile, FilterProfileRead, 0, 500, 400, 0, 64, FALSE);
+
+    entry = NULL;
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+        if (Profile->Slots[i].Key == (((LONGLONG)FilterProfileDeviceControl << 32) | 0x222003)) {
+            entry = &Profile->Slots[i].Entry;
+        }
+    }
+    if (entry == NULL) {
+        failures++;
+        printf("FAIL record: no entry for the IOCTL\n");
+        return;
+    }
+
+    Check("record type", entry->RequestType, FilterProfileDeviceControl);
+    Check("record code", entry->IoControlCode, 0x222003);
+    Check("record count", entry->Count, 2);
+    Check("record failures", entry->Failures, 1);
+    Check("record bytes in", entry->BytesIn, 24);
+    Check("record bytes out", entry->BytesOut, 32);
+    Check("record total us", entry->TotalMicroseconds, 305);
+    Check("record max us", entry->MaxMicroseconds, 300);
+    Check("record 5us bucket", entry->Buckets[FilterProfileBucket(5)], 1);
+    Check("record 300us bucket", entry->Buckets[FilterProfileBucket(300)], 1);
+
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+        if (Profile->Slots[i].Key == ((LONGLONG)FilterProfileRead << 32)) {
+            Check("backwards clock us", Profile->Slots[i].Entry.TotalMicroseconds, 0);
+            Check("backwards clock bucket", Profile->Slots[i].Entry.Buckets[0], 1);
+        }
+    }
+
+    // Reset keeps the slots but zeroes what they counted
+    FilterProfileReset(Profile);
+    Check("reset count", entry->Count, 0);
+    Check("reset max", entry->MaxMicroseconds, 0);
+    Check("reset bucket", entry->Buckets[FilterProfileBucket(300)], 0);
+    Check("reset keeps type", entry->RequestType, FilterProfileDeviceControl);
+}
+
+static VOID
+TestFullTable(
+    IN OUT PFILTER_PROFILE Profile
+    )
+{
+    ULONG code;
+
+    FilterProfileInitialize(Profile);
+
+    for (code = 0; code < FILTER_PROFILE_MAX_ENTRIES; code++) {
+        FilterProfileRecord(Profile, FilterProfileDeviceControl, 0x220000 | (code << 2), 0, 10, 0, 0, FALSE);
+    }
+    Check("full table overflows", Profile->Overflows, 0);
+
+    // A new code has nowhere to go, a known one is still counted
+    FilterProfileRecord(Profile, FilterProfileWrite, 0, 0, 10, 4, 0, FALSE);
+    Check("new code overflows", Profile->Overflows, 1);
+
+    FilterProfileRecord(Profile, FilterProfileDeviceControl, 0x220000, 0, 10, 0, 0, FALSE);
+    Check("known code overflows", Profile->Overflows, 1);
+}
+
+static VOID
+TestExport(
+    IN OUT PFILTER_PROFILE Profile
+    )
+{
+    static UCHAR buffer[sizeof(FILTER_PROFILE_EXPORT) + FILTER_PROFILE_MAX_ENTRIES * sizeof(FILTER_PROFILE_ENTRY)];
+    PFILTER_PROFILE_EXPORT header = (PFILTER_PROFILE_EXPORT)buffer;
+    PFILTER_PROFILE_ENTRY entries = (PFILTER_PROFILE_ENTRY)(header + 1);
+    SIZE_T written;
+    NTSTATUS status;
+    ULONG i;
+    LONGLONG count;
+
+    // Continues from the full table: 64 entries, one overflow
+    status = FilterProfileExport(Profile, buffer, sizeof(buffer), &written);
+    Check("export status", status, STATUS_SUCCESS);
+    Check("export version", header->Version, FILTER_PROFILE_VERSION);
+    Check("export buckets", header->BucketCount, FILTER_PROFILE_BUCKETS);
+    Check("export entry count", header->EntryCount, FILTER_PROFILE_MAX_ENTRIES);
+    Check("export entries returned", header->EntriesReturned, FILTER_PROFILE_MAX_ENTRIES);
+    Check("export overflows", header->Overflows, 1);
+    Check("export written", written, sizeof(buffer));
+
+    count = 0;
+    for (i = 0; i < header->EntriesReturned; i++) {
+        Check("export entry type", entries[i].RequestType, FilterProfileDeviceControl);
+        count += entries[i].Count;
+    }
+    Check("export counts", count, FILTER_PROFILE_MAX_ENTRIES + 1);
+
+    // Room for the header and one entry and a half: one entry, and the
+    // count says how many there are
+    memset(buffer, 0xCC, sizeof(buffer));
+    status = FilterProfileExport(Profile, buffer,
+                                 sizeof(FILTER_PROFILE_EXPORT) + sizeof(FILTER_PROFILE_ENTRY) * 3 / 2,
+                                 &written);
+    Check("partial status", status, STATUS_SUCCESS);
+    Check("partial entry count", header->EntryCount, FILTER_PROFILE_MAX_ENTRIES);
+    Check("partial entries returned", header->EntriesReturned, 1);
+    Check("partial written", written, sizeof(FILTER_PROFILE_EXPORT) + sizeof(FILTER_PROFILE_ENTRY));
+    Check("partial leaves the rest", buffer[written], 0xCC);
+
+    // Just the header: no entries
+    status = FilterProfileExport(Profile, buffer, sizeof(FILTER_PROFILE_EXPORT), &written);
+    Check("header only status", status, STATUS_SUCCESS);
+    Check("header only entries returned", header->EntriesReturned, 0);
+    Check("header only written", written, sizeof(FILTER_PROFILE_EXPORT));
+
+    // Too small for the header: nothing written at all
+    memset(buffer, 0xCC, sizeof(buffer));
+    written = 1;
+    status = FilterProfileExport(Profile, buffer, sizeof(FILTER_PROFILE_EXPORT) - 1, &written);
+    Check("too small status", status, STATUS_BUFFER_TOO_SMALL);
+    Check("too small written", written, 0);
+    Check("too small untouched", buffer[0], 0xCC);
+
+    status = FilterProfileExport(Profile, buffer, 0, &written);
+    Check("empty buffer status", status, STATUS_BUFFER_TOO_SMALL);
+}
+
+typedef struct _TEST_WORKER {
+    PFILTER_PROFILE Profile;
+    ULONG Seed;
+} TEST_WORKER;
+
+static void *
+TestWorker(
+    void *Context
+    )
+{
+    TEST_WORKER *worker = (TEST_WORKER *)Context;
+    ULONG i;
+    ULONG code;
+
+    for (i = 0; i < TEST_RECORDS_PER_THREAD; i++) {
+        // Eight codes shared by every thread, latencies up to 1ms
+        code = 0x220000 | ((i % 8) << 2);
+        FilterProfileRecord(worker->Profile, FilterProfileDeviceControl, code,
+                            0, (LONGLONG)((i * 7 + worker->Seed) % 1000) * TEST_TICKS_PER_US,
+                            1, 2, (i % 10) == 0);
+    }
+    return NULL;
+}
+
+static VOID
+TestConcurrent(
+    IN OUT PFILTER_PROFILE Profile
+    )
+{
+    pthread_t threads[TEST_THREADS];
+    TEST_WORKER workers[TEST_THREADS];
+    LONGLONG count = 0;
+    LONGLONG failed = 0;
+    LONGLONG bytesOut = 0;
+    LONGLONG bucketed;
+    LONGLONG max = 0;
+    ULONG slots = 0;
+    ULONG i;
+    ULONG j;
+
+    FilterProfileInitialize(Profile);
+    Profile->TicksPerSecond = TEST_TICKS_PER_US * 1000000LL;
+
+    for (i = 0; i < TEST_THREADS; i++) {
+        workers[i].Profile = Profile;
+        workers[i].Seed = i * 131;
+        pthread_create(&threads[i], NULL, TestWorker, &workers[i]);
+    }
+    for (i = 0; i < TEST_THREADS; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    for (i = 0; i < FILTER_PROFILE_MAX_ENTRIES; i++) {
+        PFILTER_PROFILE_ENTRY entry = &Profile->Slots[i].Entry;
+
+        if (Profile->Slots[i].Key == 0) {
+            continue;
+        }
+        slots++;
+        count += entry->Count;
+        failed += entry->Failures;
+        bytesOut += entry->BytesOut;
+        max = entry->MaxMicroseconds > max ? entry->MaxMicroseconds : max;
+
+        bucketed = 0;
+        for (j = 0; j < FILTER_PROFILE_BUCKETS; j++) {
+            bucketed += entry->Buckets[j];
+        }
+        Check("concurrent buckets", bucketed, entry->Count);
+    }
+
+    // Each code was claimed once, however many threads raced for it
+    Check("concurrent slots", slots, 8);
+    Check("concurrent count", count, (LONGLONG)TEST_THREADS * TEST_RECORDS_PER_THREAD);
+    Check("concurrent failures", failed, (LONGLONG)TEST_THREADS * TEST_RECORDS_PER_THREAD / 10);
+    Check("concurrent bytes out", bytesOut, 2LL * TEST_THREADS * TEST_RECORDS_PER_THREAD);
+    Check("concurrent max", max, 999);
+}
+
+int
+main(
+    VOID
+    )
+{
+    PFILTER_PROFILE profile;
+
+    profile = (PFILTER_PROFILE)malloc(sizeof(FILTER_PROFILE));
+    if (profile == NULL) {
+        return 1;
+    }
+
+    TestBucket();
+    TestRecord(profile);
+    TestFullTable(profile);
+    TestExport(profile);
+    TestConcurrent(profile);
+
+    free(profile);
+
+    if (failures != 0) {
+        return 1;
+    }
+
+    printf("Filter profile test passed\n");
+    return 0;
+}
@@ -0,0 +1,3 @@
+//
+// Empty: windows.h in this directory has everything profile.c needs.
+//
@@ -0,0 +1,89 @@
+/*++
+
+Module Name:
+
+    windows.h
+
+Abstract:
+
+    Minimal stand-in for the Windows headers that filter.h includes,
+    with just what profile.c needs, so the profiling code builds on a
+    host without the SDK. It claims the filter.h guard, which leaves out
+    the framework declarations, and pulls in the filter-only half of
+    profile.h in their place.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#if !defined(_TEST_WINDOWS_H_)
+#define _TEST_WINDOWS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define IN
+#define OUT
+
+typedef void VOID, *PVOID;
+typedef unsigned char UCHAR, BOOLEAN;
+typedef uint32_t ULONG;
+typedef int64_t LONGLONG;
+typedef uint64_t ULONGLONG;
+typedef size_t SIZE_T;
+typedef int32_t NTSTATUS;
+
+typedef union _LARGE_INTEGER {
+    LONGLONG QuadPart;
+} LARGE_INTEGER;
+
+#define TRUE    1
+#define FALSE   0
+
+#define STATUS_SUCCESS              ((NTSTATUS)0x00000000L)
+#define STATUS_BUFFER_TOO_SMALL     ((NTSTATUS)0xC0000023L)
+
+#define ZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+
+//
+// The test sets TicksPerSecond itself when it needs exact latencies
+//
+static inline int
+QueryPerformanceFrequency(LARGE_INTEGER *Frequency)
+{
+    Frequency->QuadPart = 10000000;
+    return 1;
+}
+
+static inline LONGLONG
+InterlockedExchange64(volatile LONGLONG *Target, LONGLONG Value)
+{
+    return __atomic_exchange_n(Target, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG
+InterlockedExchangeAdd64(volatile LONGLONG *Addend, LONGLONG Value)
+{
+    return __atomic_fetch_add(Addend, Value, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG
+InterlockedIncrement64(volatile LONGLONG *Addend)
+{
+    return __atomic_add_fetch(Addend, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline LONGLONG
+InterlockedCompareExchange64(volatile LONGLONG *Destination, LONGLONG Exchange, LONGLONG Comparand)
+{
+    __atomic_compare_exchange_n(Destination, &Comparand, Exchange, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+    return Comparand;
+}
+
+#define _FILTER_H_
+#include "../profile.h"
+
+#endif //_TEST_WINDOWS_H_
@@ -51,6 +51,8 @@ Return Value:
 
     WDF_PNPPOWER_EVENT_CALLBACKS_INIT(&pnpPowerCallbacks);
     pnpPowerCallbacks.EvtDevicePrepareHardware = USBUMDF2Driver2EvtDevicePrepareHardware;
+    pnpPowerCallbacks.EvtDeviceD0Entry = USBUMDF2Driver2EvtDeviceD0Entry;
+    pnpPowerCallbacks.EvtDeviceD0Exit = USBUMDF2Driver2EvtDeviceD0Exit;
     WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpPowerCallbacks);
 
 	WdfDeviceInitSetIoType(DeviceInit, WdfDeviceIoBuffered); //STIG
@@ -78,6 +80,11 @@ Return Value:
         //
 		
         deviceContext->PrivateDeviceData = 0; //STIG
+
+		status = StreamReadConfiguration(device);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
 		
 
         //
@@ -248,6 +255,16 @@ Return Value:
 		return status;
 	}
 
+	//
+	// In streaming mode the bulk-in pipe belongs to a continuous reader
+	//
+	if (pDeviceContext->StreamingEnabled) {
+		status = StreamConfigureReader(Device);
+		if (!NT_SUCCESS(status)) {
+			return status;
+		}
+	}
+
     TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE, "%!FUNC! Device prepare HW Exit");
 
     return status;
@@ -33,6 +33,16 @@ typedef struct _DEVICE_CONTEXT
 	PCWSTR                          DeviceName;
 	WDFMEMORY                       LocationMemory;
 	PCWSTR                          Location;
+
+	//
+	// Streaming mode, see stream.cpp
+	//
+	BOOLEAN                         StreamingEnabled;
+	ULONG                           StreamUrbCount;
+	ULONG                           StreamBufferCount;
+	WDFSPINLOCK                     StreamLock;      // protects StreamRing
+	STREAM_RING                     StreamRing;
+	WDFQUEUE                        StreamReadQueue; // reads waiting for data
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 //
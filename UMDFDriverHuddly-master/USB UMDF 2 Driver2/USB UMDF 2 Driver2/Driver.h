@@ -21,6 +21,8 @@ Environment:
 #include <initguid.h>
 #include <assert.h>
 
+#include "public.h"
+#include "stream.h"
 #include "device.h"
 #include "queue.h"
 #include "trace.h"
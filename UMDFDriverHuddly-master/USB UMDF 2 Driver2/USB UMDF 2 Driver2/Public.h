@@ -0,0 +1,40 @@
+/*++
+
+Module Name:
+
+    public.h
+
+Abstract:
+
+    This module contains the common declarations shared by driver
+    and user applications.
+
+Environment:
+
+    user and kernel
+
+--*/
+
+//
+// Returns USBUMDF2DRIVER2_STREAM_STATISTICS. Fails with
+// STATUS_INVALID_DEVICE_REQUEST when the driver is not streaming.
+//
+#define IOCTL_USBUMDF2DRIVER2_GET_STREAM_STATISTICS \
+    CTL_CODE(FILE_DEVICE_UNKNOWN, 0x800, METHOD_BUFFERED, FILE_READ_ACCESS)
+
+//
+// Streaming mode counters, all counted since the device started
+//
+typedef struct _USBUMDF2DRIVER2_STREAM_STATISTICS {
+	ULONGLONG BytesReceived;   // bytes the bulk-in endpoint delivered
+	ULONGLONG BytesRead;       // bytes handed out to ReadFile
+	ULONGLONG BytesDropped;    // bytes overwritten before anyone read them
+	ULONG     Transfers;       // bulk-in transfers completed
+	ULONG     Overruns;        // transfers that arrived with the ring full
+	ULONG     Underruns;       // reads that arrived with the ring empty
+	ULONG     ReadErrors;      // times the continuous reader failed and was reset
+	ULONG     BuffersQueued;   // ring buffers holding data right now
+	ULONG     BufferCount;     // ring buffers in total
+	ULONG     BufferSize;      // size of one ring buffer, also the transfer size
+	ULONG     UrbCount;        // bulk-in transfers kept in flight
+} USBUMDF2DRIVER2_STREAM_STATISTICS, *PUSBUMDF2DRIVER2_STREAM_STATISTICS;
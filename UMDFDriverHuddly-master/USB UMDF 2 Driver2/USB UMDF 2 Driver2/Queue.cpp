@@ -200,6 +200,11 @@ Return Value:
                 "%!FUNC! Queue 0x%p, Request 0x%p OutputBufferLength %d InputBufferLength %d IoControlCode %d", 
                 Queue, Request, (int) OutputBufferLength, (int) InputBufferLength, IoControlCode);
 
+	if (IoControlCode == IOCTL_USBUMDF2DRIVER2_GET_STREAM_STATISTICS) {
+		StreamGetStatistics(WdfIoQueueGetDevice(Queue), Request);
+		return;
+	}
+
     WdfRequestComplete(Request, STATUS_SUCCESS);
 
     return;
@@ -332,12 +337,12 @@ USBUMDF2Driver2EvtIoWrite(
 	
 
 
+	// A stalled endpoint must not hold the write queue forever. Send and
+	// forget can't be used here, the completion routine reports the length.
 	WDF_REQUEST_SEND_OPTIONS_INIT(&options,0); 
-	WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(&options, WDF_REQUEST_SEND_OPTION_SEND_AND_FORGET);
 	WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(&options, WDF_REL_TIMEOUT_IN_SEC(3));
 	
-	if (WdfRequestSend(Request, WdfUsbTargetPipeGetIoTarget(pipe), WDF_NO_SEND_OPTIONS) == FALSE) {
-	//if (WdfRequestSend(Request, WdfUsbTargetPipeGetIoTarget(pipe), &options) == FALSE) {
+	if (WdfRequestSend(Request, WdfUsbTargetPipeGetIoTarget(pipe), &options) == FALSE) {
 		//
 		// Framework couldn't send the request for some reason.
 		//
@@ -422,6 +427,16 @@ USBUMDF2Driver2EvtIoRead(
 
 	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,  "-->USBUMDF2Driver2EvtIoRead\n");
 
+	deviceContext = DeviceGetContext(WdfIoQueueGetDevice(Queue));
+
+	//
+	// In streaming mode reads are served from the ring, any length
+	//
+	if (deviceContext->StreamingEnabled) {
+		StreamRead(WdfIoQueueGetDevice(Queue), Request, Length);
+		return;
+	}
+
 	//
 	// First validate input parameters.
 	//
@@ -432,8 +447,6 @@ USBUMDF2Driver2EvtIoRead(
 		goto Exit;
 	}
 
-	deviceContext = DeviceGetContext(WdfIoQueueGetDevice(Queue));
-
 	pipe = deviceContext->BulkReadPipe;
 
 	status = WdfRequestRetrieveOutputMemory(Request, &reqMemory); //Retrive a handle to the framework memory object from the IO request
@@ -0,0 +1,471 @@
+/*++
+
+Module Name:
+
+    stream.cpp
+
+Abstract:
+
+    This file contains the streaming mode: the continuous reader that
+    feeds the buffer ring and the read path that drains it. The ring
+    itself is in streamring.cpp.
+
+Environment:
+
+    User-mode Driver Framework 2
+
+--*/
+
+#include "driver.h"
+#include "stream.tmh"
+
+static VOID
+StreamServiceReads(
+	_In_ PDEVICE_CONTEXT DeviceContext
+	);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+StreamReadConfiguration(
+	_In_ WDFDEVICE Device
+	)
+/*++
+
+Routine Description:
+
+	Reads the streaming settings from the device's registry key and, if
+	streaming is turned on, creates the lock and the queue that holds
+	reads waiting for data. The ring itself is allocated once the pipe
+	is known, in StreamConfigureReader.
+
+Arguments:
+
+	Device - Handle to a framework device
+
+Return Value:
+
+	NT status value
+
+--*/
+{
+	NTSTATUS status;
+	PDEVICE_CONTEXT pDeviceContext;
+	WDFKEY key;
+	ULONG value;
+	WDF_IO_QUEUE_CONFIG queueConfig;
+	DECLARE_CONST_UNICODE_STRING(enableName, STREAM_REGISTRY_ENABLE);
+	DECLARE_CONST_UNICODE_STRING(urbCountName, STREAM_REGISTRY_URB_COUNT);
+	DECLARE_CONST_UNICODE_STRING(bufferCountName, STREAM_REGISTRY_BUFFER_COUNT);
+
+	pDeviceContext = DeviceGetContext(Device);
+
+	pDeviceContext->StreamingEnabled = FALSE;
+	pDeviceContext->StreamUrbCount = STREAM_DEFAULT_URB_COUNT;
+	pDeviceContext->StreamBufferCount = STREAM_DEFAULT_BUFFER_COUNT;
+
+	status = WdfDeviceOpenRegistryKey(Device,
+		PLUGPLAY_REGKEY_DEVICE,
+		KEY_READ,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&key);
+	if (!NT_SUCCESS(status)) {
+		//
+		// No key, no streaming
+		//
+		return STATUS_SUCCESS;
+	}
+
+	if (NT_SUCCESS(WdfRegistryQueryULong(key, &enableName, &value))) {
+		pDeviceContext->StreamingEnabled = (value != 0);
+	}
+
+	if (NT_SUCCESS(WdfRegistryQueryULong(key, &urbCountName, &value)) &&
+		value >= 1 && value <= STREAM_MAX_URB_COUNT) {
+		pDeviceContext->StreamUrbCount = value;
+	}
+
+	//
+	// The ring needs at least one buffer more than the transfers in
+	// flight or a burst of completions overwrites itself
+	//
+	if (NT_SUCCESS(WdfRegistryQueryULong(key, &bufferCountName, &value)) &&
+		value <= STREAM_MAX_BUFFER_COUNT) {
+		pDeviceContext->StreamBufferCount = value;
+	}
+	if (pDeviceContext->StreamBufferCount <= pDeviceContext->StreamUrbCount) {
+		pDeviceContext->StreamBufferCount = pDeviceContext->StreamUrbCount + 1;
+	}
+
+	WdfRegistryClose(key);
+
+	if (!pDeviceContext->StreamingEnabled) {
+		return STATUS_SUCCESS;
+	}
+
+	TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_DEVICE,
+		"Streaming mode, %d transfers in flight, %d buffers\n",
+		(int)pDeviceContext->StreamUrbCount, (int)pDeviceContext->StreamBufferCount);
+
+	status = WdfSpinLockCreate(WDF_NO_OBJECT_ATTRIBUTES, &pDeviceContext->StreamLock);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+			"WdfSpinLockCreate failed %!STATUS!\n", status);
+		return status;
+	}
+
+	WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
+
+	status = WdfIoQueueCreate(Device,
+		&queueConfig,
+		WDF_NO_OBJECT_ATTRIBUTES,
+		&pDeviceContext->StreamReadQueue);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+			"WdfIoQueueCreate for stream reads failed %!STATUS!\n", status);
+		return status;
+	}
+
+	return status;
+}
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+StreamConfigureReader(
+	_In_ WDFDEVICE Device
+	)
+/*++
+
+Routine Description:
+
+	Allocates the ring the first time through and puts a continuous
+	reader on the bulk-in pipe. Called from PrepareHardware after the
+	pipes have been selected, the pipe handles change on every restart.
+
+Arguments:
+
+	Device - Handle to a framework device
+
+Return Value:
+
+	NT status value
+
+--*/
+{
+	NTSTATUS status;
+	PDEVICE_CONTEXT pDeviceContext;
+	WDF_USB_PIPE_INFORMATION pipeInfo;
+	WDF_USB_CONTINUOUS_READER_CONFIG readerConfig;
+	WDF_OBJECT_ATTRIBUTES attributes;
+	WDFMEMORY storageMemory;
+	WDFMEMORY lengthsMemory;
+	PVOID storage;
+	PVOID lengths;
+	ULONG bufferSize;
+
+	pDeviceContext = DeviceGetContext(Device);
+
+	if (pDeviceContext->StreamRing.Storage == NULL) {
+		//
+		// Transfers must be a whole number of packets
+		//
+		WDF_USB_PIPE_INFORMATION_INIT(&pipeInfo);
+		WdfUsbTargetPipeGetInformation(pDeviceContext->BulkReadPipe, &pipeInfo);
+
+		bufferSize = TEST_BOARD_TRANSFER_BUFFER_SIZE;
+		if (pipeInfo.MaximumPacketSize != 0) {
+			bufferSize -= bufferSize % pipeInfo.MaximumPacketSize;
+		}
+
+		WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+		attributes.ParentObject = Device;
+
+		status = WdfMemoryCreate(&attributes,
+			NonPagedPool,
+			0,
+			(SIZE_T)bufferSize * pDeviceContext->StreamBufferCount,
+			&storageMemory,
+			&storage);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+				"WdfMemoryCreate for the stream ring failed %!STATUS!\n", status);
+			return status;
+		}
+
+		status = WdfMemoryCreate(&attributes,
+			NonPagedPool,
+			0,
+			sizeof(ULONG) * pDeviceContext->StreamBufferCount,
+			&lengthsMemory,
+			&lengths);
+		if (!NT_SUCCESS(status)) {
+			TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+				"WdfMemoryCreate for the stream lengths failed %!STATUS!\n", status);
+			return status;
+		}
+
+		StreamRingInitialize(&pDeviceContext->StreamRing,
+			(PUCHAR)storage,
+			(PULONG)lengths,
+			bufferSize,
+			pDeviceContext->StreamBufferCount);
+	}
+
+	WDF_USB_CONTINUOUS_READER_CONFIG_INIT(&readerConfig,
+		StreamEvtReadComplete,
+		Device,
+		pDeviceContext->StreamRing.BufferSize);
+
+	readerConfig.NumPendingReads = pDeviceContext->StreamUrbCount;
+	readerConfig.EvtUsbTargetPipeReadersFailed = StreamEvtReadersFailed;
+
+	status = WdfUsbTargetPipeConfigContinuousReader(pDeviceContext->BulkReadPipe, &readerConfig);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_ERROR, TRACE_DEVICE,
+			"WdfUsbTargetPipeConfigContinuousReader failed %!STATUS!\n", status);
+		return status;
+	}
+
+	return status;
+}
+
+NTSTATUS
+USBUMDF2Driver2EvtDeviceD0Entry(
+	_In_ WDFDEVICE Device,
+	_In_ WDF_POWER_DEVICE_STATE PreviousState
+	)
+/*++
+
+Routine Description:
+
+	The continuous reader only runs while its pipe's I/O target is
+	started, and the driver has to start it itself.
+
+--*/
+{
+	PDEVICE_CONTEXT pDeviceContext = DeviceGetContext(Device);
+
+	UNREFERENCED_PARAMETER(PreviousState);
+
+	if (!pDeviceContext->StreamingEnabled) {
+		return STATUS_SUCCESS;
+	}
+
+	return WdfIoTargetStart(WdfUsbTargetPipeGetIoTarget(pDeviceContext->BulkReadPipe));
+}
+
+NTSTATUS
+USBUMDF2Driver2EvtDeviceD0Exit(
+	_In_ WDFDEVICE Device,
+	_In_ WDF_POWER_DEVICE_STATE TargetState
+	)
+{
+	PDEVICE_CONTEXT pDeviceContext = DeviceGetContext(Device);
+
+	UNREFERENCED_PARAMETER(TargetState);
+
+	if (pDeviceContext->StreamingEnabled) {
+		WdfIoTargetStop(WdfUsbTargetPipeGetIoTarget(pDeviceContext->BulkReadPipe),
+			WdfIoTargetCancelSentIo);
+	}
+
+	return STATUS_SUCCESS;
+}
+
+VOID
+StreamEvtReadComplete(
+	_In_ WDFUSBPIPE Pipe,
+	_In_ WDFMEMORY Buffer,
+	_In_ size_t NumBytesTransferred,
+	_In_ WDFCONTEXT Context
+	)
+/*++
+
+Routine Description:
+
+	Called for every bulk-in transfer the continuous reader completes.
+	The framework resubmits the transfer as soon as this returns, so the
+	data is copied out right away.
+
+--*/
+{
+	PDEVICE_CONTEXT pDeviceContext = DeviceGetContext((WDFDEVICE)Context);
+	PUCHAR data;
+
+	UNREFERENCED_PARAMETER(Pipe);
+
+	data = (PUCHAR)WdfMemoryGetBuffer(Buffer, NULL);
+
+	WdfSpinLockAcquire(pDeviceContext->StreamLock);
+	StreamRingPut(&pDeviceContext->StreamRing, data, (ULONG)NumBytesTransferred);
+	WdfSpinLockRelease(pDeviceContext->StreamLock);
+
+	StreamServiceReads(pDeviceContext);
+}
+
+BOOLEAN
+StreamEvtReadersFailed(
+	_In_ WDFUSBPIPE Pipe,
+	_In_ NTSTATUS Status,
+	_In_ USBD_STATUS UsbdStatus
+	)
+{
+	PDEVICE_CONTEXT pDeviceContext;
+
+	pDeviceContext = DeviceGetContext(WdfIoTargetGetDevice(WdfUsbTargetPipeGetIoTarget(Pipe)));
+
+	TraceEvents(TRACE_LEVEL_ERROR, TRACE_QUEUE,
+		"Stream read failed - request status 0x%x UsbdStatus 0x%x\n",
+		Status, UsbdStatus);
+
+	WdfSpinLockAcquire(pDeviceContext->StreamLock);
+	pDeviceContext->StreamRing.Statistics.ReadErrors++;
+	WdfSpinLockRelease(pDeviceContext->StreamLock);
+
+	//
+	// Let the framework reset the pipe and restart the reader
+	//
+	return TRUE;
+}
+
+VOID
+StreamRead(
+	_In_ WDFDEVICE Device,
+	_In_ WDFREQUEST Request,
+	_In_ size_t Length
+	)
+/*++
+
+Routine Description:
+
+	Satisfies a read from the ring. If the ring is empty the request
+	waits until the next transfer completes. Reads are not limited to
+	the transfer size, a large read collects several buffers at once.
+
+--*/
+{
+	PDEVICE_CONTEXT pDeviceContext = DeviceGetContext(Device);
+	NTSTATUS status;
+	PVOID buffer;
+	SIZE_T bytesRead;
+
+	if (Length == 0) {
+		WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, 0);
+		return;
+	}
+
+	status = WdfRequestRetrieveOutputBuffer(Request, 1, &buffer, NULL);
+	if (!NT_SUCCESS(status)) {
+		TraceEvents(TRACE_LEVEL_INFORMATION, TRACE_QUEUE,
+			"WdfRequestRetrieveOutputBuffer failed %!STATUS!\n", status);
+		WdfRequestComplete(Request, status);
+		return;
+	}
+
+	WdfSpinLockAcquire(pDeviceContext->StreamLock);
+	bytesRead = StreamRingGet(&pDeviceContext->StreamRing, (PUCHAR)buffer, Length);
+	if (bytesRead == 0) {
+		pDeviceContext->StreamRing.Statistics.Underruns++;
+	}
+	WdfSpinLockRelease(pDeviceContext->StreamLock);
+
+	if (bytesRead != 0) {
+		WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, bytesRead);
+		return;
+	}
+
+	status = WdfRequestForwardToIoQueue(Request, pDeviceContext->StreamReadQueue);
+	if (!NT_SUCCESS(status)) {
+		WdfRequestComplete(Request, status);
+		return;
+	}
+
+	//
+	// A transfer may have completed before the request was queued
+	//
+	StreamServiceReads(pDeviceContext);
+}
+
+static VOID
+StreamServiceReads(
+	_In_ PDEVICE_CONTEXT DeviceContext
+	)
+{
+	NTSTATUS status;
+	WDFREQUEST request;
+	PVOID buffer;
+	size_t length;
+	SIZE_T bytesRead;
+	ULONG queued;
+
+	for (;;) {
+		WdfSpinLockAcquire(DeviceContext->StreamLock);
+		queued = DeviceContext->StreamRing.Queued;
+		WdfSpinLockRelease(DeviceContext->StreamLock);
+
+		if (queued == 0) {
+			break;
+		}
+
+		status = WdfIoQueueRetrieveNextRequest(DeviceContext->StreamReadQueue, &request);
+		if (!NT_SUCCESS(status)) {
+			break;
+		}
+
+		status = WdfRequestRetrieveOutputBuffer(request, 1, &buffer, &length);
+		if (!NT_SUCCESS(status)) {
+			WdfRequestComplete(request, status);
+			continue;
+		}
+
+		WdfSpinLockAcquire(DeviceContext->StreamLock);
+		bytesRead = StreamRingGet(&DeviceContext->StreamRing, (PUCHAR)buffer, length);
+		WdfSpinLockRelease(DeviceContext->StreamLock);
+
+		if (bytesRead == 0) {
+			//
+			// Someone else got the data first, the loop checks again in
+			// case more arrived meanwhile
+			//
+			WdfRequestRequeue(request);
+			continue;
+		}
+
+		WdfRequestCompleteWithInformation(request, STATUS_SUCCESS, bytesRead);
+	}
+}
+
+VOID
+StreamGetStatistics(
+	_In_ WDFDEVICE Device,
+	_In_ WDFREQUEST Request
+	)
+{
+	PDEVICE_CONTEXT pDeviceContext = DeviceGetContext(Device);
+	PUSBUMDF2DRIVER2_STREAM_STATISTICS statistics;
+	NTSTATUS status;
+
+	if (!pDeviceContext->StreamingEnabled) {
+		WdfRequestComplete(Request, STATUS_INVALID_DEVICE_REQUEST);
+		return;
+	}
+
+	status = WdfRequestRetrieveOutputBuffer(Request,
+		sizeof(*statistics),
+		(PVOID *)&statistics,
+		NULL);
+	if (!NT_SUCCESS(status)) {
+		WdfRequestComplete(Request, status);
+		return;
+	}
+
+	WdfSpinLockAcquire(pDeviceContext->StreamLock);
+	*statistics = pDeviceContext->StreamRing.Statistics;
+	statistics->BuffersQueued = pDeviceContext->StreamRing.Queued;
+	WdfSpinLockRelease(pDeviceContext->StreamLock);
+
+	statistics->BufferCount = pDeviceContext->StreamRing.BufferCount;
+	statistics->BufferSize = pDeviceContext->StreamRing.BufferSize;
+	statistics->UrbCount = pDeviceContext->StreamUrbCount;
+
+	WdfRequestCompleteWithInformation(Request, STATUS_SUCCESS, sizeof(*statistics));
+}
@@ -0,0 +1,109 @@
+/*++
+
+Module Name:
+
+    stream.h
+
+Abstract:
+
+    This file contains the streaming mode definitions.
+
+    In streaming mode the bulk-in pipe runs a continuous reader, so a
+    fixed number of transfers are always in flight. Each completed
+    transfer is copied into the next buffer of a ring and ReadFile is
+    satisfied from the ring. When the ring is full the oldest buffer is
+    overwritten, a camera only cares about the newest data.
+
+Environment:
+
+    User-mode Driver Framework 2
+
+--*/
+
+EXTERN_C_START
+
+//
+// Registry values under the device key
+//
+#define STREAM_REGISTRY_ENABLE          L"StreamingMode"
+#define STREAM_REGISTRY_URB_COUNT       L"StreamUrbCount"
+#define STREAM_REGISTRY_BUFFER_COUNT    L"StreamBufferCount"
+
+#define STREAM_DEFAULT_URB_COUNT        4
+#define STREAM_MAX_URB_COUNT            16
+#define STREAM_DEFAULT_BUFFER_COUNT     32
+#define STREAM_MAX_BUFFER_COUNT         256
+
+//
+// Ring of equally sized buffers, one per completed transfer. Not
+// synchronized, the caller holds the stream lock.
+//
+typedef struct _STREAM_RING {
+	PUCHAR    Storage;      // BufferCount * BufferSize bytes
+	PULONG    Lengths;      // valid bytes in each buffer
+	ULONG     BufferSize;
+	ULONG     BufferCount;
+	ULONG     Head;         // next buffer to fill
+	ULONG     Tail;         // oldest buffer holding data
+	ULONG     Queued;       // buffers holding data
+	ULONG     Offset;       // bytes of the tail buffer already read
+	USBUMDF2DRIVER2_STREAM_STATISTICS Statistics;
+} STREAM_RING, *PSTREAM_RING;
+
+VOID
+StreamRingInitialize(
+	_Out_ PSTREAM_RING Ring,
+	_In_ PUCHAR Storage,
+	_In_ PULONG Lengths,
+	_In_ ULONG BufferSize,
+	_In_ ULONG BufferCount
+	);
+
+VOID
+StreamRingPut(
+	_Inout_ PSTREAM_RING Ring,
+	_In_reads_bytes_(Length) const UCHAR *Data,
+	_In_ ULONG Length
+	);
+
+SIZE_T
+StreamRingGet(
+	_Inout_ PSTREAM_RING Ring,
+	_Out_writes_bytes_to_(Length, return) PUCHAR Buffer,
+	_In_ SIZE_T Length
+	);
+
+//
+// Driver side of streaming mode
+//
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+StreamReadConfiguration(
+	_In_ WDFDEVICE Device
+	);
+
+_IRQL_requires_(PASSIVE_LEVEL)
+NTSTATUS
+StreamConfigureReader(
+	_In_ WDFDEVICE Device
+	);
+
+VOID
+StreamRead(
+	_In_ WDFDEVICE Device,
+	_In_ WDFREQUEST Request,
+	_In_ size_t Length
+	);
+
+VOID
+StreamGetStatistics(
+	_In_ WDFDEVICE Device,
+	_In_ WDFREQUEST Request
+	);
+
+EVT_WDF_DEVICE_D0_ENTRY USBUMDF2Driver2EvtDeviceD0Entry;
+EVT_WDF_DEVICE_D0_EXIT USBUMDF2Driver2EvtDeviceD0Exit;
+EVT_WDF_USB_READER_COMPLETION_ROUTINE StreamEvtReadComplete;
+EVT_WDF_USB_READERS_FAILED StreamEvtReadersFailed;
+
+EXTERN_C_END
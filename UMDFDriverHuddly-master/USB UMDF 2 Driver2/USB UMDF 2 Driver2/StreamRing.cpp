@@ -0,0 +1,122 @@
+/*++
+
+Module Name:
+
+    streamring.cpp
+
+Abstract:
+
+    This file contains the streaming mode buffer ring. It makes no
+    framework calls and takes no lock, the caller holds the stream lock,
+    so it also builds on a host for test/StreamRingTest.cpp.
+
+Environment:
+
+    User-mode Driver Framework 2
+
+--*/
+
+#include "driver.h"
+
+VOID
+StreamRingInitialize(
+	_Out_ PSTREAM_RING Ring,
+	_In_ PUCHAR Storage,
+	_In_ PULONG Lengths,
+	_In_ ULONG BufferSize,
+	_In_ ULONG BufferCount
+	)
+{
+	RtlZeroMemory(Ring, sizeof(*Ring));
+
+	Ring->Storage = Storage;
+	Ring->Lengths = Lengths;
+	Ring->BufferSize = BufferSize;
+	Ring->BufferCount = BufferCount;
+}
+
+VOID
+StreamRingPut(
+	_Inout_ PSTREAM_RING Ring,
+	_In_reads_bytes_(Length) const UCHAR *Data,
+	_In_ ULONG Length
+	)
+/*++
+
+Routine Description:
+
+	Copies one completed transfer into the next buffer. If every buffer
+	is full the oldest one is dropped to make room.
+
+--*/
+{
+	Ring->Statistics.Transfers++;
+
+	if (Length == EMPTY_PACKAGE) {
+		return;
+	}
+
+	if (Length > Ring->BufferSize) {
+		Length = Ring->BufferSize;
+	}
+
+	if (Ring->Queued == Ring->BufferCount) {
+		Ring->Statistics.Overruns++;
+		Ring->Statistics.BytesDropped += Ring->Lengths[Ring->Tail] - Ring->Offset;
+
+		Ring->Tail = (Ring->Tail + 1) % Ring->BufferCount;
+		Ring->Queued--;
+		Ring->Offset = 0;
+	}
+
+	RtlCopyMemory(Ring->Storage + (SIZE_T)Ring->Head * Ring->BufferSize, Data, Length);
+	Ring->Lengths[Ring->Head] = Length;
+
+	Ring->Head = (Ring->Head + 1) % Ring->BufferCount;
+	Ring->Queued++;
+	Ring->Statistics.BytesReceived += Length;
+}
+
+SIZE_T
+StreamRingGet(
+	_Inout_ PSTREAM_RING Ring,
+	_Out_writes_bytes_to_(Length, return) PUCHAR Buffer,
+	_In_ SIZE_T Length
+	)
+/*++
+
+Routine Description:
+
+	Copies up to Length bytes out of the ring, oldest first. A read can
+	span several buffers and can stop in the middle of one, the rest of
+	that buffer goes to the next read.
+
+--*/
+{
+	SIZE_T copied = 0;
+	SIZE_T bytes;
+
+	while (copied < Length && Ring->Queued != 0) {
+		bytes = Ring->Lengths[Ring->Tail] - Ring->Offset;
+		if (bytes > Length - copied) {
+			bytes = Length - copied;
+		}
+
+		RtlCopyMemory(Buffer + copied,
+			Ring->Storage + (SIZE_T)Ring->Tail * Ring->BufferSize + Ring->Offset,
+			bytes);
+
+		copied += bytes;
+		Ring->Offset += (ULONG)bytes;
+
+		if (Ring->Offset == Ring->Lengths[Ring->Tail]) {
+			Ring->Tail = (Ring->Tail + 1) % Ring->BufferCount;
+			Ring->Queued--;
+			Ring->Offset = 0;
+		}
+	}
+
+	Ring->Statistics.BytesRead += copied;
+
+	return copied;
+}
@@ -0,0 +1,329 @@
+/*++
+
+Module Name:
+
+    StreamRingTest.cpp
+
+Abstract:
+
+    Host test for the streaming mode buffer ring. The first part checks
+    partial reads, reads spanning buffers, overruns over a partly read
+    buffer, zero length packets and oversized transfers one by one.
+
+    The second part runs the ring against a simulated bulk-in endpoint
+    with a configurable bandwidth. The endpoint cuts camera frames into
+    transfers the way a continuous reader sees them, and a reader drains
+    the ring at its own pace. Every 8 bytes of a transfer hold its
+    sequence number and word index, so the reader can check that data
+    comes out in order, is never repeated and only skips forward where
+    the ring dropped it. The byte counters must add up at the end.
+
+    Builds with the stub driver.h in this directory:
+
+        c++ -O2 -Wall -Wextra -I test test/StreamRingTest.cpp StreamRing.cpp -o StreamRingTest
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include "driver.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int failures;
+
+static VOID
+Check(
+	_In_ const char *Name,
+	_In_ ULONGLONG Actual,
+	_In_ ULONGLONG Expected
+	)
+{
+	if (Actual != Expected) {
+		failures++;
+		printf("FAIL %s: got %llu, expected %llu\n", Name,
+			(unsigned long long)Actual, (unsigned long long)Expected);
+	}
+}
+
+static VOID
+Fill(
+	_Out_ PUCHAR Data,
+	_In_ ULONG Length,
+	_In_ UCHAR Value
+	)
+{
+	memset(Data, Value, Length);
+}
+
+static VOID
+TestPartialReads(
+	VOID
+	)
+{
+	UCHAR storage[4 * 256];
+	ULONG lengths[4];
+	UCHAR data[512];
+	UCHAR out[1024];
+	STREAM_RING ring;
+	SIZE_T bytes;
+
+	StreamRingInitialize(&ring, storage, lengths, 256, 4);
+
+	// A read shorter than the buffer leaves the rest for the next one
+	Fill(data, 100, 'A');
+	StreamRingPut(&ring, data, 100);
+	Fill(data, 200, 'B');
+	StreamRingPut(&ring, data, 200);
+
+	bytes = StreamRingGet(&ring, out, 30);
+	Check("partial read length", bytes, 30);
+	Check("partial read data", out[29], 'A');
+	Check("partial read queued", ring.Queued, 2);
+	Check("partial read offset", ring.Offset, 30);
+
+	// The next read finishes that buffer and goes on into the next
+	bytes = StreamRingGet(&ring, out, 150);
+	Check("spanning read length", bytes, 150);
+	Check("spanning read end of A", out[69], 'A');
+	Check("spanning read start of B", out[70], 'B');
+	Check("spanning read queued", ring.Queued, 1);
+	Check("spanning read offset", ring.Offset, 80);
+
+	// A large read takes what there is
+	bytes = StreamRingGet(&ring, out, sizeof(out));
+	Check("draining read length", bytes, 120);
+	Check("draining read queued", ring.Queued, 0);
+
+	// An empty ring gives nothing
+	bytes = StreamRingGet(&ring, out, sizeof(out));
+	Check("underrun read length", bytes, 0);
+	Check("bytes received", ring.Statistics.BytesReceived, 300);
+	Check("bytes read", ring.Statistics.BytesRead, 300);
+}
+
+static VOID
+TestOverrun(
+	VOID
+	)
+{
+	UCHAR storage[2 * 256];
+	ULONG lengths[2];
+	UCHAR data[512];
+	UCHAR out[512];
+	STREAM_RING ring;
+	SIZE_T bytes;
+
+	StreamRingInitialize(&ring, storage, lengths, 256, 2);
+
+	Fill(data, 100, 'A');
+	StreamRingPut(&ring, data, 100);
+	Fill(data, 100, 'B');
+	StreamRingPut(&ring, data, 100);
+	StreamRingGet(&ring, out, 30);
+
+	// The ring is full: the oldest buffer goes, only its unread part
+	// counts as dropped
+	Fill(data, 100, 'C');
+	StreamRingPut(&ring, data, 100);
+	Check("overruns", ring.Statistics.Overruns, 1);
+	Check("bytes dropped", ring.Statistics.BytesDropped, 70);
+
+	bytes = StreamRingGet(&ring, out, sizeof(out));
+	Check("after overrun length", bytes, 200);
+	Check("after overrun first", out[0], 'B');
+	Check("after overrun last", out[199], 'C');
+
+	// A zero length packet is a transfer but no data
+	StreamRingPut(&ring, data, EMPTY_PACKAGE);
+	Check("empty package transfers", ring.Statistics.Transfers, 4);
+	Check("empty package queued", ring.Queued, 0);
+
+	// A transfer can't be bigger than a buffer
+	Fill(data, 512, 'D');
+	StreamRingPut(&ring, data, 512);
+	Check("oversized queued length", ring.Lengths[(ring.Head + 1) % 2], 256);
+	bytes = StreamRingGet(&ring, out, sizeof(out));
+	Check("oversized read", bytes, 256);
+}
+
+//
+// Bandwidth simulation
+//
+typedef struct _SIM_CONFIG {
+	const char *Name;
+	ULONG     BytesPerMs;           // endpoint bandwidth
+	ULONG     FrameBytes;           // camera frame, ends with a short transfer
+	ULONG     BufferSize;           // transfer and ring buffer size
+	ULONG     BufferCount;
+	ULONG     ReadLength;           // ReadFile size, a multiple of 8
+	ULONG     ReadIntervalUs;
+	BOOLEAN   ExpectOverruns;
+	BOOLEAN   ExpectUnderruns;
+} SIM_CONFIG;
+
+#define SIM_TICK_US     50
+#define SIM_RUN_US      2000000
+
+typedef struct _SIM_READER {
+	ULONG     Sequence;             // transfer the last word came from
+	ULONG     Word;                 // its index within the transfer
+	BOOLEAN   Started;
+	ULONG     Skips;                // places where data went missing
+	ULONG     Errors;
+} SIM_READER;
+
+static VOID
+SimCheckRead(
+	_Inout_ SIM_READER *Reader,
+	_In_reads_bytes_(Length) const UCHAR *Data,
+	_In_ SIZE_T Length
+	)
+{
+	for (SIZE_T i = 0; i + 8 <= Length; i += 8) {
+		ULONG sequence;
+		ULONG word;
+
+		memcpy(&sequence, Data + i, 4);
+		memcpy(&word, Data + i + 4, 4);
+
+		if (!Reader->Started) {
+			Reader->Started = TRUE;
+		} else if (sequence == Reader->Sequence && word == Reader->Word + 1) {
+			// next word of the same transfer
+		} else if (sequence > Reader->Sequence && word == 0) {
+			// the next transfer, or a later one after an overrun
+			if (sequence != Reader->Sequence + 1) {
+				Reader->Skips++;
+			}
+		} else {
+			Reader->Errors++;
+		}
+
+		Reader->Sequence = sequence;
+		Reader->Word = word;
+	}
+}
+
+static VOID
+SimRun(
+	_In_ const SIM_CONFIG *Config
+	)
+{
+	PUCHAR storage = (PUCHAR)malloc((SIZE_T)Config->BufferSize * Config->BufferCount);
+	PULONG lengths = (PULONG)malloc(sizeof(ULONG) * Config->BufferCount);
+	PUCHAR transfer = (PUCHAR)malloc(Config->BufferSize);
+	PUCHAR readBuffer = (PUCHAR)malloc(Config->ReadLength);
+	STREAM_RING ring;
+	SIM_READER reader = {};
+	ULONGLONG produced = 0;         // bytes the endpoint has sent, in 1/1000 of a byte
+	ULONG sequence = 0;
+	ULONG fill = 0;                 // bytes in the transfer being filled
+	ULONG frameLeft = Config->FrameBytes;
+	ULONG nextReadUs = Config->ReadIntervalUs;
+	ULONG reads = 0;
+	ULONG underruns = 0;
+	ULONGLONG queuedBytes = 0;
+
+	StreamRingInitialize(&ring, storage, lengths, Config->BufferSize, Config->BufferCount);
+
+	for (ULONG now = 0; now < SIM_RUN_US; now += SIM_TICK_US) {
+		//
+		// Endpoint: what the bandwidth allows this tick, in 8 byte words.
+		// A transfer completes when it is full or the frame ends, and a
+		// frame that ends on a transfer boundary sends a zero length packet.
+		//
+		produced += (ULONGLONG)Config->BytesPerMs * SIM_TICK_US;
+		while (produced >= 8 * 1000) {
+			ULONG word = fill / 8;
+
+			memcpy(transfer + fill, &sequence, 4);
+			memcpy(transfer + fill + 4, &word, 4);
+			fill += 8;
+			frameLeft -= 8;
+			produced -= 8 * 1000;
+
+			if (fill == Config->BufferSize || frameLeft == 0) {
+				StreamRingPut(&ring, transfer, fill);
+				sequence++;
+				if (frameLeft == 0 && fill == Config->BufferSize) {
+					StreamRingPut(&ring, transfer, EMPTY_PACKAGE);
+				}
+				fill = 0;
+			}
+			if (frameLeft == 0) {
+				frameLeft = Config->FrameBytes;
+			}
+		}
+
+		//
+		// Reader
+		//
+		if (now >= nextReadUs) {
+			SIZE_T bytes = StreamRingGet(&ring, readBuffer, Config->ReadLength);
+
+			if (bytes == 0) {
+				underruns++;
+			}
+			SimCheckRead(&reader, readBuffer, bytes);
+			reads++;
+			nextReadUs = now + Config->ReadIntervalUs;
+		}
+	}
+
+	for (ULONG b = 0, i = ring.Tail; b < ring.Queued; b++, i = (i + 1) % ring.BufferCount) {
+		queuedBytes += ring.Lengths[i];
+	}
+	queuedBytes -= ring.Offset;
+
+	printf("%-28s %6.1f MB/s in, %6.1f MB/s out, %5u overruns (%8llu bytes), %5u of %u reads empty\n",
+		Config->Name,
+		ring.Statistics.BytesReceived / (SIM_RUN_US / 1e6) / 1e6,
+		ring.Statistics.BytesRead / (SIM_RUN_US / 1e6) / 1e6,
+		ring.Statistics.Overruns,
+		(unsigned long long)ring.Statistics.BytesDropped,
+		underruns, reads);
+
+	Check("stream order", reader.Errors, 0);
+	Check("bytes add up", ring.Statistics.BytesReceived,
+		ring.Statistics.BytesRead + ring.Statistics.BytesDropped + queuedBytes);
+	Check("skips match overruns", reader.Skips <= ring.Statistics.Overruns, TRUE);
+	Check("overruns", ring.Statistics.Overruns != 0, Config->ExpectOverruns);
+	Check("underruns", underruns != 0, Config->ExpectUnderruns);
+
+	free(readBuffer);
+	free(transfer);
+	free(lengths);
+	free(storage);
+}
+
+int
+main(
+	VOID
+	)
+{
+	static const SIM_CONFIG configs[] = {
+		// Name                      Bandwidth  Frame    Buffer  Count  Read     Every  Overruns Underruns
+		{ "reader keeps up",         32768,     200000,  16384,  8,     65536,   250,   FALSE,   TRUE  },
+		{ "slow reader",             32768,     200000,  16384,  8,     8192,    1000,  TRUE,    FALSE },
+		{ "partial reads",           20000,     65536,   16384,  32,    3000,    150,   FALSE,   TRUE  },
+		{ "bursty reader, few bufs", 40000,     131072,  4096,   5,     262144,  20000, TRUE,    FALSE },
+	};
+
+	TestPartialReads();
+	TestOverrun();
+
+	for (ULONG i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+		SimRun(&configs[i]);
+	}
+
+	if (failures != 0) {
+		return 1;
+	}
+
+	printf("Stream ring test passed\n");
+	return 0;
+}
@@ -0,0 +1,63 @@
+/*++
+
+Module Name:
+
+    driver.h
+
+Abstract:
+
+    Stand-in for the driver definitions, with just what streamring.cpp
+    and stream.h need, so the ring builds on a host without the WDK.
+    The sources include "driver.h" while the real file is Driver.h, so
+    on a case-sensitive host -I test picks this one up.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef void VOID, *PVOID;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN;
+typedef uint32_t ULONG, *PULONG;
+typedef uint64_t ULONGLONG;
+typedef size_t SIZE_T;
+typedef int32_t NTSTATUS;
+
+#define TRUE 1
+#define FALSE 0
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Out_writes_bytes_to_(size, count)
+#define _IRQL_requires_(irql)
+
+#define EXTERN_C_START extern "C" {
+#define EXTERN_C_END }
+
+#define RtlZeroMemory(Destination, Length) memset((Destination), 0, (Length))
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+//
+// Framework handles and callback types stream.h declares, never used here
+//
+typedef struct WDFDEVICE__ *WDFDEVICE;
+typedef struct WDFREQUEST__ *WDFREQUEST;
+typedef NTSTATUS EVT_WDF_DEVICE_D0_ENTRY(void);
+typedef NTSTATUS EVT_WDF_DEVICE_D0_EXIT(void);
+typedef VOID EVT_WDF_USB_READER_COMPLETION_ROUTINE(void);
+typedef UCHAR EVT_WDF_USB_READERS_FAILED(void);
+
+#include "../Public.h"
+#include "../Stream.h"
+
+#define TEST_BOARD_TRANSFER_BUFFER_SIZE (64*1024)
+#define EMPTY_PACKAGE (0)
@@ -15,6 +15,12 @@ Abstract:
 
     A simple test for bthecho sample.
 
+    Run without arguments the app echoes a fixed string until an echo
+    fails. Run with -b it measures echo round-trip latency percentiles
+    and throughput for a sweep of payload sizes:
+
+        bthecho -b [iterations] [max payload]
+
 Environment:
 
     user mode only
@@ -34,6 +40,15 @@ Environment:
 char testData[] = "WDF Bluetooth Sample Echo";
 char replyData[sizeof(testData)];
 
+//
+// Benchmark defaults. Payloads sweep from BENCHMARK_MIN_PAYLOAD doubling
+// up to the max payload, which must not exceed the server's read buffer
+// size (256 bytes unless configured otherwise).
+//
+#define BENCHMARK_DEFAULT_ITERATIONS    1000
+#define BENCHMARK_MIN_PAYLOAD           16
+#define BENCHMARK_DEFAULT_MAX_PAYLOAD   256
+
 DWORD
 GetDevicePath(
     _In_ LPGUID InterfaceGuid,
@@ -45,14 +60,51 @@ DoEcho(
     HANDLE hDevice
     );
 
+BOOL
+DoBenchmark(
+    HANDLE hDevice,
+    ULONG Iterations,
+    ULONG MaxPayload
+    );
+
 VOID 
 __cdecl 
-wmain()
+wmain(
+    int argc,
+    _In_reads_(argc) wchar_t *argv[]
+    )
 {
     HANDLE hDevice = INVALID_HANDLE_VALUE;
     BOOL echo = TRUE;
+    BOOL benchmark = FALSE;
+    ULONG iterations = BENCHMARK_DEFAULT_ITERATIONS;
+    ULONG maxPayload = BENCHMARK_DEFAULT_MAX_PAYLOAD;
     LPWSTR devicePath = NULL;
-    DWORD err = GetDevicePath((LPGUID)&BTHECHOSAMPLE_DEVICE_INTERFACE, &devicePath);
+    DWORD err;
+
+    if (argc > 1) {
+        if (0 != _wcsicmp(argv[1], L"-b")) {
+            printf("Usage: bthecho [-b [iterations] [max payload]]\n");
+            exit(1);
+        }
+
+        benchmark = TRUE;
+
+        if (argc > 2) {
+            iterations = wcstoul(argv[2], NULL, 0);
+        }
+
+        if (argc > 3) {
+            maxPayload = wcstoul(argv[3], NULL, 0);
+        }
+
+        if (0 == iterations || maxPayload < BENCHMARK_MIN_PAYLOAD) {
+            printf("Invalid benchmark parameters\n");
+            exit(1);
+        }
+    }
+
+    err = GetDevicePath((LPGUID)&BTHECHOSAMPLE_DEVICE_INTERFACE, &devicePath);
 
     if (ERROR_SUCCESS != err) {
         printf("Failed to find the BTHECHO device\n");
@@ -75,9 +127,16 @@ wmain()
 
     printf("Opened device successfully\n");
 
-    while (echo)
+    if (benchmark)
     {
-        echo = DoEcho(hDevice);
+        (void) DoBenchmark(hDevice, iterations, maxPayload);
+    }
+    else
+    {
+        while (echo)
+        {
+            echo = DoEcho(hDevice);
+        }
     }
                 
     if (INVALID_HANDLE_VALUE != hDevice) {
@@ -144,6 +203,183 @@ exit:
     return retval;
 }
 
+int
+__cdecl
+CompareLatency(
+    const void *A,
+    const void *B
+    )
+{
+    LONGLONG a = *(const LONGLONG *)A;
+    LONGLONG b = *(const LONGLONG *)B;
+
+    return (a < b) ? -1 : ((a > b) ? 1 : 0);
+}
+
+double
+LatencyPercentileUs(
+    _In_reads_(Count) LONGLONG * SortedLatencies,
+    ULONG Count,
+    ULONG Percentile,
+    LONGLONG Frequency
+    )
+{
+    ULONG index = (ULONG)(((ULONGLONG)Count * Percentile + 99) / 100);
+
+    if (index > 0) {
+        index--;
+    }
+
+    return (double)SortedLatencies[index] * 1000000.0 / (double)Frequency;
+}
+
+BOOL
+BenchmarkPayload(
+    HANDLE hDevice,
+    ULONG Iterations,
+    ULONG Payload,
+    _Out_writes_(Payload) PUCHAR WriteBuffer,
+    _Out_writes_(Payload) PUCHAR ReadBuffer,
+    _Out_writes_(Iterations) LONGLONG * Latencies,
+    LONGLONG Frequency
+    )
+/*++
+
+Routine Description:
+
+    Echoes Iterations payloads of Payload bytes, one at a time, and prints
+    round-trip latency percentiles and echo throughput.
+
+--*/
+{
+    LARGE_INTEGER start, end, sweepStart, sweepEnd;
+    DWORD cbWritten, cbRead;
+    ULONG i;
+    double seconds;
+
+    QueryPerformanceCounter(&sweepStart);
+
+    for (i = 0; i < Iterations; i++)
+    {
+        //
+        // Vary the payload so a stale reply is detected
+        //
+        memset(WriteBuffer, (int)(i & 0xFF), Payload);
+
+        QueryPerformanceCounter(&start);
+
+        if (!WriteFile(hDevice, WriteBuffer, Payload, &cbWritten, NULL) ||
+            cbWritten != Payload)
+        {
+            printf("Write of %d bytes failed. Error: %d\n", Payload, GetLastError());
+            return FALSE;
+        }
+
+        if (!ReadFile(hDevice, ReadBuffer, Payload, &cbRead, NULL))
+        {
+            printf("Read of %d bytes failed. Error: %d\n", Payload, GetLastError());
+            return FALSE;
+        }
+
+        QueryPerformanceCounter(&end);
+
+        if (cbRead != Payload || 0 != memcmp(ReadBuffer, WriteBuffer, Payload))
+        {
+            printf("Echo mismatch at iteration %d for %d byte payload\n", i, Payload);
+            return FALSE;
+        }
+
+        Latencies[i] = end.QuadPart - start.QuadPart;
+    }
+
+    QueryPerformanceCounter(&sweepEnd);
+
+    qsort(Latencies, Iterations, sizeof(Latencies[0]), CompareLatency);
+
+    seconds = (double)(sweepEnd.QuadPart - sweepStart.QuadPart) / (double)Frequency;
+
+    printf("%8d %10.1f %10.1f %10.1f %10.1f %10.3f\n",
+           Payload,
+           LatencyPercentileUs(Latencies, Iterations, 50, Frequency),
+           LatencyPercentileUs(Latencies, Iterations, 90, Frequency),
+           LatencyPercentileUs(Latencies, Iterations, 99, Frequency),
+           LatencyPercentileUs(Latencies, Iterations, 100, Frequency),
+           ((double)Payload * Iterations) / (1024.0 * 1024.0) / seconds);
+
+    return TRUE;
+}
+
+BOOL
+DoBenchmark(
+    HANDLE hDevice,
+    ULONG Iterations,
+    ULONG MaxPayload
+    )
+/*++
+
+Routine Description:
+
+    Runs BenchmarkPayload for payloads from BENCHMARK_MIN_PAYLOAD doubling
+    up to MaxPayload (MaxPayload itself is always measured).
+
+--*/
+{
+    BOOL retval = FALSE;
+    LARGE_INTEGER frequency;
+    PUCHAR writeBuffer = NULL;
+    PUCHAR readBuffer = NULL;
+    LONGLONG * latencies = NULL;
+    ULONG payload;
+
+    QueryPerformanceFrequency(&frequency);
+
+    writeBuffer = (PUCHAR)malloc(MaxPayload);
+    readBuffer = (PUCHAR)malloc(MaxPayload);
+    latencies = (LONGLONG *)malloc(Iterations * sizeof(LONGLONG));
+
+    if (NULL == writeBuffer || NULL == readBuffer || NULL == latencies)
+    {
+        printf("Failed to allocate benchmark buffers\n");
+        goto exit;
+    }
+
+    printf("%d iterations per payload, round trip latency in us\n", Iterations);
+    printf("%8s %10s %10s %10s %10s %10s\n",
+           "bytes", "p50", "p90", "p99", "max", "MB/s");
+
+    payload = BENCHMARK_MIN_PAYLOAD;
+
+    for (;;)
+    {
+        if (!BenchmarkPayload(hDevice,
+                              Iterations,
+                              payload,
+                              writeBuffer,
+                              readBuffer,
+                              latencies,
+                              frequency.QuadPart))
+        {
+            goto exit;
+        }
+
+        if (payload == MaxPayload)
+        {
+            break;
+        }
+
+        payload = (payload > MaxPayload / 2) ? MaxPayload : payload * 2;
+    }
+
+    retval = TRUE;
+
+exit:
+    free(writeBuffer);
+    free(readBuffer);
+    free(latencies);
+
+    return retval;
+}
+
 DWORD
 GetDevicePath(
     _In_ LPGUID InterfaceGuid,
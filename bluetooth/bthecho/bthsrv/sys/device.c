@@ -38,6 +38,7 @@ Environment:
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text (PAGE, BthEchoSrvEvtDriverDeviceAdd)
 #pragma alloc_text (PAGE, BthEchoSrvEvtDeviceSelfManagedIoCleanup)
+#pragma alloc_text (PAGE, BthEchoSrvReadConfiguration)
 #endif
 
 NTSTATUS
@@ -115,6 +116,8 @@ Return Value:
         goto exit;       
     }
 
+    BthEchoSrvReadConfiguration(GetServerDeviceContext(device));
+
     //
     // Query for interfaces and pre-allocate BRBs
     //
@@ -134,6 +137,76 @@ exit:
     return status;
 }
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+BthEchoSrvReadConfiguration(
+    _In_ PBTHECHOSAMPLE_SERVER_CONTEXT DevCtx
+    )
+/*++
+Routine Description:
+
+    Reads the continuous reader configuration from the device's hardware
+    key. Values which are missing or out of range leave the defaults set
+    by BthEchoSampleServerContextInit in place.
+
+Arguments:
+
+    DevCtx - Server device context
+
+--*/
+{
+    NTSTATUS status;
+    WDFKEY key;
+    ULONG value;
+    DECLARE_CONST_UNICODE_STRING(readersValueName, BTHECHOSAMPLE_REG_CONTINUOUS_READERS);
+    DECLARE_CONST_UNICODE_STRING(bufferSizeValueName, BTHECHOSAMPLE_REG_READ_BUFFER_SIZE);
+
+    PAGED_CODE();
+
+    status = WdfDeviceOpenRegistryKey(
+        DevCtx->Header.Device,
+        PLUGPLAY_REGISTRY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_WARNING, DBG_PNP, 
+            "Opening device registry key failed, using defaults, Status code %!STATUS!\n", status);
+
+        goto exit;
+    }
+
+    status = WdfRegistryQueryULong(key, &readersValueName, &value);
+
+    if (NT_SUCCESS(status) && 
+        value > 0 && 
+        value <= BTHECHOSAMPLE_MAX_CONTINUOUS_READERS)
+    {
+        DevCtx->ContinuousReaderCount = value;
+    }
+
+    status = WdfRegistryQueryULong(key, &bufferSizeValueName, &value);
+
+    if (NT_SUCCESS(status) && 
+        value >= BthEchoSampleMaxDataLength && 
+        value <= BTHECHOSAMPLE_MAX_READ_BUFFER_SIZE)
+    {
+        DevCtx->ReadBufferSize = value;
+    }
+
+    WdfRegistryClose(key);
+
+exit:
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP, 
+        "Continuous readers per connection: %d, read buffer size: %d\n",
+        DevCtx->ContinuousReaderCount,
+        DevCtx->ReadBufferSize
+        );
+}
+
 NTSTATUS
 BthEchoSrvEvtDeviceSelfManagedIoInit(
     _In_ WDFDEVICE  Device
@@ -311,10 +384,11 @@ Return Value:
 }
 
 _IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
+BOOLEAN
 BthEchoSrvConnectionObjectContReaderReadCompletedCallback(
     _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
     _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader,
     _In_ PVOID Buffer,
     _In_ size_t BufferLength
     )
@@ -329,14 +403,21 @@ Arguments:
 
     DevCtxHdr - Device context
     Connection - Connection whose continous reader had read completion
+    RepeatReader - Repeat reader which owns Buffer
     Bufer - Buffer which received read
     SrcBufferLength - Length of read
 
+Return Value:
+
+    TRUE if the echo is sent directly from Buffer, in which case the
+    reader is resubmitted when the echo completes.
+
 --*/
 {
-    BthEchoSrvSendEcho(
+    return BthEchoSrvSendEcho(
         DevCtxHdr,
         Connection,
+        RepeatReader,
         Buffer,
         BufferLength
         );
@@ -391,15 +472,34 @@ Arguments:
 --*/
 {
     PBTHECHO_CONNECTION connection;
+    PBTHECHOSAMPLE_SERVER_CONTEXT devCtx;
     NTSTATUS status;
 
     connection = GetConnectionObjectContext(ConnectionObject);
+    devCtx = (PBTHECHOSAMPLE_SERVER_CONTEXT) connection->DevCtxHdr;
+
+    //
+    // Create echo pool before the readers so that it is available
+    // on first read completion
+    //
+    status = BthEchoSrvEchoPoolCreate(
+        connection->DevCtxHdr,
+        connection,
+        devCtx->ContinuousReaderCount,
+        devCtx->ReadBufferSize
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
 
     status = BthEchoConnectionObjectInitializeContinuousReader(
         connection,
         BthEchoSrvConnectionObjectContReaderReadCompletedCallback,
         BthEchoSrvConnectionObjectContReaderFailedCallback,
-        BthEchoSampleMaxDataLength
+        devCtx->ContinuousReaderCount,
+        devCtx->ReadBufferSize
         );
 
     if (!NT_SUCCESS(status))
@@ -1,5 +1,14 @@
 #include "clisrv.h" 
 
+//
+// Per connection continuous reader configuration, read from the device's
+// hardware key (ContinuousReaders, ReadBufferSize)
+//
+#define BTHECHOSAMPLE_REG_CONTINUOUS_READERS    L"ContinuousReaders"
+#define BTHECHOSAMPLE_REG_READ_BUFFER_SIZE      L"ReadBufferSize"
+
+#define BTHECHOSAMPLE_MAX_READ_BUFFER_SIZE      (64 * 1024)
+
 typedef struct _BTHECHOSAMPLE_SERVER_CONTEXT
 {
     //
@@ -40,6 +49,12 @@ typedef struct _BTHECHOSAMPLE_SERVER_CONTEXT
     // Outstanding open connections
     //
     LIST_ENTRY ConnectionList;
+
+    //
+    // Number of repeat readers and their buffer size for each connection
+    //
+    ULONG ContinuousReaderCount;
+    ULONG ReadBufferSize;
     
 } BTHECHOSAMPLE_SERVER_CONTEXT, *PBTHECHOSAMPLE_SERVER_CONTEXT;
 
@@ -75,6 +90,9 @@ BthEchoSampleServerContextInit(
 
     InitializeListHead(&Context->ConnectionList);
 
+    Context->ContinuousReaderCount = BTHECHOSAMPLE_NUM_CONTINUOUS_READERS;
+    Context->ReadBufferSize = BthEchoSampleMaxDataLength;
+
 exit:
     return status;
 }
@@ -85,6 +103,12 @@ EVT_WDF_DEVICE_SELF_MANAGED_IO_INIT BthEchoSrvEvtDeviceSelfManagedIoInit;
 
 EVT_WDF_DEVICE_SELF_MANAGED_IO_CLEANUP BthEchoSrvEvtDeviceSelfManagedIoCleanup;
 
+_IRQL_requires_max_(PASSIVE_LEVEL)
+VOID
+BthEchoSrvReadConfiguration(
+    _In_ PBTHECHOSAMPLE_SERVER_CONTEXT DevCtx
+    );
+
 //////////////////////////////////////////////////////
 // Device specific functionality invoked by server.c
 //////////////////////////////////////////////////////
@@ -100,10 +124,11 @@ BthEchoSrvConnectionStateConnected(
 ////////////////////////////////////////////////////////////////////
 
 _IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
+BOOLEAN
 BthEchoSrvConnectionObjectContReaderReadCompletedCallback(
     _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
     _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader,
     _In_ PVOID Buffer,
     _In_ size_t BufferLength
     );
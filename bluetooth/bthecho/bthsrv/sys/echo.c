@@ -15,6 +15,13 @@ Abstract:
 
     Contains echo related functionality
 
+    Each connection owns a pool of preformatted L2CA ACL transfers
+    (request, BRB and BRB memory object) which are recycled on write
+    completion. When another continuous reader is still outstanding,
+    the read buffer is echoed in place and the reader owning it is
+    resubmitted only when the echo completes; otherwise the data is
+    copied into the transfer so the reader can be resubmitted at once.
+
 Environment:
 
     Kernel mode only
@@ -79,7 +86,7 @@ Arguments:
 
 _IRQL_requires_max_(DISPATCH_LEVEL)
 VOID
-BthEchoSrvSendEcho(
+BthEchoSrvSendEchoAllocated(
     _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
     _In_ PBTHECHO_CONNECTION Connection,
     _In_ PVOID SrcBuffer,
@@ -88,10 +95,11 @@ BthEchoSrvSendEcho(
 /*++
 Routine Description:
 
-    Performs L2Cap transfer to client to do the echo.
+    Performs L2Cap transfer to client to do the echo using a newly
+    allocated request, memory and BRB.
     
-    This routine is invoked by continuous reader read completion callback
-    (BthEchoSrvConnectionObjectContReaderReadCompletedCallback).
+    This routine is used by BthEchoSrvSendEcho when the connection's
+    echo pool is exhausted.
 
 Arguments:
 
@@ -224,4 +232,576 @@ exit:
     }    
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthEchoSrvEchoPoolCreate(
+    _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ ULONG ReaderCount,
+    _In_ size_t BufferSize
+    )
+/*++
+Routine Description:
+
+    Allocates the echo pool as an additional context of the connection
+    object and preformats its transfers.
+
+    The lock and transfer requests are parented to the connection object
+    so that the framework deletes them after the pool cleanup callback
+    has waited for in flight echoes.
+
+Arguments:
+
+    DevCtxHdr - Device context
+    Connection - Connection to create the pool for
+    ReaderCount - Number of continuous readers the connection will use
+    BufferSize - Read buffer size of the continuous readers
+
+Return Value:
+
+    NTSTATUS Status code.
+
+--*/
+{
+    NTSTATUS status;
+    WDF_OBJECT_ATTRIBUTES attributes;
+    WDFMEMORY copyMemory;
+    PBTHECHO_ECHO_POOL pool = NULL;
+    UINT i, transfersCount;
+
+    WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, BTHECHO_ECHO_POOL);
+    attributes.EvtCleanupCallback = BthEchoSrvEvtEchoPoolCleanup;
+
+    status = WdfObjectAllocateContext(
+        WdfObjectContextGetObject(Connection),
+        &attributes,
+        (PVOID *) &pool
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, 
+            "Allocating echo pool failed, Status code %!STATUS!\n",
+            status
+            );
+
+        goto exit;
+    }
+
+    pool->DevCtxHdr = DevCtxHdr;
+    pool->Connection = Connection;
+    pool->FreeList.Next = NULL;
+
+    //
+    // Reference held by the pool is dropped by the cleanup callback
+    //
+    pool->Outstanding = 1;
+    KeInitializeEvent(&pool->IdleEvent, NotificationEvent, FALSE);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = WdfObjectContextGetObject(Connection);
+
+    status = WdfSpinLockCreate(
+        &attributes,
+        &pool->Lock
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    transfersCount = min(2 * ReaderCount, BTHECHOSAMPLE_ECHO_POOL_DEPTH);
+
+    for (i = 0; i < transfersCount; i++)
+    {
+        PBTHECHO_ECHO_TRANSFER transfer = &pool->Transfers[i];
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = WdfObjectContextGetObject(Connection);
+
+        status = WdfRequestCreate(
+            &attributes,
+            DevCtxHdr->IoTarget,
+            &transfer->Request
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, 
+                "Creating request for echo pool failed, Status code %!STATUS!\n",
+                status
+                );
+
+            goto exit;
+        }
+
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = transfer->Request;
+
+        status = WdfMemoryCreatePreallocated(
+            &attributes,
+            &transfer->Brb,
+            sizeof(transfer->Brb),
+            &transfer->BrbMemory
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, 
+                "Creating Brb memory for echo pool failed, Status code %!STATUS!\n",
+                status
+                );
+
+            WdfObjectDelete(transfer->Request);
+            transfer->Request = NULL;
+
+            goto exit;
+        }
+
+        //
+        // Copy buffer matches the read buffer so that copied echoes never
+        // need to fall back to allocating
+        //
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = transfer->Request;
+
+        status = WdfMemoryCreate(
+            &attributes,
+            NonPagedPoolNx,
+            POOLTAG_BTHECHOSAMPLE,
+            BufferSize,
+            &copyMemory,
+            (PVOID *) &transfer->CopyBuffer
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_CONNECT, 
+                "Creating copy buffer for echo pool failed, Status code %!STATUS!\n",
+                status
+                );
+
+            WdfObjectDelete(transfer->Request);
+            transfer->Request = NULL;
+
+            goto exit;
+        }
+
+        transfer->CopyBufferSize = BufferSize;
+
+        DevCtxHdr->ProfileDrvInterface.BthInitializeBrb(
+            (PBRB) &transfer->Brb,
+            BRB_L2CA_ACL_TRANSFER
+            );
+
+        transfer->Pool = pool;
+
+        PushEntryList(&pool->FreeList, &transfer->FreeListEntry);
 
+        ++pool->InitializedTransfersCount;
+    }
+
+exit:
+    //
+    // In case of error the transfers created so far are deleted along
+    // with the connection object
+    //
+    return status;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+PBTHECHO_ECHO_TRANSFER
+BthEchoSrvEchoPoolAcquire(
+    _In_ PBTHECHO_ECHO_POOL Pool
+    )
+/*++
+Routine Description:
+
+    Takes a transfer from the pool free list.
+
+Arguments:
+
+    Pool - Echo pool
+
+Return Value:
+
+    Transfer, or NULL if all transfers are in flight
+
+--*/
+{
+    PSINGLE_LIST_ENTRY entry;
+
+    WdfSpinLockAcquire(Pool->Lock);
+
+    entry = PopEntryList(&Pool->FreeList);
+
+    if (NULL != entry)
+    {
+        InterlockedIncrement(&Pool->Outstanding);
+
+        ++Pool->Stats.InFlight;
+
+        if (Pool->Stats.InFlight > Pool->Stats.MaxInFlight)
+        {
+            Pool->Stats.MaxInFlight = Pool->Stats.InFlight;
+        }
+
+        ++Pool->Stats.PooledEchoes;
+    }
+    else
+    {
+        ++Pool->Stats.AllocatedEchoes;
+    }
+
+    WdfSpinLockRelease(Pool->Lock);
+
+    return (NULL != entry) ? 
+        CONTAINING_RECORD(entry, BTHECHO_ECHO_TRANSFER, FreeListEntry) : NULL;
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthEchoSrvEchoPoolRelease(
+    _In_ PBTHECHO_ECHO_TRANSFER Transfer
+    )
+/*++
+Routine Description:
+
+    Returns a transfer to the pool free list.
+
+Arguments:
+
+    Transfer - Transfer to return
+
+--*/
+{
+    PBTHECHO_ECHO_POOL pool = Transfer->Pool;
+
+    WdfSpinLockAcquire(pool->Lock);
+
+    PushEntryList(&pool->FreeList, &Transfer->FreeListEntry);
+
+    NT_ASSERT(pool->Stats.InFlight > 0);
+
+    --pool->Stats.InFlight;
+
+    WdfSpinLockRelease(pool->Lock);
+
+    //
+    // Signal the cleanup callback only after the lock is released. Once
+    // the event is set the pool may be freed so this is the last access.
+    //
+    if (0 == InterlockedDecrement(&pool->Outstanding))
+    {
+        KeSetEvent(&pool->IdleEvent, 0, FALSE);
+    }
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthEchoSrvEchoPoolReleaseReader(
+    _In_ PBTHECHO_ECHO_TRANSFER Transfer
+    )
+/*++
+Routine Description:
+
+    Releases the repeat reader whose buffer a transfer was echoing, if any,
+    which resubmits that reader.
+
+Arguments:
+
+    Transfer - Transfer whose reader to release
+
+--*/
+{
+    PBTHECHO_REPEAT_READER repeatReader = Transfer->RetainedReader;
+
+    if (NULL != repeatReader)
+    {
+        Transfer->RetainedReader = NULL;
+
+        InterlockedDecrement(&Transfer->Pool->RetainedReaders);
+
+        BthEchoConnectionObjectContinuousReaderReleaseBuffer(
+            Transfer->Pool->Connection,
+            repeatReader
+            );
+    }
+}
+
+void
+BthEchoSrvPooledWriteCompletion(
+    _In_ WDFREQUEST  Request,
+    _In_ WDFIOTARGET  Target,
+    _In_ PWDF_REQUEST_COMPLETION_PARAMS  Params,
+    _In_ WDFCONTEXT  Context
+    )
+/*++
+Description:
+
+    Completion routine for pooled echo L2Ca transfer
+
+    The reader whose buffer was echoed in place, if any, is resubmitted
+    and the transfer is returned to the pool.
+
+Arguments:
+
+    Request - Request that completed
+    Target - Target to which request was sent
+    Params - Request completion parameters
+    Context - We receive the pooled transfer as the context
+
+--*/
+{
+    PBTHECHO_ECHO_TRANSFER transfer = (PBTHECHO_ECHO_TRANSFER) Context;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, 
+        "Pooled write completion, status: %!STATUS!", Params->IoStatus.Status);        
+
+    //
+    // As with BthEchoSrvWriteCompletion we don't disconnect on failure.
+    //
+    // The reader is released before the transfer so that the connection
+    // (which waits for its readers to stop) outlives this routine.
+    //
+
+    BthEchoSrvEchoPoolReleaseReader(transfer);
+
+    BthEchoSrvEchoPoolRelease(transfer);
+}
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+BOOLEAN
+BthEchoSrvSendEcho(
+    _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader,
+    _In_ PVOID SrcBuffer,
+    _In_ size_t SrcBufferLength
+    )
+/*++
+Routine Description:
+
+    Performs L2Cap transfer to client to do the echo.
+    
+    This routine is invoked by continuous reader read completion callback
+    (BthEchoSrvConnectionObjectContReaderReadCompletedCallback).
+
+    A transfer is taken from the connection's echo pool. If the pool is
+    empty we fall back to BthEchoSrvSendEchoAllocated.
+
+Arguments:
+
+    DevCtxHdr - Device context
+    Connection - Connection whose continous reader had read completion
+    RepeatReader - Repeat reader which owns SrcBuffer
+    SrcBuffer - Source buffer for the echo
+    SrcBufferLength - Length of the source buffer
+
+Return Value:
+
+    TRUE if SrcBuffer is retained for the echo; the reader is then
+    resubmitted by BthEchoSrvPooledWriteCompletion.
+
+--*/
+{
+    NTSTATUS status;
+    WDF_REQUEST_REUSE_PARAMS reuseParams;
+    PBTHECHO_ECHO_POOL pool;
+    PBTHECHO_ECHO_TRANSFER transfer;
+    PVOID buffer;
+    BOOLEAN retained = FALSE;
+
+    pool = GetEchoPoolContext(WdfObjectContextGetObject(Connection));
+
+    if (SrcBufferLength <= 0 || 
+        SrcBufferLength > Connection->ContinuousReader.BufferSize ||
+        SrcBufferLength > MAXULONG) 
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER,
+            "SrcBufferLength has an invalid value: %I64d\n",
+            SrcBufferLength
+            );
+
+        BthEchoSrvDisconnectConnection(Connection);        
+
+        return FALSE;
+    }
+
+    transfer = BthEchoSrvEchoPoolAcquire(pool);
+
+    if (NULL == transfer)
+    {
+        BthEchoSrvSendEchoAllocated(DevCtxHdr, Connection, SrcBuffer, SrcBufferLength);
+
+        return FALSE;
+    }
+
+    //
+    // Echo in place only if that leaves at least one other reader
+    // outstanding, otherwise copy so this reader can be resubmitted now
+    //
+
+    if (InterlockedIncrement(&pool->RetainedReaders) <
+        (LONG) Connection->ContinuousReader.InitializedReadersCount)
+    {
+        retained = TRUE;
+        transfer->RetainedReader = RepeatReader;
+        buffer = SrcBuffer;
+    }
+    else
+    {
+        InterlockedDecrement(&pool->RetainedReaders);
+
+        if (SrcBufferLength > transfer->CopyBufferSize)
+        {
+            //
+            // Not expected, the copy buffer is sized to the read buffer
+            //
+            BthEchoSrvEchoPoolRelease(transfer);
+
+            BthEchoSrvSendEchoAllocated(DevCtxHdr, Connection, SrcBuffer, SrcBufferLength);
+
+            return FALSE;
+        }
+
+        memcpy(transfer->CopyBuffer, SrcBuffer, SrcBufferLength);
+        buffer = transfer->CopyBuffer;
+    }
+
+    WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams, WDF_REQUEST_REUSE_NO_FLAGS, STATUS_UNSUCCESSFUL);
+    status = WdfRequestReuse(transfer->Request, &reuseParams);
+    NT_ASSERT(NT_SUCCESS(status));
+
+    status = BthEchoConnectionObjectFormatRequestForPreallocatedL2CaTransfer(
+        Connection,
+        transfer->Request,
+        &transfer->Brb,
+        transfer->BrbMemory,
+        buffer,
+        (ULONG) SrcBufferLength,
+        ACL_TRANSFER_DIRECTION_OUT
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    WdfRequestSetCompletionRoutine(
+        transfer->Request,
+        BthEchoSrvPooledWriteCompletion,
+        transfer
+        );
+
+    //
+    // Count the echo before sending, the completion may run before
+    // WdfRequestSend returns
+    //
+
+    WdfSpinLockAcquire(pool->Lock);
+
+    if (retained)
+    {
+        ++pool->Stats.ZeroCopyEchoes;
+    }
+    else
+    {
+        ++pool->Stats.CopiedEchoes;
+    }
+
+    WdfSpinLockRelease(pool->Lock);
+
+    if (FALSE == WdfRequestSend(
+        transfer->Request,
+        DevCtxHdr->IoTarget,
+        NULL
+        ))
+    {
+        status = WdfRequestGetStatus(transfer->Request);
+
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER, 
+            "Request send failed for pooled request 0x%p, Status code %!STATUS!\n", 
+            transfer->Request,
+            status
+            );
+
+        goto exit;
+    }    
+
+exit:
+    if (!NT_SUCCESS(status))
+    {
+        //
+        // Reader is not retained if we failed to send, the continuous
+        // reader resubmits it as usual
+        //
+        if (retained)
+        {
+            transfer->RetainedReader = NULL;
+            InterlockedDecrement(&pool->RetainedReaders);
+            retained = FALSE;
+        }
+
+        BthEchoSrvEchoPoolRelease(transfer);
+
+        //
+        // If we failed disconnect
+        //
+        BthEchoSrvDisconnectConnection(Connection);        
+    }
+
+    return retained;
+}
+
+#pragma warning(push)
+#pragma warning(disable:28118) // this callback will run at IRQL=PASSIVE_LEVEL
+_Use_decl_annotations_
+VOID
+BthEchoSrvEvtEchoPoolCleanup(
+    WDFOBJECT  ConnectionObject
+    )
+/*++
+
+Description:
+
+    This routine is invoked by the Framework when the connection object
+    the echo pool is attached to gets deleted.
+
+    Connection object has passive execution level so we can wait for
+    in flight echoes to complete. The pool's lock and requests are its
+    children and are deleted by the framework afterwards.
+
+Arguments:
+
+    ConnectionObject - The Connection Object
+
+--*/
+{
+    PBTHECHO_ECHO_POOL pool = GetEchoPoolContext(ConnectionObject);
+
+    if (0 != InterlockedDecrement(&pool->Outstanding))
+    {
+        KeWaitForSingleObject(&pool->IdleEvent,
+            Executive,
+            KernelMode,
+            FALSE,
+            NULL);
+    }
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONNECT, 
+        "Echo pool 0x%p: pooled %I64d, allocated %I64d, zero-copy %I64d, "
+        "copied %I64d, max in flight %d",
+        pool,
+        pool->Stats.PooledEchoes,
+        pool->Stats.AllocatedEchoes,
+        pool->Stats.ZeroCopyEchoes,
+        pool->Stats.CopiedEchoes,
+        pool->Stats.MaxInFlight
+        );
+}
+#pragma warning(pop) // enable 28118 again
@@ -22,11 +22,143 @@ Environment:
 
 --*/
 
+//
+// Maximum number of preformatted echo transfers per connection. A pool
+// holds two transfers per continuous reader.
+//
+// Echoes beyond this depth fall back to allocating a request per echo.
+//
+#define BTHECHOSAMPLE_ECHO_POOL_DEPTH (2 * BTHECHOSAMPLE_MAX_CONTINUOUS_READERS)
+
+typedef struct _BTHECHO_ECHO_POOL * PBTHECHO_ECHO_POOL;
+
+//
+// Preformatted L2CA ACL transfer used for echo
+//
+
+typedef struct _BTHECHO_ECHO_TRANSFER
+{
+    //
+    // Entry in the pool free list
+    //
+    SINGLE_LIST_ENTRY FreeListEntry;
+
+    PBTHECHO_ECHO_POOL Pool;
+
+    //
+    // Request, BRB and memory object describing the BRB are created once
+    // and reused for every echo
+    //
+    WDFREQUEST Request;
+
+    struct _BRB_L2CA_ACL_TRANSFER Brb;
+
+    WDFMEMORY BrbMemory;
+
+    //
+    // Repeat reader whose buffer is being echoed in place, NULL if the
+    // data was copied to CopyBuffer
+    //
+    PBTHECHO_REPEAT_READER RetainedReader;
+
+    //
+    // Copy buffer, sized to the connection's read buffer size
+    //
+    PUCHAR CopyBuffer;
+
+    size_t CopyBufferSize;
+    
+} BTHECHO_ECHO_TRANSFER, *PBTHECHO_ECHO_TRANSFER;
+
+//
+// Echo pool counters
+//
+
+typedef struct _BTHECHO_ECHO_POOL_STATS
+{
+    //
+    // Echoes sent using a pooled transfer (no allocation)
+    //
+    LONG64 PooledEchoes;
+
+    //
+    // Echoes that found the pool empty and allocated a request
+    //
+    LONG64 AllocatedEchoes;
+
+    //
+    // Pooled echoes sent directly from the continuous reader buffer
+    // versus copied
+    //
+    LONG64 ZeroCopyEchoes;
+    LONG64 CopiedEchoes;
+
+    //
+    // Pooled transfers currently sent and the high watermark
+    //
+    LONG InFlight;
+    LONG MaxInFlight;
+    
+} BTHECHO_ECHO_POOL_STATS, *PBTHECHO_ECHO_POOL_STATS;
+
+//
+// Per connection echo pool. Allocated as an additional context
+// on the connection object.
+//
+
+typedef struct _BTHECHO_ECHO_POOL
+{
+    PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr;
+
+    PBTHECHO_CONNECTION Connection;
+
+    //
+    // Protects FreeList and Stats
+    //
+    WDFSPINLOCK Lock;
+
+    SINGLE_LIST_ENTRY FreeList;
+
+    //
+    // Number of repeat readers whose buffers are being echoed in place.
+    // At least one reader is always kept outstanding.
+    //
+    LONG RetainedReaders;
+
+    //
+    // One reference per pooled transfer in flight plus one held by the
+    // pool until cleanup. IdleEvent is signaled when the last reference
+    // is dropped.
+    //
+    LONG Outstanding;
+
+    KEVENT IdleEvent;
+
+    BTHECHO_ECHO_POOL_STATS Stats;
+
+    DWORD InitializedTransfersCount;
+
+    BTHECHO_ECHO_TRANSFER Transfers[BTHECHOSAMPLE_ECHO_POOL_DEPTH];
+    
+} BTHECHO_ECHO_POOL;
+
+WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BTHECHO_ECHO_POOL, GetEchoPoolContext)
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthEchoSrvEchoPoolCreate(
+    _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ ULONG ReaderCount,
+    _In_ size_t BufferSize
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
-VOID
+BOOLEAN
 BthEchoSrvSendEcho(
     _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
     _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader,
     _In_ PVOID SrcBuffer,
     _In_ size_t SrcBufferLength
     );
@@ -35,3 +167,7 @@ WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(BRB, GetEchoRequestContext)
 
 EVT_WDF_REQUEST_COMPLETION_ROUTINE BthEchoSrvWriteCompletion;  
 
+EVT_WDF_REQUEST_COMPLETION_ROUTINE BthEchoSrvPooledWriteCompletion;  
+
+EVT_WDF_OBJECT_CONTEXT_CLEANUP BthEchoSrvEvtEchoPoolCleanup;
+
@@ -22,13 +22,27 @@ Environment:
 --*/
 
 typedef struct _BTHECHO_CONNECTION * PBTHECHO_CONNECTION;
+typedef struct _BTHECHO_REPEAT_READER * PBTHECHO_REPEAT_READER;
 
+//
+// Default and maximum number of repeat readers per connection
+//
 #define BTHECHOSAMPLE_NUM_CONTINUOUS_READERS 2
+#define BTHECHOSAMPLE_MAX_CONTINUOUS_READERS 16
 
-typedef VOID
+//
+// Read completion callback.
+//
+// If the callback returns TRUE it has retained Buffer (which belongs to
+// RepeatReader) and the reader is not resubmitted until the callback owner
+// calls BthEchoConnectionObjectContinuousReaderReleaseBuffer. If it returns
+// FALSE the buffer must not be used after the callback returns.
+//
+typedef BOOLEAN
 (*PFN_BTHECHO_CONNECTION_OBJECT_CONTREADER_READ_COMPLETE) (
     _In_ PBTHECHOSAMPLE_DEVICE_CONTEXT_HEADER DevCtxHdr,
     _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader,
     _In_ PVOID Buffer,
     _In_ size_t BufferSize
     );
@@ -58,10 +72,16 @@ typedef struct _BTHECHO_REPEAT_READER
     WDFMEMORY MemoryPendingRead;
 
     //
-    // Dpc for resubmitting pending read
+    // Dpc for resubmitting pending read when it cannot be resubmitted
+    // inline (below DISPATCH_LEVEL or from within a nested completion)
     //
     KDPC ResubmitDpc;
 
+    //
+    // Non-zero while the reader is being resubmitted inline
+    //
+    LONG InlineResubmit;
+
     //
     // Whether the continuous reader is transitioning to stopped state
     //
@@ -98,7 +118,7 @@ typedef enum _BTHECHO_CONNECTION_STATE {
 typedef struct _BTHECHO_CONTINUOUS_READER {
 
     BTHECHO_REPEAT_READER         
-        RepeatReaders[BTHECHOSAMPLE_NUM_CONTINUOUS_READERS];
+        RepeatReaders[BTHECHOSAMPLE_MAX_CONTINUOUS_READERS];
 
     PFN_BTHECHO_CONNECTION_OBJECT_CONTREADER_READ_COMPLETE    
         BthEchoConnectionObjectContReaderReadCompleteCallback;
@@ -107,6 +127,17 @@ typedef struct _BTHECHO_CONTINUOUS_READER {
         BthEchoConnectionObjectContReaderFailedCallback;
         
     DWORD                                   InitializedReadersCount;
+
+    //
+    // Size of the buffer of each repeat reader
+    //
+    size_t                                  BufferSize;
+
+    //
+    // Resubmissions done inline vs. through ResubmitDpc
+    //
+    LONG64                                  InlineResubmits;
+    LONG64                                  DpcResubmits;
     
 } BTHECHO_CONTINUOUS_READER, * PBTHECHO_CONTINUOUS_READER;
 
@@ -174,6 +205,7 @@ BthEchoConnectionObjectInitializeContinuousReader(
         BthEchoConnectionObjectContReaderReadCompleteCallback,
     _In_ PFN_BTHECHO_CONNECTION_OBJECT_CONTREADER_FAILED 
         BthEchoConnectionObjectContReaderFailedCallback,
+    _In_ ULONG ReaderCount,
     _In_ size_t BufferSize
     );
 
@@ -189,6 +221,13 @@ BthEchoConnectionObjectContinuousReaderCancelReaders(
     _In_ PBTHECHO_CONNECTION Connection
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthEchoConnectionObjectContinuousReaderReleaseBuffer(
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader
+    );
+
 _IRQL_requires_max_(DISPATCH_LEVEL)
 BOOLEAN
 BthEchoConnectionObjectRemoteDisconnect(
@@ -214,4 +253,16 @@ BthEchoConnectionObjectFormatRequestForL2CaTransfer(
     _In_ ULONG TransferFlags //flags include direction of transfer
     );
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthEchoConnectionObjectFormatRequestForPreallocatedL2CaTransfer(
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ WDFREQUEST Request,
+    _In_ struct _BRB_L2CA_ACL_TRANSFER * Brb,
+    _In_ WDFMEMORY BrbMemory,
+    _In_reads_bytes_(BufferSize) PVOID Buffer,
+    _In_ ULONG BufferSize,
+    _In_ ULONG TransferFlags //flags include direction of transfer
+    );
+
 EVT_WDF_OBJECT_CONTEXT_CLEANUP BthEchoEvtConnectionObjectCleanup;
@@ -114,6 +114,65 @@ Arguments:
     }
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthEchoRepeatReaderResubmit(
+    _In_ PBTHECHO_REPEAT_READER RepeatReader
+    )
+/*++
+
+Description:
+
+    Resubmits a repeat reader after its read completed.
+
+    When we are already at DISPATCH_LEVEL the reader is resubmitted inline,
+    saving a Dpc per read. If the request completes synchronously while we
+    are resubmitting it, that nested completion uses the Dpc to avoid
+    recursing. Below DISPATCH_LEVEL the Dpc is always used.
+
+Arguments:
+
+    RepeatReader - Repeat reader to resubmit
+
+--*/
+{
+    PBTHECHO_CONTINUOUS_READER continuousReader = 
+        &RepeatReader->Connection->ContinuousReader;
+
+    if (KeGetCurrentIrql() == DISPATCH_LEVEL &&
+        InterlockedIncrement(&RepeatReader->InlineResubmit) == 1)
+    {
+        InterlockedIncrement64(&continuousReader->InlineResubmits);
+
+        //
+        // BthEchoRepeatReaderSubmit will invoke contreader
+        // failure callback in case of failure
+        // so we don't check for failure here
+        //
+        (void) BthEchoRepeatReaderSubmit(
+            RepeatReader->Connection->DevCtxHdr,
+            RepeatReader
+            );
+
+        InterlockedDecrement(&RepeatReader->InlineResubmit);
+    }
+    else
+    {
+        BOOLEAN ret;
+
+        if (KeGetCurrentIrql() == DISPATCH_LEVEL)
+        {
+            InterlockedDecrement(&RepeatReader->InlineResubmit);
+        }
+
+        InterlockedIncrement64(&continuousReader->DpcResubmits);
+
+        ret = KeInsertQueueDpc(&RepeatReader->ResubmitDpc, RepeatReader, NULL);
+        NT_ASSERT (TRUE == ret); //we only expect one outstanding dpc
+        UNREFERENCED_PARAMETER(ret); //ret remains unused in fre build
+    }
+}
+
 EVT_WDF_REQUEST_COMPLETION_ROUTINE
 BthEchoRepeatReaderPendingReadCompletion;
 
@@ -147,6 +206,7 @@ Arguments:
 {
     PBTHECHO_REPEAT_READER repeatReader;
     NTSTATUS status;
+    BOOLEAN bufferRetained = FALSE;
 
     UNREFERENCED_PARAMETER(Target);
     UNREFERENCED_PARAMETER(Request);
@@ -167,9 +227,10 @@ Arguments:
             repeatReader->TransferBrb.BufferSize            
             );
            
-        repeatReader->Connection->ContinuousReader.BthEchoConnectionObjectContReaderReadCompleteCallback(
+        bufferRetained = repeatReader->Connection->ContinuousReader.BthEchoConnectionObjectContReaderReadCompleteCallback(
             repeatReader->Connection->DevCtxHdr,
             repeatReader->Connection,
+            repeatReader,
             repeatReader->TransferBrb.Buffer,
             repeatReader->TransferBrb.BufferSize
             );
@@ -208,16 +269,25 @@ Arguments:
         //
         KeSetEvent(&repeatReader->StopEvent, 0, FALSE);        
     }
+    else if (bufferRetained)
+    {
+        //
+        // The read complete callback still uses our buffer. The reader is
+        // resubmitted when the buffer is released.
+        //
+
+        TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONT_READER, 
+            "RepeatReader: 0x%p buffer retained by read complete callback", 
+            repeatReader
+            );
+    }
     else
     {
         //
         // Resubmit pending read
-        // We use a Dpc to avoid recursing in this completion routine
         //
 
-        BOOLEAN ret = KeInsertQueueDpc(&repeatReader->ResubmitDpc, repeatReader, NULL);
-        NT_ASSERT (TRUE == ret); //we only expect one outstanding dpc
-        UNREFERENCED_PARAMETER(ret); //ret remains unused in fre build
+        BthEchoRepeatReaderResubmit(repeatReader);
     }
 }
 
@@ -574,6 +644,7 @@ BthEchoConnectionObjectInitializeContinuousReader(
         BthEchoConnectionObjectContReaderReadCompleteCallback,
     _In_ PFN_BTHECHO_CONNECTION_OBJECT_CONTREADER_FAILED 
         BthEchoConnectionObjectContReaderFailedCallback,
+    _In_ ULONG ReaderCount,
     _In_ size_t BufferSize
     )
 /*++
@@ -588,6 +659,8 @@ Arguments:
         Pending read completion callback
     BthEchoConnectionObjectContReaderFailedCallback - 
         Repeat reader failed callback
+    ReaderCount - Number of repeat readers, between 1 and
+        BTHECHOSAMPLE_MAX_CONTINUOUS_READERS
     BufferSize - Buffer size for the pending read
 
 Return Value:
@@ -599,12 +672,23 @@ Return Value:
     NTSTATUS status = STATUS_SUCCESS;
     UINT i;
 
+    if (ReaderCount == 0 || ReaderCount > BTHECHOSAMPLE_MAX_CONTINUOUS_READERS)
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_CONT_READER,
+            "ReaderCount has an invalid value: %d\n",
+            ReaderCount
+            );
+
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    Connection->ContinuousReader.BufferSize = BufferSize;
     Connection->ContinuousReader.BthEchoConnectionObjectContReaderReadCompleteCallback = 
         BthEchoConnectionObjectContReaderReadCompleteCallback;
     Connection->ContinuousReader.BthEchoConnectionObjectContReaderFailedCallback = 
         BthEchoConnectionObjectContReaderFailedCallback;
         
-    for (i = 0; i < BTHECHOSAMPLE_NUM_CONTINUOUS_READERS; i++)
+    for (i = 0; i < ReaderCount; i++)
     {
         status = BthEchoRepeatReaderInitialize(
             Connection,
@@ -656,7 +740,7 @@ Return Value:
     UINT i;
 
     NT_ASSERT (Connection->ContinuousReader.InitializedReadersCount
-        <= BTHECHOSAMPLE_NUM_CONTINUOUS_READERS);
+        <= BTHECHOSAMPLE_MAX_CONTINUOUS_READERS);
     
     for (i = 0; i < Connection->ContinuousReader.InitializedReadersCount; i++)
     {
@@ -706,7 +790,7 @@ Arguments:
     UINT i;
 
     NT_ASSERT (Connection->ContinuousReader.InitializedReadersCount
-        <= BTHECHOSAMPLE_NUM_CONTINUOUS_READERS);
+        <= BTHECHOSAMPLE_MAX_CONTINUOUS_READERS);
 
     for (i = 0; i < Connection->ContinuousReader.InitializedReadersCount; i++)
     {
@@ -714,6 +798,34 @@ Arguments:
     }
 }
 
+_IRQL_requires_max_(DISPATCH_LEVEL)
+VOID
+BthEchoConnectionObjectContinuousReaderReleaseBuffer(
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ PBTHECHO_REPEAT_READER RepeatReader
+    )
+/*++
+
+Description:
+
+    This routine returns a buffer retained by the read complete callback
+    and resubmits the repeat reader that owns it.
+
+    If the reader was cancelled while its buffer was retained the
+    resubmission stops the reader instead.
+
+Arguments:
+
+    Connection - Connection the repeat reader belongs to
+    RepeatReader - Repeat reader whose buffer was retained
+
+--*/
+{
+    NT_ASSERT(RepeatReader->Connection == Connection);
+    UNREFERENCED_PARAMETER(Connection); //Connection remains unused in fre build
+
+    BthEchoRepeatReaderResubmit(RepeatReader);
+}
 
 _IRQL_requires_max_(PASSIVE_LEVEL)
 VOID
@@ -738,7 +850,7 @@ Arguments:
     PAGED_CODE();
 
     NT_ASSERT (Connection->ContinuousReader.InitializedReadersCount
-        <= BTHECHOSAMPLE_NUM_CONTINUOUS_READERS);
+        <= BTHECHOSAMPLE_MAX_CONTINUOUS_READERS);
     
     for (i = 0; i < Connection->ContinuousReader.InitializedReadersCount; i++)
     {
@@ -747,6 +859,15 @@ Arguments:
         BthEchoRepeatReaderWaitForStop(repeatReader); //It is OK to wait on unsubmitted readers
         BthEchoRepeatReaderUninitialize(repeatReader);
     }    
+
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_CONT_READER, 
+        "Connection 0x%p continuous reader: %d readers, inline resubmits %I64d, "
+        "dpc resubmits %I64d",
+        Connection,
+        Connection->ContinuousReader.InitializedReadersCount,
+        Connection->ContinuousReader.InlineResubmits,
+        Connection->ContinuousReader.DpcResubmits
+        );
 }
 
 #pragma warning(push)
@@ -1341,3 +1462,89 @@ exit:
     
     return status;
 }
+
+_IRQL_requires_max_(DISPATCH_LEVEL)
+NTSTATUS
+BthEchoConnectionObjectFormatRequestForPreallocatedL2CaTransfer(
+    _In_ PBTHECHO_CONNECTION Connection,
+    _In_ WDFREQUEST Request,
+    _In_ struct _BRB_L2CA_ACL_TRANSFER * Brb,
+    _In_ WDFMEMORY BrbMemory,
+    _In_reads_bytes_(BufferSize) PVOID Buffer,
+    _In_ ULONG BufferSize,
+    _In_ ULONG TransferFlags //flags include direction of transfer
+    )
+/*++
+
+Description:
+
+    Formats a request for L2Ca transfer using a caller owned Brb and a
+    memory object already describing that Brb.
+
+    Unlike BthEchoConnectionObjectFormatRequestForL2CaTransfer this routine
+    does not allocate anything, so a request, Brb and Brb memory object can
+    be created once and reused for every transfer.
+
+Arguments:
+
+    Connection - Connection on which L2Ca transfer will be made
+    Request - Request to be formatted
+    Brb - Brb to use for the transfer
+    BrbMemory - Memory object describing Brb
+    Buffer - Buffer for the transfer
+    BufferSize - Size of Buffer
+    TransferFlags - Transfer flags which include direction of the transfer
+
+Return Value:
+
+    NTSTATUS Status code.
+
+--*/
+{
+    NTSTATUS status;
+
+    WdfSpinLockAcquire(Connection->ConnectionLock);
+
+    if(Connection->ConnectionState != ConnectionStateConnected)
+    {
+        WdfSpinLockRelease(Connection->ConnectionLock);
+        return STATUS_CONNECTION_DISCONNECTED;
+    }
+
+    WdfSpinLockRelease(Connection->ConnectionLock);
+
+    Connection->DevCtxHdr->ProfileDrvInterface.BthReuseBrb(
+        (PBRB)Brb, BRB_L2CA_ACL_TRANSFER
+        );
+
+    Brb->BtAddress = Connection->RemoteAddress;
+    Brb->BufferMDL = NULL;
+    Brb->Buffer = Buffer;
+    Brb->BufferSize = BufferSize;
+    Brb->ChannelHandle = Connection->ChannelHandle;
+    Brb->TransferFlags = TransferFlags;
+
+    status = WdfIoTargetFormatRequestForInternalIoctlOthers(
+        Connection->DevCtxHdr->IoTarget,
+        Request,
+        IOCTL_INTERNAL_BTH_SUBMIT_BRB,
+        BrbMemory,
+        NULL, //OtherArg1Offset
+        NULL, //OtherArg2
+        NULL, //OtherArg2Offset
+        NULL, //OtherArg4
+        NULL  //OtherArg4Offset
+        );
+
+    if (!NT_SUCCESS(status))
+    {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_UTIL, 
+            "Formatting request 0x%p with Brb 0x%p failed, Status code %!STATUS!\n",
+            Request,
+            Brb,
+            status
+            );
+    }
+
+    return status;
+}
@@ -1239,6 +1239,16 @@ Return Value:
         goto Exit;
     }
 
+    //
+    // Queues to hold write requests until the controller has credits for them
+    //
+    Status = WriteResourcesAllocate(_Device);
+
+    if (!NT_SUCCESS(Status)) {
+        DoTrace(LEVEL_ERROR, TFLAG_IO, (" WriteResourcesAllocate failed %!STATUS!", Status));
+        goto Exit;
+    }
+
     // Issue pending IO request to prefetch HCI event and data
     FdoExtension = FdoGetExtension(_Device);
     FdoExtension->ReadContext.RequestState = REQUEST_COMPLETE;
@@ -1378,6 +1388,12 @@ Return Value:
             goto Done;
         }
 
+        // The controller starts over with one command credit and empty buffers.
+        // Reset before the read pump runs so that no event it processes is undone.
+        WdfSpinLockAcquire(FdoExtension->CreditLock);
+          HciCreditsReset(&FdoExtension->Credits);
+        WdfSpinLockRelease(FdoExtension->CreditLock);
+
         // Restart read pump
         DoTrace(LEVEL_INFO, TFLAG_IO, (" Restarting read pump"));
         Status = ReadH4Packet(&FdoExtension->ReadContext,
@@ -1389,6 +1405,8 @@ Return Value:
             DoTrace(LEVEL_ERROR, TFLAG_IO, ("ReadH4Packet [0] failed %!STATUS!", Status));
             goto Done;
         }
+
+        WritePumpRun(FdoExtension);
     }
 
 Done:
@@ -1675,6 +1693,13 @@ Return Value:
     TransferContext->RequestToUART      = RequestToUART;
     TransferContext->HCIPacket          = Data;
     TransferContext->HCIPacketLen       = DataLength;
+    TransferContext->PacketType         = _HCIContext->Type;
+    TransferContext->ConnectionHandle   = 0;
+
+    if (_HCIContext->Type == (UCHAR) HciPacketAclData)
+    {
+        TransferContext->ConnectionHandle = HCI_ACL_CONNECTION_HANDLE(_HCIContext->Data);
+    }
 
     //
     // Both Requests are typically accessed by the completion routine, and in rare case also
@@ -1916,6 +1941,14 @@ Return Value:
             break;
         }
 
+        // The write pump reads the ACL connection handle to account for its credit
+        if (PacketType == HciPacketAclData && HCIContext->DataLen < HCI_ACL_HEADER_SIZE)
+        {
+            Status = STATUS_INVALID_PARAMETER;
+            DoTrace(LEVEL_ERROR, TFLAG_IOCTL,(" Write HCI ACL data too short %!STATUS!", Status));
+            break;
+        }
+
         if (PacketType == HciPacketCommand)
         {
             InterlockedIncrement(&FdoExtension->CntCommandReq);
@@ -1925,10 +1958,18 @@ Return Value:
             InterlockedIncrement(&FdoExtension->CntWriteDataReq);
         }
 
-        Status = FdoWriteDeviceIO(_Request,
-                                  Device,
-                                  FdoExtension,
-                                  HCIContext);
+        //
+        // Hold the packet until the controller has a credit for it; commands and
+        // data are queued separately so that either can proceed without the other.
+        //
+        Status = WdfRequestForwardToIoQueue(_Request,
+                                            PacketType == HciPacketCommand ?
+                                                FdoExtension->WriteCommandQueue :
+                                                FdoExtension->WriteDataQueue);
+        if (NT_SUCCESS(Status))
+        {
+            WritePumpRun(FdoExtension);
+        }
         break;
 
     case IOCTL_BTHX_READ_HCI:
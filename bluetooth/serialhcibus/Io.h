@@ -165,6 +165,13 @@ typedef struct _UART_WRITE_CONTEXT {
     //
     ULONG HCIPacketLen;
 
+    //
+    // Packet type and ACL connection handle, to return the credit of a
+    // packet that did not reach the controller
+    //
+    UCHAR  PacketType;
+    USHORT ConnectionHandle;
+
 } UART_WRITE_CONTEXT, *PUART_WRITE_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(UART_WRITE_CONTEXT, GetWriteRequestContext)
@@ -0,0 +1,316 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    credit.c
+
+Abstract:
+
+    This module tracks the HCI command and ACL data credits granted by the
+    controller. Packets from bthport are held in the write queues until
+    HciCreditsAcquire allows them out, and HciCreditsUpdate picks up the
+    credits that come back in events.
+
+Environment:
+
+    kernel mode only
+
+--*/
+
+#include "driver.h"
+
+static PHCI_CREDIT_LINK
+HciCreditsFindLink(
+    _In_ PHCI_CREDITS _Credits,
+    _In_ USHORT       _Handle
+    )
+{
+    ULONG Index;
+
+    for (Index = 0; Index < HCI_CREDIT_MAX_LINKS; Index++)
+    {
+        if (_Credits->Links[Index].Outstanding &&
+            _Credits->Links[Index].Handle == _Handle)
+        {
+            return &_Credits->Links[Index];
+        }
+    }
+
+    return NULL;
+}
+
+static VOID
+HciCreditsAclCompleted(
+    _Inout_ PHCI_CREDITS _Credits,
+    _In_ USHORT          _Handle,
+    _In_ ULONG           _Count
+    )
+{
+    PHCI_CREDIT_LINK Link;
+
+    Link = HciCreditsFindLink(_Credits, _Handle);
+    if (Link)
+    {
+        Link->Outstanding = (USHORT) (_Count < Link->Outstanding ? Link->Outstanding - _Count : 0);
+    }
+
+    // Packets sent while every link entry was in use are only counted in the total
+    _Credits->AclOutstanding = _Count < _Credits->AclOutstanding ? _Credits->AclOutstanding - _Count : 0;
+}
+
+VOID
+HciCreditsReset(
+    _Out_ PHCI_CREDITS _Credits
+    )
+/*++
+
+Routine Description:
+
+    Return the credits to the state the controller is in after power on:
+    one command may be sent and the ACL buffer count is not known yet.
+
+Arguments:
+
+    _Credits - credit state
+
+Return Value:
+
+    none
+
+--*/
+{
+    RtlZeroMemory(_Credits, sizeof(HCI_CREDITS));
+
+    _Credits->CommandCredits = HCI_INITIAL_COMMAND_CREDITS;
+}
+
+BOOLEAN
+HciCreditsAcquire(
+    _Inout_ PHCI_CREDITS _Credits,
+    _In_ UCHAR           _Type,
+    _In_ USHORT          _Handle
+    )
+/*++
+
+Routine Description:
+
+    Take a credit for a packet that is about to be sent to the controller.
+
+Arguments:
+
+    _Credits - credit state
+    _Type - HciPacketCommand or HciPacketAclData
+    _Handle - connection handle of an ACL data packet
+
+Return Value:
+
+    TRUE if the packet can be sent, FALSE if it has to wait
+
+--*/
+{
+    PHCI_CREDIT_LINK Link;
+    ULONG Index;
+
+    if (_Type == (UCHAR) HciPacketCommand)
+    {
+        if (_Credits->CommandCredits == 0)
+        {
+            _Credits->CommandStalls++;
+            return FALSE;
+        }
+
+        _Credits->CommandCredits--;
+        return TRUE;
+    }
+
+    if (_Credits->AclTotal && _Credits->AclOutstanding >= _Credits->AclTotal)
+    {
+        _Credits->AclStalls++;
+        return FALSE;
+    }
+
+    _Credits->AclOutstanding++;
+
+    Link = HciCreditsFindLink(_Credits, _Handle);
+    if (!Link)
+    {
+        for (Index = 0; Index < HCI_CREDIT_MAX_LINKS; Index++)
+        {
+            if (_Credits->Links[Index].Outstanding == 0)
+            {
+                Link = &_Credits->Links[Index];
+                Link->Handle = _Handle;
+                break;
+            }
+        }
+    }
+
+    if (Link)
+    {
+        Link->Outstanding++;
+    }
+
+    return TRUE;
+}
+
+VOID
+HciCreditsRelease(
+    _Inout_ PHCI_CREDITS _Credits,
+    _In_ UCHAR           _Type,
+    _In_ USHORT          _Handle
+    )
+/*++
+
+Routine Description:
+
+    Give back the credit of a packet that never reached the controller.
+
+Arguments:
+
+    _Credits - credit state
+    _Type - HciPacketCommand or HciPacketAclData
+    _Handle - connection handle of an ACL data packet
+
+Return Value:
+
+    none
+
+--*/
+{
+    if (_Type == (UCHAR) HciPacketCommand)
+    {
+        _Credits->CommandCredits++;
+    }
+    else
+    {
+        HciCreditsAclCompleted(_Credits, _Handle, 1);
+    }
+}
+
+BOOLEAN
+HciCreditsUpdate(
+    _Inout_ PHCI_CREDITS _Credits,
+    _In_reads_bytes_(_EventLength) PUCHAR _Event,
+    _In_ ULONG           _EventLength
+    )
+/*++
+
+Routine Description:
+
+    Pick up the flow control information in an HCI event from the controller.
+
+    Command Complete and Command Status carry the number of commands the
+    controller can now accept. Number Of Completed Packets returns ACL
+    credits per connection handle, and Disconnection Complete returns the
+    credits of packets the controller flushed for the link. The ACL buffer
+    count comes from the Command Complete of HCI_Read_Buffer_Size.
+
+Arguments:
+
+    _Credits - credit state
+    _Event - HCI event packet, starting with the event code
+    _EventLength - length of the event packet
+
+Return Value:
+
+    TRUE if credits were returned and held packets may now be sent
+
+--*/
+{
+    PHCI_EVENT_PACKET Event = (PHCI_EVENT_PACKET) _Event;
+    PUCHAR Params = Event->Params;
+    ULONG  ParamsCount;
+    ULONG  Index;
+    USHORT Opcode;
+    PHCI_CREDIT_LINK Link;
+    BOOLEAN Returned = FALSE;
+
+    if (_EventLength < HCI_EVENT_HEADER_LEN)
+    {
+        return FALSE;
+    }
+
+    ParamsCount = min(Event->ParamsCount, _EventLength - HCI_EVENT_HEADER_LEN);
+
+    switch (Event->EventCode)
+    {
+    case HCI_EVENT_COMMAND_COMPLETE:
+        // Num_HCI_Command_Packets(1), Command_Opcode(2), Return_Parameters
+        if (ParamsCount < 3)
+        {
+            break;
+        }
+
+        _Credits->CommandCredits = Params[0];
+        Returned = (BOOLEAN) (Params[0] != 0);
+
+        Opcode = (USHORT) (Params[1] | (Params[2] << 8));
+
+        if (Opcode == HCI_OPCODE_RESET && ParamsCount >= 4 && Params[3] == 0)
+        {
+            // The controller has dropped all connections and their data
+            _Credits->AclOutstanding = 0;
+            RtlZeroMemory(_Credits->Links, sizeof(_Credits->Links));
+            Returned = TRUE;
+        }
+        else if (Opcode == HCI_OPCODE_READ_BUFFER_SIZE && ParamsCount >= 11 && Params[3] == 0)
+        {
+            // Status(1), ACL_Data_Packet_Length(2), SCO_Data_Packet_Length(1),
+            // Total_Num_ACL_Data_Packets(2), Total_Num_SCO_Data_Packets(2)
+            _Credits->AclTotal = Params[7] | (Params[8] << 8);
+        }
+        break;
+
+    case HCI_EVENT_COMMAND_STATUS:
+        // Status(1), Num_HCI_Command_Packets(1), Command_Opcode(2)
+        if (ParamsCount < 4)
+        {
+            break;
+        }
+
+        _Credits->CommandCredits = Params[1];
+        Returned = (BOOLEAN) (Params[1] != 0);
+        break;
+
+    case HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS:
+        // Number_of_Handles(1), then Connection_Handle(2) and
+        // Num_Completed_Packets(2) for each handle
+        if (ParamsCount < 1 || ParamsCount < 1 + 4 * (ULONG) Params[0])
+        {
+            break;
+        }
+
+        for (Index = 0; Index < Params[0]; Index++)
+        {
+            PUCHAR Entry = &Params[1 + 4 * Index];
+
+            HciCreditsAclCompleted(_Credits,
+                                   HCI_ACL_CONNECTION_HANDLE(Entry),
+                                   Entry[2] | (Entry[3] << 8));
+        }
+        Returned = TRUE;
+        break;
+
+    case HCI_EVENT_DISCONNECTION_COMPLETE:
+        // Status(1), Connection_Handle(2), Reason(1)
+        if (ParamsCount < 4 || Params[0] != 0)
+        {
+            break;
+        }
+
+        Link = HciCreditsFindLink(_Credits, HCI_ACL_CONNECTION_HANDLE(&Params[1]));
+        if (Link)
+        {
+            HciCreditsAclCompleted(_Credits, Link->Handle, Link->Outstanding);
+            Returned = TRUE;
+        }
+        break;
+
+    default:
+        break;
+    }
+
+    return Returned;
+}
@@ -0,0 +1,107 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+   credit.h
+
+Abstract:
+
+    Definitions for HCI flow control. The controller grants the host a
+    number of HCI commands (Num_HCI_Command_Packets in Command Complete and
+    Command Status events) and a number of ACL data packets (learnt from
+    Read_Buffer_Size and returned by Number Of Completed Packets events).
+    A packet may only be sent down while a credit is available for it.
+
+    This module makes no WDF calls and does no locking; the caller
+    serializes all calls on one HCI_CREDITS.
+
+Environment:
+
+   Kernel mode only
+
+--*/
+
+#ifndef __CREDIT_H__
+#define __CREDIT_H__
+
+//
+// HCI event and command opcodes that carry flow control information
+//
+#define HCI_EVENT_DISCONNECTION_COMPLETE          0x05
+#define HCI_EVENT_COMMAND_COMPLETE                0x0e
+#define HCI_EVENT_COMMAND_STATUS                  0x0f
+#define HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS     0x13
+
+#define HCI_OPCODE_RESET                          0x0c03
+#define HCI_OPCODE_READ_BUFFER_SIZE               0x1005
+
+//
+// The host may send one command after power on or reset until the
+// controller tells it otherwise.
+//
+#define HCI_INITIAL_COMMAND_CREDITS     1
+
+//
+// Number of connection handles to track outstanding ACL packets on
+//
+#define HCI_CREDIT_MAX_LINKS            32
+
+//
+// Connection handle from the first two bytes of an ACL data packet
+//
+#define HCI_ACL_CONNECTION_HANDLE(_Data)  ((USHORT) (((_Data)[0] | ((_Data)[1] << 8)) & 0x0fff))
+
+typedef struct _HCI_CREDIT_LINK {
+    USHORT  Handle;
+    USHORT  Outstanding;            // 0 means the entry is free
+} HCI_CREDIT_LINK, *PHCI_CREDIT_LINK;
+
+typedef struct _HCI_CREDITS {
+
+    //
+    // Commands the controller can currently accept
+    //
+    ULONG   CommandCredits;
+
+    //
+    // ACL buffers in the controller; 0 until Read_Buffer_Size completes,
+    // and ACL data is not held back until then.
+    //
+    ULONG   AclTotal;
+
+    //
+    // ACL packets sent and not yet reported as completed, in total and
+    // per connection handle
+    //
+    ULONG   AclOutstanding;
+    HCI_CREDIT_LINK Links[HCI_CREDIT_MAX_LINKS];
+
+    //
+    // Number of times a packet had to wait for a credit
+    //
+    ULONG   CommandStalls;
+    ULONG   AclStalls;
+
+} HCI_CREDITS, *PHCI_CREDITS;
+
+VOID
+HciCreditsReset(_Out_ PHCI_CREDITS _Credits);
+
+BOOLEAN
+HciCreditsAcquire(_Inout_ PHCI_CREDITS _Credits,
+                  _In_ UCHAR           _Type,
+                  _In_ USHORT          _Handle);
+
+VOID
+HciCreditsRelease(_Inout_ PHCI_CREDITS _Credits,
+                  _In_ UCHAR           _Type,
+                  _In_ USHORT          _Handle);
+
+BOOLEAN
+HciCreditsUpdate(_Inout_ PHCI_CREDITS _Credits,
+                 _In_reads_bytes_(_EventLength) PUCHAR _Event,
+                 _In_ ULONG           _EventLength);
+
+#endif // __CREDIT_H__
@@ -35,6 +35,7 @@ Environment:
 
 #include "device.h"     // Device specific
 #include "io.h"         // Read pump
+#include "credit.h"     // HCI flow control
 #include "debugdef.h"   // WPP trace
 #include "public.h"     // Share between driver and application
 
@@ -297,6 +298,20 @@ typedef struct _FDO_EXTENSION
     LIST_ENTRY  ReadDataList;
     LONG        DataListCount;
 
+    //
+    // WDF Queues to hold HCI command and write data Requests until the controller
+    // has a credit for them, and the credits it has granted
+    //
+    WDFQUEUE    WriteCommandQueue;
+    WDFQUEUE    WriteDataQueue;
+    WDFSPINLOCK CreditLock;
+    HCI_CREDITS Credits;
+
+    //
+    // Nonzero while the write pump is sending held Requests
+    //
+    LONG        WritePumpActive;
+
     //
     // Counts used to track HCI requests received and completed for various packet types
     //
@@ -503,6 +518,10 @@ PdoDevEnableWakeAtBus(_In_ WDFDEVICE          _Device,
 //
 NTSTATUS ReadResourcesAllocate(_In_ WDFDEVICE _Device);
 VOID ReadResourcesFree(_In_ WDFDEVICE _Device);
+NTSTATUS WriteResourcesAllocate(_In_ WDFDEVICE _Device);
+
+VOID
+WritePumpRun(_In_ PFDO_EXTENSION _FdoExtension);
 
 NTSTATUS
 HLP_AllocateResourceForWrite(_In_ WDFDEVICE   _Device,
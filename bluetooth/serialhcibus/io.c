@@ -287,6 +287,20 @@ Return Value:
     DoTrace(LEVEL_INFO, TFLAG_DATA,("+CR_WriteDeviceIO: %!STATUS!, Request %p, Context %p",
             Status, _Request, _Context));
 
+    if (!NT_SUCCESS(Status))
+    {
+        // The packet did not reach the controller; let a held one use its credit.
+        FdoExtension = TransferContext->FdoExtension;
+
+        WdfSpinLockAcquire(FdoExtension->CreditLock);
+          HciCreditsRelease(&FdoExtension->Credits,
+                            TransferContext->PacketType,
+                            TransferContext->ConnectionHandle);
+        WdfSpinLockRelease(FdoExtension->CreditLock);
+
+        WritePumpRun(FdoExtension);
+    }
+
     NT_ASSERT( (Status == STATUS_SUCCESS || Status == STATUS_CANCELLED) && L"WriteHCI request failed!");
 
     //
@@ -437,6 +451,134 @@ Done:
     DoTrace(LEVEL_INFO, TFLAG_IO,("-CR_WriteDeviceIO"));
 }
 
+static VOID
+WritePumpQueue(
+    _In_  PFDO_EXTENSION  _FdoExtension,
+    _In_  WDFQUEUE        _Queue
+    )
+/*++
+
+Routine Description:
+
+    This helper function sends the Requests held in one write queue, in order,
+    until the queue is empty or the controller is out of credits for the next one.
+
+Arguments:
+
+    _FdoExtension - Device's context
+    _Queue - WriteCommandQueue or WriteDataQueue
+
+Return Value:
+
+    none
+
+--*/
+{
+    NTSTATUS   Status;
+    WDFREQUEST Request;
+    WDFMEMORY  ReqInMemory;
+    PBTHX_HCI_READ_WRITE_CONTEXT HCIContext;
+    USHORT     ConnectionHandle;
+    BOOLEAN    CreditAcquired;
+
+    while (NT_SUCCESS(WdfIoQueueRetrieveNextRequest(_Queue, &Request)))
+    {
+        // Input has been validated before the Request was queued
+        Status = WdfRequestRetrieveInputMemory(Request, &ReqInMemory);
+        if (!NT_SUCCESS(Status))
+        {
+            WdfRequestComplete(Request, Status);
+            continue;
+        }
+
+        HCIContext = (PBTHX_HCI_READ_WRITE_CONTEXT) WdfMemoryGetBuffer(ReqInMemory, NULL);
+
+        ConnectionHandle = 0;
+        if (HCIContext->Type == (UCHAR) HciPacketAclData)
+        {
+            ConnectionHandle = HCI_ACL_CONNECTION_HANDLE(HCIContext->Data);
+        }
+
+        WdfSpinLockAcquire(_FdoExtension->CreditLock);
+          CreditAcquired = HciCreditsAcquire(&_FdoExtension->Credits,
+                                             HCIContext->Type,
+                                             ConnectionHandle);
+        WdfSpinLockRelease(_FdoExtension->CreditLock);
+
+        if (!CreditAcquired)
+        {
+            // Put it back at the head of the queue; it is sent when credits are returned.
+            Status = WdfRequestRequeue(Request);
+            if (!NT_SUCCESS(Status))
+            {
+                DoTrace(LEVEL_ERROR, TFLAG_IO, (" WdfRequestRequeue failed %!STATUS!", Status));
+                WdfRequestComplete(Request, Status);
+            }
+            break;
+        }
+
+        Status = FdoWriteDeviceIO(Request,
+                                  _FdoExtension->WdfDevice,
+                                  _FdoExtension,
+                                  HCIContext);
+        if (!NT_SUCCESS(Status))
+        {
+            WdfSpinLockAcquire(_FdoExtension->CreditLock);
+              HciCreditsRelease(&_FdoExtension->Credits,
+                                HCIContext->Type,
+                                ConnectionHandle);
+            WdfSpinLockRelease(_FdoExtension->CreditLock);
+
+            WdfRequestComplete(Request, Status);
+        }
+    }
+}
+
+VOID
+WritePumpRun(
+    _In_  PFDO_EXTENSION  _FdoExtension
+    )
+/*++
+
+Routine Description:
+
+    This function sends held HCI command and data Requests to the device for as
+    long as the controller has credits for them.  It is called whenever a Request
+    is queued or credits are returned.
+
+    Only one caller services the queues at a time; a caller that finds the pump
+    running leaves its work to it, and the running pump makes one more pass.
+
+Arguments:
+
+    _FdoExtension - Device's context
+
+Return Value:
+
+    none
+
+--*/
+{
+    if (InterlockedIncrement(&_FdoExtension->WritePumpActive) != 1)
+    {
+        return;
+    }
+
+    for (;;)
+    {
+        WritePumpQueue(_FdoExtension, _FdoExtension->WriteCommandQueue);
+        WritePumpQueue(_FdoExtension, _FdoExtension->WriteDataQueue);
+
+        if (InterlockedDecrement(&_FdoExtension->WritePumpActive) == 0)
+        {
+            break;
+        }
+
+        // Somebody called in while the queues were serviced; go around again.
+        InterlockedExchange(&_FdoExtension->WritePumpActive, 1);
+    }
+}
+
 
 VOID
 ReadSegmentStateSet(
@@ -513,6 +655,18 @@ ReadH4PacketComplete(
 
     if (_Type == (UCHAR) HciPacketEvent)
     {
+        BOOLEAN CreditReturned;
+
+        // Pick up the command and data credits that come back with events
+        WdfSpinLockAcquire(_FdoExtension->CreditLock);
+          CreditReturned = HciCreditsUpdate(&_FdoExtension->Credits, _Buffer, _BufferLength);
+        WdfSpinLockRelease(_FdoExtension->CreditLock);
+
+        if (CreditReturned)
+        {
+            WritePumpRun(_FdoExtension);
+        }
+
         ReadRequestComplete(_FdoExtension,
                             HciPacketEvent,
                             _BufferLength,
@@ -1567,3 +1721,84 @@ Done:
     return Status;
 }
 
+NTSTATUS
+WriteResourcesAllocate(
+    _In_  WDFDEVICE _Device
+)
+/*++
+Routine Description:
+
+    This helper function allocates the queues that hold HCI write Requests from
+    upper layer until the controller has a credit for them.
+
+Arguments:
+
+    _Device - WDF Device object
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    NTSTATUS  Status;
+    PFDO_EXTENSION   FdoExtension;
+    WDF_IO_QUEUE_CONFIG QueueConfig;
+    WDF_OBJECT_ATTRIBUTES ObjAttributes;
+
+    DoTrace(LEVEL_INFO, TFLAG_IO,("+WriteResourcesAllocate"));
+
+    FdoExtension = FdoGetExtension(_Device);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&ObjAttributes);
+    ObjAttributes.ParentObject = _Device;
+
+    Status = WdfSpinLockCreate(&ObjAttributes, &FdoExtension->CreditLock);
+    if (!NT_SUCCESS(Status))
+    {
+        DoTrace(LEVEL_ERROR, TFLAG_IO, (" WdfSpinLockCreate(Credit) %!STATUS!", Status));
+        goto Done;
+    }
+
+    HciCreditsReset(&FdoExtension->Credits);
+    FdoExtension->WritePumpActive = 0;
+
+    //
+    // Held Requests stay queued across a power down and are sent once the
+    // controller grants credits again, so these queues are not power managed.
+    //
+    WDF_IO_QUEUE_CONFIG_INIT(&QueueConfig,
+                             WdfIoQueueDispatchManual);
+    QueueConfig.PowerManaged = WdfFalse;
+
+    // HCI_COMMAND
+    Status = WdfIoQueueCreate(_Device,
+                              &QueueConfig,
+                              WDF_NO_OBJECT_ATTRIBUTES,
+                              &FdoExtension->WriteCommandQueue);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DoTrace(LEVEL_ERROR, TFLAG_IO, (" WdfIoQueueCreate(Command) %!STATUS!", Status));
+        goto Done;
+    }
+
+    // HCI_DATA
+    Status = WdfIoQueueCreate(_Device,
+                              &QueueConfig,
+                              WDF_NO_OBJECT_ATTRIBUTES,
+                              &FdoExtension->WriteDataQueue);
+
+    if (!NT_SUCCESS(Status))
+    {
+        DoTrace(LEVEL_ERROR, TFLAG_IO, (" WdfIoQueueCreate(WriteData) %!STATUS!", Status));
+        goto Done;
+    }
+
+Done:
+
+    DoTrace(LEVEL_INFO, TFLAG_IO,("-WriteResourcesAllocate %!STATUS!", Status));
+
+    return Status;
+}
+
@@ -0,0 +1,563 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    creditsim.c
+
+Abstract:
+
+    Host simulation of HCI flow control. A model controller with an
+    initialization time, a limited number of command slots and ACL
+    buffers answers the commands and ACL data that a model host sends
+    through HciCreditsAcquire, the way the write pump in io.c does. Its
+    events go through HciCreditsUpdate, and the host only tries to send
+    again when that returns TRUE, so a credit that is never handed back
+    shows up as a stall.
+
+    The controller fails the run if the host ever sends a command or an
+    ACL packet it has no room for. At the end every credit must be back.
+
+    Builds with the stub driver.h in this directory:
+
+        cc -O2 -Wall -Wextra test/creditsim.c -o creditsim
+
+Environment:
+
+    user mode, host test only
+
+--*/
+
+#include "driver.h"
+#include "../credit.c"
+
+#include <stdio.h>
+
+#define HCI_OPCODE_READ_LOCAL_VERSION   0x1001
+#define HCI_OPCODE_DISCONNECT           0x0406
+
+#define SIM_TICK_US                     10
+#define SIM_LIMIT_US                    2000000
+#define SIM_LINKS                       3
+#define SIM_ACL_PER_LINK                200
+#define SIM_MAX_COMMANDS                16
+#define SIM_MAX_ACL                     256
+
+typedef struct _SIM_CONFIG {
+    const char *Name;
+    ULONG   InitTimeUs;             // power on, and HCI_Reset, before the controller answers
+    ULONG   CommandTimeUs;          // time to run any other command
+    ULONG   CommandSlots;           // Num_HCI_Command_Packets once reset
+    ULONG   AclBuffers;             // Total_Num_ACL_Data_Packets
+    ULONG   AclTimeUs;              // air time of one ACL packet
+    ULONG   CompletedBatch;         // packets per Number Of Completed Packets event
+    ULONG   WriteFailEvery;         // every Nth ACL write to the UART fails, 0 for never
+    ULONG   DisconnectAtUs;         // link 2 is disconnected this long after init
+} SIM_CONFIG;
+
+typedef struct _SIM_COMMAND {
+    ULONG   At;                     // when bthport hands it down
+    USHORT  Opcode;
+    USHORT  Handle;
+} SIM_COMMAND;
+
+typedef struct _SIM {
+    const SIM_CONFIG *Config;
+    ULONG   Now;
+    BOOLEAN Failed;
+
+    //
+    // Host side: the credits, and what bthport still has to send
+    //
+    HCI_CREDITS Credits;
+    SIM_COMMAND HostCommands[SIM_MAX_COMMANDS];
+    ULONG   HostCommandCount;
+    ULONG   HostCommandNext;
+    BOOLEAN AclReady;
+    ULONG   AclPending[SIM_LINKS];
+    ULONG   NextLink;
+    ULONG   Writes;
+    ULONG   WriteFailures[SIM_LINKS];
+    ULONG   Dropped[SIM_LINKS];
+
+    //
+    // Controller side
+    //
+    BOOLEAN Initialized;
+    ULONG   ReadyAt;
+    SIM_COMMAND Commands[SIM_MAX_COMMANDS];
+    ULONG   CommandCount;
+    ULONG   CommandDoneAt;
+    USHORT  Acl[SIM_MAX_ACL];       // handles of buffered packets, oldest first
+    ULONG   AclCount;
+    ULONG   AclDoneAt;
+    ULONG   AclPeak;
+    ULONG   Completed[SIM_LINKS];
+    ULONG   CompletedTotal;
+    ULONG   Transmitted[SIM_LINKS];
+    ULONG   Flushed[SIM_LINKS];
+} SIM, *PSIM;
+
+static int Failures;
+
+static VOID
+SimFail(
+    _Inout_ PSIM _Sim,
+    _In_ const char *_What
+    )
+{
+    if (!_Sim->Failed)
+    {
+        printf("FAIL %s: %s at %u us\n", _Sim->Config->Name, _What, _Sim->Now);
+        _Sim->Failed = TRUE;
+        Failures++;
+    }
+}
+
+static VOID HostPump(_Inout_ PSIM _Sim);
+
+static VOID
+HostEvent(
+    _Inout_ PSIM _Sim,
+    _In_reads_bytes_(_Length) PUCHAR _Event,
+    _In_ ULONG   _Length
+    )
+{
+    BOOLEAN Returned;
+
+    Returned = HciCreditsUpdate(&_Sim->Credits, _Event, _Length);
+
+    // bthport starts on ACL data once it knows the buffer count, and
+    // drops what it still had for a link that went away
+    if (_Event[0] == HCI_EVENT_COMMAND_COMPLETE &&
+        (_Event[3] | (_Event[4] << 8)) == HCI_OPCODE_READ_BUFFER_SIZE)
+    {
+        _Sim->AclReady = TRUE;
+    }
+    else if (_Event[0] == HCI_EVENT_DISCONNECTION_COMPLETE)
+    {
+        ULONG Link = HCI_ACL_CONNECTION_HANDLE(&_Event[3]) - 1;
+
+        _Sim->Dropped[Link] += _Sim->AclPending[Link];
+        _Sim->AclPending[Link] = 0;
+    }
+
+    if (Returned)
+    {
+        HostPump(_Sim);
+    }
+}
+
+static ULONG
+ControllerCommandSlots(
+    _In_ PSIM _Sim
+    )
+{
+    return _Sim->Initialized ? _Sim->Config->CommandSlots : HCI_INITIAL_COMMAND_CREDITS;
+}
+
+static VOID
+ControllerCommandComplete(
+    _Inout_ PSIM _Sim,
+    _In_ USHORT  _Opcode
+    )
+{
+    UCHAR Event[2 + 11] = { 0 };
+    UCHAR Length = 4;
+
+    Event[0] = HCI_EVENT_COMMAND_COMPLETE;
+    Event[2] = (UCHAR) (ControllerCommandSlots(_Sim) - _Sim->CommandCount);
+    Event[3] = (UCHAR) _Opcode;
+    Event[4] = (UCHAR) (_Opcode >> 8);
+    Event[5] = 0;                               // Status
+
+    if (_Opcode == HCI_OPCODE_READ_BUFFER_SIZE)
+    {
+        Event[6] = (UCHAR) 1021;                // ACL_Data_Packet_Length
+        Event[7] = (UCHAR) (1021 >> 8);
+        Event[8] = 64;                          // SCO_Data_Packet_Length
+        Event[9] = (UCHAR) _Sim->Config->AclBuffers;
+        Event[10] = (UCHAR) (_Sim->Config->AclBuffers >> 8);
+        Length = 11;
+    }
+
+    Event[1] = Length;
+    HostEvent(_Sim, Event, 2 + Length);
+}
+
+static VOID
+ControllerDisconnect(
+    _Inout_ PSIM _Sim,
+    _In_ USHORT  _Handle
+    )
+{
+    UCHAR Status[] = { HCI_EVENT_COMMAND_STATUS, 4, 0, 0,
+                       (UCHAR) HCI_OPCODE_DISCONNECT, (UCHAR) (HCI_OPCODE_DISCONNECT >> 8) };
+    UCHAR Complete[] = { HCI_EVENT_DISCONNECTION_COMPLETE, 4, 0,
+                         (UCHAR) _Handle, (UCHAR) (_Handle >> 8), 0x16 };
+    ULONG Link = _Handle - 1;
+    ULONG Kept = 0;
+    ULONG Index;
+
+    Status[3] = (UCHAR) (ControllerCommandSlots(_Sim) - _Sim->CommandCount);
+    HostEvent(_Sim, Status, sizeof(Status));
+
+    // Buffered packets of the link are flushed, and neither they nor the
+    // completed ones not reported yet get a Number Of Completed Packets
+    for (Index = 0; Index < _Sim->AclCount; Index++)
+    {
+        if (_Sim->Acl[Index] == _Handle)
+        {
+            _Sim->Flushed[Link]++;
+            if (Index == 0)
+            {
+                _Sim->AclDoneAt = 0;
+            }
+        }
+        else
+        {
+            _Sim->Acl[Kept++] = _Sim->Acl[Index];
+        }
+    }
+    _Sim->AclCount = Kept;
+    _Sim->CompletedTotal -= _Sim->Completed[Link];
+    _Sim->Completed[Link] = 0;
+
+    HostEvent(_Sim, Complete, sizeof(Complete));
+}
+
+static VOID
+ControllerRunCommand(
+    _Inout_ PSIM _Sim
+    )
+{
+    SIM_COMMAND Command = _Sim->Commands[0];
+    ULONG Link;
+
+    _Sim->CommandCount--;
+    memmove(&_Sim->Commands[0], &_Sim->Commands[1], _Sim->CommandCount * sizeof(SIM_COMMAND));
+    _Sim->CommandDoneAt = 0;
+
+    switch (Command.Opcode)
+    {
+    case HCI_OPCODE_RESET:
+        _Sim->Initialized = TRUE;
+        _Sim->AclCount = 0;
+        _Sim->AclDoneAt = 0;
+        for (Link = 0; Link < SIM_LINKS; Link++)
+        {
+            _Sim->Completed[Link] = 0;
+        }
+        _Sim->CompletedTotal = 0;
+        ControllerCommandComplete(_Sim, Command.Opcode);
+        break;
+
+    case HCI_OPCODE_DISCONNECT:
+        ControllerDisconnect(_Sim, Command.Handle);
+        break;
+
+    default:
+        ControllerCommandComplete(_Sim, Command.Opcode);
+        break;
+    }
+}
+
+static VOID
+ControllerReportCompleted(
+    _Inout_ PSIM _Sim
+    )
+{
+    UCHAR Event[3 + 4 * SIM_LINKS];
+    UCHAR Handles = 0;
+    ULONG Link;
+
+    Event[0] = HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS;
+    for (Link = 0; Link < SIM_LINKS; Link++)
+    {
+        if (_Sim->Completed[Link])
+        {
+            PUCHAR Entry = &Event[3 + 4 * Handles];
+
+            Entry[0] = (UCHAR) (Link + 1);
+            Entry[1] = 0;
+            Entry[2] = (UCHAR) _Sim->Completed[Link];
+            Entry[3] = (UCHAR) (_Sim->Completed[Link] >> 8);
+            _Sim->Completed[Link] = 0;
+            Handles++;
+        }
+    }
+    Event[1] = (UCHAR) (1 + 4 * Handles);
+    Event[2] = Handles;
+    _Sim->CompletedTotal = 0;
+
+    HostEvent(_Sim, Event, 3 + 4 * Handles);
+}
+
+static VOID
+ControllerStep(
+    _Inout_ PSIM _Sim
+    )
+{
+    const SIM_CONFIG *Config = _Sim->Config;
+
+    if (_Sim->Now < _Sim->ReadyAt)
+    {
+        return;
+    }
+
+    if (_Sim->CommandCount && !_Sim->CommandDoneAt)
+    {
+        _Sim->CommandDoneAt = _Sim->Now +
+            (_Sim->Commands[0].Opcode == HCI_OPCODE_RESET ? Config->InitTimeUs : Config->CommandTimeUs);
+    }
+    if (_Sim->CommandDoneAt && _Sim->Now >= _Sim->CommandDoneAt)
+    {
+        ControllerRunCommand(_Sim);
+    }
+
+    if (_Sim->AclCount && !_Sim->AclDoneAt)
+    {
+        _Sim->AclDoneAt = _Sim->Now + Config->AclTimeUs;
+    }
+    if (_Sim->AclDoneAt && _Sim->Now >= _Sim->AclDoneAt)
+    {
+        ULONG Link = _Sim->Acl[0] - 1;
+
+        _Sim->AclCount--;
+        memmove(&_Sim->Acl[0], &_Sim->Acl[1], _Sim->AclCount * sizeof(USHORT));
+        _Sim->AclDoneAt = 0;
+        _Sim->Transmitted[Link]++;
+        _Sim->Completed[Link]++;
+        _Sim->CompletedTotal++;
+    }
+
+    if (_Sim->CompletedTotal >= Config->CompletedBatch ||
+        (_Sim->CompletedTotal && _Sim->AclCount == 0))
+    {
+        ControllerReportCompleted(_Sim);
+    }
+}
+
+static VOID
+HostPump(
+    _Inout_ PSIM _Sim
+    )
+{
+    const SIM_CONFIG *Config = _Sim->Config;
+
+    while (_Sim->HostCommandNext < _Sim->HostCommandCount &&
+           _Sim->HostCommands[_Sim->HostCommandNext].At <= _Sim->Now)
+    {
+        if (!HciCreditsAcquire(&_Sim->Credits, (UCHAR) HciPacketCommand, 0))
+        {
+            break;
+        }
+        if (_Sim->CommandCount >= ControllerCommandSlots(_Sim))
+        {
+            SimFail(_Sim, "command sent without a free command slot");
+            return;
+        }
+        _Sim->Commands[_Sim->CommandCount++] = _Sim->HostCommands[_Sim->HostCommandNext++];
+    }
+
+    while (_Sim->AclReady)
+    {
+        ULONG Link = SIM_LINKS;
+        ULONG Index;
+
+        for (Index = 0; Index < SIM_LINKS; Index++)
+        {
+            if (_Sim->AclPending[(_Sim->NextLink + Index) % SIM_LINKS])
+            {
+                Link = (_Sim->NextLink + Index) % SIM_LINKS;
+                break;
+            }
+        }
+        if (Link == SIM_LINKS ||
+            !HciCreditsAcquire(&_Sim->Credits, (UCHAR) HciPacketAclData, (USHORT) (Link + 1)))
+        {
+            break;
+        }
+
+        _Sim->AclPending[Link]--;
+        _Sim->NextLink = Link + 1;
+
+        // A failed UART write completes the request with an error
+        if (Config->WriteFailEvery && ++_Sim->Writes % Config->WriteFailEvery == 0)
+        {
+            HciCreditsRelease(&_Sim->Credits, (UCHAR) HciPacketAclData, (USHORT) (Link + 1));
+            _Sim->WriteFailures[Link]++;
+            continue;
+        }
+
+        if (_Sim->AclCount >= Config->AclBuffers)
+        {
+            SimFail(_Sim, "ACL packet sent without a free buffer");
+            return;
+        }
+        _Sim->Acl[_Sim->AclCount++] = (USHORT) (Link + 1);
+        _Sim->AclPeak = max(_Sim->AclPeak, _Sim->AclCount);
+    }
+}
+
+static BOOLEAN
+SimIdle(
+    _In_ PSIM _Sim
+    )
+{
+    ULONG Link;
+
+    if (_Sim->HostCommandNext < _Sim->HostCommandCount || _Sim->CommandCount ||
+        _Sim->AclCount || _Sim->CompletedTotal)
+    {
+        return FALSE;
+    }
+    for (Link = 0; Link < SIM_LINKS; Link++)
+    {
+        if (_Sim->AclPending[Link])
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static VOID
+SimRun(
+    _In_ const SIM_CONFIG *_Config
+    )
+{
+    static SIM Sim;
+    SIM_COMMAND *Command;
+    ULONG Next;
+    ULONG Link;
+    ULONG Total = 0;
+
+    memset(&Sim, 0, sizeof(Sim));
+    Sim.Config = _Config;
+    Sim.ReadyAt = _Config->InitTimeUs;
+    HciCreditsReset(&Sim.Credits);
+
+    // bthport's start up sequence, then a disconnect while data flows
+    Command = Sim.HostCommands;
+    *Command++ = (SIM_COMMAND) { 0, HCI_OPCODE_RESET, 0 };
+    *Command++ = (SIM_COMMAND) { 0, HCI_OPCODE_READ_BUFFER_SIZE, 0 };
+    *Command++ = (SIM_COMMAND) { 0, HCI_OPCODE_READ_LOCAL_VERSION, 0 };
+    *Command++ = (SIM_COMMAND) { 0, HCI_OPCODE_READ_LOCAL_VERSION, 0 };
+    *Command++ = (SIM_COMMAND) { 0, HCI_OPCODE_READ_LOCAL_VERSION, 0 };
+    *Command++ = (SIM_COMMAND) { 2 * _Config->InitTimeUs + _Config->DisconnectAtUs, HCI_OPCODE_DISCONNECT, 2 };
+    Sim.HostCommandCount = (ULONG) (Command - Sim.HostCommands);
+
+    for (Link = 0; Link < SIM_LINKS; Link++)
+    {
+        Sim.AclPending[Link] = SIM_ACL_PER_LINK;
+    }
+
+    HostPump(&Sim);
+    for (Sim.Now = 0; Sim.Now < SIM_LIMIT_US && !Sim.Failed && !SimIdle(&Sim); Sim.Now += SIM_TICK_US)
+    {
+        // A command handed down by bthport kicks the pump, as a new write request would
+        Next = Sim.HostCommandNext;
+        if (Next < Sim.HostCommandCount &&
+            Sim.HostCommands[Next].At > Sim.Now - SIM_TICK_US &&
+            Sim.HostCommands[Next].At <= Sim.Now)
+        {
+            HostPump(&Sim);
+        }
+        ControllerStep(&Sim);
+    }
+
+    if (!Sim.Failed && !SimIdle(&Sim))
+    {
+        SimFail(&Sim, "stalled with packets left to send");
+    }
+    if (Sim.Credits.AclOutstanding != 0)
+    {
+        SimFail(&Sim, "ACL credits not all returned");
+    }
+    for (Link = 0; Link < HCI_CREDIT_MAX_LINKS; Link++)
+    {
+        if (Sim.Credits.Links[Link].Outstanding)
+        {
+            SimFail(&Sim, "link entry still holds packets");
+        }
+    }
+    for (Link = 0; Link < SIM_LINKS; Link++)
+    {
+        if (Sim.Transmitted[Link] + Sim.Flushed[Link] + Sim.Dropped[Link] + Sim.WriteFailures[Link] !=
+            SIM_ACL_PER_LINK)
+        {
+            SimFail(&Sim, "ACL packets lost");
+        }
+        Total += Sim.Transmitted[Link];
+    }
+    if (Sim.Credits.CommandCredits != _Config->CommandSlots)
+    {
+        SimFail(&Sim, "command credits not all returned");
+    }
+    if (_Config->InitTimeUs && Sim.Credits.CommandStalls == 0)
+    {
+        SimFail(&Sim, "no command waited for initialization");
+    }
+
+    printf("%-34s %7.2f ms, %4u ACL sent (%3u flushed, %3u dropped), "
+           "stalls %2u cmd %4u ACL, ACL peak %u/%u\n",
+           _Config->Name, Sim.Now / 1000.0, Total,
+           Sim.Flushed[1], Sim.Dropped[1],
+           Sim.Credits.CommandStalls, Sim.Credits.AclStalls,
+           Sim.AclPeak, _Config->AclBuffers);
+}
+
+static VOID
+MalformedEvents(
+    VOID
+    )
+{
+    HCI_CREDITS Credits;
+    UCHAR ShortComplete[] = { HCI_EVENT_COMMAND_COMPLETE, 3, 5, 0x03 };
+    UCHAR ShortCompleted[] = { HCI_EVENT_NUMBER_OF_COMPLETED_PACKETS, 5, 2, 1, 0, 1, 0 };
+
+    // Truncated events are ignored and the credits stay as they were
+    HciCreditsReset(&Credits);
+    HciCreditsAcquire(&Credits, (UCHAR) HciPacketAclData, 1);
+
+    if (HciCreditsUpdate(&Credits, ShortComplete, 1) ||
+        HciCreditsUpdate(&Credits, ShortComplete, sizeof(ShortComplete)) ||
+        HciCreditsUpdate(&Credits, ShortCompleted, sizeof(ShortCompleted)) ||
+        Credits.CommandCredits != HCI_INITIAL_COMMAND_CREDITS ||
+        Credits.AclOutstanding != 1)
+    {
+        printf("FAIL malformed events changed the credits\n");
+        Failures++;
+    }
+}
+
+int
+main(
+    VOID
+    )
+{
+    static const SIM_CONFIG Configs[] = {
+        // Name                             Init    Cmd  Slots Bufs  Air  Batch Fail  Disconnect
+        { "ready controller",               0,      100, 1,    8,    100, 4,    0,    10000 },
+        { "10 ms init, 4 command slots",    10000,  100, 4,    8,    100, 1,    0,    10000 },
+        { "100 ms init, slow radio",        100000, 500, 1,    4,    625, 2,    0,    50000 },
+        { "100 ms init, failing writes",    100000, 100, 1,    8,    100, 8,    7,    10000 },
+    };
+    ULONG Index;
+
+    MalformedEvents();
+    for (Index = 0; Index < sizeof(Configs) / sizeof(Configs[0]); Index++)
+    {
+        SimRun(&Configs[Index]);
+    }
+
+    if (Failures)
+    {
+        return 1;
+    }
+
+    printf("HCI credit simulation passed\n");
+    return 0;
+}
@@ -0,0 +1,71 @@
+/*++
+
+Copyright (c) Microsoft Corporation All Rights Reserved
+
+Module Name:
+
+    driver.h
+
+Abstract:
+
+    Stand-in for the driver's common header, with just what credit.c
+    needs, so the credit tracking builds on a host without the WDK.
+    It claims the DRIVER_H guard, so the real driver.h that credit.c
+    includes is skipped.
+
+Environment:
+
+    user mode, host test only
+
+--*/
+
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+typedef void VOID;
+typedef unsigned char UCHAR, *PUCHAR, BOOLEAN;
+typedef unsigned short USHORT;
+typedef uint16_t UINT16;
+typedef uint32_t ULONG;
+
+#define TRUE  1
+#define FALSE 0
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(_Size)
+
+#define FIELD_OFFSET(_Type, _Field) offsetof(_Type, _Field)
+#define RtlZeroMemory(_Destination, _Length) memset((_Destination), 0, (_Length))
+#define min(_A, _B) (((_A) < (_B)) ? (_A) : (_B))
+#define max(_A, _B) (((_A) > (_B)) ? (_A) : (_B))
+
+//
+// From BthXDDI.h
+//
+typedef enum _BTHX_HCI_PACKET_TYPE {
+    HciPacketCommand = 0x01,
+    HciPacketAclData = 0x02,
+    HciPacketEvent   = 0x04
+} BTHX_HCI_PACKET_TYPE;
+
+//
+// From Io.h
+//
+#pragma pack(push, 1)
+typedef struct _HCI_EVENT_PACKET {
+    UCHAR   EventCode;
+    UCHAR   ParamsCount;            // 0..255
+    UCHAR   Params[1];
+} HCI_EVENT_PACKET, *PHCI_EVENT_PACKET;
+#pragma pack(pop)
+#define HCI_EVENT_HEADER_LEN  FIELD_OFFSET(HCI_EVENT_PACKET, Params)
+
+#include "../credit.h"
+
+#endif // DRIVER_H
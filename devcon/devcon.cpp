@@ -15,12 +15,6 @@ Abstract:
 
 #include "devcon.h"
 
-struct IdEntry {
-    LPCTSTR String;     // string looking for
-    LPCTSTR Wild;       // first wild character if any
-    BOOL    InstanceId;
-};
-
 void FormatToStream(_In_ FILE * stream, _In_ DWORD fmt,...)
 /*++
 
@@ -313,50 +307,6 @@ Return Value:
     return desc;
 }
 
-IdEntry GetIdType(_In_ LPCTSTR Id)
-/*++
-
-Routine Description:
-
-    Determine if this is instance id or hardware id and if there's any wildcards
-    instance ID is prefixed by '@'
-    wildcards are '*'
-
-
-Arguments:
-
-    Id - ptr to string to check
-
-Return Value:
-
-    IdEntry
-
---*/
-{
-    IdEntry Entry;
-
-    Entry.InstanceId = FALSE;
-    Entry.Wild = NULL;
-    Entry.String = Id;
-
-    if(Entry.String[0] == INSTANCEID_PREFIX_CHAR) {
-        Entry.InstanceId = TRUE;
-        Entry.String = CharNext(Entry.String);
-    }
-    if(Entry.String[0] == QUOTE_PREFIX_CHAR) {
-        //
-        // prefix to treat rest of string literally
-        //
-        Entry.String = CharNext(Entry.String);
-    } else {
-        //
-        // see if any wild characters exist
-        //
-        Entry.Wild = _tcschr(Entry.String,WILD_CHAR);
-    }
-    return Entry;
-}
-
 __drv_allocatesMem(object)
 LPTSTR * GetMultiSzIndexArray(_In_ __drv_aliasesMem LPTSTR MultiSz)
 /*++
@@ -552,6 +502,40 @@ failed:
     return NULL;
 }
 
+__drv_allocatesMem(object)
+LPTSTR * GetFoldedDevMultiSz(_In_ HDEVINFO Devs, _In_ PSP_DEVINFO_DATA DevInfo, _In_ DWORD Prop)
+/*++
+
+Routine Description:
+
+    Get a multi-sz device property as GetDevMultiSz does
+    and case-fold every string for WildCompareHwIds
+
+Arguments:
+
+    Devs    - HDEVINFO containing DevInfo
+    DevInfo - Specific device
+    Prop    - SPDRP_HARDWAREID or SPDRP_COMPATIBLEIDS
+
+Return Value:
+
+    array of strings. last entry+1 of array contains NULL
+    returns NULL on failure
+
+--*/
+{
+    LPTSTR * array;
+    int i;
+
+    array = GetDevMultiSz(Devs,DevInfo,Prop);
+    if(array) {
+        for(i = 0; array[i]; i++) {
+            FoldIdString(array[i]);
+        }
+    }
+    return array;
+}
+
 __drv_allocatesMem(object)
 LPTSTR * GetRegMultiSz(_In_ HKEY hKey, _In_ LPCTSTR Val)
 /*++
@@ -619,145 +603,7 @@ failed:
     return NULL;
 }
 
-BOOL WildCardMatch(_In_ LPCTSTR Item, _In_ const IdEntry & MatchEntry)
-/*++
-
-Routine Description:
-
-    Compare a single item against wildcard
-    I'm sure there's better ways of implementing this
-    Other than a command-line management tools
-    it's a bad idea to use wildcards as it implies
-    assumptions about the hardware/instance ID
-    eg, it might be tempting to enumerate root\* to
-    find all root devices, however there is a CfgMgr
-    API to query status and determine if a device is
-    root enumerated, which doesn't rely on implementation
-    details.
-
-Arguments:
-
-    Item - item to find match for eg a\abcd\c
-    MatchEntry - eg *\*bc*\*
-
-Return Value:
-
-    TRUE if any match, otherwise FALSE
-
---*/
-{
-    LPCTSTR scanItem;
-    LPCTSTR wildMark;
-    LPCTSTR nextWild;
-    size_t matchlen;
-
-    //
-    // before attempting anything else
-    // try and compare everything up to first wild
-    //
-    if(!MatchEntry.Wild) {
-        return _tcsicmp(Item,MatchEntry.String) ? FALSE : TRUE;
-    }
-    if(_tcsnicmp(Item,MatchEntry.String,MatchEntry.Wild-MatchEntry.String) != 0) {
-        return FALSE;
-    }
-    wildMark = MatchEntry.Wild;
-    scanItem = Item + (MatchEntry.Wild-MatchEntry.String);
-
-    for(;wildMark[0];) {
-        //
-        // if we get here, we're either at or past a wildcard
-        //
-        if(wildMark[0] == WILD_CHAR) {
-            //
-            // so skip wild chars
-            //
-            wildMark = CharNext(wildMark);
-            continue;
-        }
-        //
-        // find next wild-card
-        //
-        nextWild = _tcschr(wildMark,WILD_CHAR);
-        if(nextWild) {
-            //
-            // substring
-            //
-            matchlen = nextWild-wildMark;
-        } else {
-            //
-            // last portion of match
-            //
-            size_t scanlen = _tcslen(scanItem);
-            matchlen = _tcslen(wildMark);
-            if(scanlen < matchlen) {
-                return FALSE;
-            }
-            return _tcsicmp(scanItem+scanlen-matchlen,wildMark) ? FALSE : TRUE;
-        }
-        if(_istalpha(wildMark[0])) {
-            //
-            // scan for either lower or uppercase version of first character
-            //
-
-            //
-            // the code suppresses the warning 28193 for the calls to _totupper
-            // and _totlower.  This suppression is done because those functions
-            // have a check return annotation on them.  However, they don't return
-            // error codes and the check return annotation is really being used
-            // to indicate that the return value of the function should be looked
-            // at and/or assigned to a variable.  The check return annotation means
-            // the return value should always be checked in all code paths.
-            // We assign the return values to variables but the while loop does not
-            // examine both values in all code paths (e.g. when scanItem[0] == 0,
-            // neither u nor l will be examined) and it doesn't need to examine
-            // the values in all code paths.
-            //
-#pragma warning( suppress: 28193)
-            TCHAR u = _totupper(wildMark[0]);
-#pragma warning( suppress: 28193)
-            TCHAR l = _totlower(wildMark[0]);
-            while(scanItem[0] && scanItem[0]!=u && scanItem[0]!=l) {
-                scanItem = CharNext(scanItem);
-            }
-            if(!scanItem[0]) {
-                //
-                // ran out of string
-                //
-                return FALSE;
-            }
-        } else {
-            //
-            // scan for first character (no case)
-            //
-            scanItem = _tcschr(scanItem,wildMark[0]);
-            if(!scanItem) {
-                //
-                // ran out of string
-                //
-                return FALSE;
-            }
-        }
-        //
-        // try and match the sub-string at wildMark against scanItem
-        //
-        if(_tcsnicmp(scanItem,wildMark,matchlen)!=0) {
-            //
-            // nope, try again
-            //
-            scanItem = CharNext(scanItem);
-            continue;
-        }
-        //
-        // substring matched
-        //
-        scanItem += matchlen;
-        wildMark += matchlen;
-    }
-    return (wildMark[0] ? FALSE : TRUE);
-}
-
-BOOL WildCompareHwIds(_In_ PZPWSTR Array, _In_ const IdEntry & MatchEntry)
+BOOL WildCompareHwIds(_In_opt_ PZPWSTR Array, _In_ const IdEntry & MatchEntry)
 /*++
 
 Routine Description:
@@ -767,7 +613,7 @@ Routine Description:
 
 Arguments:
 
-    Array - pointer returned by GetDevMultiSz
+    Array - pointer returned by GetFoldedDevMultiSz
     MatchEntry - string to compare against
 
 Return Value:
@@ -864,6 +710,8 @@ Return Value:
     BOOL doSearch = FALSE;
     BOOL match;
     BOOL all = FALSE;
+    BOOL needInstanceId = FALSE;
+    BOOL needHwIds = FALSE;
     GUID cls;
     DWORD numClass = 0;
     int skip = 0;
@@ -874,7 +722,7 @@ Return Value:
         return EXIT_USAGE;
     }
 
-    templ = new IdEntry[argc];
+    templ = new IdEntry[argc]();
     if(!templ) {
         goto final;
     }
@@ -915,12 +763,23 @@ Return Value:
     //
     for(argIndex=skip;argIndex<argc;argIndex++) {
         templ[argIndex] = GetIdType(argv[argIndex]);
+        if(!CompileIdEntry(templ[argIndex])) {
+            goto final;
+        }
         if(templ[argIndex].Wild || !templ[argIndex].InstanceId) {
             //
             // anything other than simple InstanceId's require a search
             //
             doSearch = TRUE;
         }
+        //
+        // note which device properties the search will need
+        //
+        if(templ[argIndex].InstanceId) {
+            needInstanceId = TRUE;
+        } else {
+            needHwIds = TRUE;
+        }
     }
     if(doSearch || all) {
         //
@@ -975,17 +834,33 @@ Return Value:
     for(devIndex=0;SetupDiEnumDeviceInfo(devs,devIndex,&devInfo);devIndex++) {
 
         if(doSearch) {
-            for(argIndex=skip,match=FALSE;(argIndex<argc) && !match;argIndex++) {
-                TCHAR devID[MAX_DEVICE_ID_LEN];
-                LPTSTR *hwIds = NULL;
-                LPTSTR *compatIds = NULL;
+            TCHAR devID[MAX_DEVICE_ID_LEN];
+            LPTSTR *hwIds = NULL;
+            LPTSTR *compatIds = NULL;
+
+            //
+            // fetch the properties needed by the patterns once per device,
+            // already case-folded, rather than once per pattern
+            //
+            devID[0] = TEXT('\0');
+            if(needInstanceId) {
                 //
                 // determine instance ID
                 //
                 if(CM_Get_Device_ID_Ex(devInfo.DevInst,devID,MAX_DEVICE_ID_LEN,0,devInfoListDetail.RemoteMachineHandle)!=CR_SUCCESS) {
                     devID[0] = TEXT('\0');
                 }
+                FoldIdString(devID);
+            }
+            if(needHwIds) {
+                //
+                // determine hardware ID's
+                //
+                hwIds = GetFoldedDevMultiSz(devs,&devInfo,SPDRP_HARDWAREID);
+                compatIds = GetFoldedDevMultiSz(devs,&devInfo,SPDRP_COMPATIBLEIDS);
+            }
 
+            for(argIndex=skip,match=FALSE;(argIndex<argc) && !match;argIndex++) {
                 if(templ[argIndex].InstanceId) {
                     //
                     // match on the instance ID
@@ -995,20 +870,16 @@ Return Value:
                     }
                 } else {
                     //
-                    // determine hardware ID's
-                    // and search for matches
+                    // search hardware ID's for matches
                     //
-                    hwIds = GetDevMultiSz(devs,&devInfo,SPDRP_HARDWAREID);
-                    compatIds = GetDevMultiSz(devs,&devInfo,SPDRP_COMPATIBLEIDS);
-
                     if(WildCompareHwIds(hwIds,templ[argIndex]) ||
                         WildCompareHwIds(compatIds,templ[argIndex])) {
                         match = TRUE;
                     }
                 }
-                DelMultiSz(hwIds);
-                DelMultiSz(compatIds);
             }
+            DelMultiSz(hwIds);
+            DelMultiSz(compatIds);
         } else {
             match = TRUE;
         }
@@ -1025,6 +896,11 @@ Return Value:
 
 final:
     if(templ) {
+        for(argIndex=0;argIndex<argc;argIndex++) {
+            if(templ[argIndex].Folded) {
+                delete [] templ[argIndex].Folded;
+            }
+        }
         delete [] templ;
     }
     if(devs != INVALID_HANDLE_VALUE) {
@@ -0,0 +1,219 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+Module Name:
+
+    idmatch.cpp
+
+Abstract:
+
+    Device Console
+    matching of hardware and instance ID's against command-line patterns
+
+--*/
+
+#include <windows.h>
+#include <tchar.h>
+
+#include "idmatch.h"
+
+IdEntry GetIdType(_In_ LPCTSTR Id)
+/*++
+
+Routine Description:
+
+    Determine if this is instance id or hardware id and if there's any wildcards
+    instance ID is prefixed by '@'
+    wildcards are '*'
+
+
+Arguments:
+
+    Id - ptr to string to check
+
+Return Value:
+
+    IdEntry
+
+--*/
+{
+    IdEntry Entry;
+
+    Entry.InstanceId = FALSE;
+    Entry.Wild = NULL;
+    Entry.String = Id;
+
+    if(Entry.String[0] == INSTANCEID_PREFIX_CHAR) {
+        Entry.InstanceId = TRUE;
+        Entry.String = CharNext(Entry.String);
+    }
+    if(Entry.String[0] == QUOTE_PREFIX_CHAR) {
+        //
+        // prefix to treat rest of string literally
+        //
+        Entry.String = CharNext(Entry.String);
+    } else {
+        //
+        // see if any wild characters exist
+        //
+        Entry.Wild = _tcschr(Entry.String,WILD_CHAR);
+    }
+    return Entry;
+}
+
+void FoldIdString(_Inout_ LPTSTR Id)
+/*++
+
+Routine Description:
+
+    Case-fold an id in place so that it can be compared
+    against a compiled IdEntry with plain (case sensitive) compares
+
+Arguments:
+
+    Id - string to fold
+
+Return Value:
+
+    none
+
+--*/
+{
+    for(;Id[0];Id++) {
+        Id[0] = (TCHAR)_totupper(Id[0]);
+    }
+}
+
+BOOL CompileIdEntry(_Inout_ IdEntry & Entry)
+/*++
+
+Routine Description:
+
+    Compile an IdEntry returned by GetIdType for repeated matching
+    The string is case-folded once and split at the wild characters
+    into a literal prefix followed by NUL separated segments,
+    so that each compare is a straight scan with no case conversion
+
+Arguments:
+
+    Entry - entry to compile, Folded must be freed with delete []
+
+Return Value:
+
+    TRUE on success, FALSE if out of memory
+
+--*/
+{
+    size_t len = _tcslen(Entry.String);
+    size_t i;
+
+    Entry.Folded = new TCHAR[len+1];
+    if(!Entry.Folded) {
+        return FALSE;
+    }
+    for(i = 0; i < len; i++) {
+        if(Entry.Wild && Entry.String[i] == WILD_CHAR) {
+            Entry.Folded[i] = TEXT('\0');
+        } else {
+            Entry.Folded[i] = (TCHAR)_totupper(Entry.String[i]);
+        }
+    }
+    Entry.Folded[len] = TEXT('\0');
+    Entry.FoldedLen = len;
+    Entry.PrefixLen = Entry.Wild ? (size_t)(Entry.Wild-Entry.String) : len;
+    return TRUE;
+}
+
+BOOL WildCardMatch(_In_ LPCTSTR Item, _In_ const IdEntry & MatchEntry)
+/*++
+
+Routine Description:
+
+    Compare a single item against wildcard
+    Other than a command-line management tools
+    it's a bad idea to use wildcards as it implies
+    assumptions about the hardware/instance ID
+    eg, it might be tempting to enumerate root\* to
+    find all root devices, however there is a CfgMgr
+    API to query status and determine if a device is
+    root enumerated, which doesn't rely on implementation
+    details.
+
+    The only wild character matches any run of characters,
+    so taking the leftmost match of each segment is always
+    correct and no backtracking is needed.
+
+Arguments:
+
+    Item - item to find match for eg a\abcd\c, folded by FoldIdString
+    MatchEntry - eg *\*bc*\*, compiled by CompileIdEntry
+
+Return Value:
+
+    TRUE if any match, otherwise FALSE
+
+--*/
+{
+    LPCTSTR scanItem;
+    LPCTSTR itemEnd;
+    LPCTSTR segment;
+    LPCTSTR patternEnd;
+    size_t itemLen;
+    size_t matchlen;
+
+    itemLen = _tcslen(Item);
+
+    //
+    // before attempting anything else
+    // try and compare everything up to first wild
+    //
+    if(!MatchEntry.Wild) {
+        return (itemLen == MatchEntry.FoldedLen &&
+                _tcscmp(Item,MatchEntry.Folded) == 0) ? TRUE : FALSE;
+    }
+    if(itemLen < MatchEntry.PrefixLen ||
+       _tcsncmp(Item,MatchEntry.Folded,MatchEntry.PrefixLen) != 0) {
+        return FALSE;
+    }
+    scanItem = Item + MatchEntry.PrefixLen;
+    itemEnd = Item + itemLen;
+    segment = MatchEntry.Folded + MatchEntry.PrefixLen;
+    patternEnd = MatchEntry.Folded + MatchEntry.FoldedLen;
+
+    while(segment < patternEnd) {
+        matchlen = _tcslen(segment);
+        if(!matchlen) {
+            //
+            // skip wild chars
+            //
+            segment++;
+            continue;
+        }
+        if(segment+matchlen == patternEnd) {
+            //
+            // last portion of match, anchored at the end of the item
+            //
+            if((size_t)(itemEnd-scanItem) < matchlen) {
+                return FALSE;
+            }
+            return _tcscmp(itemEnd-matchlen,segment) ? FALSE : TRUE;
+        }
+        //
+        // find the first occurrence of the sub-string
+        //
+        scanItem = _tcsstr(scanItem,segment);
+        if(!scanItem) {
+            //
+            // ran out of string
+            //
+            return FALSE;
+        }
+        scanItem += matchlen;
+        segment += matchlen;
+    }
+    //
+    // pattern ended with a wild character
+    //
+    return TRUE;
+}
@@ -0,0 +1,32 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+Module Name:
+
+    idmatch.h
+
+Abstract:
+
+    Device Console
+    ID pattern matching, kept free of SetupAPI so it can be tested on its own
+
+--*/
+
+#define INSTANCEID_PREFIX_CHAR TEXT('@') // character used to prefix instance ID's
+#define WILD_CHAR              TEXT('*') // wild character
+#define QUOTE_PREFIX_CHAR      TEXT('\'') // prefix character to ignore wild characters
+
+struct IdEntry {
+    LPCTSTR String;     // string looking for
+    LPCTSTR Wild;       // first wild character if any
+    BOOL    InstanceId;
+    LPTSTR  Folded;     // case-folded String, wild characters replaced by NULs
+    size_t  FoldedLen;  // length of Folded, including the NULs
+    size_t  PrefixLen;  // length of the literal prefix before first wild
+};
+
+IdEntry GetIdType(_In_ LPCTSTR Id);
+void FoldIdString(_Inout_ LPTSTR Id);
+BOOL CompileIdEntry(_Inout_ IdEntry & Entry);
+BOOL WildCardMatch(_In_ LPCTSTR Item, _In_ const IdEntry & MatchEntry);
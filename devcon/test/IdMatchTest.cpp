@@ -0,0 +1,293 @@
+/*++
+
+Module Name:
+
+    IdMatchTest.cpp
+
+Abstract:
+
+    Host test for the devcon ID matcher. Checks what GetIdType makes of
+    the '@' and quote prefixes, what CompileIdEntry and FoldIdString
+    produce, and WildCardMatch on empty patterns and items, leading,
+    trailing, adjacent and repeated '*' segments and case folding.
+    Finishes by comparing WildCardMatch against a plain backtracking
+    matcher on every short pattern and ID over a small alphabet.
+
+    Builds with the stub headers in this directory:
+
+        c++ -O2 -Wall -Wextra -I test test/IdMatchTest.cpp idmatch.cpp -o IdMatchTest
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include <windows.h>
+#include <tchar.h>
+
+#include "../idmatch.h"
+
+#include <stdio.h>
+
+static int failures;
+
+static void Check(_In_ const char * Name, _In_ size_t Actual, _In_ size_t Expected)
+{
+    if(Actual != Expected) {
+        failures++;
+        printf("FAIL %s: got %zu, expected %zu\n", Name, Actual, Expected);
+    }
+}
+
+static BOOL Match(_In_ LPCTSTR Pattern, _In_ LPCTSTR Id)
+/*++
+
+Routine Description:
+
+    Match one ID against one pattern the way EnumerateDevices does:
+    compile the pattern, fold the ID, then compare
+
+--*/
+{
+    IdEntry entry = GetIdType(Pattern);
+    TCHAR folded[64];
+    BOOL match;
+
+    if(!CompileIdEntry(entry)) {
+        return FALSE;
+    }
+    wcsncpy(folded,Id,ARRAYSIZE(folded));
+    folded[ARRAYSIZE(folded)-1] = TEXT('\0');
+    FoldIdString(folded);
+    match = WildCardMatch(folded,entry);
+    delete [] entry.Folded;
+    return match;
+}
+
+static BOOL Reference(_In_ LPCTSTR Pattern, _In_ LPCTSTR Id)
+/*++
+
+Routine Description:
+
+    Backtracking matcher to compare against, '*' matches any run and
+    everything else matches itself regardless of case
+
+--*/
+{
+    if(!Pattern[0]) {
+        return Id[0] ? FALSE : TRUE;
+    }
+    if(Pattern[0] == WILD_CHAR) {
+        for(;;) {
+            if(Reference(Pattern+1,Id)) {
+                return TRUE;
+            }
+            if(!Id[0]) {
+                return FALSE;
+            }
+            Id++;
+        }
+    }
+    if(!Id[0] || towupper(Pattern[0]) != towupper(Id[0])) {
+        return FALSE;
+    }
+    return Reference(Pattern+1,Id+1);
+}
+
+static void TestIdType()
+{
+    IdEntry entry;
+
+    entry = GetIdType(TEXT("PCI\\VEN_8086*"));
+    Check("hardware id not instance", entry.InstanceId, FALSE);
+    Check("hardware id wild", entry.Wild - entry.String, 12);
+
+    entry = GetIdType(TEXT("@ROOT\\*"));
+    Check("instance id", entry.InstanceId, TRUE);
+    Check("instance id skips prefix", entry.String[0], TEXT('R'));
+    Check("instance id wild", entry.Wild - entry.String, 5);
+
+    // the quote turns the rest into a literal, wild characters included
+    entry = GetIdType(TEXT("'*PNP0A03"));
+    Check("quoted string", entry.String[0], WILD_CHAR);
+    Check("quoted not wild", entry.Wild == NULL, TRUE);
+
+    entry = GetIdType(TEXT("@'ROOT\\*"));
+    Check("quoted instance id", entry.InstanceId, TRUE);
+    Check("quoted instance not wild", entry.Wild == NULL, TRUE);
+
+    entry = GetIdType(TEXT(""));
+    Check("empty not instance", entry.InstanceId, FALSE);
+    Check("empty not wild", entry.Wild == NULL, TRUE);
+
+    entry = GetIdType(TEXT("@"));
+    Check("bare prefix instance", entry.InstanceId, TRUE);
+    Check("bare prefix empty", entry.String[0], TEXT('\0'));
+}
+
+static void TestCompile()
+{
+    IdEntry entry;
+    TCHAR id[] = TEXT("Pci\\Ven_8086&dev_1234");
+
+    FoldIdString(id);
+    Check("fold", wcscmp(id,TEXT("PCI\\VEN_8086&DEV_1234")), 0);
+
+    entry = GetIdType(TEXT("ab*c*"));
+    CompileIdEntry(entry);
+    Check("compile length", entry.FoldedLen, 5);
+    Check("compile prefix", entry.PrefixLen, 2);
+    Check("compile folded", wmemcmp(entry.Folded,TEXT("AB\0C\0"),6), 0);
+    delete [] entry.Folded;
+
+    entry = GetIdType(TEXT("root\\legacy"));
+    CompileIdEntry(entry);
+    Check("compile literal length", entry.FoldedLen, 11);
+    Check("compile literal prefix", entry.PrefixLen, 11);
+    Check("compile literal folded", wcscmp(entry.Folded,TEXT("ROOT\\LEGACY")), 0);
+    delete [] entry.Folded;
+
+    // a quoted '*' stays a character
+    entry = GetIdType(TEXT("'a*"));
+    CompileIdEntry(entry);
+    Check("compile quoted", wcscmp(entry.Folded,TEXT("A*")), 0);
+    Check("compile quoted prefix", entry.PrefixLen, 2);
+    delete [] entry.Folded;
+
+    entry = GetIdType(TEXT(""));
+    CompileIdEntry(entry);
+    Check("compile empty length", entry.FoldedLen, 0);
+    Check("compile empty prefix", entry.PrefixLen, 0);
+    delete [] entry.Folded;
+}
+
+static void TestMatch()
+{
+    static const struct {
+        LPCTSTR Pattern;
+        LPCTSTR Id;
+        BOOL    Expected;
+    } cases[] = {
+        // no wild characters: the whole ID, any case
+        { TEXT("root\\system"),     TEXT("ROOT\\SYSTEM"),           TRUE  },
+        { TEXT("root\\system"),     TEXT("Root\\System0"),          FALSE },
+        { TEXT("root\\system"),     TEXT("root\\syste"),            FALSE },
+
+        // empty pattern and empty ID
+        { TEXT(""),                 TEXT(""),                       TRUE  },
+        { TEXT(""),                 TEXT("ROOT"),                   FALSE },
+        { TEXT("*"),                TEXT(""),                       TRUE  },
+        { TEXT("*"),                TEXT("ACPI\\PNP0A03"),          TRUE  },
+        { TEXT("a*"),               TEXT(""),                       FALSE },
+
+        // trailing wild: prefix only
+        { TEXT("root\\*"),          TEXT("ROOT\\"),                 TRUE  },
+        { TEXT("root\\*"),          TEXT("root\\legacy_beep"),      TRUE  },
+        { TEXT("root\\*"),          TEXT("ROO"),                    FALSE },
+        { TEXT("root\\*"),          TEXT("XROOT\\A"),               FALSE },
+
+        // leading wild: anchored at the end
+        { TEXT("*pnp0a03"),         TEXT("ACPI\\PNP0A03"),          TRUE  },
+        { TEXT("*pnp0a03"),         TEXT("ACPI\\PNP0A03X"),         FALSE },
+        { TEXT("*pnp0a03"),         TEXT("PNP0A0"),                 FALSE },
+        { TEXT("*\\pnp0a03"),       TEXT("\\PNP0A03"),              TRUE  },
+
+        // wild on both sides: anywhere
+        { TEXT("*ven_8086*"),       TEXT("PCI\\VEN_8086&DEV_1234"), TRUE  },
+        { TEXT("*ven_8086*"),       TEXT("VEN_8086"),               TRUE  },
+        { TEXT("*ven_8086*"),       TEXT("PCI\\VEN_10DE"),          FALSE },
+
+        // several segments, in order
+        { TEXT("pci\\*ven_*dev_*"), TEXT("PCI\\VEN_8086&DEV_1234"), TRUE  },
+        { TEXT("pci\\*dev_*ven_*"), TEXT("PCI\\VEN_8086&DEV_1234"), FALSE },
+        { TEXT("a*b*c"),            TEXT("AXBYC"),                  TRUE  },
+        { TEXT("a*b*c"),            TEXT("ACB"),                    FALSE },
+
+        // adjacent wild characters are one
+        { TEXT("a**b"),             TEXT("AB"),                     TRUE  },
+        { TEXT("a**b"),             TEXT("AXXB"),                   TRUE  },
+        { TEXT("**"),               TEXT(""),                       TRUE  },
+
+        // prefix and suffix must not share characters
+        { TEXT("ab*ba"),            TEXT("ABA"),                    FALSE },
+        { TEXT("ab*ba"),            TEXT("ABBA"),                   TRUE  },
+        { TEXT("a*b*b"),            TEXT("AB"),                     FALSE },
+        { TEXT("a*b*b"),            TEXT("ABB"),                    TRUE  },
+
+        // the suffix is the last occurrence, not the first
+        { TEXT("*ab"),              TEXT("ABXAB"),                  TRUE  },
+        { TEXT("*a*ab"),            TEXT("AAB"),                    TRUE  },
+
+        // quoted and instance ID's
+        { TEXT("'*root"),           TEXT("*ROOT"),                  TRUE  },
+        { TEXT("'*root"),           TEXT("XROOT"),                  FALSE },
+        { TEXT("@root\\*"),         TEXT("ROOT\\SYSTEM\\0000"),     TRUE  },
+        { TEXT("@'root\\*"),        TEXT("ROOT\\SYSTEM"),           FALSE },
+    };
+    char name[128];
+
+    for(size_t i = 0; i < ARRAYSIZE(cases); i++) {
+        snprintf(name,sizeof(name),"match '%ls' '%ls'",cases[i].Pattern,cases[i].Id);
+        Check(name,Match(cases[i].Pattern,cases[i].Id),cases[i].Expected);
+    }
+}
+
+static void Expand(_Out_writes_(Length+1) LPTSTR Buffer, _In_ LPCTSTR Alphabet, _In_ size_t Radix, _In_ size_t Length, _In_ size_t Index)
+{
+    for(size_t i = 0; i < Length; i++) {
+        Buffer[i] = Alphabet[Index % Radix];
+        Index /= Radix;
+    }
+    Buffer[Length] = TEXT('\0');
+}
+
+static void TestExhaustive()
+{
+    static const TCHAR patternChars[] = TEXT("aB*");
+    static const TCHAR idChars[] = TEXT("Ab");
+    TCHAR pattern[8];
+    TCHAR id[10];
+    size_t compares = 0;
+    size_t misses = 0;
+
+    for(size_t patternLen = 0; patternLen <= 6; patternLen++) {
+        size_t patterns = 1;
+
+        for(size_t i = 0; i < patternLen; i++) {
+            patterns *= 3;
+        }
+        for(size_t p = 0; p < patterns; p++) {
+            Expand(pattern,patternChars,3,patternLen,p);
+
+            for(size_t idLen = 0; idLen <= 8; idLen++) {
+                for(size_t n = 0; n < ((size_t)1 << idLen); n++) {
+                    Expand(id,idChars,2,idLen,n);
+                    compares++;
+                    if(Match(pattern,id) != Reference(pattern,id)) {
+                        if(misses++ < 10) {
+                            printf("FAIL exhaustive '%ls' '%ls': got %d\n",pattern,id,Match(pattern,id));
+                        }
+                    }
+                }
+            }
+        }
+    }
+    Check("exhaustive mismatches",misses,0);
+    printf("%zu pattern/ID pairs compared\n",compares);
+}
+
+int main()
+{
+    TestIdType();
+    TestCompile();
+    TestMatch();
+    TestExhaustive();
+
+    if(failures != 0) {
+        return 1;
+    }
+
+    printf("ID match test passed\n");
+    return 0;
+}
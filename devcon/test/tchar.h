@@ -0,0 +1,28 @@
+/*++
+
+Module Name:
+
+    tchar.h
+
+Abstract:
+
+    Host stand-in for the generic text routines, mapped to their wide
+    character versions.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <wchar.h>
+#include <wctype.h>
+
+#define _tcslen     wcslen
+#define _tcscmp     wcscmp
+#define _tcsncmp    wcsncmp
+#define _tcsstr     wcsstr
+#define _tcschr     wcschr
+#define _totupper   towupper
@@ -0,0 +1,46 @@
+/*++
+
+Module Name:
+
+    windows.h
+
+Abstract:
+
+    Host stand-in for the few Windows types and SAL annotations the ID
+    matcher uses, so idmatch.cpp builds on a machine without the SDK.
+    Unicode build, as devcon is.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <wchar.h>
+#include <wctype.h>
+
+#define _In_
+#define _Inout_
+#define _Out_writes_(n)
+
+typedef int BOOL;
+typedef wchar_t TCHAR;
+typedef wchar_t *LPTSTR;
+typedef const wchar_t *LPCTSTR;
+
+#define TRUE 1
+#define FALSE 0
+
+#define TEXT(s) L##s
+
+#ifndef ARRAYSIZE
+#define ARRAYSIZE(a) (sizeof(a)/sizeof(a[0]))
+#endif
+
+static inline LPTSTR CharNext(LPCTSTR s)
+{
+    return (LPTSTR)(*s ? s + 1 : s);
+}
@@ -69,6 +69,7 @@ void *__fastcall sub_140003A80(__int64 a1);
 // PVOID __stdcall ExAllocatePoolWithTag(POOL_TYPE PoolType, SIZE_T NumberOfBytes, ULONG Tag);
 // void __stdcall RtlInitUnicodeString(PUNICODE_STRING DestinationString, PCWSTR SourceString);
 __int64 __fastcall sub_140008000(__int64 a1);
+void __fastcall ezTouchFilterEvtDeviceCleanup(__int64 a1);
 void __fastcall sub_1400081AC(__int64 a1);
 void __fastcall sub_140008238(__int64 a1, __int64 a2);
 __int64 (*sub_1400082E0())(void);
@@ -90,7 +91,8 @@ __int128 xmmword_140005140 = 0x2846DCD8360E551465A43D0901951075i64; // weak
 __int128 xmmword_140005150 = 0x47003502813E090281232826DCD81623i64; // weak
 __int128 xmmword_140005160 = 0xB402813F0900008CA027001500008CA0i64; // weak
 PDEVICE_OBJECT DeviceObject = &DeviceObject; // idb
-void *off_140006020 = &unk_140006008; // weak
+void *off_140006020 = &unk_140006008; // weak   device context, 0x50 bytes (ContextSizeOverride):
+                                           //   +40 splice mode, +64 cached spliced report descriptor, +72 its length
 _UNKNOWN unk_140006040; // weak
 _UNKNOWN unk_140006070; // weak
 _QWORD qword_140006080 = 0i64; // idb
@@ -911,12 +913,10 @@ __int64 __fastcall sub_1400028B8(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
   char *v13; // rcx
   int v14; // er15
   char *v15; // r14
-  int v16; // eax
   int v17; // er12
   int v18; // ecx
   int *v19; // rsi
   int i; // edi
-  __int64 v21; // r9
   int v22; // edi
   int v23; // esi
   unsigned __int16 v24; // r9
@@ -945,8 +945,6 @@ __int64 __fastcall sub_1400028B8(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
   __int64 v47; // [rsp+88h] [rbp-78h]
   int v48; // [rsp+90h] [rbp-70h] BYREF
   int v49; // [rsp+94h] [rbp-6Ch]
-  char Dest[64]; // [rsp+B0h] [rbp-50h] BYREF
-  char v51[32]; // [rsp+F0h] [rbp-10h] BYREF
 
   v47 = a4;
   v42 = a1;
@@ -972,6 +970,7 @@ __int64 __fastcall sub_1400028B8(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
              v7,
              *(unsigned int *)(v4 + 8));
   }
+  // the spliced descriptor (+36 bytes) is kept in the device context and served by sub_140002F7C from then on
   v46 = (char *)ExAllocatePoolWithTag((POOL_TYPE)512, *(int *)(a4 + 36), 0x657A5446u);
   v10 = v46;
   if ( !v46 )
@@ -998,22 +997,6 @@ __int64 __fastcall sub_1400028B8(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
   do
   {
     v15 = &v13[v12];
-    v16 = ((unsigned __int8)*v15 >> 2) & 3;
-    if ( v16 )
-    {
-      if ( v16 == 1 )
-      {
-        sub_140001590(Dest, 64i64, "%04X:[G]", v12);
-      }
-      else if ( v16 == 2 )
-      {
-        sub_140001590(Dest, 64i64, "%04X:[L]", v12);
-      }
-    }
-    else
-    {
-      sub_140001590(Dest, 64i64, "%04X:[M]", v12);
-    }
     if ( (*v15 & 3) == 3 )
       v17 = 4;
     else
@@ -1030,17 +1013,12 @@ __int64 __fastcall sub_1400028B8(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
         }
         else
         {
-          v21 = (unsigned __int8)*v15;
-          *v19 = v21;
-          sub_140001590(v51, 32i64, "%02X ", v21);
-          sub_1400014D0(Dest, 64i64, (__int64)v51);
-          v18 = v41;
+          *v19 = (unsigned __int8)*v15;
         }
       }
       ++v15;
       ++v19;
     }
-    sub_140001DF4((__int64)DeviceObject->DeviceExtension, 2u, 4u, 0x28u, (__int64)&unk_140005110, Dest);
     v22 = v48;
     if ( v48 == 5 )
     {
@@ -1151,7 +1129,7 @@ LABEL_68:
   v29 = v47;
   *(_DWORD *)(v47 + 40) = v36;
   v30 = *(int *)(v29 + 36);
-  memset(v10, 0, v30);
+  // prefix, the 48 bytes of the tilt collection, suffix: every byte of v10[0..v30) is written once
   memmove(v10, Src, v8);
   *(_OWORD *)&v10[v8] = xmmword_140005140;
   *(_OWORD *)&v10[v8 + 16] = xmmword_140005150;
@@ -1166,6 +1144,18 @@ LABEL_68:
   if ( v31 >= 0 )
   {
     (*(void (__fastcall **)(__int64, __int64, size_t))(qword_140006118 + 2200))(qword_140006110, v7, v30);
+    if ( v41 > 0 )
+    {
+      // publish the cache; a request that raced us through here built the same bytes, so the loser just frees its copy
+      // and only the winner fills in the length
+      if ( !_InterlockedCompareExchange64((volatile __int64 *)(v29 + 64), (__int64)v10, 0i64) )
+      {
+        *(_DWORD *)(v29 + 72) = v30;
+        LODWORD(v32) = v30;
+        sub_1400010C0((__int64)DeviceObject->DeviceExtension, 2u, 4u, 0x28u, (__int64)&unk_140005110, v32);
+        v10 = 0i64;
+      }
+    }
   }
   else
   {
@@ -1174,7 +1164,8 @@ LABEL_68:
   }
   v4 = v45;
 LABEL_72:
-  ExFreePoolWithTag(v10, 0);
+  if ( v10 )
+    ExFreePoolWithTag(v10, 0);
 LABEL_73:
   (*(void (__fastcall **)(__int64, __int64, _QWORD))(qword_140006118 + 2104))(///status_result= (NTSTATUS *) void WdfRequestComplete(Request_a2, status_v7);???
     qword_140006110,
@@ -1195,7 +1186,30 @@ __int64 __fastcall sub_140002F7C(__int64 a1, __int64 a2, __int64 a3)
   __int64 result; // rax
   unsigned int v7; // ebx
   int v8; // [rsp+28h] [rbp-10h]
+  char *v9; // cached spliced descriptor
+  __int64 v10; // output memory
 
+  v9 = *(char **)(a3 + 64);
+  if ( v9 )
+  {
+    // the descriptor of the lower device never changes, serve the spliced copy built by sub_1400028B8 with a single copy
+    v7 = (*(__int64 (__fastcall **)(__int64, __int64, __int64 *))(qword_140006118 + 2144))(qword_140006110, a1, &v10);
+    if ( (v7 & 0x80000000) == 0 )
+    {
+      v7 = (*(__int64 (__fastcall **)(__int64, __int64, _QWORD, char *, size_t))(qword_140006118 + 1576))(
+             qword_140006110,
+             v10,
+             0i64,
+             v9,
+             *(unsigned int *)(a3 + 36));// spliced length; +72 may not be filled in yet by the publisher
+      if ( (v7 & 0x80000000) == 0 )
+        (*(void (__fastcall **)(__int64, __int64, size_t))(qword_140006118 + 2200))(
+          qword_140006110,
+          a1,
+          *(unsigned int *)(a3 + 36));
+    }
+    return (*(__int64 (__fastcall **)(__int64, __int64, _QWORD))(qword_140006118 + 2104))(qword_140006110, a1, v7);///WdfRequestComplete(Request_a1, status_v7);
+  }
   (*(void (__fastcall **)(__int64, __int64))(qword_140006118 + 2008))(qword_140006110, a1);
   (*(void (__fastcall **)(__int64, __int64, __int64 (__fastcall *)(__int64, __int64, __int64, __int64), __int64))(qword_140006118 + 2080))(
     qword_140006110,
@@ -1222,25 +1236,16 @@ __int64 __fastcall sub_140002F7C(__int64 a1, __int64 a2, __int64 a3)
 //----- (000000014000305C) ----------------------------------------------------
 __int64 __fastcall sub_14000305C(__int64 a1, __int64 a2, __int64 a3, __int64 a4)
 {
-  char *v7; // rsi
   unsigned __int16 v8; // r9
   int v9; // eax
   int v10; // ecx
   size_t v11; // r15
   int v12; // eax
   _BYTE *v13; // r12
-  char *v14; // rbx
-  int v15; // eax
   int v17; // [rsp+28h] [rbp-40h]
-  char Src; // [rsp+80h] [rbp+18h] BYREF
-  char v19; // [rsp+81h] [rbp+19h]
-  char v20; // [rsp+82h] [rbp+1Ah]
-  char v21; // [rsp+83h] [rbp+1Bh]
-  char v22; // [rsp+84h] [rbp+1Ch]
-  char v23; // [rsp+85h] [rbp+1Dh]
   __int64 v24; // [rsp+88h] [rbp+20h] BYREF
+  size_t v25; // output buffer capacity
 
-  v7 = 0i64;
   sub_140001000((__int64)DeviceObject->DeviceExtension, 4u, 4u, 0x35u, (__int64)&unk_140005110);
   if ( *(int *)(a3 + 8) < 0 )
   {
@@ -1255,13 +1260,6 @@ LABEL_3:
   v10 = *(_DWORD *)(a4 + 44) + v9;
   v11 = v10;
   *(_DWORD *)(a4 + 28) = v10;
-  v7 = (char *)ExAllocatePoolWithTag((POOL_TYPE)512, v10, 0x657A5446u);
-  if ( !v7 )
-  {
-    v8 = 55;
-    v17 = -1073741670;
-    goto LABEL_3;
-  }
   v12 = (*(__int64 (__fastcall **)(__int64, __int64, __int64 *))(qword_140006118 + 2144))(qword_140006110, a1, &v24);
   if ( v12 < 0 )
   {
@@ -1269,38 +1267,25 @@ LABEL_3:
     v17 = v12;
     goto LABEL_3;
   }
-  v13 = (_BYTE *)(*(__int64 (__fastcall **)(__int64, __int64, _QWORD))(qword_140006118 + 1552))(
+  v25 = 0i64;
+  v13 = (_BYTE *)(*(__int64 (__fastcall **)(__int64, __int64, size_t *))(qword_140006118 + 1552))(
                    qword_140006110,
                    v24,
-                   0i64);
+                   &v25);
   if ( *v13 == 7 )
   {
-    Src = *(_BYTE *)(a4 + 12);
-    v19 = *(_BYTE *)(a4 + 13);
-    v20 = *(_BYTE *)(a4 + 14);
-    v21 = *(_BYTE *)(a4 + 15);
-    v22 = *(_BYTE *)(a4 + 16);
-    v23 = *(_BYTE *)(a4 + 17);
-    memset(v7, 0, v11);
-    memmove(v7, v13, *(int *)(a4 + 40));
-    v14 = &v7[*(int *)(a4 + 40)];
-    memmove(v14, &Src, *(int *)(a4 + 44));
-    memmove(&v14[*(int *)(a4 + 44)], &v13[*(int *)(a4 + 40)], *(_DWORD *)(a4 + 24) - *(_DWORD *)(a4 + 40));
-    v15 = (*(__int64 (__fastcall **)(__int64, __int64, _QWORD, char *, size_t))(qword_140006118 + 1576))(
-            qword_140006110,
-            v24,
-            0i64,
-            v7,
-            v11);
-    if ( v15 < 0 )
+    // splice the tilt bytes (+12, +44 long) into the report in place: the read buffer is sized for the
+    // spliced report descriptor, so no scratch allocation, zeroing or copy back is needed
+    if ( v25 >= v11 )
     {
-      sub_1400010C0((__int64)DeviceObject->DeviceExtension, 2u, 4u, 0x3Au, (__int64)&unk_140005110, v15);
-      (*(void (__fastcall **)(__int64, __int64, _QWORD))(qword_140006118 + 2104))(///status_result= (NTSTATUS *) void WdfRequestComplete(Request_a2, status_v7);???
-        qword_140006110,
-        a1,
-        *(unsigned int *)(a3 + 8));
+      memmove(&v13[*(int *)(a4 + 40) + *(int *)(a4 + 44)], &v13[*(int *)(a4 + 40)], *(_DWORD *)(a4 + 24) - *(_DWORD *)(a4 + 40));
+      memmove(&v13[*(int *)(a4 + 40)], (const void *)(a4 + 12), *(int *)(a4 + 44));
+      (*(void (__fastcall **)(__int64, __int64, size_t))(qword_140006118 + 2200))(qword_140006110, a1, v11);
+    }
+    else
+    {
+      sub_1400010C0((__int64)DeviceObject->DeviceExtension, 2u, 4u, 0x3Au, (__int64)&unk_140005110, -1073741789);
     }
-    (*(void (__fastcall **)(__int64, __int64, size_t))(qword_140006118 + 2200))(qword_140006110, a1, v11);
   }
   else
   {
@@ -1311,8 +1296,6 @@ LABEL_13:
     qword_140006110,
     a1,
     *(unsigned int *)(a3 + 8));
-  if ( v7 )
-    ExFreePoolWithTag(v7, 0);
   return sub_140001000((__int64)DeviceObject->DeviceExtension, 4u, 4u, 0x3Bu, (__int64)&unk_140005110);
 }
 // 140006110: using guessed type __int64 qword_140006110;
@@ -1644,7 +1627,9 @@ __int64 __fastcall sub_140008000(__int64 a1)
   (*(void (__fastcall **)(__int64, __int64))(qword_140006118 + 1032))(qword_140006110, a1);
   memset(Dst, 0, 0x38ui64);
   Dst[6] = off_140006020;
+  Dst[5] = 0x50i64;//deviceAttributes.ContextSizeOverride = covers the cached descriptor at +64/+72
   LODWORD(Dst[0]) = 56;
+  Dst[1] = ezTouchFilterEvtDeviceCleanup;//deviceAttributes.EvtCleanupCallback = frees the cached report descriptor
   Dst[3] = 0x100000001i64;
   sub_140001000((__int64)DeviceObject->DeviceExtension, 4u, 2u, 0x10u, (__int64)&Length);
   v1 = (*(__int64 (__fastcall **)(__int64, __int64 *, _QWORD *, __int64 *))(qword_140006118 + 600))(
@@ -1664,6 +1649,8 @@ __int64 __fastcall sub_140008000(__int64 a1)
     *(_DWORD *)(v4 + 14) = 0;
     *(_WORD *)(v4 + 12) = 0;
     *(_WORD *)(v4 + 60) = 256;
+    *(_QWORD *)(v4 + 64) = 0i64;
+    *(_DWORD *)(v4 + 72) = 0;
     result = (*(__int64 (__fastcall **)(__int64, __int64, void *, _QWORD))(qword_140006118 + 616))(
                qword_140006110,
                v10,
@@ -1693,6 +1680,24 @@ __int64 __fastcall sub_140008000(__int64 a1)
 // 140006110: using guessed type __int64 qword_140006110;
 // 140006118: using guessed type __int64 qword_140006118;
 
+//----- ezTouchFilterEvtDeviceCleanup -------------------------------------------
+void __fastcall ezTouchFilterEvtDeviceCleanup(__int64 a1)
+{
+  __int64 v1; // rbx
+  void *v2; // rcx
+
+  v1 = (*(__int64 (__fastcall **)(__int64, __int64, void *))(qword_140006118 + 1616))(
+         qword_140006110,///pDeviceContext_v1 = GetDeviceContext(Device_a1);
+         a1,
+         off_140006020);
+  v2 = (void *)_InterlockedExchange64((volatile __int64 *)(v1 + 64), 0i64);
+  if ( v2 )
+    ExFreePoolWithTag(v2, 0);
+}
+// 140006020: using guessed type void *off_140006020;
+// 140006110: using guessed type __int64 qword_140006110;
+// 140006118: using guessed type __int64 qword_140006118;
+
 //----- (00000001400081AC) ----------------------------------------------------
 void __fastcall sub_1400081AC(__int64 a1)
 {
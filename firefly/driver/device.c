@@ -27,6 +27,8 @@ Environment:
 
 #ifdef ALLOC_PRAGMA
 #pragma alloc_text(PAGE, FireFlyEvtDeviceAdd)
+#pragma alloc_text(PAGE, FireFlyEvtDeviceSelfManagedIoInit)
+#pragma alloc_text(PAGE, FireFlyEvtDeviceSelfManagedIoCleanup)
 #endif
 
 NTSTATUS
@@ -54,6 +56,7 @@ Return Value:
 --*/    
 {
     WDF_OBJECT_ATTRIBUTES           attributes;
+    WDF_PNPPOWER_EVENT_CALLBACKS    pnpPowerCallbacks;
     NTSTATUS                        status;
     PDEVICE_CONTEXT                 pDeviceContext;
     WDFDEVICE                       device;
@@ -69,6 +72,15 @@ Return Value:
     //
     WdfFdoInitSetFilter(DeviceInit);
 
+    //
+    // The HID target used to set the feature is opened once, when
+    // self-managed I/O starts, and closed when the device is removed.
+    //
+    WDF_PNPPOWER_EVENT_CALLBACKS_INIT(&pnpPowerCallbacks);
+    pnpPowerCallbacks.EvtDeviceSelfManagedIoInit = FireFlyEvtDeviceSelfManagedIoInit;
+    pnpPowerCallbacks.EvtDeviceSelfManagedIoCleanup = FireFlyEvtDeviceSelfManagedIoCleanup;
+    WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpPowerCallbacks);
+
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(&attributes, DEVICE_CONTEXT);
 
     status = WdfDeviceCreate(&DeviceInit, &attributes, &device);
@@ -82,6 +94,20 @@ Return Value:
     //
     pDeviceContext = WdfObjectGet_DEVICE_CONTEXT(device);
 
+    //
+    // Serializes the set-feature requests
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = device;
+
+    status = WdfSpinLockCreate(&attributes, &pDeviceContext->FeatureLock);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("FireFly: WdfSpinLockCreate failed 0x%x\n", status));
+        return status;
+    }
+
+    KeInitializeEvent(&pDeviceContext->FeatureIdleEvent, NotificationEvent, TRUE);
+
     //
     // Initialize our WMI support
     //
@@ -126,3 +152,63 @@ Return Value:
 
     return status;
 }
+
+NTSTATUS
+FireFlyEvtDeviceSelfManagedIoInit(
+    WDFDEVICE Device
+    )
+/*++
+Routine Description:
+
+    Called once, after the device first enters D0. Opens the HID target
+    and caches what is needed to set the feature.
+
+Arguments:
+
+    Device - Handle to a framework device object
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    NTSTATUS status;
+
+    PAGED_CODE();
+
+    //
+    // The filter keeps working without light control, so a failure
+    // here only makes FireflySetFeature fail.
+    //
+    status = FireflyInitializeFeature(WdfObjectGet_DEVICE_CONTEXT(Device));
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("FireFly: FireflyInitializeFeature failed 0x%x\n", status));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+FireFlyEvtDeviceSelfManagedIoCleanup(
+    WDFDEVICE Device
+    )
+/*++
+Routine Description:
+
+    Called when the device is removed. Closes the HID target.
+
+Arguments:
+
+    Device - Handle to a framework device object
+
+Return Value:
+
+    None
+
+--*/
+{
+    PAGED_CODE();
+
+    FireflyCleanupFeature(WdfObjectGet_DEVICE_CONTEXT(Device));
+}
@@ -33,6 +33,36 @@ typedef struct _DEVICE_CONTEXT
 
     UNICODE_STRING PdoName;
 
+    //
+    // HID target for the feature reports. It is opened once when
+    // self-managed I/O starts, together with the collection's
+    // preparsed data and a zeroed feature report used as the
+    // template for every set-feature.
+    //
+    WDFIOTARGET HidTarget;
+
+    PHIDP_PREPARSED_DATA PreparsedData;
+
+    PCHAR ReportTemplate;
+
+    USHORT FeatureReportLength;
+
+    //
+    // One preallocated set-feature request. FeatureState, protected
+    // by FeatureLock, says whether it is in flight and what to send
+    // next. FeatureIdleEvent is signaled while no set-feature is in
+    // flight.
+    //
+    WDFSPINLOCK FeatureLock;
+
+    KEVENT FeatureIdleEvent;
+
+    WDFREQUEST FeatureRequest;
+
+    WDFMEMORY FeatureMemory;
+
+    FIREFLY_FEATURE_STATE FeatureState;
+
 } DEVICE_CONTEXT, *PDEVICE_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE(DEVICE_CONTEXT)
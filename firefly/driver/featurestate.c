@@ -0,0 +1,212 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+Module Name:
+
+    featurestate.c
+
+Abstract:
+
+    This module decides when a set-feature is sent and builds its
+    report. It only uses the HID parser, so it also builds on a host
+    for test/featuretest.c.
+
+Environment:
+
+    Kernel mode
+
+--*/
+
+#include <ntddk.h>
+
+#pragma warning(disable:4201)  // nameless struct/union
+#pragma warning(disable:4214)  // bit field types other than int
+
+#include <hidpi.h>
+
+#pragma warning(default:4201)
+#pragma warning(default:4214)
+
+#include "featurestate.h"
+
+BOOLEAN
+FireflyFeatureRequest(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    IN  UCHAR                   PageId,
+    IN  USHORT                  FeatureId,
+    IN  BOOLEAN                 EnableFeature
+    )
+/*++
+
+Routine Description:
+
+    This routine records the requested feature state. The caller holds
+    the feature lock.
+
+Arguments:
+
+    State - Set-feature state of the device
+
+    PageID  - UsagePage of the light control feature.
+
+    FeatureId - Usage ID of the feature.
+
+    EnableFeature - True to turn the light on, False to turn it off.
+
+Return Value:
+
+    TRUE if nothing was in flight and the caller must now send the
+    set-feature, FALSE if the one in flight will be followed by another
+    carrying this state.
+
+--*/
+{
+    State->PageId = PageId;
+    State->FeatureId = FeatureId;
+    State->Enabled = EnableFeature;
+
+    if (State->InFlight) {
+        State->Pending = TRUE;
+        return FALSE;
+    }
+
+    State->InFlight = TRUE;
+    return TRUE;
+}
+
+VOID
+FireflyFeatureTake(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    OUT PUCHAR                  PageId,
+    OUT PUSAGE                  FeatureId,
+    OUT PBOOLEAN                EnableFeature
+    )
+/*++
+
+Routine Description:
+
+    This routine returns the latest requested state for the set-feature
+    about to be sent. Anything requested after this goes into the next
+    one. The caller holds the feature lock.
+
+Arguments:
+
+    State - Set-feature state of the device
+
+    PageID, FeatureId, EnableFeature - Receive the state to send
+
+Return Value:
+
+    None
+
+--*/
+{
+    *PageId = State->PageId;
+    *FeatureId = State->FeatureId;
+    *EnableFeature = State->Enabled;
+    State->Pending = FALSE;
+}
+
+BOOLEAN
+FireflyFeatureFinish(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    IN  BOOLEAN                 CanResend
+    )
+/*++
+
+Routine Description:
+
+    This routine is called when the set-feature in flight completed or
+    could not be sent. The caller holds the feature lock.
+
+Arguments:
+
+    State - Set-feature state of the device
+
+    CanResend - FALSE once the target is gone
+
+Return Value:
+
+    TRUE if a newer state came in meanwhile and the caller must send it.
+    FALSE if nothing is in flight any more, in which case the caller
+    signals that the feature is idle.
+
+--*/
+{
+    if (State->Pending && CanResend) {
+        return TRUE;
+    }
+
+    State->InFlight = FALSE;
+    State->Pending = FALSE;
+    return FALSE;
+}
+
+NTSTATUS
+FireflyBuildFeatureReport(
+    OUT PCHAR                   Report,
+    IN  const CHAR              *Template,
+    IN  USHORT                  ReportLength,
+    IN  PHIDP_PREPARSED_DATA    PreparsedData,
+    IN  UCHAR                   PageId,
+    IN  USAGE                   FeatureId,
+    IN  BOOLEAN                 EnableFeature
+    )
+/*++
+
+Routine Description:
+
+    This routine builds a feature report. It starts from the zeroed
+    template, which is all a disabled feature needs, and sets the usage
+    of an enabled one. It can be called at DISPATCH_LEVEL.
+
+Arguments:
+
+    Report - Receives ReportLength bytes
+
+    Template - Zeroed feature report
+
+    ReportLength - Feature report length of the collection
+
+    PreparsedData - Nonpaged preparsed data of the collection
+
+    PageID, FeatureId, EnableFeature - State to put in the report
+
+Return Value:
+
+    NT Status code
+
+--*/
+{
+    NTSTATUS    status = STATUS_SUCCESS;
+    ULONG       usageLength;
+
+    RtlCopyMemory(Report, Template, ReportLength);
+
+    if (EnableFeature) {
+
+        usageLength = 1;
+
+        status = HidP_SetUsages(
+            HidP_Feature,
+            PageId,
+            0,
+            &FeatureId, // pointer to the usage list
+            &usageLength, // number of usages in the usage list
+            PreparsedData,
+            Report,
+            ReportLength
+            );
+        if (!NT_SUCCESS(status)) {
+            KdPrint(("FireFly: HidP_SetUsages failed 0x%x\n", status));
+        }
+    }
+
+    return status;
+}
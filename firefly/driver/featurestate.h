@@ -0,0 +1,82 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+
+Module Name:
+
+    featurestate.h
+
+Abstract:
+
+    This module contains the set-feature coalescing state and the
+    feature report builder of the firefly filter driver. Neither
+    depends on the framework.
+
+Environment:
+
+    Kernel mode
+
+--*/
+
+#if !defined(_FEATURESTATE_H_)
+#define _FEATURESTATE_H_
+
+//
+// Only one set-feature is in flight at a time. State changes made
+// meanwhile are folded into a single follow-up carrying the latest
+// state. The caller serializes access, the driver with FeatureLock.
+//
+typedef struct _FIREFLY_FEATURE_STATE
+{
+    BOOLEAN InFlight;
+
+    BOOLEAN Pending;
+
+    UCHAR PageId;
+
+    USHORT FeatureId;
+
+    BOOLEAN Enabled;
+
+} FIREFLY_FEATURE_STATE, *PFIREFLY_FEATURE_STATE;
+
+BOOLEAN
+FireflyFeatureRequest(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    IN  UCHAR                   PageId,
+    IN  USHORT                  FeatureId,
+    IN  BOOLEAN                 EnableFeature
+    );
+
+VOID
+FireflyFeatureTake(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    OUT PUCHAR                  PageId,
+    OUT PUSAGE                  FeatureId,
+    OUT PBOOLEAN                EnableFeature
+    );
+
+BOOLEAN
+FireflyFeatureFinish(
+    IN  PFIREFLY_FEATURE_STATE  State,
+    IN  BOOLEAN                 CanResend
+    );
+
+NTSTATUS
+FireflyBuildFeatureReport(
+    OUT PCHAR                   Report,
+    IN  const CHAR              *Template,
+    IN  USHORT                  ReportLength,
+    IN  PHIDP_PREPARSED_DATA    PreparsedData,
+    IN  UCHAR                   PageId,
+    IN  USAGE                   FeatureId,
+    IN  BOOLEAN                 EnableFeature
+    );
+
+#endif // _FEATURESTATE_H_
@@ -30,6 +30,15 @@ Environment:
 #include <initguid.h>
 #include <wdmguid.h>
 
+#pragma warning(disable:4201)  // nameless struct/union
+#pragma warning(disable:4214)  // bit field types other than int
+
+#include <hidpddi.h>
+#include <hidclass.h>
+
+#pragma warning(default:4201)
+#pragma warning(default:4214)
+
 //
 // Our drivers generated include from firefly.mof
 // See makefile.inc for wmi commands
@@ -37,6 +46,7 @@ Environment:
 #include "fireflymof.h"
 
 // Our drivers modules includes
+#include "featurestate.h"
 #include "device.h"
 #include "wmi.h"
 #include "vfeature.h"
@@ -50,3 +60,7 @@ DRIVER_INITIALIZE DriverEntry;
 
 EVT_WDF_DRIVER_DEVICE_ADD FireFlyEvtDeviceAdd;
 
+EVT_WDF_DEVICE_SELF_MANAGED_IO_INIT FireFlyEvtDeviceSelfManagedIoInit;
+
+EVT_WDF_DEVICE_SELF_MANAGED_IO_CLEANUP FireFlyEvtDeviceSelfManagedIoCleanup;
+
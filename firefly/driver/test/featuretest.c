@@ -0,0 +1,373 @@
+/*++
+
+Module Name:
+
+    featuretest.c
+
+Abstract:
+
+    Host test for the set-feature coalescing and the feature report
+    builder. A model of vfeature.c drives the helpers the way the driver
+    does, against a device that completes the request in flight when
+    the test says so and a target that can refuse sends or go away.
+    Fixed cases check bursts, failed sends and a closed target, then a
+    long random run checks that only one request is ever in flight, that
+    no more are sent than were asked for, and that the device always
+    ends up with the latest state.
+
+    Builds with the stub headers in this directory:
+
+        cc -O2 -Wall -Wextra -Wno-unknown-pragmas -I test test/featuretest.c featurestate.c -o featuretest
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include <ntddk.h>
+#include <hidpi.h>
+
+#include "../featurestate.h"
+
+#include <stdlib.h>
+
+#define TEST_PAGE           0xff        // TAILLIGHT_PAGE
+#define TEST_USAGE          0x02        // TAILLIGHT_FEATURE
+#define TEST_REPORT_ID      0x25
+#define TEST_REPORT_LENGTH  8
+#define TEST_RANDOM_STEPS   1000000
+
+static int failures;
+
+static VOID
+Check(
+    IN  const char  *Name,
+    IN  long long   Actual,
+    IN  long long   Expected
+    )
+{
+    if (Actual != Expected) {
+        failures++;
+        printf("FAIL %s: got %lld, expected %lld\n", Name, Actual, Expected);
+    }
+}
+
+//
+// The made-up collection: report TEST_REPORT_ID, the light is bit 0 of
+// byte 1 on TEST_PAGE
+//
+struct _HIDP_PREPARSED_DATA {
+    ULONG SetUsagesCalls;
+};
+
+NTSTATUS
+HidP_SetUsages(
+    IN      HIDP_REPORT_TYPE        ReportType,
+    IN      USAGE                   UsagePage,
+    IN      USHORT                  LinkCollection,
+    IN      PUSAGE                  UsageList,
+    IN OUT  PULONG                  UsageLength,
+    IN      PHIDP_PREPARSED_DATA    PreparsedData,
+    IN OUT  PCHAR                   Report,
+    IN      ULONG                   ReportLength
+    )
+{
+    PreparsedData->SetUsagesCalls++;
+
+    if (ReportType != HidP_Feature || UsagePage != TEST_PAGE || LinkCollection != 0 ||
+        *UsageLength != 1 || UsageList[0] != TEST_USAGE) {
+        return HIDP_STATUS_USAGE_NOT_FOUND;
+    }
+    if (ReportLength < 2) {
+        return HIDP_STATUS_INVALID_REPORT_LENGTH;
+    }
+
+    Report[0] = TEST_REPORT_ID;
+    Report[1] |= 1;
+    return STATUS_SUCCESS;
+}
+
+//
+// Model of the driver, following vfeature.c. There is one thread, so
+// the feature lock is left out.
+//
+typedef struct _TEST_DEVICE {
+    FIREFLY_FEATURE_STATE   State;
+    struct _HIDP_PREPARSED_DATA Preparsed;
+    CHAR                    Template[TEST_REPORT_LENGTH];
+    CHAR                    Request[TEST_REPORT_LENGTH];
+    BOOLEAN                 TargetOpen;
+    BOOLEAN                 RefuseSend;     // WdfRequestSend fails
+    BOOLEAN                 Busy;           // the device holds the request
+    BOOLEAN                 Idle;           // FeatureIdleEvent
+    BOOLEAN                 Light;          // what the device last applied
+    ULONG                   Requests;
+    ULONG                   Sends;
+    ULONG                   SendFailures;
+} TEST_DEVICE, *PTEST_DEVICE;
+
+static VOID
+TestInitialize(
+    OUT PTEST_DEVICE Device
+    )
+{
+    memset(Device, 0, sizeof(*Device));
+    Device->TargetOpen = TRUE;
+    Device->Idle = TRUE;
+}
+
+static NTSTATUS
+TestSendFeature(
+    IN  PTEST_DEVICE Device
+    )
+{
+    NTSTATUS    status;
+    UCHAR       pageId;
+    USAGE       usage;
+    BOOLEAN     enableFeature;
+    BOOLEAN     targetOpen;
+
+    for (;;) {
+
+        targetOpen = Device->TargetOpen;
+        FireflyFeatureTake(&Device->State, &pageId, &usage, &enableFeature);
+
+        if (!targetOpen) {
+            status = STATUS_DEVICE_NOT_READY;
+        } else {
+            status = FireflyBuildFeatureReport(Device->Request,
+                                               Device->Template,
+                                               TEST_REPORT_LENGTH,
+                                               &Device->Preparsed,
+                                               (UCHAR) pageId,
+                                               usage,
+                                               enableFeature);
+
+            if (NT_SUCCESS(status)) {
+                if (Device->Busy) {
+                    failures++;
+                    printf("FAIL send: a request is already in flight\n");
+                }
+
+                if (!Device->RefuseSend) {
+                    Device->Busy = TRUE;
+                    Device->Sends++;
+                    return STATUS_SUCCESS;
+                }
+
+                status = STATUS_UNSUCCESSFUL;
+                Device->SendFailures++;
+            }
+        }
+
+        if (!FireflyFeatureFinish(&Device->State, targetOpen)) {
+            Device->Idle = TRUE;
+            return status;
+        }
+    }
+}
+
+static NTSTATUS
+TestSetFeature(
+    IN  PTEST_DEVICE Device,
+    IN  UCHAR        PageId,
+    IN  BOOLEAN      EnableFeature
+    )
+{
+    if (!Device->TargetOpen) {
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    Device->Requests++;
+
+    if (!FireflyFeatureRequest(&Device->State, PageId, TEST_USAGE, EnableFeature)) {
+        return STATUS_SUCCESS;
+    }
+
+    Device->Idle = FALSE;
+    return TestSendFeature(Device);
+}
+
+static VOID
+TestComplete(
+    IN  PTEST_DEVICE Device
+    )
+{
+    Device->Busy = FALSE;
+    Device->Light = (Device->Request[1] & 1) != 0;
+
+    if (!FireflyFeatureFinish(&Device->State, TRUE)) {
+        Device->Idle = TRUE;
+        return;
+    }
+
+    (VOID) TestSendFeature(Device);
+}
+
+static VOID
+TestBuildReport(
+    VOID
+    )
+{
+    CHAR templ[TEST_REPORT_LENGTH] = {0};
+    CHAR report[TEST_REPORT_LENGTH];
+    struct _HIDP_PREPARSED_DATA preparsed = {0};
+    NTSTATUS status;
+
+    // Disabled: the template, and the parser isn't asked
+    memset(report, 0x5a, sizeof(report));
+    status = FireflyBuildFeatureReport(report, templ, TEST_REPORT_LENGTH, &preparsed,
+                                       TEST_PAGE, TEST_USAGE, FALSE);
+    Check("disabled status", status, STATUS_SUCCESS);
+    Check("disabled report", memcmp(report, templ, sizeof(report)), 0);
+    Check("disabled parser calls", preparsed.SetUsagesCalls, 0);
+
+    // Enabled: the template with the usage set
+    status = FireflyBuildFeatureReport(report, templ, TEST_REPORT_LENGTH, &preparsed,
+                                       TEST_PAGE, TEST_USAGE, TRUE);
+    Check("enabled status", status, STATUS_SUCCESS);
+    Check("enabled report id", (UCHAR) report[0], TEST_REPORT_ID);
+    Check("enabled bit", report[1], 1);
+    Check("enabled rest", report[TEST_REPORT_LENGTH - 1], 0);
+
+    // A usage the collection doesn't have fails the build
+    status = FireflyBuildFeatureReport(report, templ, TEST_REPORT_LENGTH, &preparsed,
+                                       TEST_PAGE - 1, TEST_USAGE, TRUE);
+    Check("wrong page status", status, HIDP_STATUS_USAGE_NOT_FOUND);
+}
+
+static VOID
+TestCoalescing(
+    VOID
+    )
+{
+    static TEST_DEVICE device;
+    ULONG i;
+
+    // Idle: sent at once
+    TestInitialize(&device);
+    Check("first status", TestSetFeature(&device, TEST_PAGE, FALSE), STATUS_SUCCESS);
+    Check("first sends", device.Sends, 1);
+    Check("first busy", device.Busy, TRUE);
+    Check("first idle", device.Idle, FALSE);
+    TestComplete(&device);
+    Check("first completes idle", device.Idle, TRUE);
+    Check("first light", device.Light, FALSE);
+
+    // A burst while in flight: one follow-up with the last state
+    TestSetFeature(&device, TEST_PAGE, FALSE);
+    for (i = 0; i < 100; i++) {
+        TestSetFeature(&device, TEST_PAGE, (BOOLEAN) (i & 1));
+    }
+    Check("burst sends", device.Sends, 2);
+    TestComplete(&device);
+    Check("burst follow-up", device.Sends, 3);
+    Check("burst not idle", device.Idle, FALSE);
+    TestComplete(&device);
+    Check("burst idle", device.Idle, TRUE);
+    Check("burst last state", device.Light, TRUE);
+
+    // A refused send is not retried on its own...
+    device.RefuseSend = TRUE;
+    Check("refused status", TestSetFeature(&device, TEST_PAGE, FALSE), STATUS_UNSUCCESSFUL);
+    Check("refused idle", device.Idle, TRUE);
+    Check("refused in flight", device.State.InFlight, FALSE);
+
+    // ...and a refused follow-up goes idle too
+    device.RefuseSend = FALSE;
+    TestSetFeature(&device, TEST_PAGE, TRUE);
+    TestSetFeature(&device, TEST_PAGE, FALSE);
+    device.RefuseSend = TRUE;
+    TestComplete(&device);
+    Check("refused follow-up idle", device.Idle, TRUE);
+    Check("refused follow-up light", device.Light, TRUE);
+    device.RefuseSend = FALSE;
+
+    // The target going away drops the pending state and goes idle
+    TestSetFeature(&device, TEST_PAGE, TRUE);
+    TestSetFeature(&device, TEST_PAGE, FALSE);
+    device.TargetOpen = FALSE;
+    TestComplete(&device);
+    Check("closed idle", device.Idle, TRUE);
+    Check("closed pending", device.State.Pending, FALSE);
+    Check("closed refuses", TestSetFeature(&device, TEST_PAGE, TRUE), STATUS_DEVICE_NOT_READY);
+}
+
+static VOID
+TestRandom(
+    VOID
+    )
+{
+    static TEST_DEVICE device;
+    BOOLEAN lastRequested = FALSE;
+    BOOLEAN lastDelivered = FALSE;
+    ULONG refusedBefore = 0;
+    ULONG seed = 1;
+    ULONG i;
+
+    TestInitialize(&device);
+
+    for (i = 0; i < TEST_RANDOM_STEPS; i++) {
+
+        seed = seed * 1103515245 + 12345;
+
+        switch ((seed >> 16) % 8) {
+        case 0:
+        case 1:
+        case 2:
+            lastRequested = (BOOLEAN) ((seed >> 8) & 1);
+            device.RefuseSend = ((seed >> 24) % 16) == 0;
+            refusedBefore = device.SendFailures;
+            TestSetFeature(&device, TEST_PAGE, lastRequested);
+            lastDelivered = FALSE;
+            device.RefuseSend = FALSE;
+            break;
+
+        default:
+            if (device.Busy) {
+                TestComplete(&device);
+            }
+            break;
+        }
+
+        Check("random idle matches", device.Idle, !device.State.InFlight);
+        Check("random busy matches", device.Busy, device.State.InFlight);
+        if (device.Sends > device.Requests) {
+            failures++;
+            printf("FAIL random: %u sends for %u requests\n", device.Sends, device.Requests);
+            break;
+        }
+        if (device.Idle && !lastDelivered && device.SendFailures == refusedBefore) {
+            //
+            // Whenever things settle, and no send was refused since the
+            // last request, the device has the latest state
+            //
+            Check("random settles on the latest state", device.Light, lastRequested);
+            lastDelivered = TRUE;
+        }
+    }
+
+    while (device.Busy) {
+        TestComplete(&device);
+    }
+
+    printf("%u requests, %u sends, %u refused\n", device.Requests, device.Sends, device.SendFailures);
+}
+
+int
+main(
+    VOID
+    )
+{
+    TestBuildReport();
+    TestCoalescing();
+    TestRandom();
+
+    if (failures != 0) {
+        return 1;
+    }
+
+    printf("Feature coalescing test passed\n");
+    return 0;
+}
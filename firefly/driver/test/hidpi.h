@@ -0,0 +1,43 @@
+/*++
+
+Module Name:
+
+    hidpi.h
+
+Abstract:
+
+    Stand-in for the HID parser header. test/featuretest.c provides
+    HidP_SetUsages for a made-up collection.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+typedef USHORT USAGE, *PUSAGE;
+
+typedef struct _HIDP_PREPARSED_DATA *PHIDP_PREPARSED_DATA;
+
+typedef enum _HIDP_REPORT_TYPE {
+    HidP_Input,
+    HidP_Output,
+    HidP_Feature
+} HIDP_REPORT_TYPE;
+
+#define HIDP_STATUS_USAGE_NOT_FOUND         ((NTSTATUS)0xC0110004L)
+#define HIDP_STATUS_INVALID_REPORT_LENGTH   ((NTSTATUS)0xC0110003L)
+
+NTSTATUS
+HidP_SetUsages(
+    IN      HIDP_REPORT_TYPE        ReportType,
+    IN      USAGE                   UsagePage,
+    IN      USHORT                  LinkCollection,
+    IN      PUSAGE                  UsageList,
+    IN OUT  PULONG                  UsageLength,
+    IN      PHIDP_PREPARSED_DATA    PreparsedData,
+    IN OUT  PCHAR                   Report,
+    IN      ULONG                   ReportLength
+    );
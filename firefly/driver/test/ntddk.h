@@ -0,0 +1,45 @@
+/*++
+
+Module Name:
+
+    ntddk.h
+
+Abstract:
+
+    Stand-in for the kernel headers with just what featurestate.c uses,
+    so that test/featuretest.c builds on a host.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <stdio.h>
+#include <string.h>
+
+#define IN
+#define OUT
+
+typedef void VOID;
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR;
+typedef unsigned char BOOLEAN, *PBOOLEAN;
+typedef unsigned short USHORT, *PUSHORT;
+typedef unsigned int ULONG, *PULONG;
+typedef int NTSTATUS;
+
+#define TRUE    1
+#define FALSE   0
+
+#define STATUS_SUCCESS              ((NTSTATUS)0x00000000L)
+#define STATUS_DEVICE_NOT_READY     ((NTSTATUS)0xC00000A3L)
+#define STATUS_UNSUCCESSFUL         ((NTSTATUS)0xC0000001L)
+
+#define NT_SUCCESS(Status)          (((NTSTATUS)(Status)) >= 0)
+
+#define RtlCopyMemory(Destination, Source, Length) memcpy((Destination), (Source), (Length))
+
+#define KdPrint(_x_)
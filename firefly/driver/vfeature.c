@@ -23,76 +23,60 @@ Environment:
 
 #include "firefly.h"
 
-#pragma warning(disable:4201)  // nameless struct/union
-#pragma warning(disable:4214)  // bit field types other than int
-
-#include <hidpddi.h>
-#include <hidclass.h>
+static
+NTSTATUS
+FireflySendFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
+    );
 
-#pragma warning(default:4201)
-#pragma warning(default:4214)
+static
+WDFIOTARGET
+FireflyDetachFeatureTarget(
+    IN  PDEVICE_CONTEXT DeviceContext
+    );
 
 #ifdef ALLOC_PRAGMA
-#pragma alloc_text(PAGE, FireflySetFeature)
+#pragma alloc_text(PAGE, FireflyInitializeFeature)
+#pragma alloc_text(PAGE, FireflyCleanupFeature)
 #endif
 
 NTSTATUS
-FireflySetFeature(
-    IN  PDEVICE_CONTEXT DeviceContext,
-    IN  UCHAR           PageId,
-    IN  USHORT          FeatureId,
-    IN  BOOLEAN         EnableFeature
+FireflyInitializeFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
     )
 /*++
 
 Routine Description:
 
-    This routine sets the HID feature by sending HID ioctls to our device.
-    These IOCTLs will be handled by HIDUSB and converted into USB requests
-    and send to the device.
+    This routine opens the HID target used to set the feature, caches
+    the collection's preparsed data and builds the feature report
+    template. It is called once, when self-managed I/O is initialized.
 
 Arguments:
 
     DeviceContext - Context for our device
 
-    PageID  - UsagePage of the light control feature.
-
-    FeatureId - Usage ID of the feature.
-
-    EnanbleFeature - True to turn the light on, Falst to turn if off.
-
-
 Return Value:
 
     NT Status code
 
 --*/
 {
-    WDF_MEMORY_DESCRIPTOR       inputDescriptor, outputDescriptor;
+    WDF_MEMORY_DESCRIPTOR       outputDescriptor;
     NTSTATUS                    status;
     HID_COLLECTION_INFORMATION  collectionInformation = {0};
-    PHIDP_PREPARSED_DATA        preparsedData;
     HIDP_CAPS                   caps;
-    USAGE                       usage;
-    ULONG                       usageLength;
-    PCHAR                       report;
-    WDFIOTARGET                 hidTarget;
     WDF_IO_TARGET_OPEN_PARAMS   openParams;
+    WDF_OBJECT_ATTRIBUTES       attributes;
 
     PAGED_CODE();
 
-    //
-    // Preinit for error.
-    //
-    preparsedData = NULL;
-    report = NULL;
-    hidTarget = NULL;
-    
-    status = WdfIoTargetCreate(WdfObjectContextGetObject(DeviceContext), 
-                            WDF_NO_OBJECT_ATTRIBUTES, 
-                            &hidTarget);    
+    status = WdfIoTargetCreate(WdfObjectContextGetObject(DeviceContext),
+                            WDF_NO_OBJECT_ATTRIBUTES,
+                            &DeviceContext->HidTarget);
     if (!NT_SUCCESS(status)) {
-        KdPrint(("FireFly: WdfIoTargetCreate failed 0x%x\n", status));        
+        KdPrint(("FireFly: WdfIoTargetCreate failed 0x%x\n", status));
+        DeviceContext->HidTarget = NULL;
         return status;
     }
 
@@ -110,12 +94,11 @@ Return Value:
     //
     openParams.ShareAccess = FILE_SHARE_WRITE | FILE_SHARE_READ;
 
-    status = WdfIoTargetOpen(hidTarget, &openParams);
+    status = WdfIoTargetOpen(DeviceContext->HidTarget, &openParams);
     if (!NT_SUCCESS(status)) {
-        KdPrint(("FireFly: WdfIoTargetOpen failed 0x%x\n", status));                
+        KdPrint(("FireFly: WdfIoTargetOpen failed 0x%x\n", status));
         goto ExitAndFree;
     }
-    
 
     WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&outputDescriptor,
                                       (PVOID) &collectionInformation,
@@ -124,7 +107,7 @@ Return Value:
     //
     // Now get the collection information for this device
     //
-    status = WdfIoTargetSendIoctlSynchronously(hidTarget,
+    status = WdfIoTargetSendIoctlSynchronously(DeviceContext->HidTarget,
                                   NULL,
                                   IOCTL_HID_GET_COLLECTION_INFORMATION,
                                   NULL,
@@ -133,23 +116,27 @@ Return Value:
                                   NULL);
 
     if (!NT_SUCCESS(status)) {
-        KdPrint(("FireFly: WdfIoTargetSendIoctlSynchronously failed 0x%x\n", status));                
+        KdPrint(("FireFly: WdfIoTargetSendIoctlSynchronously failed 0x%x\n", status));
         goto ExitAndFree;
     }
 
-    preparsedData = (PHIDP_PREPARSED_DATA) ExAllocatePool2(
+    //
+    // The preparsed data is used by HidP_SetUsages from the completion
+    // routine, so it must be nonpaged.
+    //
+    DeviceContext->PreparsedData = (PHIDP_PREPARSED_DATA) ExAllocatePool2(
         POOL_FLAG_NON_PAGED, collectionInformation.DescriptorSize, 'ffly');
 
-    if (preparsedData == NULL) {
+    if (DeviceContext->PreparsedData == NULL) {
         status = STATUS_INSUFFICIENT_RESOURCES;
         goto ExitAndFree;
     }
 
     WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&outputDescriptor,
-                                      (PVOID) preparsedData,
+                                      (PVOID) DeviceContext->PreparsedData,
                                       collectionInformation.DescriptorSize);
 
-    status = WdfIoTargetSendIoctlSynchronously(hidTarget,
+    status = WdfIoTargetSendIoctlSynchronously(DeviceContext->HidTarget,
                                   NULL,
                                   IOCTL_HID_GET_COLLECTION_DESCRIPTOR,
                                   NULL,
@@ -158,7 +145,7 @@ Return Value:
                                   NULL);
 
     if (!NT_SUCCESS(status)) {
-        KdPrint(("FireFly: WdfIoTargetSendIoctlSynchronously failed 0x%x\n", status));                
+        KdPrint(("FireFly: WdfIoTargetSendIoctlSynchronously failed 0x%x\n", status));
         goto ExitAndFree;
     }
 
@@ -167,83 +154,371 @@ Return Value:
     //
     RtlZeroMemory(&caps, sizeof(HIDP_CAPS));
 
-    status = HidP_GetCaps(preparsedData, &caps);
+    status = HidP_GetCaps(DeviceContext->PreparsedData, &caps);
 
     if (!NT_SUCCESS(status)) {
 
         goto ExitAndFree;
     }
 
+    DeviceContext->FeatureReportLength = caps.FeatureReportByteLength;
+
     //
-    // Create a report to send to the device.
+    // The template is a zeroed report. If we are disabling the feature,
+    // this is all we need to send.
     //
-    report = (PCHAR) ExAllocatePool2(
+    DeviceContext->ReportTemplate = (PCHAR) ExAllocatePool2(
         POOL_FLAG_NON_PAGED, caps.FeatureReportByteLength, 'ffly');
 
-    if (report == NULL) {
+    if (DeviceContext->ReportTemplate == NULL) {
+        status = STATUS_INSUFFICIENT_RESOURCES;
         goto ExitAndFree;
     }
 
     //
-    // Start with a zeroed report. If we are disabling the feature, this might
-    // be all we need to do.
+    // Preallocate the set-feature request and its report buffer. Both
+    // are children of the target and go away with it.
     //
-    status = STATUS_SUCCESS;
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = DeviceContext->HidTarget;
 
-    if (EnableFeature) {
-
-        //
-        // Edit the report to reflect the enabled feature
-        //
-        usage = FeatureId;
-        usageLength = 1;
-
-        status = HidP_SetUsages(
-            HidP_Feature,
-            PageId,
-            0,
-            &usage, // pointer to the usage list
-            &usageLength, // number of usages in the usage list
-            preparsedData,
-            report,
-            caps.FeatureReportByteLength
-            );
-        if (!NT_SUCCESS(status)) {
-            KdPrint(("FireFly: HidP_SetUsages failed 0x%x\n", status));                
-            goto ExitAndFree;
-        }
+    status = WdfRequestCreate(&attributes,
+                              DeviceContext->HidTarget,
+                              &DeviceContext->FeatureRequest);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("FireFly: WdfRequestCreate failed 0x%x\n", status));
+        goto ExitAndFree;
     }
 
-    WDF_MEMORY_DESCRIPTOR_INIT_BUFFER(&inputDescriptor,
-                                      report,
-                                      caps.FeatureReportByteLength);
-    status = WdfIoTargetSendIoctlSynchronously(hidTarget,
-                                  NULL,
-                                  IOCTL_HID_SET_FEATURE,
-                                  &inputDescriptor,
-                                  NULL,
-                                  NULL,
-                                  NULL);
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = DeviceContext->FeatureRequest;
+
+    status = WdfMemoryCreate(&attributes,
+                             NonPagedPoolNx,
+                             'ffly',
+                             caps.FeatureReportByteLength,
+                             &DeviceContext->FeatureMemory,
+                             NULL);
     if (!NT_SUCCESS(status)) {
-        KdPrint(("FireFly: WdfIoTargetSendIoctlSynchronously failed 0x%x\n", status));                
+        KdPrint(("FireFly: WdfMemoryCreate failed 0x%x\n", status));
         goto ExitAndFree;
     }
 
 ExitAndFree:
 
-    if (preparsedData != NULL) {
-        ExFreePool(preparsedData);
-        preparsedData = NULL;
+    if (!NT_SUCCESS(status)) {
+        FireflyCleanupFeature(DeviceContext);
     }
 
-    if (report != NULL) {
-        ExFreePool(report);
-        report = NULL;
+    return status;
+}
+
+VOID
+FireflyCleanupFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    This routine waits for the set-feature in flight, if any, and
+    releases everything FireflyInitializeFeature set up.
+
+Arguments:
+
+    DeviceContext - Context for our device
+
+Return Value:
+
+    None
+
+--*/
+{
+    WDFIOTARGET     hidTarget;
+
+    PAGED_CODE();
+
+    hidTarget = FireflyDetachFeatureTarget(DeviceContext);
+
+    if (hidTarget == NULL) {
+        return;
     }
 
-    if (hidTarget != NULL) {
-        WdfObjectDelete(hidTarget);
+    //
+    // A purged target cancels the set-feature in flight and fails any
+    // request sent to it afterwards instead of queuing it, including a
+    // follow-up sent with a target handle read before it was detached.
+    //
+    WdfIoTargetPurge(hidTarget, WdfIoTargetPurgeIoAndWait);
+
+    KeWaitForSingleObject(&DeviceContext->FeatureIdleEvent,
+                          Executive,
+                          KernelMode,
+                          FALSE,
+                          NULL);
+
+    //
+    // Deleting the target also deletes the request and its memory
+    //
+    WdfObjectDelete(hidTarget);
+    DeviceContext->FeatureRequest = NULL;
+    DeviceContext->FeatureMemory = NULL;
+
+    if (DeviceContext->PreparsedData != NULL) {
+        ExFreePool(DeviceContext->PreparsedData);
+        DeviceContext->PreparsedData = NULL;
     }
 
-    return status;
+    if (DeviceContext->ReportTemplate != NULL) {
+        ExFreePool(DeviceContext->ReportTemplate);
+        DeviceContext->ReportTemplate = NULL;
+    }
+}
+
+static
+WDFIOTARGET
+FireflyDetachFeatureTarget(
+    IN  PDEVICE_CONTEXT DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    This routine stops new set-features from being started. It takes
+    the spin lock, so it is not pageable.
+
+Arguments:
+
+    DeviceContext - Context for our device
+
+Return Value:
+
+    The HID target, or NULL if it was never opened
+
+--*/
+{
+    WDFIOTARGET hidTarget;
+
+    WdfSpinLockAcquire(DeviceContext->FeatureLock);
+    hidTarget = DeviceContext->HidTarget;
+    DeviceContext->HidTarget = NULL;
+    WdfSpinLockRelease(DeviceContext->FeatureLock);
+
+    return hidTarget;
+}
+
+NTSTATUS
+FireflySetFeature(
+    IN  PDEVICE_CONTEXT DeviceContext,
+    IN  UCHAR           PageId,
+    IN  USHORT          FeatureId,
+    IN  BOOLEAN         EnableFeature
+    )
+/*++
+
+Routine Description:
+
+    This routine sets the HID feature by sending HID ioctls to our device.
+    These IOCTLs will be handled by HIDUSB and converted into USB requests
+    and send to the device.
+
+    The set-feature is sent asynchronously. If one is already in flight,
+    the new state is recorded and sent when it completes, so a burst of
+    calls results in at most one more request carrying the latest state.
+    FireflyFeatureRequest makes that decision.
+
+Arguments:
+
+    DeviceContext - Context for our device
+
+    PageID  - UsagePage of the light control feature.
+
+    FeatureId - Usage ID of the feature.
+
+    EnanbleFeature - True to turn the light on, Falst to turn if off.
+
+
+Return Value:
+
+    NT Status code
+
+--*/
+{
+    WdfSpinLockAcquire(DeviceContext->FeatureLock);
+
+    if (DeviceContext->HidTarget == NULL ||
+        DeviceContext->FeatureMemory == NULL) {
+        WdfSpinLockRelease(DeviceContext->FeatureLock);
+        return STATUS_DEVICE_NOT_READY;
+    }
+
+    if (!FireflyFeatureRequest(&DeviceContext->FeatureState,
+                               PageId,
+                               FeatureId,
+                               EnableFeature)) {
+        //
+        // Picked up by the completion routine
+        //
+        WdfSpinLockRelease(DeviceContext->FeatureLock);
+        return STATUS_SUCCESS;
+    }
+
+    KeClearEvent(&DeviceContext->FeatureIdleEvent);
+    WdfSpinLockRelease(DeviceContext->FeatureLock);
+
+    return FireflySendFeature(DeviceContext);
+}
+
+static
+NTSTATUS
+FireflySendFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
+    )
+/*++
+
+Routine Description:
+
+    This routine builds the feature report for the latest requested
+    state and sends it with the preallocated request. The caller must
+    have been told to send by FireflyFeatureRequest or
+    FireflyFeatureFinish. It can be called at DISPATCH_LEVEL.
+
+Arguments:
+
+    DeviceContext - Context for our device
+
+Return Value:
+
+    NT Status code. On failure the feature is idle again.
+
+--*/
+{
+    NTSTATUS                status;
+    WDFIOTARGET             hidTarget;
+    UCHAR                   pageId;
+    USAGE                   usage;
+    BOOLEAN                 enableFeature;
+    PCHAR                   report;
+    WDF_REQUEST_REUSE_PARAMS reuseParams;
+
+    for (;;) {
+
+        WdfSpinLockAcquire(DeviceContext->FeatureLock);
+        hidTarget = DeviceContext->HidTarget;
+        FireflyFeatureTake(&DeviceContext->FeatureState,
+                           &pageId,
+                           &usage,
+                           &enableFeature);
+        WdfSpinLockRelease(DeviceContext->FeatureLock);
+
+        if (hidTarget == NULL) {
+            status = STATUS_DEVICE_NOT_READY;
+        } else {
+
+            report = (PCHAR) WdfMemoryGetBuffer(DeviceContext->FeatureMemory, NULL);
+
+            status = FireflyBuildFeatureReport(report,
+                                               DeviceContext->ReportTemplate,
+                                               DeviceContext->FeatureReportLength,
+                                               DeviceContext->PreparsedData,
+                                               pageId,
+                                               usage,
+                                               enableFeature);
+
+            if (NT_SUCCESS(status)) {
+                WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams,
+                                              WDF_REQUEST_REUSE_NO_FLAGS,
+                                              STATUS_SUCCESS);
+                WdfRequestReuse(DeviceContext->FeatureRequest, &reuseParams);
+
+                status = WdfIoTargetFormatRequestForIoctl(hidTarget,
+                                              DeviceContext->FeatureRequest,
+                                              IOCTL_HID_SET_FEATURE,
+                                              DeviceContext->FeatureMemory,
+                                              NULL,
+                                              NULL,
+                                              NULL);
+            }
+
+            if (NT_SUCCESS(status)) {
+                WdfRequestSetCompletionRoutine(DeviceContext->FeatureRequest,
+                                               FireflyEvtSetFeatureComplete,
+                                               DeviceContext);
+
+                if (WdfRequestSend(DeviceContext->FeatureRequest,
+                                   hidTarget,
+                                   WDF_NO_SEND_OPTIONS)) {
+                    //
+                    // The completion routine takes it from here
+                    //
+                    return STATUS_SUCCESS;
+                }
+
+                status = WdfRequestGetStatus(DeviceContext->FeatureRequest);
+                KdPrint(("FireFly: WdfRequestSend failed 0x%x\n", status));
+            }
+        }
+
+        //
+        // Nothing was sent. Give up unless a newer state came in
+        // meanwhile.
+        //
+        WdfSpinLockAcquire(DeviceContext->FeatureLock);
+        if (!FireflyFeatureFinish(&DeviceContext->FeatureState, hidTarget != NULL)) {
+            KeSetEvent(&DeviceContext->FeatureIdleEvent, 0, FALSE);
+            WdfSpinLockRelease(DeviceContext->FeatureLock);
+            return status;
+        }
+        WdfSpinLockRelease(DeviceContext->FeatureLock);
+    }
+}
+
+VOID
+FireflyEvtSetFeatureComplete(
+    IN  WDFREQUEST                  Request,
+    IN  WDFIOTARGET                 Target,
+    IN  PWDF_REQUEST_COMPLETION_PARAMS Params,
+    IN  WDFCONTEXT                  Context
+    )
+/*++
+
+Routine Description:
+
+    Completion routine for the set-feature request. Sends the latest
+    state if it changed while the request was in flight.
+
+Arguments:
+
+    Request - The preallocated set-feature request
+
+    Target - The HID target
+
+    Params - Completion parameters
+
+    Context - Context for our device
+
+Return Value:
+
+    None
+
+--*/
+{
+    PDEVICE_CONTEXT deviceContext = (PDEVICE_CONTEXT) Context;
+
+    UNREFERENCED_PARAMETER(Request);
+    UNREFERENCED_PARAMETER(Target);
+
+    if (!NT_SUCCESS(Params->IoStatus.Status)) {
+        KdPrint(("FireFly: IOCTL_HID_SET_FEATURE failed 0x%x\n", Params->IoStatus.Status));
+    }
+
+    WdfSpinLockAcquire(deviceContext->FeatureLock);
+    if (!FireflyFeatureFinish(&deviceContext->FeatureState, TRUE)) {
+        KeSetEvent(&deviceContext->FeatureIdleEvent, 0, FALSE);
+        WdfSpinLockRelease(deviceContext->FeatureLock);
+        return;
+    }
+    WdfSpinLockRelease(deviceContext->FeatureLock);
+
+    (VOID) FireflySendFeature(deviceContext);
 }
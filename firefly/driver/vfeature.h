@@ -26,6 +26,16 @@ Environment:
 #if !defined(_VFEATURE_H_)
 #define _VFEATURE_H_
 
+NTSTATUS
+FireflyInitializeFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
+    );
+
+VOID
+FireflyCleanupFeature(
+    IN  PDEVICE_CONTEXT DeviceContext
+    );
+
 NTSTATUS
 FireflySetFeature(
     IN  PDEVICE_CONTEXT DeviceContext,
@@ -34,4 +44,6 @@ FireflySetFeature(
     IN  BOOLEAN         EnableFeature
     );
 
+EVT_WDF_REQUEST_COMPLETION_ROUTINE FireflyEvtSetFeatureComplete;
+
 #endif // _VFEATURE_H
@@ -30,6 +30,7 @@ CLuminous::CLuminous(
     m_pIWbemServices = NULL;
     m_pIWbemClassObject = NULL;
     m_bCOMInitialized = FALSE;
+    m_bstrPropertyName = NULL;
 }
 
 
@@ -80,6 +81,12 @@ CLuminous::Open(
         goto OpenCleanup;
     }
 
+    m_bstrPropertyName = AnsiToBstr( PROPERTY_NAME, -1 );
+    if ( !m_bstrPropertyName ) {
+        _tprintf( TEXT("Error out of memory.\n") );
+        goto OpenCleanup;
+    }
+
      bRet = TRUE;
 
 OpenCleanup:
@@ -116,6 +123,11 @@ CLuminous::Close(
         m_pIWbemClassObject = NULL;
     }
 
+    if (m_bstrPropertyName) {
+        SysFreeString( m_bstrPropertyName );
+        m_bstrPropertyName = NULL;
+    }
+
     if(m_bCOMInitialized) {
         CoUninitialize();
         m_bCOMInitialized = FALSE;
@@ -131,7 +143,6 @@ CLuminous::Get(
 {
 
     VARIANT     varPropVal;
-    BSTR          bstrPropertyName = NULL;
     HRESULT     hResult;
     CIMTYPE     cimType;
     BOOL          bRet= FALSE;
@@ -142,20 +153,12 @@ CLuminous::Get(
 
     VariantInit( &varPropVal );
 
-    bstrPropertyName = AnsiToBstr( PROPERTY_NAME, -1 );
-
-    if ( !bstrPropertyName ) {
-        _tprintf( TEXT("Error out of memory.\n") );
-        VariantClear( &varPropVal );
-        return FALSE ;
-    }
-
     //
     // Get the property value.
     //
 
     hResult = m_pIWbemClassObject->Get(
-                             bstrPropertyName,
+                             m_bstrPropertyName,
                              0,
                              &varPropVal,
                              &cimType,
@@ -173,10 +176,6 @@ CLuminous::Get(
         }
     }
 
-    if(bstrPropertyName) {
-        SysFreeString( bstrPropertyName );
-    }
-
     VariantClear( &varPropVal );
 
     return bRet;
@@ -189,7 +188,6 @@ CLuminous::Set(
     )
 {
     VARIANT     varPropVal;
-    BSTR          bstrPropertyName = NULL;
     HRESULT     hResult;
     CIMTYPE     cimType;
     BOOL         bRet = FALSE;
@@ -201,19 +199,12 @@ CLuminous::Set(
 
     VariantInit( &varPropVal );
 
-    bstrPropertyName = AnsiToBstr( lpProperty, -1 );
-
-    if ( !bstrPropertyName ) {
-        _tprintf( TEXT("Error out of memory.\n") );
-        goto End ;
-    }
-
     //
     // Get the property value.
     //
 
     hResult = m_pIWbemClassObject->Get(
-                             bstrPropertyName,
+                             m_bstrPropertyName,
                              0,
                              &varPropVal,
                              &cimType,
@@ -235,7 +226,7 @@ CLuminous::Set(
         //
 
         hResult = m_pIWbemClassObject->Put(
-                                    bstrPropertyName,
+                                    m_bstrPropertyName,
                                     0,
                                     &varPropVal,
                                     cimType
@@ -266,10 +257,6 @@ CLuminous::Set(
 
 End:
 
-    if(bstrPropertyName) {
-        SysFreeString( bstrPropertyName );
-    }
-
     VariantClear( &varPropVal );
 
     return bRet;
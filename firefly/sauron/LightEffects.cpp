@@ -0,0 +1,309 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+Module Name: LightEffects.cpp
+
+
+Abstract: Light effects engine. Plays the timelines compiled by
+          LightTimeline.cpp on the firefly light from a single worker
+          thread at a fixed frame rate.
+
+
+Environment:
+
+    User mode only.
+
+--*/
+
+#include "stdafx.h"
+#include "LightEffects.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::CLightEffectEngine
+// Constructor
+
+CLightEffectEngine::CLightEffectEngine() :
+m_hThread(NULL),
+m_hStopEvent(NULL),
+m_dwFrameRate(LIGHT_EFFECT_FRAME_RATE),
+m_dwFree(LIGHT_EFFECT_TIMELINES),
+m_pPending(NULL),
+m_bFinalState(TRUE),
+m_ullFrames(0),
+m_ullFramesSent(0),
+m_ullFramesDropped(0)
+{
+    DWORD i;
+
+    for (i = 0; i < LIGHT_EFFECT_TIMELINES; i++) {
+
+        m_pFree[i] = &m_Timelines[i];
+    }
+
+    InitializeCriticalSection(&m_Lock);
+    InitializeCriticalSection(&m_PlayLock);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::~CLightEffectEngine
+// Destructor
+
+CLightEffectEngine::~CLightEffectEngine()
+{
+    Stop(m_bFinalState);
+
+    DeleteCriticalSection(&m_PlayLock);
+    DeleteCriticalSection(&m_Lock);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::Start
+// Starts the worker thread. The light is left alone until the first
+// effect is played.
+
+BOOL CLightEffectEngine::Start(DWORD dwFrameRate)
+{
+    if (m_hThread) {
+
+        return TRUE;
+    }
+
+    if (dwFrameRate == 0) {
+
+        return FALSE;
+    }
+
+    m_dwFrameRate = dwFrameRate;
+
+    m_hStopEvent = ::CreateEvent(NULL, TRUE, FALSE, NULL);
+    if (m_hStopEvent == NULL) {
+
+        return FALSE;
+    }
+
+    m_hThread = ::CreateThread(NULL, 0, WorkerThread, this, 0, NULL);
+    if (m_hThread == NULL) {
+
+        ::CloseHandle(m_hStopEvent);
+        m_hStopEvent = NULL;
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::Stop
+// Stops the worker thread and leaves the light in bFinalState
+
+void CLightEffectEngine::Stop(BOOL bFinalState)
+{
+    if (m_hThread == NULL) {
+
+        return;
+    }
+
+    m_bFinalState = bFinalState;
+
+    ::SetEvent(m_hStopEvent);
+    ::WaitForSingleObject(m_hThread, INFINITE);
+
+    ::CloseHandle(m_hThread);
+    m_hThread = NULL;
+
+    ::CloseHandle(m_hStopEvent);
+    m_hStopEvent = NULL;
+
+    ATLTRACE(_T("Sauron: %I64u frames, %I64u sent, %I64u dropped\n"),
+             m_ullFrames, m_ullFramesSent, m_ullFramesDropped);
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::Play
+// Compiles the effect into a free timeline and hands it to the worker,
+// which starts it at the next frame. Any effect still waiting to start
+// goes back on the free list. With one Play at a time, the worker holds
+// at most the playing and the pending timeline, so one is always free.
+
+BOOL CLightEffectEngine::Play(const LIGHT_EFFECT *pEffect)
+{
+    CLightTimeline *pTimeline;
+
+    if (m_hThread == NULL) {
+
+        return FALSE;
+    }
+
+    ::EnterCriticalSection(&m_PlayLock);
+
+    ::EnterCriticalSection(&m_Lock);
+    pTimeline = m_pFree[--m_dwFree];
+    ::LeaveCriticalSection(&m_Lock);
+
+    if (!pTimeline->Compile(pEffect, m_dwFrameRate)) {
+
+        ReleaseTimeline(pTimeline);
+        ::LeaveCriticalSection(&m_PlayLock);
+        return FALSE;
+    }
+
+    ::EnterCriticalSection(&m_Lock);
+    if (m_pPending) {
+
+        m_pFree[m_dwFree++] = m_pPending;
+    }
+    m_pPending = pTimeline;
+    ::LeaveCriticalSection(&m_Lock);
+
+    ::LeaveCriticalSection(&m_PlayLock);
+
+    return TRUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::ReleaseTimeline
+// Puts a timeline back on the free list
+
+void CLightEffectEngine::ReleaseTimeline(CLightTimeline *pTimeline)
+{
+    ::EnterCriticalSection(&m_Lock);
+    m_pFree[m_dwFree++] = pTimeline;
+    ::LeaveCriticalSection(&m_Lock);
+}
+
+DWORD WINAPI CLightEffectEngine::WorkerThread(LPVOID pContext)
+{
+    static_cast<CLightEffectEngine *>(pContext)->Worker();
+
+    return 0;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine::Worker
+// Plays the current timeline. Frames are scheduled against the time the
+// engine started, so a slow device update delays at most the frames it
+// overlaps, which are dropped, and never shifts the ones after it.
+
+void CLightEffectEngine::Worker()
+{
+    CLuminous       luminous;
+    CLightTimeline  *pTimeline = NULL;
+    CLightTimeline  *pPending;
+    LARGE_INTEGER   liFrequency;
+    LARGE_INTEGER   liStart;
+    LARGE_INTEGER   liNow;
+    ULONGLONG       ullElapsed;
+    ULONGLONG       ullDue;
+    ULONGLONG       ullFrame;
+    ULONGLONG       ullNextFrame = 0;
+    ULONGLONG       ullTimelineStart = 0;
+    DWORD           dwWait;
+    BOOL            bOn = FALSE;
+    BOOL            bLastSent = FALSE;
+    BOOL            bSent = FALSE;
+    BOOL            bPlaying = FALSE;
+
+    //
+    // The WMI connection belongs to the apartment that opened it, so the
+    // worker opens its own and keeps it for its lifetime.
+    //
+    if (!luminous.Open()) {
+
+        return;
+    }
+
+    ::QueryPerformanceFrequency(&liFrequency);
+    ::QueryPerformanceCounter(&liStart);
+
+    for (;;) {
+
+        //
+        // Sleep until the next frame is due
+        //
+        ::QueryPerformanceCounter(&liNow);
+        ullElapsed = liNow.QuadPart - liStart.QuadPart;
+        ullDue = ullNextFrame * liFrequency.QuadPart / m_dwFrameRate;
+
+        dwWait = 0;
+        if (ullDue > ullElapsed) {
+
+            dwWait = (DWORD) (((ullDue - ullElapsed) * 1000 + liFrequency.QuadPart - 1) /
+                              liFrequency.QuadPart);
+        }
+
+        if (::WaitForSingleObject(m_hStopEvent, dwWait) == WAIT_OBJECT_0) {
+
+            break;
+        }
+
+        ::QueryPerformanceCounter(&liNow);
+        ullFrame = (liNow.QuadPart - liStart.QuadPart) * m_dwFrameRate / liFrequency.QuadPart;
+        if (ullFrame < ullNextFrame) {
+
+            continue;
+        }
+
+        m_ullFrames++;
+        m_ullFramesDropped += ullFrame - ullNextFrame;
+        ullNextFrame = ullFrame + 1;
+
+        ::EnterCriticalSection(&m_Lock);
+        pPending = m_pPending;
+        m_pPending = NULL;
+        if (pPending && pTimeline) {
+
+            m_pFree[m_dwFree++] = pTimeline;
+        }
+        ::LeaveCriticalSection(&m_Lock);
+
+        if (pPending) {
+
+            pTimeline = pPending;
+            ullTimelineStart = ullFrame;
+            bPlaying = TRUE;
+        }
+
+        if (!bPlaying) {
+
+            continue;
+        }
+
+        if (pTimeline && !pTimeline->GetFrame(ullFrame - ullTimelineStart, &bOn)) {
+
+            //
+            // Finished, bOn holds the state it ended in
+            //
+            ReleaseTimeline(pTimeline);
+            pTimeline = NULL;
+        }
+
+        //
+        // Unchanged frames cost nothing
+        //
+        if (bSent && bOn == bLastSent) {
+
+            continue;
+        }
+
+        if (luminous.Set(bOn)) {
+
+            bSent = TRUE;
+            bLastSent = bOn;
+            m_ullFramesSent++;
+        }
+    }
+
+    if (pTimeline) {
+
+        ReleaseTimeline(pTimeline);
+    }
+
+    luminous.Set(m_bFinalState);
+    luminous.Close();
+}
@@ -0,0 +1,109 @@
+/////////////////////////////////////////////////////////////////////////////
+//
+// LightEffects.h : Declaration of the light effects engine
+//
+// Effects are compiled into a timeline of light states, one per frame.
+// A single worker thread plays the current timeline at a fixed frame
+// rate and only talks to the device when the state actually changes.
+//
+/////////////////////////////////////////////////////////////////////////////
+
+#ifndef __LIGHTEFFECTS_H_
+#define __LIGHTEFFECTS_H_
+
+#include "luminous.h"
+
+// frames per second the engine runs at
+#define LIGHT_EFFECT_FRAME_RATE     30
+
+// longest effect cycle, in milliseconds
+#define LIGHT_EFFECT_MAX_PERIOD     60000
+
+// timelines the engine owns: the one playing, the pending one, and one
+// for Play to compile into
+#define LIGHT_EFFECT_TIMELINES      3
+
+enum LIGHT_EFFECT_TYPE {
+    LightEffectSteady = 0,      // hold On
+    LightEffectBlink,           // on for DutyPercent of each period
+    LightEffectFade,            // ramp up and down once per period
+    LightEffectPattern          // one Pattern bit per PeriodMs step
+};
+
+typedef struct _LIGHT_EFFECT {
+    LIGHT_EFFECT_TYPE   Type;
+    BOOL                On;             // steady state
+    DWORD               PeriodMs;       // cycle length, or step length for patterns
+    DWORD               DutyPercent;    // blink on time
+    DWORD               Pattern;        // bit n is the state of step n
+    DWORD               PatternLength;  // number of steps, 1 to 32
+    DWORD               Repeat;         // number of cycles, 0 loops forever
+} LIGHT_EFFECT, *PLIGHT_EFFECT;
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightTimeline
+// One cycle of an effect, sampled at the frame rate
+class CLightTimeline
+{
+private:
+    BOOL    *m_Frames;
+    DWORD   m_FrameCount;
+    DWORD   m_Capacity;         // frames m_Frames has room for
+    DWORD   m_Repeat;
+
+public:
+    CLightTimeline();
+    ~CLightTimeline();
+
+    BOOL Compile(const LIGHT_EFFECT *pEffect, DWORD dwFrameRate);
+
+    // Returns FALSE once the effect has finished
+    BOOL GetFrame(ULONGLONG ullFrame, BOOL *pOn) const;
+};
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightEffectEngine
+class CLightEffectEngine
+{
+private:
+    HANDLE              m_hThread;
+    HANDLE              m_hStopEvent;
+    CRITICAL_SECTION    m_Lock;
+    CRITICAL_SECTION    m_PlayLock;     // one Play at a time
+    DWORD               m_dwFrameRate;
+
+    // allocated once and passed between Play and the worker, so that
+    // playing an effect on every beat doesn't allocate
+    CLightTimeline      m_Timelines[LIGHT_EFFECT_TIMELINES];
+
+    // protected by m_Lock
+    CLightTimeline      *m_pFree[LIGHT_EFFECT_TIMELINES];
+    DWORD               m_dwFree;
+
+    // set by Play, picked up by the worker at the next frame
+    CLightTimeline      *m_pPending;
+
+    // light state to leave behind when the engine stops
+    BOOL                m_bFinalState;
+
+    // statistics, updated by the worker
+    ULONGLONG           m_ullFrames;
+    ULONGLONG           m_ullFramesSent;
+    ULONGLONG           m_ullFramesDropped;
+
+    static DWORD WINAPI WorkerThread(LPVOID pContext);
+    void Worker();
+    void ReleaseTimeline(CLightTimeline *pTimeline);
+
+public:
+    CLightEffectEngine();
+    ~CLightEffectEngine();
+
+    BOOL Start(DWORD dwFrameRate);
+    void Stop(BOOL bFinalState);
+
+    // Replaces the effect being played
+    BOOL Play(const LIGHT_EFFECT *pEffect);
+};
+
+#endif //__LIGHTEFFECTS_H_
@@ -0,0 +1,196 @@
+/*++
+
+Copyright (c) Microsoft Corporation.  All rights reserved.
+
+    THIS CODE AND INFORMATION IS PROVIDED "AS IS" WITHOUT WARRANTY OF ANY
+    KIND, EITHER EXPRESSED OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE
+    IMPLIED WARRANTIES OF MERCHANTABILITY AND/OR FITNESS FOR A PARTICULAR
+    PURPOSE.
+
+Module Name: LightTimeline.cpp
+
+
+Abstract: Compiles blink, fade and pattern effects into timelines of
+          light states, one per frame. Nothing in here talks to the
+          device, so it also builds on a host for test/LightTimelineTest.cpp.
+
+
+Environment:
+
+    User mode only.
+
+--*/
+
+#include "stdafx.h"
+#include "LightEffects.h"
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightTimeline::CLightTimeline
+// Constructor
+
+CLightTimeline::CLightTimeline() :
+m_Frames(NULL),
+m_FrameCount(0),
+m_Capacity(0),
+m_Repeat(0)
+{
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightTimeline::~CLightTimeline
+// Destructor
+
+CLightTimeline::~CLightTimeline()
+{
+    delete [] m_Frames;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightTimeline::Compile
+// Samples one cycle of the effect at the frame rate. The light is either
+// on or off, so fades are rendered by switching it on for a growing and
+// then shrinking share of the frames. The frame buffer is kept from one
+// compile to the next and only grows, so replaying an effect the timeline
+// has held before doesn't allocate.
+
+BOOL CLightTimeline::Compile(const LIGHT_EFFECT *pEffect, DWORD dwFrameRate)
+{
+    DWORD dwPeriod = pEffect->PeriodMs;
+    DWORD dwCount;
+    DWORD dwStep = 1;
+    DWORD dwLength = 1;
+    DWORD dwOnFrames;
+    DWORD dwLevel;
+    DWORD dwAccumulator = 0;
+    DWORD i;
+
+    if (dwPeriod == 0) {
+
+        dwPeriod = 1;
+    }
+
+    if (dwPeriod > LIGHT_EFFECT_MAX_PERIOD) {
+
+        dwPeriod = LIGHT_EFFECT_MAX_PERIOD;
+    }
+
+    //
+    // Frames in one cycle (or in one pattern step)
+    //
+    dwCount = dwPeriod * dwFrameRate / 1000;
+    if (dwCount == 0) {
+
+        dwCount = 1;
+    }
+
+    switch (pEffect->Type)
+    {
+    case LightEffectSteady:
+        dwCount = 1;
+        break;
+
+    case LightEffectPattern:
+        dwLength = pEffect->PatternLength;
+        if (dwLength == 0 || dwLength > 32) {
+
+            return FALSE;
+        }
+        dwStep = dwCount;
+        dwCount *= dwLength;
+        break;
+
+    case LightEffectBlink:
+    case LightEffectFade:
+        break;
+
+    default:
+        return FALSE;
+    }
+
+    if (dwCount > m_Capacity) {
+
+        delete [] m_Frames;
+        m_Capacity = 0;
+        m_FrameCount = 0;
+
+        m_Frames = new BOOL[dwCount];
+        if (m_Frames == NULL) {
+
+            return FALSE;
+        }
+
+        m_Capacity = dwCount;
+    }
+
+    m_FrameCount = dwCount;
+    m_Repeat = pEffect->Repeat;
+
+    switch (pEffect->Type)
+    {
+    case LightEffectSteady:
+        m_Frames[0] = pEffect->On;
+        break;
+
+    case LightEffectBlink:
+        dwOnFrames = dwCount * min(pEffect->DutyPercent, 100) / 100;
+        for (i = 0; i < dwCount; i++) {
+
+            m_Frames[i] = (i < dwOnFrames);
+        }
+        break;
+
+    case LightEffectFade:
+        for (i = 0; i < dwCount; i++) {
+
+            //
+            // Brightness rises from 0 to dwCount over the first half of
+            // the cycle and falls back over the second. Carrying the
+            // remainder over spreads the on frames evenly.
+            //
+            dwLevel = (2 * i <= dwCount) ? 2 * i : 2 * (dwCount - i);
+            dwAccumulator += dwLevel;
+            if (dwAccumulator >= dwCount) {
+
+                dwAccumulator -= dwCount;
+                m_Frames[i] = TRUE;
+
+            } else {
+
+                m_Frames[i] = FALSE;
+            }
+        }
+        break;
+
+    case LightEffectPattern:
+        for (i = 0; i < dwCount; i++) {
+
+            m_Frames[i] = (pEffect->Pattern >> (i / dwStep)) & 1;
+        }
+        break;
+    }
+
+    return TRUE;
+}
+
+/////////////////////////////////////////////////////////////////////////////
+// CLightTimeline::GetFrame
+// Returns the light state for a frame, counted from the start of the
+// effect. Once the effect has finished the last state is returned along
+// with FALSE.
+
+BOOL CLightTimeline::GetFrame(ULONGLONG ullFrame, BOOL *pOn) const
+{
+    if (m_FrameCount == 0) {
+
+        return FALSE;
+    }
+
+    if (m_Repeat != 0 && ullFrame >= (ULONGLONG) m_FrameCount * m_Repeat) {
+
+        *pOn = m_Frames[m_FrameCount - 1];
+        return FALSE;
+    }
+
+    *pOn = m_Frames[ullFrame % m_FrameCount];
+    return TRUE;
+}
@@ -24,9 +24,22 @@ Environment:
 #include "stdafx.h"
 #include "iSauron.h"
 #include "Sauron.h"
-#include "luminous.h"
+#include "LightEffects.h"
 #include <strsafe.h>
 
+//
+// Light on for 100ms, then off
+//
+static const LIGHT_EFFECT s_BeatEffect = {
+    LightEffectBlink,   // Type
+    FALSE,              // On
+    200,                // PeriodMs
+    50,                 // DutyPercent
+    0,                  // Pattern
+    0,                  // PatternLength
+    1                   // Repeat
+};
+
 /////////////////////////////////////////////////////////////////////////////
 // CSauron::CSauron
 // Constructor
@@ -35,7 +48,7 @@ CSauron::CSauron() :
 m_clrForeground(0x0000FF),
 m_nPreset(0)
 {
-    m_Luminous = NULL;
+    m_Effects = NULL;
 }
 
 /////////////////////////////////////////////////////////////////////////////
@@ -44,10 +57,10 @@ m_nPreset(0)
 
 CSauron::~CSauron()
 {
-    if (m_Luminous) {
+    if (m_Effects) {
 
-        delete m_Luminous;
-        m_Luminous = NULL;
+        delete m_Effects;
+        m_Effects = NULL;
     }
 }
 
@@ -59,13 +72,13 @@ CSauron::~CSauron()
 
 HRESULT CSauron::FinalConstruct()
 {
-    if (m_Luminous == NULL) {
+    if (m_Effects == NULL) {
 
-        m_Luminous = new CLuminous();
+        m_Effects = new CLightEffectEngine();
 
-        if (m_Luminous) {
+        if (m_Effects) {
 
-            m_Luminous->Open();
+            m_Effects->Start(LIGHT_EFFECT_FRAME_RATE);
         }
     }
 
@@ -79,14 +92,13 @@ HRESULT CSauron::FinalConstruct()
 
 void CSauron::FinalRelease()
 {
-    if (m_Luminous) {
+    if (m_Effects) {
 
-        m_Luminous->Set(TRUE);
-        m_Luminous->Close();
+        m_Effects->Stop(TRUE);
 
-        delete m_Luminous;
+        delete m_Effects;
 
-        m_Luminous = NULL;
+        m_Effects = NULL;
     }
 }
 
@@ -152,9 +164,14 @@ STDMETHODIMP CSauron::Render(TimedLevel *pLevels, HDC hdc, RECT *prc)
                 }
             }
 
-            if (m_Luminous) {
+            //
+            // Each beat (re)starts a short flash. The effects engine
+            // updates the light at its own frame rate, so rendering
+            // never waits for the device.
+            //
+            if (m_Effects && setLight) {
 
-                m_Luminous->Set(setLight);
+                m_Effects->Play(&s_BeatEffect);
             }
 
             if (m_nPreset == PRESET_FLASH) {
@@ -9,7 +9,7 @@
 
 #include "resource.h"
 #include "effects.h"
-#include "luminous.h"
+#include "LightEffects.h"
 
 // preset values
 enum {
@@ -29,7 +29,7 @@ class ATL_NO_VTABLE CSauron :
 private:
     COLORREF    m_clrForeground;    // foreground color
     LONG        m_nPreset;          // current preset
-    CLuminous     *m_Luminous;           // light control
+    CLightEffectEngine *m_Effects;   // light control
 
     HRESULT WzToColor(const WCHAR *pwszColor, COLORREF *pcrColor);
     HRESULT ColorToWz( BSTR* pbstrColor, COLORREF crColor);
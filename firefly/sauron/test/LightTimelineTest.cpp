@@ -0,0 +1,383 @@
+/*++
+
+Module Name: LightTimelineTest.cpp
+
+
+Abstract: Host test for CLightTimeline. The first part checks what
+          Compile makes of each effect type, the limits it applies, and
+          that recompiling into a timeline only allocates when the
+          effect needs more frames than it ever held.
+
+          The second part plays timelines into a mock sink the way
+          CLightEffectEngine::Worker does: frames are due at fixed times
+          from the start, waits are rounded up to milliseconds, every
+          wake-up is late by a random jitter, now and then by a long
+          stall, and each device update takes time of its own. The sink
+          records when the light changed. Every change must be a state
+          the timeline holds at that moment, never come early, and come
+          at most the jitter, stall and update time late, so late frames
+          are dropped and never shift the ones after them.
+
+          Builds with the stub headers in this directory:
+
+              c++ -O2 -Wall -Wextra -I test test/LightTimelineTest.cpp LightTimeline.cpp -o LightTimelineTest
+
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include "stdafx.h"
+#include "../LightEffects.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <new>
+
+#define TEST_RATE           LIGHT_EFFECT_FRAME_RATE
+#define TEST_US             1000000ULL
+#define TEST_MAX_CHANGES    4096
+
+static int failures;
+static DWORD allocations;
+
+//
+// Counts the frame buffers Compile allocates
+//
+void *operator new[](size_t size)
+{
+    void *p = malloc(size ? size : 1);
+
+    if (p == NULL) {
+
+        throw std::bad_alloc();
+    }
+    allocations++;
+    return p;
+}
+
+void operator delete[](void *p) noexcept
+{
+    free(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    free(p);
+}
+
+static void
+Check(
+    const char *pName,
+    ULONGLONG ullActual,
+    ULONGLONG ullExpected
+    )
+{
+    if (ullActual != ullExpected) {
+
+        failures++;
+        printf("FAIL %s: got %llu, expected %llu\n", pName, ullActual, ullExpected);
+    }
+}
+
+static LIGHT_EFFECT
+Effect(
+    LIGHT_EFFECT_TYPE Type,
+    DWORD PeriodMs,
+    DWORD DutyPercent,
+    DWORD Pattern,
+    DWORD PatternLength,
+    DWORD Repeat
+    )
+{
+    LIGHT_EFFECT effect = { Type, TRUE, PeriodMs, DutyPercent, Pattern, PatternLength, Repeat };
+
+    return effect;
+}
+
+static DWORD
+CountOn(
+    const CLightTimeline &timeline,
+    DWORD dwFrames
+    )
+{
+    DWORD dwOn = 0;
+    BOOL bOn;
+
+    for (DWORD i = 0; i < dwFrames; i++) {
+
+        timeline.GetFrame(i, &bOn);
+        dwOn += bOn ? 1 : 0;
+    }
+    return dwOn;
+}
+
+static void
+TestCompile(
+    void
+    )
+{
+    CLightTimeline timeline;
+    LIGHT_EFFECT effect;
+    BOOL bOn = FALSE;
+    DWORD dwBefore;
+
+    // Steady: one frame, forever
+    effect = Effect(LightEffectSteady, 0, 0, 0, 0, 0);
+    Check("steady compiles", timeline.Compile(&effect, TEST_RATE), TRUE);
+    Check("steady plays", timeline.GetFrame(1000000, &bOn), TRUE);
+    Check("steady state", bOn, TRUE);
+
+    // Blink: 1s at 30 fps, 30% on, at the start of the cycle
+    effect = Effect(LightEffectBlink, 1000, 30, 0, 0, 0);
+    Check("blink compiles", timeline.Compile(&effect, TEST_RATE), TRUE);
+    Check("blink on frames", CountOn(timeline, 30), 9);
+    timeline.GetFrame(8, &bOn);
+    Check("blink last on", bOn, TRUE);
+    timeline.GetFrame(9, &bOn);
+    Check("blink first off", bOn, FALSE);
+    timeline.GetFrame(30, &bOn);
+    Check("blink loops", bOn, TRUE);
+
+    // Duty above 100 is all on
+    effect = Effect(LightEffectBlink, 1000, 250, 0, 0, 0);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("blink full duty", CountOn(timeline, 30), 30);
+
+    // Fade: on half of the time overall, little at the ends, a lot in the middle
+    effect = Effect(LightEffectFade, 2000, 0, 0, 0, 0);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("fade on frames", CountOn(timeline, 60) >= 29 && CountOn(timeline, 60) <= 31, TRUE);
+    Check("fade dim start", CountOn(timeline, 10) <= 2, TRUE);
+    Check("fade bright middle", CountOn(timeline, 35) - CountOn(timeline, 25) >= 9, TRUE);
+
+    // Pattern: 100ms per step, 3 frames at 30 fps
+    effect = Effect(LightEffectPattern, 100, 0, 0x5, 4, 2);
+    Check("pattern compiles", timeline.Compile(&effect, TEST_RATE), TRUE);
+    for (DWORD i = 0; i < 24; i++) {
+
+        timeline.GetFrame(i, &bOn);
+        Check("pattern step", bOn, (0x5 >> ((i % 12) / 3)) & 1);
+    }
+
+    // Repeat: FALSE once done, with the state it ended in
+    Check("repeat done", timeline.GetFrame(24, &bOn), FALSE);
+    Check("repeat final state", bOn, FALSE);
+
+    // Bad effects are refused
+    effect = Effect(LightEffectPattern, 100, 0, 1, 0, 0);
+    Check("pattern length 0", timeline.Compile(&effect, TEST_RATE), FALSE);
+    effect = Effect(LightEffectPattern, 100, 0, 1, 33, 0);
+    Check("pattern length 33", timeline.Compile(&effect, TEST_RATE), FALSE);
+    effect = Effect((LIGHT_EFFECT_TYPE)7, 100, 0, 0, 0, 0);
+    Check("unknown type", timeline.Compile(&effect, TEST_RATE), FALSE);
+
+    // Periods are clamped: 0 is one frame, the longest is 60s
+    effect = Effect(LightEffectBlink, 0, 100, 0, 0, 1);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("zero period plays one frame", timeline.GetFrame(1, &bOn), FALSE);
+    effect = Effect(LightEffectBlink, 10 * LIGHT_EFFECT_MAX_PERIOD, 50, 0, 0, 1);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("long period clamped", timeline.GetFrame(LIGHT_EFFECT_MAX_PERIOD / 1000 * TEST_RATE, &bOn), FALSE);
+
+    // The frame buffer is kept: the clamped effect above was the largest so far
+    dwBefore = allocations;
+    effect = Effect(LightEffectBlink, 200, 50, 0, 0, 1);
+    for (DWORD i = 0; i < 1000; i++) {
+
+        timeline.Compile(&effect, TEST_RATE);
+    }
+    effect = Effect(LightEffectBlink, LIGHT_EFFECT_MAX_PERIOD, 50, 0, 0, 1);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("recompiles allocate", allocations - dwBefore, 0);
+
+    effect = Effect(LightEffectPattern, LIGHT_EFFECT_MAX_PERIOD, 0, 1, 2, 1);
+    timeline.Compile(&effect, TEST_RATE);
+    Check("growing allocates", allocations - dwBefore, 1);
+}
+
+//
+// Mock device and scheduler
+//
+typedef struct _SIM_CONFIG {
+    const char  *pName;
+    LIGHT_EFFECT Effect;
+    ULONGLONG   ullRunUs;
+    DWORD       dwJitterUs;         // every wake-up is late by up to this
+    DWORD       dwStallUs;          // and now and then by this much more
+    DWORD       dwStallEveryUs;
+    DWORD       dwSetUs;            // time a device update takes
+    DWORD       dwChanges;          // light changes the sink should see
+} SIM_CONFIG;
+
+typedef struct _SIM_SINK {
+    DWORD       dwChanges;
+    ULONGLONG   ullTime[TEST_MAX_CHANGES];
+    BOOL        bState[TEST_MAX_CHANGES];
+} SIM_SINK;
+
+static DWORD
+Random(
+    DWORD *pSeed
+    )
+{
+    *pSeed = *pSeed * 1103515245 + 12345;
+    return *pSeed >> 8;
+}
+
+static void
+SimRun(
+    const SIM_CONFIG *pConfig
+    )
+{
+    static SIM_SINK sink;
+    CLightTimeline timeline;
+    ULONGLONG ullNow = 0;
+    ULONGLONG ullNextFrame = 0;
+    ULONGLONG ullNextStall = pConfig->dwStallEveryUs;
+    ULONGLONG ullDue;
+    ULONGLONG ullFrame;
+    ULONGLONG ullDropped = 0;
+    ULONGLONG ullLate;
+    ULONGLONG ullMaxLate = 0;
+    ULONGLONG ullBound;
+    DWORD dwSeed = 1;
+    BOOL bOn = FALSE;
+    BOOL bExpected;
+    BOOL bPlaying = TRUE;
+
+    sink.dwChanges = 0;
+    if (!timeline.Compile(&pConfig->Effect, TEST_RATE)) {
+
+        failures++;
+        printf("FAIL %s: compile\n", pConfig->pName);
+        return;
+    }
+
+    //
+    // The worker loop, against a simulated clock in microseconds
+    //
+    while (ullNow < pConfig->ullRunUs) {
+
+        ullDue = ullNextFrame * TEST_US / TEST_RATE;
+        if (ullDue > ullNow) {
+
+            ullNow += (ullDue - ullNow + 999) / 1000 * 1000;
+        }
+
+        ullNow += Random(&dwSeed) % (pConfig->dwJitterUs + 1);
+        if (pConfig->dwStallEveryUs && ullNow >= ullNextStall) {
+
+            ullNow += pConfig->dwStallUs;
+            ullNextStall += pConfig->dwStallEveryUs;
+        }
+
+        ullFrame = ullNow * TEST_RATE / TEST_US;
+        if (ullFrame < ullNextFrame) {
+
+            continue;
+        }
+
+        ullDropped += ullFrame - ullNextFrame;
+        ullNextFrame = ullFrame + 1;
+
+        if (bPlaying && !timeline.GetFrame(ullFrame, &bOn)) {
+
+            bPlaying = FALSE;
+        }
+
+        if (sink.dwChanges != 0 && sink.bState[sink.dwChanges - 1] == bOn) {
+
+            continue;
+        }
+
+        if (sink.dwChanges == TEST_MAX_CHANGES) {
+
+            break;
+        }
+
+        sink.ullTime[sink.dwChanges] = ullNow;
+        sink.bState[sink.dwChanges] = bOn;
+        sink.dwChanges++;
+        ullNow += pConfig->dwSetUs;
+    }
+
+    //
+    // Each change is what the timeline held when it was sent, and came
+    // no earlier than the frame where the timeline switched to it
+    //
+    ullBound = 1000 + pConfig->dwJitterUs + pConfig->dwStallUs + pConfig->dwSetUs;
+
+    for (DWORD i = 0; i < sink.dwChanges; i++) {
+
+        ullFrame = sink.ullTime[i] * TEST_RATE / TEST_US;
+        timeline.GetFrame(ullFrame, &bExpected);
+        Check("sent state", sink.bState[i], bExpected);
+
+        while (ullFrame > 0) {
+
+            timeline.GetFrame(ullFrame - 1, &bExpected);
+            if (bExpected != sink.bState[i]) {
+
+                break;
+            }
+            ullFrame--;
+        }
+
+        ullDue = ullFrame * TEST_US / TEST_RATE;
+        if (sink.ullTime[i] < ullDue) {
+
+            failures++;
+            printf("FAIL %s: change %u sent %llu us early\n", pConfig->pName, i, ullDue - sink.ullTime[i]);
+            continue;
+        }
+
+        ullLate = sink.ullTime[i] - ullDue;
+        ullMaxLate = ullLate > ullMaxLate ? ullLate : ullMaxLate;
+        if (ullLate > ullBound) {
+
+            failures++;
+            printf("FAIL %s: change %u sent %llu us late\n", pConfig->pName, i, ullLate);
+        }
+    }
+
+    printf("%-24s %5u changes, %6llu frames dropped, latest change %6.1f ms (bound %6.1f ms)\n",
+           pConfig->pName, sink.dwChanges, ullDropped, ullMaxLate / 1000.0, ullBound / 1000.0);
+
+    if (pConfig->dwChanges != 0) {
+
+        Check(pConfig->pName, sink.dwChanges, pConfig->dwChanges);
+    }
+}
+
+int
+main(
+    void
+    )
+{
+    static const SIM_CONFIG configs[] = {
+        // Name                 Effect                                              Run us    Jitter Stall   Every    Set    Changes
+        { "beat",               { LightEffectBlink, FALSE, 200, 50, 0, 0, 1 },      1000000,  16000, 0,      0,       2000,  2   },
+        { "blink, stalls",      { LightEffectBlink, FALSE, 1000, 30, 0, 0, 0 },     60650000, 16000, 250000, 7000000, 5000,  122 },
+        { "blink, slow device", { LightEffectBlink, FALSE, 500, 50, 0, 0, 0 },      10100000, 2000,  0,      0,       40000, 41  },
+        { "fade",               { LightEffectFade, FALSE, 2000, 0, 0, 0, 0 },       10000000, 16000, 100000, 3000000, 3000,  0   },
+        { "pattern",            { LightEffectPattern, FALSE, 100, 0, 0x1d5, 9, 3 }, 5000000,  16000, 0,      0,       2000,  0   },
+    };
+
+    TestCompile();
+
+    for (DWORD i = 0; i < sizeof(configs) / sizeof(configs[0]); i++) {
+
+        SimRun(&configs[i]);
+    }
+
+    if (failures != 0) {
+
+        return 1;
+    }
+
+    printf("Light timeline test passed\n");
+    return 0;
+}
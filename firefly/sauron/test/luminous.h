@@ -0,0 +1,5 @@
+// luminous.h : Empty stand-in for lib\luminous.h. The timeline doesn't
+//      talk to the device, test/LightTimelineTest.cpp plays it into a
+//      mock sink instead.
+
+#pragma once
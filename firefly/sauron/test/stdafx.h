@@ -0,0 +1,25 @@
+// stdafx.h : Stand-in for the ATL precompiled header, with just the
+//      Windows types LightEffects.h and LightTimeline.cpp use, so that
+//      test/LightTimelineTest.cpp builds on a host.
+
+#pragma once
+
+#include <stddef.h>
+
+typedef int BOOL;
+typedef unsigned int DWORD;
+typedef unsigned long long ULONGLONG;
+typedef void *HANDLE;
+typedef void *LPVOID;
+
+typedef struct _CRITICAL_SECTION {
+    void *Unused;
+} CRITICAL_SECTION;
+
+#define WINAPI
+#define TRUE    1
+#define FALSE   0
+
+#ifndef min
+#define min(a, b) (((a) < (b)) ? (a) : (b))
+#endif
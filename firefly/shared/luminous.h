@@ -58,6 +58,11 @@ private:
     IWbemClassObject     *m_pIWbemClassObject;
     BOOL m_bCOMInitialized;
 
+    //
+    // PROPERTY_NAME, converted once by Open for Get and Set
+    //
+    BSTR m_bstrPropertyName;
+
 };
 
 
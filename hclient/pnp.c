@@ -28,6 +28,91 @@ Environment:
 
 #pragma warning(disable:28146) // Warning is meant for kernel mode drivers 
 
+//
+// Upper bound on the number of thread pool callbacks used to open the
+// devices found by FindKnownHidDevices. Opening a device is mostly spent
+// waiting on the HID class driver, so a few more workers than processors
+// still helps, but there is no point in one per collection.
+//
+
+#define FIND_DEVICES_MAX_WORKERS    8
+
+typedef struct _FIND_DEVICES_CONTEXT {
+    PHID_DEVICE     HidDevices;     // The array being filled in
+    PCHAR          *DevicePaths;    // Device path for each entry
+    ULONG           NumberDevices;
+    volatile LONG   NextDevice;     // Next entry to be claimed by a worker
+} FIND_DEVICES_CONTEXT, *PFIND_DEVICES_CONTEXT;
+
+static
+VOID
+FillKnownHidDevices (
+    IN  PFIND_DEVICES_CONTEXT Context
+    )
+/*++
+Routine Description:
+   Open and fill in the entries of the device array that have not been
+   claimed yet. Several workers may run this at the same time, each entry
+   is claimed by exactly one of them.
+--*/
+{
+    ULONG       index;
+    PHID_DEVICE hidDeviceInst;
+    PCHAR       devicePath;
+
+    for (;;)
+    {
+        index = (ULONG) InterlockedIncrement(&Context -> NextDevice) - 1;
+
+        if (index >= Context -> NumberDevices)
+        {
+            break;
+        }
+
+        hidDeviceInst = Context -> HidDevices + index;
+        devicePath = Context -> DevicePaths[index];
+
+        //
+        // Open device with just generic query abilities to begin with
+        //
+
+        if (! OpenHidDevice (devicePath,
+                       FALSE,      // ReadAccess - none
+                       FALSE,      // WriteAccess - none
+                       FALSE,       // Overlapped - no
+                       FALSE,       // Exclusive - no
+                       hidDeviceInst))
+        {
+            //
+            // Save the device path so it can be still listed. The
+            // listing phase's copy is simply handed over.
+            //
+
+            hidDeviceInst -> DevicePath = devicePath;
+            Context -> DevicePaths[index] = NULL;
+        }
+    }
+
+    return;
+}
+
+static
+VOID
+CALLBACK
+FindKnownHidDevicesWorker (
+    _Inout_     PTP_CALLBACK_INSTANCE Instance,
+    _Inout_opt_ PVOID                 Context,
+    _Inout_     PTP_WORK              Work
+    )
+{
+    UNREFERENCED_PARAMETER(Instance);
+    UNREFERENCED_PARAMETER(Work);
+
+    FillKnownHidDevices((PFIND_DEVICES_CONTEXT) Context);
+
+    return;
+}
+
 BOOLEAN
 FindKnownHidDevices (
    OUT PHID_DEVICE * HidDevices, // A array of struct _HID_DEVICE
@@ -37,24 +122,35 @@ FindKnownHidDevices (
 Routine Description:
    Do the required PnP things in order to find all the HID devices in
    the system at this time.
+
+   This is done in two phases. The listing phase only asks Plug and Play
+   for the device interfaces and their paths, which doesn't touch the
+   devices. The detail phase then opens every device and fills in its
+   preparsed data and capabilities. Since opening a device waits on its
+   driver, the detail phase is spread over the system thread pool.
 --*/
 {
     HDEVINFO                            hardwareDeviceInfo = INVALID_HANDLE_VALUE;
     SP_DEVICE_INTERFACE_DATA            deviceInfoData;
     ULONG                               i;
     BOOLEAN                             done = FALSE;
-    PHID_DEVICE                         hidDeviceInst;
     GUID                                hidGuid;
     PSP_DEVICE_INTERFACE_DETAIL_DATA    functionClassDeviceData = NULL;
     ULONG                               predictedLength = 0;
     ULONG                               requiredLength = 0;
-    PHID_DEVICE                         newHidDevices;
+    ULONG                               numberInterfaces = 0;
+    INT                                 iDevicePathSize;
+    FIND_DEVICES_CONTEXT                context;
+    PTP_WORK                            work = NULL;
+    ULONG                               numberWorkers;
 
 
     HidD_GetHidGuid (&hidGuid);
 
     *HidDevices = NULL;
     *NumberDevices = 0;
+
+    RtlZeroMemory(&context, sizeof(context));
     
     //
     // Open a handle to the plug and play dev node.
@@ -71,140 +167,165 @@ Routine Description:
     }
 
     //
-    // Take a wild guess to start
+    // Count the interfaces so the arrays are allocated once, at their
+    // final size.
     //
-    
-    *NumberDevices = 4;
-    done = FALSE;
+
     deviceInfoData.cbSize = sizeof (SP_DEVICE_INTERFACE_DATA);
 
-    i=0;
-    while (!done) 
+    while (SetupDiEnumDeviceInterfaces (hardwareDeviceInfo,
+                                        0, // No care about specific PDOs
+                                        &hidGuid,
+                                        numberInterfaces,
+                                        &deviceInfoData))
+    {
+        numberInterfaces++;
+    }
+
+    if (ERROR_NO_MORE_ITEMS != GetLastError())
     {
-        *NumberDevices *= 2;
+        goto Done;
+    }
+
+    //
+    // Allocate at least one entry so that an empty list is still returned
+    // as a valid array.
+    //
+
+    *HidDevices = calloc (max(numberInterfaces, 1), sizeof (HID_DEVICE));
 
-        if (*HidDevices) 
+    context.DevicePaths = calloc (max(numberInterfaces, 1), sizeof (PCHAR));
+
+    if (NULL == *HidDevices || NULL == context.DevicePaths) 
+    {
+        goto Done;
+    }
+
+    //
+    // Listing phase: get the device path of every interface
+    //
+
+    for (i = 0; i < numberInterfaces; i++) 
+    {
+        (*HidDevices)[i].HidDevice = INVALID_HANDLE_VALUE;
+
+        if (!SetupDiEnumDeviceInterfaces (hardwareDeviceInfo,
+                                          0, // No care about specific PDOs
+                                          &hidGuid,
+                                          i,
+                                          &deviceInfoData))
         {
-            newHidDevices =
-               realloc (*HidDevices, (*NumberDevices * sizeof (HID_DEVICE)));
+            continue;
+        }
+
+        //
+        // allocate a function class device data structure to receive the
+        // goods about this particular device.
+        //
+
+        SetupDiGetDeviceInterfaceDetail (
+                hardwareDeviceInfo,
+                &deviceInfoData,
+                NULL, // probing so no output buffer yet
+                0, // probing so output buffer length of zero
+                &requiredLength,
+                NULL); // not interested in the specific dev-node
 
-            if (NULL == newHidDevices)
-            {
-                free(*HidDevices);
-            }
 
-            *HidDevices = newHidDevices;
+        predictedLength = requiredLength;
+
+        functionClassDeviceData = malloc (predictedLength);
+        if (functionClassDeviceData)
+        {
+            functionClassDeviceData->cbSize = sizeof (SP_DEVICE_INTERFACE_DETAIL_DATA);
+            ZeroMemory(functionClassDeviceData->DevicePath, sizeof(functionClassDeviceData->DevicePath));
         }
         else
         {
-            *HidDevices = calloc (*NumberDevices, sizeof (HID_DEVICE));
+            goto Done;
         }
 
-        if (NULL == *HidDevices) 
+        //
+        // Retrieve the information from Plug and Play.
+        //
+
+        if (SetupDiGetDeviceInterfaceDetail (
+                   hardwareDeviceInfo,
+                   &deviceInfoData,
+                   functionClassDeviceData,
+                   predictedLength,
+                   &requiredLength,
+                   NULL)) 
         {
-            goto Done;
+            iDevicePathSize = (INT)strlen(functionClassDeviceData -> DevicePath) + 1;
+
+            context.DevicePaths[i] = malloc(iDevicePathSize);
+
+            if (NULL != context.DevicePaths[i]) 
+            {
+                StringCbCopy(context.DevicePaths[i], iDevicePathSize, functionClassDeviceData -> DevicePath);
+            }
         }
 
-        hidDeviceInst = *HidDevices + i;
+        free(functionClassDeviceData);
+        functionClassDeviceData = NULL;
+    }
 
-        for (; i < *NumberDevices; i++, hidDeviceInst++) 
-        {
-            //
-            // Initialize an empty HID_DEVICE
-            //
-            RtlZeroMemory(hidDeviceInst,sizeof(HID_DEVICE));
+    //
+    // Detail phase: open the devices. Entries whose path could not be
+    // retrieved are left empty, as they always have been.
+    //
 
-            hidDeviceInst -> HidDevice = INVALID_HANDLE_VALUE;
+    context.HidDevices = *HidDevices;
+    context.NumberDevices = numberInterfaces;
+    context.NextDevice = 0;
 
-            if (SetupDiEnumDeviceInterfaces (hardwareDeviceInfo,
-                                             0, // No care about specific PDOs
-                                             &hidGuid,
-                                             i,
-                                             &deviceInfoData))
-            {
-                //
-                // allocate a function class device data structure to receive the
-                // goods about this particular device.
-                //
+    numberWorkers = min(numberInterfaces, FIND_DEVICES_MAX_WORKERS);
 
-                SetupDiGetDeviceInterfaceDetail (
-                        hardwareDeviceInfo,
-                        &deviceInfoData,
-                        NULL, // probing so no output buffer yet
-                        0, // probing so output buffer length of zero
-                        &requiredLength,
-                        NULL); // not interested in the specific dev-node
+    if (numberWorkers > 1)
+    {
+        work = CreateThreadpoolWork(FindKnownHidDevicesWorker, &context, NULL);
+    }
 
+    if (NULL != work)
+    {
+        //
+        // The calling thread takes its share of the devices too, so one
+        // less callback is needed.
+        //
 
-                predictedLength = requiredLength;
+        for (i = 1; i < numberWorkers; i++)
+        {
+            SubmitThreadpoolWork(work);
+        }
 
-                functionClassDeviceData = malloc (predictedLength);
-                if (functionClassDeviceData)
-                {
-                    functionClassDeviceData->cbSize = sizeof (SP_DEVICE_INTERFACE_DETAIL_DATA);
-                    ZeroMemory(functionClassDeviceData->DevicePath, sizeof(functionClassDeviceData->DevicePath));
-                }
-                else
-                {
-                    goto Done;
-                }
+        FillKnownHidDevices(&context);
 
-                //
-                // Retrieve the information from Plug and Play.
-                //
-
-                if (SetupDiGetDeviceInterfaceDetail (
-                           hardwareDeviceInfo,
-                           &deviceInfoData,
-                           functionClassDeviceData,
-                           predictedLength,
-                           &requiredLength,
-                           NULL)) 
-                {
-                    //
-                    // Open device with just generic query abilities to begin with
-                    //
-
-                    if (! OpenHidDevice (functionClassDeviceData -> DevicePath, 
-                                   FALSE,      // ReadAccess - none
-                                   FALSE,      // WriteAccess - none
-                                   FALSE,       // Overlapped - no
-                                   FALSE,       // Exclusive - no
-                                   hidDeviceInst))
-                    {
-                        //
-                        // Save the device path so it can be still listed.
-                        //
-                        INT     iDevicePathSize;
-
-                        iDevicePathSize = (INT)strlen(functionClassDeviceData -> DevicePath) + 1;
-
-                        hidDeviceInst -> DevicePath = malloc(iDevicePathSize);
-
-                        if (NULL != hidDeviceInst -> DevicePath) 
-                        {
-                            StringCbCopy(hidDeviceInst -> DevicePath, iDevicePathSize, functionClassDeviceData -> DevicePath);
-                        }
-                    }
-                }
+        WaitForThreadpoolWorkCallbacks(work, FALSE);
+        CloseThreadpoolWork(work);
+    }
+    else
+    {
+        FillKnownHidDevices(&context);
+    }
 
-                free(functionClassDeviceData);
-                functionClassDeviceData = NULL;
-            }
-            else
+    *NumberDevices = numberInterfaces;
+    done = TRUE;
+
+Done:
+    if (NULL != context.DevicePaths)
+    {
+        for (i = 0; i < numberInterfaces; i++)
+        {
+            if (NULL != context.DevicePaths[i])
             {
-                if (ERROR_NO_MORE_ITEMS == GetLastError()) 
-                {
-                    done = TRUE;
-                    break;
-                }
+                free(context.DevicePaths[i]);
             }
         }
-    }
 
-    *NumberDevices = i;
+        free(context.DevicePaths);
+    }
 
-Done:
     if (FALSE == done)
     {
         if (NULL != *HidDevices)
@@ -35,8 +35,7 @@ Revision History:
 #endif
 
 #ifdef ALLOC_PRAGMA
-    #pragma alloc_text( PAGE, HidFx2SetFeature)
-    #pragma alloc_text( PAGE, HidFx2GetFeature)
+    #pragma alloc_text( PAGE, HidFx2InitializeFeatureCache)
     #pragma alloc_text( PAGE, SendVendorCommand)
     #pragma alloc_text( PAGE, GetVendorData)
 #endif
@@ -246,6 +245,12 @@ Routine Description
     This routine sets the state of the Feature: in this
     case Segment Display on the USB FX2 board.
 
+    The new value is stored in the feature cache and written to the
+    device with an asynchronous control transfer, so the request is
+    completed without waiting for the device. If a write to the same
+    register is already in flight, the value is only recorded and sent
+    once that write completes; any value it replaces is never sent.
+
 Arguments:
 
     Request - Wdf Request
@@ -262,8 +267,9 @@ Return Value:
     PHIDFX2_FEATURE_REPORT       featureReport = NULL;
     WDFDEVICE                    device;
     UCHAR                        featureUsage = 0;
-
-    PAGED_CODE();
+    PDEVICE_EXTENSION            devContext = NULL;
+    PHIDFX2_FEATURE_REGISTER     featureRegister = NULL;
+    BOOLEAN                      sendWrite = FALSE;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTL, "HidFx2SetFeature Enter\n");
 
@@ -314,25 +320,20 @@ Return Value:
     featureReport = (PHIDFX2_FEATURE_REPORT)transferPacket->reportBuffer;
     featureUsage = featureReport->FeatureData;
 
+    devContext = GetDeviceContext(device);
+
 	//
 	// The feature reports map directly to the command
-	// data that is sent down to the device.
+	// data that is sent down to the device. The switch
+	// state report is read only.
 	//
 	if (transferPacket->reportId == SEVEN_SEGMENT_REPORT_ID)
 	{
-        status = SendVendorCommand(
-            device,
-            HIDFX2_SET_7SEGMENT_DISPLAY,
-            &featureUsage
-            );
+        featureRegister = &devContext->Features[HidFx2FeatureSevenSegment];
 	}
 	else if (transferPacket->reportId == BARGRAPH_REPORT_ID)
 	{
-        status = SendVendorCommand(
-            device,
-            HIDFX2_SET_BARGRAPH_DISPLAY,
-            &featureUsage
-            );
+        featureRegister = &devContext->Features[HidFx2FeatureBarGraph];
 	}
 	else
 	{
@@ -342,6 +343,36 @@ Return Value:
         return status;
 	}
 
+    InterlockedIncrement(&devContext->FeatureStats.WritesRequested);
+
+    WdfSpinLockAcquire(devContext->FeatureLock);
+
+    featureRegister->Value = featureUsage;
+    featureRegister->Valid = TRUE;
+
+    if (featureRegister->WriteInFlight) {
+        //
+        // The value already waiting behind the in-flight write is replaced
+        // and will never reach the device.
+        //
+        if (featureRegister->WritePending) {
+            InterlockedIncrement(&devContext->FeatureStats.WritesCoalesced);
+        }
+
+        featureRegister->PendingValue = featureUsage;
+        featureRegister->WritePending = TRUE;
+    }
+    else {
+        featureRegister->WriteInFlight = TRUE;
+        sendWrite = TRUE;
+    }
+
+    WdfSpinLockRelease(devContext->FeatureLock);
+
+    if (sendWrite) {
+        HidFx2SendFeatureWrite(devContext, featureRegister, featureUsage);
+    }
+
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTL, "HidFx2SetFeature Exit\n");
     return status;
 }
@@ -358,6 +389,11 @@ Routine Description
     This routine gets the state of the Feature: in this
     case Segment Display or bargraph display on the USB FX2 board.
 
+    The display registers are served from the feature cache and the
+    device is only read when the cached value is not valid. The switch
+    state is served from the value kept by the interrupt endpoint
+    continuous reader.
+
 Arguments:
 
     Request - Wdf Request
@@ -375,8 +411,10 @@ Return Value:
     WDF_REQUEST_PARAMETERS       params;
     PHIDFX2_FEATURE_REPORT       featureReport = NULL;
     WDFDEVICE                    device;
-
-    PAGED_CODE();
+    PDEVICE_EXTENSION            devContext = NULL;
+    PHIDFX2_FEATURE_REGISTER     featureRegister = NULL;
+    BOOLEAN                      cacheHit = FALSE;
+    UCHAR                        featureData = 0;
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTL, "HidFx2GetFeature Enter\n");
 
@@ -428,21 +466,23 @@ Return Value:
 
     featureReport = (PHIDFX2_FEATURE_REPORT)transferPacket->reportBuffer;
 
+    devContext = GetDeviceContext(device);
+
     if (transferPacket->reportId == SEVEN_SEGMENT_REPORT_ID)
     {
-        status = GetVendorData(
-            device,
-            HIDFX2_READ_7SEGMENT_DISPLAY,
-            &featureReport->FeatureData
-            );
+        featureRegister = &devContext->Features[HidFx2FeatureSevenSegment];
     }
     else if (transferPacket->reportId == BARGRAPH_REPORT_ID)
     {
-        status = GetVendorData(
-            device,
-            HIDFX2_READ_BARGRAPH_DISPLAY,
-            &featureReport->FeatureData
-            );
+        featureRegister = &devContext->Features[HidFx2FeatureBarGraph];
+    }
+    else if (transferPacket->reportId == DIP_SWITCHES_REPORT_ID)
+    {
+        featureReport->FeatureData = devContext->CurrentSwitchState;
+        InterlockedIncrement(&devContext->FeatureStats.CacheHits);
+
+        *BytesReturned = sizeof (HIDFX2_FEATURE_REPORT);
+        return status;
     }
     else
     {
@@ -452,6 +492,45 @@ Return Value:
         return status;
     }
 
+    WdfSpinLockAcquire(devContext->FeatureLock);
+
+    if (featureRegister->Valid) {
+        featureData = featureRegister->Value;
+        cacheHit = TRUE;
+    }
+
+    WdfSpinLockRelease(devContext->FeatureLock);
+
+    if (cacheHit) {
+        InterlockedIncrement(&devContext->FeatureStats.CacheHits);
+    }
+    else {
+        InterlockedIncrement(&devContext->FeatureStats.CacheMisses);
+
+        status = GetVendorData(
+            device,
+            featureRegister->ReadCommand,
+            &featureData
+            );
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+
+        //
+        // Don't overwrite a value set while the device was being read
+        //
+        WdfSpinLockAcquire(devContext->FeatureLock);
+
+        if (!featureRegister->Valid && !featureRegister->WriteInFlight) {
+            featureRegister->Value = featureData;
+            featureRegister->Valid = TRUE;
+        }
+
+        WdfSpinLockRelease(devContext->FeatureLock);
+    }
+
+    featureReport->FeatureData = featureData;
+
     *BytesReturned = sizeof (HIDFX2_FEATURE_REPORT);
 
     TraceEvents(TRACE_LEVEL_VERBOSE, DBG_IOCTL, "HidFx2GetFeature Exit\n");
@@ -633,6 +712,358 @@ Return Value:
 }
 
 
+NTSTATUS
+HidFx2InitializeFeatureCache(
+    IN WDFDEVICE Device
+    )
+/*++
+
+Routine Description
+
+    This routine creates the lock protecting the feature cache and, for
+    each writable feature register, the request and buffer that are reused
+    for every write to the register. It's called from every PrepareHardware
+    event once the USB device object exists, and only creates the objects
+    that don't exist yet.
+
+Arguments:
+
+    Device - Handle to a framework device object.
+
+Return Value:
+
+    NT status value
+
+--*/
+{
+    NTSTATUS                     status = STATUS_SUCCESS;
+    PDEVICE_EXTENSION            devContext = NULL;
+    PHIDFX2_FEATURE_REGISTER     featureRegister = NULL;
+    WDF_OBJECT_ATTRIBUTES        attributes;
+    ULONG                        i;
+
+    PAGED_CODE();
+
+    devContext = GetDeviceContext(Device);
+
+    devContext->Features[HidFx2FeatureSevenSegment].ReadCommand =
+        HIDFX2_READ_7SEGMENT_DISPLAY;
+    devContext->Features[HidFx2FeatureSevenSegment].WriteCommand =
+        HIDFX2_SET_7SEGMENT_DISPLAY;
+    devContext->Features[HidFx2FeatureBarGraph].ReadCommand =
+        HIDFX2_READ_BARGRAPH_DISPLAY;
+    devContext->Features[HidFx2FeatureBarGraph].WriteCommand =
+        HIDFX2_SET_BARGRAPH_DISPLAY;
+
+    if (devContext->FeatureLock == NULL) {
+        WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+        attributes.ParentObject = Device;
+
+        status = WdfSpinLockCreate(&attributes, &devContext->FeatureLock);
+        if (!NT_SUCCESS(status)) {
+            TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
+                "WdfSpinLockCreate failed 0x%x\n", status);
+            devContext->FeatureLock = NULL;
+            return status;
+        }
+    }
+
+    for (i = 0; i < HidFx2FeatureMax; i++) {
+        featureRegister = &devContext->Features[i];
+
+        if (featureRegister->WriteRequest == NULL) {
+            WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+            attributes.ParentObject = Device;
+
+            status = WdfRequestCreate(&attributes,
+                                      WdfUsbTargetDeviceGetIoTarget(devContext->UsbDevice),
+                                      &featureRegister->WriteRequest);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
+                    "WdfRequestCreate for feature write failed 0x%x\n", status);
+                featureRegister->WriteRequest = NULL;
+                return status;
+            }
+        }
+
+        if (featureRegister->WriteMemory == NULL) {
+            WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+            attributes.ParentObject = featureRegister->WriteRequest;
+
+            status = WdfMemoryCreate(&attributes,
+                                     NonPagedPoolNx,
+                                     POOL_TAG,
+                                     sizeof(UCHAR),
+                                     &featureRegister->WriteMemory,
+                                     NULL);
+            if (!NT_SUCCESS(status)) {
+                TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
+                    "WdfMemoryCreate for feature write failed 0x%x\n", status);
+                featureRegister->WriteMemory = NULL;
+                return status;
+            }
+        }
+    }
+
+    return status;
+}
+
+
+VOID
+HidFx2InvalidateFeatureCache(
+    IN WDFDEVICE Device
+    )
+/*++
+
+Routine Description
+
+    This routine marks the cached feature registers as stale so that the
+    next get-feature reads them from the device. It's called when the
+    device enters D0, since the device may have lost its display state
+    while powered down. Registers with a write in flight keep their value,
+    which is about to be written to the device.
+
+Arguments:
+
+    Device - Handle to a framework device object.
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PDEVICE_EXTENSION            devContext = NULL;
+    ULONG                        i;
+
+    devContext = GetDeviceContext(Device);
+
+    WdfSpinLockAcquire(devContext->FeatureLock);
+
+    for (i = 0; i < HidFx2FeatureMax; i++) {
+        if (!devContext->Features[i].WriteInFlight) {
+            devContext->Features[i].Valid = FALSE;
+        }
+    }
+
+    WdfSpinLockRelease(devContext->FeatureLock);
+}
+
+
+static
+BOOLEAN
+HidFx2FeatureWriteDone(
+    IN PDEVICE_EXTENSION DevContext,
+    IN PHIDFX2_FEATURE_REGISTER FeatureRegister,
+    IN NTSTATUS Status,
+    OUT PUCHAR NextValue
+    )
+/*++
+
+Routine Description
+
+    This routine retires the write in flight on a feature register and
+    picks up the value recorded while it was in flight, if any.
+
+Arguments:
+
+    DevContext - Pointer to device context structure
+
+    FeatureRegister - Register whose write finished
+
+    Status - Completion status of the write
+
+    NextValue - Receives the value to write next
+
+Return Value:
+
+    TRUE if NextValue must be written to the device. The register then
+    stays marked as having a write in flight.
+
+--*/
+{
+    BOOLEAN                      sendWrite = FALSE;
+
+    WdfSpinLockAcquire(DevContext->FeatureLock);
+
+    if (!NT_SUCCESS(Status)) {
+        InterlockedIncrement(&DevContext->FeatureStats.WritesFailed);
+
+        //
+        // The device no longer holds the cached value unless a newer one
+        // is about to be written.
+        //
+        if (!FeatureRegister->WritePending) {
+            FeatureRegister->Valid = FALSE;
+        }
+    }
+
+    if (FeatureRegister->WritePending) {
+        *NextValue = FeatureRegister->PendingValue;
+        FeatureRegister->WritePending = FALSE;
+        sendWrite = TRUE;
+    }
+    else {
+        FeatureRegister->WriteInFlight = FALSE;
+    }
+
+    WdfSpinLockRelease(DevContext->FeatureLock);
+
+    return sendWrite;
+}
+
+
+VOID
+HidFx2SendFeatureWrite(
+    IN PDEVICE_EXTENSION DevContext,
+    IN PHIDFX2_FEATURE_REGISTER FeatureRegister,
+    IN UCHAR Value
+    )
+/*++
+
+Routine Description
+
+    This routine writes a value to a feature register with an asynchronous
+    vendor control transfer, reusing the register's preallocated request.
+    The caller must have marked the register as having a write in flight.
+
+Arguments:
+
+    DevContext - Pointer to device context structure
+
+    FeatureRegister - Register to write
+
+    Value - Value to write
+
+Return Value:
+
+    None.
+
+--*/
+{
+    NTSTATUS                     status = STATUS_SUCCESS;
+    WDF_REQUEST_REUSE_PARAMS     reuseParams;
+    WDF_USB_CONTROL_SETUP_PACKET controlSetupPacket;
+    WDF_REQUEST_SEND_OPTIONS     sendOptions;
+    PUCHAR                       writeBuffer = NULL;
+
+    for (;;) {
+        TraceEvents(TRACE_LEVEL_INFORMATION, DBG_IOCTL,
+            "HidFx2SendFeatureWrite: Command:0x%x, data: 0x%x\n",
+            FeatureRegister->WriteCommand, Value);
+
+        WDF_REQUEST_REUSE_PARAMS_INIT(&reuseParams,
+                                      WDF_REQUEST_REUSE_NO_FLAGS,
+                                      STATUS_SUCCESS);
+
+        status = WdfRequestReuse(FeatureRegister->WriteRequest, &reuseParams);
+        ASSERT(NT_SUCCESS(status));
+
+        writeBuffer = WdfMemoryGetBuffer(FeatureRegister->WriteMemory, NULL);
+        *writeBuffer = Value;
+
+        WDF_USB_CONTROL_SETUP_PACKET_INIT_VENDOR(&controlSetupPacket,
+                                            BmRequestHostToDevice,
+                                            BmRequestToDevice,
+                                            FeatureRegister->WriteCommand, // Request
+                                            0, // Value
+                                            0); // Index
+
+        status = WdfUsbTargetDeviceFormatRequestForControlTransfer(
+                                                DevContext->UsbDevice,
+                                                FeatureRegister->WriteRequest,
+                                                &controlSetupPacket,
+                                                FeatureRegister->WriteMemory,
+                                                NULL // Offset
+                                                );
+
+        if (NT_SUCCESS(status)) {
+            WdfRequestSetCompletionRoutine(FeatureRegister->WriteRequest,
+                                           HidFx2EvtFeatureWriteComplete,
+                                           FeatureRegister);
+
+            //
+            // Keep the same timeout as the synchronous transfers so that a
+            // stuck device doesn't hold the register forever.
+            //
+            WDF_REQUEST_SEND_OPTIONS_INIT(&sendOptions,
+                                          WDF_REQUEST_SEND_OPTION_TIMEOUT);
+
+            WDF_REQUEST_SEND_OPTIONS_SET_TIMEOUT(&sendOptions,
+                                                 WDF_REL_TIMEOUT_IN_SEC(5));
+
+            if (WdfRequestSend(FeatureRegister->WriteRequest,
+                               WdfUsbTargetDeviceGetIoTarget(DevContext->UsbDevice),
+                               &sendOptions)) {
+                InterlockedIncrement(&DevContext->FeatureStats.WritesSent);
+                return;
+            }
+
+            status = WdfRequestGetStatus(FeatureRegister->WriteRequest);
+        }
+
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTL,
+            "HidFx2SendFeatureWrite: Failed to send write - 0x%x\n", status);
+
+        if (!HidFx2FeatureWriteDone(DevContext, FeatureRegister, status, &Value)) {
+            return;
+        }
+    }
+}
+
+
+VOID
+HidFx2EvtFeatureWriteComplete(
+    IN WDFREQUEST                  Request,
+    IN WDFIOTARGET                 Target,
+    IN PWDF_REQUEST_COMPLETION_PARAMS CompletionParams,
+    IN WDFCONTEXT                  Context
+    )
+/*++
+
+Routine Description
+
+    Completion routine for feature register writes. If another value was
+    set while the write was in flight, it is written now.
+
+Arguments:
+
+    Request - The feature register's write request
+
+    Target - USB device I/O target
+
+    CompletionParams - Completion parameters
+
+    Context - The feature register
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PHIDFX2_FEATURE_REGISTER     featureRegister = Context;
+    PDEVICE_EXTENSION            devContext = NULL;
+    NTSTATUS                     status;
+    UCHAR                        nextValue = 0;
+
+    UNREFERENCED_PARAMETER(Request);
+
+    devContext = GetDeviceContext(WdfIoTargetGetDevice(Target));
+    status = CompletionParams->IoStatus.Status;
+
+    if (!NT_SUCCESS(status)) {
+        TraceEvents(TRACE_LEVEL_ERROR, DBG_IOCTL,
+            "HidFx2EvtFeatureWriteComplete: Command:0x%x failed - 0x%x\n",
+            featureRegister->WriteCommand, status);
+    }
+
+    if (HidFx2FeatureWriteDone(devContext, featureRegister, status, &nextValue)) {
+        HidFx2SendFeatureWrite(devContext, featureRegister, nextValue);
+    }
+}
+
+
 NTSTATUS
 HidFx2GetHidDescriptor(
     IN WDFDEVICE Device,
@@ -230,6 +230,14 @@ CONST  HID_REPORT_DESCRIPTOR           G_DefaultReportDescriptor[] = {
     0x75,0x08,                      //   REPORT_SIZE 
     0x95,0x01,                      //   REPORT_COUNT 
     0xB1,0x00,                      //   Feature (Data,Ary,Abs)
+    0x85,DIP_SWITCHES_REPORT_ID,    // Report ID for switch pack state (read only)
+    0x19,0x00,                      //   USAGE MINIMUM 
+    0x29,0xff,                      //   USAGE MAXIMUM 
+    0x15,0x00,                      //   LOGICAL_MINIMUM(1)
+    0x26,0xff, 0x00,                //   LOGICAL_MAXIMUM(255)
+    0x75,0x08,                      //   REPORT_SIZE 
+    0x95,0x01,                      //   REPORT_COUNT 
+    0xB1,0x00,                      //   Feature (Data,Ary,Abs)
     0xC0                            // END_COLLECTION
 };
 
@@ -309,6 +317,59 @@ typedef struct _HIDFX2_FEATURE_REPORT {
 }HIDFX2_FEATURE_REPORT, *PHIDFX2_FEATURE_REPORT;
 #include <poppack.h>
 
+//
+// Writable feature registers (7-segment display and bar graph). The driver
+// keeps the last value of each register so that get-feature does not need
+// a control transfer, and sends set-feature writes asynchronously.
+//
+typedef enum _HIDFX2_FEATURE_INDEX {
+    HidFx2FeatureSevenSegment = 0,
+    HidFx2FeatureBarGraph,
+    HidFx2FeatureMax
+} HIDFX2_FEATURE_INDEX;
+
+typedef struct _HIDFX2_FEATURE_REGISTER {
+
+    //
+    // Vendor commands used to read and write the register
+    //
+    UCHAR       ReadCommand;
+    UCHAR       WriteCommand;
+
+    //
+    // Cached register value. Valid is cleared when a write fails or the
+    // device comes back to D0, so that the next get-feature reads the
+    // device again.
+    //
+    BOOLEAN     Valid;
+    UCHAR       Value;
+
+    //
+    // Only one write per register is sent at a time. Writes that arrive
+    // while it is in flight only replace PendingValue, so back-to-back
+    // writes collapse into a single transfer carrying the latest value.
+    //
+    BOOLEAN     WriteInFlight;
+    BOOLEAN     WritePending;
+    UCHAR       PendingValue;
+
+    //
+    // Request and one-byte buffer reused for every write to the register
+    //
+    WDFREQUEST  WriteRequest;
+    WDFMEMORY   WriteMemory;
+
+} HIDFX2_FEATURE_REGISTER, *PHIDFX2_FEATURE_REGISTER;
+
+typedef struct _HIDFX2_FEATURE_STATS {
+    LONG CacheHits;
+    LONG CacheMisses;
+    LONG WritesRequested;
+    LONG WritesSent;
+    LONG WritesCoalesced;
+    LONG WritesFailed;
+} HIDFX2_FEATURE_STATS, *PHIDFX2_FEATURE_STATS;
+
 
 typedef struct _DEVICE_EXTENSION{
 
@@ -353,6 +414,15 @@ typedef struct _DEVICE_EXTENSION{
     //
     WDFTIMER DebounceTimer;
 
+    //
+    // Feature register cache. FeatureLock protects Features; the switch
+    // state feature is served from CurrentSwitchState, which is kept
+    // fresh by the interrupt endpoint continuous reader.
+    //
+    WDFSPINLOCK             FeatureLock;
+    HIDFX2_FEATURE_REGISTER Features[HidFx2FeatureMax];
+    HIDFX2_FEATURE_STATS    FeatureStats;
+
 } DEVICE_EXTENSION, * PDEVICE_EXTENSION;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(DEVICE_EXTENSION, GetDeviceContext)
@@ -440,6 +510,25 @@ HidFx2GetFeature(
     OUT PULONG BytesReturned
     );
 
+NTSTATUS
+HidFx2InitializeFeatureCache(
+    IN WDFDEVICE Device
+    );
+
+VOID
+HidFx2InvalidateFeatureCache(
+    IN WDFDEVICE Device
+    );
+
+VOID
+HidFx2SendFeatureWrite(
+    IN PDEVICE_EXTENSION DevContext,
+    IN PHIDFX2_FEATURE_REGISTER FeatureRegister,
+    IN UCHAR Value
+    );
+
+EVT_WDF_REQUEST_COMPLETION_ROUTINE HidFx2EvtFeatureWriteComplete;
+
 EVT_WDF_IO_QUEUE_IO_CANCELED_ON_QUEUE HidFx2EvtIoCanceledOnQueue;
 
 NTSTATUS
@@ -120,6 +120,17 @@ Return Value:
 
     }
 
+    //
+    // Create the feature cache and the requests used to write the
+    // feature registers. This is outside the block above so that a cache
+    // left incomplete by an earlier, failed PrepareHardware is finished
+    // on the next one; objects that already exist are kept.
+    //
+    status = HidFx2InitializeFeatureCache(Device);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
     //
     // Select a device configuration by using a
     // WDF_USB_DEVICE_SELECT_CONFIG_PARAMS structure to specify USB
@@ -584,6 +595,12 @@ Return Value:
 
     devContext->CurrentSwitchState = switchState;
 
+    //
+    // The display registers are read from the device again on the next
+    // get-feature.
+    //
+    HidFx2InvalidateFeatureCache(Device);
+
     //
     // Start the target. This will start the continuous reader
     //
@@ -655,6 +672,16 @@ Return Value:
     WdfIoTargetStop(WdfUsbTargetPipeGetIoTarget(
         devContext->InterruptPipe), WdfIoTargetCancelSentIo);
 
+    TraceEvents(TRACE_LEVEL_INFORMATION, DBG_PNP,
+        "Feature cache hits:%d misses:%d, writes requested:%d sent:%d "
+        "coalesced:%d failed:%d\n",
+        devContext->FeatureStats.CacheHits,
+        devContext->FeatureStats.CacheMisses,
+        devContext->FeatureStats.WritesRequested,
+        devContext->FeatureStats.WritesSent,
+        devContext->FeatureStats.WritesCoalesced,
+        devContext->FeatureStats.WritesFailed);
+
     TraceEvents(TRACE_LEVEL_ERROR, DBG_PNP,
         "HidFx2EvtDeviceD0Exit Exit\n");
 
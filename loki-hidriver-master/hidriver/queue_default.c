@@ -3,8 +3,6 @@
 #include "device.h"
 #include "memory.h"
 
-ULONG runtimes = 0;
-
 _Use_decl_annotations_
 NTSTATUS
 QueueDefaultCreate(
@@ -48,12 +46,14 @@ QueueDefaultEvtIoDeviceControl(
     UNREFERENCED_PARAMETER(inputBufferLength);
 
     NTSTATUS                status               = STATUS_SUCCESS;
-    PDEVICE_CONTEXT         deviceContext        = DeviceGetContext(QueueDefaultGetContext(queue)->device);
-    runtimes++;
+    PQUEUE_DEFAULT_CONTEXT  queueContext         = QueueDefaultGetContext(queue);
+    PDEVICE_CONTEXT         deviceContext        = DeviceGetContext(queueContext->device);
+    QUEUE_DEFAULT_IOCTL     ioctl                = QueueDefaultIoctlNotImplemented;
+    queueContext->stats.requests++;
 
     switch (ioControlCode) {
     case IOCTL_HID_GET_DEVICE_DESCRIPTOR:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_GET_DEVICE_DESCRIPTOR", NULL, runtimes);
+        ioctl = QueueDefaultIoctlGetDeviceDescriptor;
         status = CopyToRequestBuffer(
             request,
             deviceContext->hidDescriptor,
@@ -62,7 +62,7 @@ QueueDefaultEvtIoDeviceControl(
         WdfRequestComplete(request, status);
         break;
     case IOCTL_HID_GET_DEVICE_ATTRIBUTES:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_GET_DEVICE_ATTRIBUTES", NULL, runtimes);
+        ioctl = QueueDefaultIoctlGetDeviceAttributes;
         status = CopyToRequestBuffer(
             request,
             &deviceContext->hidDeviceAttributes,
@@ -71,7 +71,7 @@ QueueDefaultEvtIoDeviceControl(
         WdfRequestComplete(request, status);
         break;
     case IOCTL_HID_GET_REPORT_DESCRIPTOR:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_GET_REPORT_DESCRIPTOR", NULL, runtimes);
+        ioctl = QueueDefaultIoctlGetReportDescriptor;
         status = CopyToRequestBuffer(
             request,
             deviceContext->hidReportDescriptor,
@@ -80,21 +80,19 @@ QueueDefaultEvtIoDeviceControl(
         WdfRequestComplete(request, status);
         break;
     case IOCTL_HID_READ_REPORT:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_READ_REPORT", NULL, runtimes);
     case IOCTL_HID_GET_INPUT_REPORT:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_GET_INPUT_REPORT", NULL, runtimes);
-        status = WdfRequestForwardToIoQueue(
+        ioctl = (ioControlCode == IOCTL_HID_READ_REPORT) ? QueueDefaultIoctlReadReport : QueueDefaultIoctlGetInputReport;
+        status = QueueManualReadReport(
             request,
-            deviceContext->queueManual
+            deviceContext
         );
-        if (!NT_SUCCESS(status)) {
+        if (status != STATUS_PENDING) {
             WdfRequestComplete(request, status);
         }
         break;
     case IOCTL_HID_WRITE_REPORT:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_WRITE_REPORT", NULL, runtimes);
     case IOCTL_HID_SET_OUTPUT_REPORT:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl IOCTL_HID_SET_OUTPUT_REPORT", NULL, runtimes);
+        ioctl = (ioControlCode == IOCTL_HID_WRITE_REPORT) ? QueueDefaultIoctlWriteReport : QueueDefaultIoctlSetOutputReport;
         status = QueueManualSendReport(
             request,
             deviceContext
@@ -102,11 +100,15 @@ QueueDefaultEvtIoDeviceControl(
         WdfRequestComplete(request, status);
         break;
     default:
-        RegDebug(L"QueueDefaultEvtIoDeviceControl STATUS_NOT_IMPLEMENTED", NULL, runtimes);
         status = STATUS_NOT_IMPLEMENTED;
         WdfRequestComplete(request, status);
         break;
     }
+
+    queueContext->stats.ioctls[ioctl]++;
+    if (!NT_SUCCESS(status)) {
+        queueContext->stats.failures[ioctl]++;
+    }
 }
 
 
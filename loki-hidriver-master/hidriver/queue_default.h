@@ -5,9 +5,32 @@
 
 #include "device.h"
 
+typedef enum _QUEUE_DEFAULT_IOCTL {
+    QueueDefaultIoctlGetDeviceDescriptor = 0,
+    QueueDefaultIoctlGetDeviceAttributes,
+    QueueDefaultIoctlGetReportDescriptor,
+    QueueDefaultIoctlReadReport,
+    QueueDefaultIoctlGetInputReport,
+    QueueDefaultIoctlWriteReport,
+    QueueDefaultIoctlSetOutputReport,
+    QueueDefaultIoctlNotImplemented,
+    QueueDefaultIoctlCount
+} QUEUE_DEFAULT_IOCTL;
+
+//
+// Per-IOCTL counters, readable from the debugger. The queue is sequential so
+// plain increments are enough.
+//
+typedef struct _QUEUE_DEFAULT_STATS {
+    ULONG64              requests;
+    ULONG64              ioctls[QueueDefaultIoctlCount];
+    ULONG64              failures[QueueDefaultIoctlCount];
+} QUEUE_DEFAULT_STATS, *PQUEUE_DEFAULT_STATS;
+
 typedef struct _QUEUE_DEFAULT_CONTEXT {
     WDFDEVICE            device;
     WDFQUEUE             queue;
+    QUEUE_DEFAULT_STATS  stats;
 } QUEUE_DEFAULT_CONTEXT, *PQUEUE_DEFAULT_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(QUEUE_DEFAULT_CONTEXT, QueueDefaultGetContext);
@@ -2,6 +2,34 @@
 #include "memory.h"
 #include "hid.h"
 
+#define QUEUE_MANUAL_POOL_TAG       'qMiH'
+
+static
+ULONG
+QueueManualReadDepth(
+    _In_ WDFDEVICE device)
+{
+    NTSTATUS                status                  = STATUS_SUCCESS;
+    WDFKEY                  key                     = NULL;
+    ULONG                   depth                   = 0;
+
+    DECLARE_CONST_UNICODE_STRING(valueName, QUEUE_MANUAL_DEPTH_VALUE_NAME);
+
+    status = WdfDeviceOpenRegistryKey(device, PLUGPLAY_REGKEY_DEVICE, KEY_READ, WDF_NO_OBJECT_ATTRIBUTES, &key);
+    if (NT_SUCCESS(status)) {
+        status = WdfRegistryQueryULong(key, &valueName, &depth);
+        WdfRegistryClose(key);
+    }
+
+    if (!NT_SUCCESS(status) || depth == 0) {
+        depth = QUEUE_MANUAL_DEPTH_DEFAULT;
+    }
+    if (depth > QUEUE_MANUAL_DEPTH_MAX) {
+        depth = QUEUE_MANUAL_DEPTH_MAX;
+    }
+    return depth;
+}
+
 _Use_decl_annotations_
 NTSTATUS
 QueueManualCreate(
@@ -11,9 +39,13 @@ QueueManualCreate(
     NTSTATUS                status                  = STATUS_SUCCESS;
     WDFQUEUE                queue                   = NULL;
     PQUEUE_MANUAL_CONTEXT   queueContext            = NULL;
+    WDFMEMORY               entriesMemory           = NULL;
+    PREPORT_BUFFER_ENTRY    entries                 = NULL;
+    ULONG                   depth                   = QueueManualReadDepth(device);
 
     WDF_IO_QUEUE_CONFIG     queueConfig;
     WDF_OBJECT_ATTRIBUTES   queueAttributes;
+    WDF_OBJECT_ATTRIBUTES   memoryAttributes;
 
     WDF_IO_QUEUE_CONFIG_INIT(&queueConfig, WdfIoQueueDispatchManual);
 
@@ -24,9 +56,26 @@ QueueManualCreate(
         return status;
     }
 
+    WDF_OBJECT_ATTRIBUTES_INIT(&memoryAttributes);
+    memoryAttributes.ParentObject = queue;
+
+    status = WdfMemoryCreate(
+        &memoryAttributes,
+        NonPagedPoolNx,
+        QUEUE_MANUAL_POOL_TAG,
+        (size_t)depth * REPORT_BUFFER_RING_COUNT * sizeof(REPORT_BUFFER_ENTRY),
+        &entriesMemory,
+        (PVOID*)&entries
+    );
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
     queueContext = QueueManualGetContext(queue);
+    RtlZeroMemory(queueContext, sizeof(QUEUE_MANUAL_CONTEXT));
     queueContext->device            = device;
     queueContext->queue             = queue;
+    ReportBufferInitialize(&queueContext->buffer, entries, depth);
 
     *queueOut                       = queue;
     return status;
@@ -40,7 +89,9 @@ QueueManualSendReport(
 {
     NTSTATUS                      status                       = STATUS_SUCCESS;
     WDFQUEUE                      queue                        = deviceContext->queueManual;
+    PQUEUE_MANUAL_CONTEXT         queueContext                 = QueueManualGetContext(queue);
     size_t                        inputReportRequiredSize      = 0;
+    ULONG                         ringIndex                    = 0;
 
     WDFREQUEST                    inputRequest;
     WDF_REQUEST_PARAMETERS        outputRequestParams;
@@ -59,11 +110,13 @@ QueueManualSendReport(
         hidXferPacket.reportId = REPORT_ID_MOUSE_INPUT;
         hidXferPacket.reportBuffer[0] = hidXferPacket.reportId;
         inputReportRequiredSize = sizeof(HID_MOUSE_INPUT_REPORT);
+        ringIndex = REPORT_BUFFER_RING_MOUSE;
         break;
     case REPORT_ID_KEYBOARD_OUTPUT:
         hidXferPacket.reportId = REPORT_ID_KEYBOARD_INPUT;
         hidXferPacket.reportBuffer[0] = hidXferPacket.reportId;
         inputReportRequiredSize = sizeof(HID_KEYBOARD_INPUT_REPORT);
+        ringIndex = REPORT_BUFFER_RING_KEYBOARD;
         break;
     default:
         status = STATUS_INVALID_PARAMETER;
@@ -75,12 +128,51 @@ QueueManualSendReport(
         return status;
     }
 
+    queueContext->stats.reportsReceived++;
+
+    //
+    // Reads are only pended while nothing is buffered, so a pended read can
+    // take the report straight away without reordering it.
+    //
     status = WdfIoQueueRetrieveNextRequest(queue, &inputRequest);
     if (!NT_SUCCESS(status)) {
+        ReportBufferPut(&queueContext->buffer, ringIndex, hidXferPacket.reportBuffer, inputReportRequiredSize, KeQueryInterruptTime());
+        status = STATUS_SUCCESS;
         return status;
     }
+    queueContext->stats.reportsCompletedDirect++;
     status = CopyToRequestBuffer(inputRequest, hidXferPacket.reportBuffer, inputReportRequiredSize);
 
     WdfRequestComplete(inputRequest, status);
     return status;
+}
+
+_Use_decl_annotations_
+NTSTATUS
+QueueManualReadReport(
+    _In_ WDFREQUEST         inputRequest,
+    _In_ PDEVICE_CONTEXT    deviceContext)
+{
+    NTSTATUS                      status                       = STATUS_SUCCESS;
+    WDFQUEUE                      queue                        = deviceContext->queueManual;
+    PQUEUE_MANUAL_CONTEXT         queueContext                 = QueueManualGetContext(queue);
+    PREPORT_BUFFER_ENTRY          oldest                       = ReportBufferOldest(&queueContext->buffer);
+
+    if (oldest == NULL) {
+        status = WdfRequestForwardToIoQueue(inputRequest, queue);
+        if (!NT_SUCCESS(status)) {
+            return status;
+        }
+        queueContext->stats.readsPended++;
+        status = STATUS_PENDING;
+        return status;
+    }
+
+    status = CopyToRequestBuffer(inputRequest, oldest->buffer, oldest->size);
+    if (!NT_SUCCESS(status)) {
+        return status;
+    }
+
+    ReportBufferRemove(&queueContext->buffer, KeQueryInterruptTime());
+    return status;
 }
\ No newline at end of file
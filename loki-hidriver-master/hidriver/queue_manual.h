@@ -5,10 +5,33 @@
 
 #include "device.h"
 #include "hid.h"
+#include "report_buffer.h"
 
+//
+// Input reports written while no read is pended are kept in one ring per
+// report ID. The depth can be set with the ReportQueueDepth value under the
+// device's hardware key.
+//
+#define QUEUE_MANUAL_DEPTH_DEFAULT          32
+#define QUEUE_MANUAL_DEPTH_MAX              1024
+#define QUEUE_MANUAL_DEPTH_VALUE_NAME       L"ReportQueueDepth"
+
+typedef struct _QUEUE_MANUAL_STATS {
+    ULONG64             reportsReceived;
+    ULONG64             reportsCompletedDirect;
+    ULONG64             readsPended;
+} QUEUE_MANUAL_STATS, *PQUEUE_MANUAL_STATS;
+
+//
+// The buffer is only touched from the default queue's callback, which is
+// sequential, so it needs no lock of its own.
+//
 typedef struct _QUEUE_MANUAL_CONTEXT {
     WDFDEVICE           device;
     WDFQUEUE            queue;
+
+    REPORT_BUFFER       buffer;
+    QUEUE_MANUAL_STATS  stats;
 } QUEUE_MANUAL_CONTEXT, *PQUEUE_MANUAL_CONTEXT;
 
 WDF_DECLARE_CONTEXT_TYPE_WITH_NAME(QUEUE_MANUAL_CONTEXT, QueueManualGetContext);
@@ -23,4 +46,14 @@ NTSTATUS
 QueueManualSendReport(
     _In_ WDFREQUEST         outputRequest,
     _In_ PDEVICE_CONTEXT    deviceContext
+);
+
+//
+// Completes inputRequest from the oldest buffered report, or pends it on the
+// manual queue and returns STATUS_PENDING when nothing is buffered.
+//
+NTSTATUS
+QueueManualReadReport(
+    _In_ WDFREQUEST         inputRequest,
+    _In_ PDEVICE_CONTEXT    deviceContext
 );
\ No newline at end of file
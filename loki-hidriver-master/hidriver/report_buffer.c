@@ -0,0 +1,161 @@
+#include "report_buffer.h"
+
+_Use_decl_annotations_
+VOID
+ReportBufferInitialize(
+    _Out_ PREPORT_BUFFER        reportBuffer,
+    _In_ PREPORT_BUFFER_ENTRY   entries,
+    _In_ ULONG                  depth)
+{
+    ULONG                       i                       = 0;
+
+    RtlZeroMemory(reportBuffer, sizeof(REPORT_BUFFER));
+    reportBuffer->depth = depth;
+
+    for (i = 0; i < REPORT_BUFFER_RING_COUNT; i++) {
+        reportBuffer->rings[i].entries = entries + (size_t)i * depth;
+    }
+}
+
+static
+PREPORT_BUFFER_ENTRY
+ReportBufferRingNewest(
+    _In_ PREPORT_BUFFER         reportBuffer,
+    _In_ PREPORT_BUFFER_RING    ring)
+{
+    if (ring->count == 0) {
+        return NULL;
+    }
+    return &ring->entries[(ring->head + ring->count - 1) % reportBuffer->depth];
+}
+
+static
+PREPORT_BUFFER_RING
+ReportBufferRingOldest(
+    _In_ PREPORT_BUFFER         reportBuffer)
+{
+    PREPORT_BUFFER_RING         oldest                  = NULL;
+    ULONG                       i                       = 0;
+
+    for (i = 0; i < REPORT_BUFFER_RING_COUNT; i++) {
+        PREPORT_BUFFER_RING ring = &reportBuffer->rings[i];
+        if (ring->count != 0 && (oldest == NULL || ring->entries[ring->head].sequence < oldest->entries[oldest->head].sequence)) {
+            oldest = ring;
+        }
+    }
+    return oldest;
+}
+
+//
+// Mouse motion is relative, so a report that has not been read yet can
+// absorb the next one as long as the buttons did not change and the summed
+// motion still fits the report. It has to be the newest report of all, or
+// the motion would be read before a keyboard report written ahead of it.
+//
+static
+BOOLEAN
+ReportBufferCoalesceMouse(
+    _In_ PREPORT_BUFFER         reportBuffer,
+    _In_ PHID_MOUSE_INPUT_REPORT report)
+{
+    PREPORT_BUFFER_ENTRY        newest                  = NULL;
+    PHID_MOUSE_INPUT_REPORT     buffered                = NULL;
+    LONG                        x                       = 0;
+    LONG                        y                       = 0;
+
+    newest = ReportBufferRingNewest(reportBuffer, &reportBuffer->rings[REPORT_BUFFER_RING_MOUSE]);
+    if (newest == NULL || newest->sequence + 1 != reportBuffer->nextSequence) {
+        return FALSE;
+    }
+
+    buffered = (PHID_MOUSE_INPUT_REPORT)newest->buffer;
+    if (buffered->buttons != report->buttons) {
+        return FALSE;
+    }
+
+    x = (LONG)buffered->x + report->x;
+    y = (LONG)buffered->y + report->y;
+    if (x < -127 || x > 127 || y < -127 || y > 127) {
+        return FALSE;
+    }
+
+    buffered->x = (CHAR)x;
+    buffered->y = (CHAR)y;
+    return TRUE;
+}
+
+_Use_decl_annotations_
+VOID
+ReportBufferPut(
+    _Inout_ PREPORT_BUFFER      reportBuffer,
+    _In_ ULONG                  ringIndex,
+    _In_reads_bytes_(size) PVOID buffer,
+    _In_ size_t                 size,
+    _In_ ULONG64                timestamp)
+{
+    PREPORT_BUFFER_RING         ring                    = &reportBuffer->rings[ringIndex];
+    PREPORT_BUFFER_ENTRY        entry                   = NULL;
+
+    if (ringIndex == REPORT_BUFFER_RING_MOUSE && ReportBufferCoalesceMouse(reportBuffer, (PHID_MOUSE_INPUT_REPORT)buffer)) {
+        reportBuffer->stats.reportsCoalesced++;
+        return;
+    }
+
+    //
+    // When the ring is full the oldest report is dropped, the reader is
+    // better served by the most recent input.
+    //
+    if (ring->count == reportBuffer->depth) {
+        ring->head = (ring->head + 1) % reportBuffer->depth;
+        ring->count--;
+        reportBuffer->stats.reportsDropped++;
+    }
+
+    entry = &ring->entries[(ring->head + ring->count) % reportBuffer->depth];
+    RtlCopyMemory(entry->buffer, buffer, size);
+    entry->size         = size;
+    entry->sequence     = reportBuffer->nextSequence++;
+    entry->timestamp    = timestamp;
+    ring->count++;
+
+    if (ring->count > reportBuffer->stats.ringHighWater[ringIndex]) {
+        reportBuffer->stats.ringHighWater[ringIndex] = ring->count;
+    }
+}
+
+_Use_decl_annotations_
+PREPORT_BUFFER_ENTRY
+ReportBufferOldest(
+    _In_ PREPORT_BUFFER         reportBuffer)
+{
+    PREPORT_BUFFER_RING         ring                    = ReportBufferRingOldest(reportBuffer);
+
+    if (ring == NULL) {
+        return NULL;
+    }
+    return &ring->entries[ring->head];
+}
+
+_Use_decl_annotations_
+VOID
+ReportBufferRemove(
+    _Inout_ PREPORT_BUFFER      reportBuffer,
+    _In_ ULONG64                now)
+{
+    PREPORT_BUFFER_RING         ring                    = ReportBufferRingOldest(reportBuffer);
+    ULONG64                     latency                 = 0;
+
+    if (ring == NULL) {
+        return;
+    }
+
+    latency = now - ring->entries[ring->head].timestamp;
+    reportBuffer->stats.latencyTotal += latency;
+    if (latency > reportBuffer->stats.latencyMax) {
+        reportBuffer->stats.latencyMax = latency;
+    }
+    reportBuffer->stats.reportsRemoved++;
+
+    ring->head = (ring->head + 1) % reportBuffer->depth;
+    ring->count--;
+}
\ No newline at end of file
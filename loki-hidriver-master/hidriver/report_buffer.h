@@ -0,0 +1,89 @@
+#pragma once
+
+#include <ntddk.h>
+#include <wdf.h>
+
+#include "hid.h"
+
+//
+// Input reports written while no read is pended, kept in one ring per
+// report ID. Nothing in here touches the framework, the queue owns the
+// storage and passes in the time, so the rings can be tested on their own.
+//
+#define REPORT_BUFFER_RING_MOUSE            0
+#define REPORT_BUFFER_RING_KEYBOARD         1
+#define REPORT_BUFFER_RING_COUNT            2
+
+#define REPORT_BUFFER_SIZE_MAX              sizeof(HID_KEYBOARD_INPUT_REPORT)
+
+typedef struct _REPORT_BUFFER_ENTRY {
+    UCHAR               buffer[REPORT_BUFFER_SIZE_MAX];
+    size_t              size;
+    ULONG64             sequence;
+    ULONG64             timestamp;
+} REPORT_BUFFER_ENTRY, *PREPORT_BUFFER_ENTRY;
+
+typedef struct _REPORT_BUFFER_RING {
+    PREPORT_BUFFER_ENTRY    entries;
+    ULONG                   head;
+    ULONG                   count;
+} REPORT_BUFFER_RING, *PREPORT_BUFFER_RING;
+
+typedef struct _REPORT_BUFFER_STATS {
+    ULONG64             reportsCoalesced;
+    ULONG64             reportsDropped;
+    ULONG64             reportsRemoved;
+    ULONG64             latencyTotal;           // 100ns units
+    ULONG64             latencyMax;             // 100ns units
+    ULONG               ringHighWater[REPORT_BUFFER_RING_COUNT];
+} REPORT_BUFFER_STATS, *PREPORT_BUFFER_STATS;
+
+typedef struct _REPORT_BUFFER {
+    ULONG               depth;
+    ULONG64             nextSequence;
+    REPORT_BUFFER_RING  rings[REPORT_BUFFER_RING_COUNT];
+    REPORT_BUFFER_STATS stats;
+} REPORT_BUFFER, *PREPORT_BUFFER;
+
+//
+// entries holds depth * REPORT_BUFFER_RING_COUNT reports.
+//
+VOID
+ReportBufferInitialize(
+    _Out_ PREPORT_BUFFER        reportBuffer,
+    _In_ PREPORT_BUFFER_ENTRY   entries,
+    _In_ ULONG                  depth
+);
+
+//
+// Buffers a report of at most REPORT_BUFFER_SIZE_MAX bytes. Mouse motion is
+// merged into the newest mouse report when it can be, and a full ring drops
+// its oldest report.
+//
+VOID
+ReportBufferPut(
+    _Inout_ PREPORT_BUFFER      reportBuffer,
+    _In_ ULONG                  ringIndex,
+    _In_reads_bytes_(size) PVOID buffer,
+    _In_ size_t                 size,
+    _In_ ULONG64                timestamp
+);
+
+//
+// The oldest report across all rings, or NULL when nothing is buffered. It
+// stays buffered until ReportBufferRemove.
+//
+PREPORT_BUFFER_ENTRY
+ReportBufferOldest(
+    _In_ PREPORT_BUFFER         reportBuffer
+);
+
+//
+// Removes the report ReportBufferOldest returned and counts how long it
+// was buffered.
+//
+VOID
+ReportBufferRemove(
+    _Inout_ PREPORT_BUFFER      reportBuffer,
+    _In_ ULONG64                now
+);
\ No newline at end of file
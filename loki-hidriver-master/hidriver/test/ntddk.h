@@ -0,0 +1,32 @@
+#pragma once
+
+//
+// Host stand-in for the few kernel types and routines the report buffer
+// uses, so report_buffer.c builds without the WDK. Host test only.
+//
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(size)
+#define _Use_decl_annotations_
+
+#define VOID void
+#define TRUE 1
+#define FALSE 0
+
+typedef unsigned char BOOLEAN;
+typedef unsigned char UCHAR;
+typedef unsigned char BYTE;
+typedef signed char CHAR;
+typedef int32_t LONG;
+typedef uint32_t ULONG;
+typedef uint64_t ULONG64;
+typedef void *PVOID;
+
+#define RtlZeroMemory(destination, length)          memset((destination), 0, (length))
+#define RtlCopyMemory(destination, source, length)  memcpy((destination), (source), (length))
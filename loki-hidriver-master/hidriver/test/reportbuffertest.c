@@ -0,0 +1,341 @@
+//
+// Host test for the report buffer. Builds with the stub headers in this
+// directory:
+//
+//   cc -O2 -Wall -Wextra -I test test/reportbuffertest.c report_buffer.c -o reportbuffertest
+//
+// Checks that a full ring drops its oldest report, that mouse motion is
+// merged only while the sums stay within -127..127 and the buttons match,
+// that reads come out in the order reports were written across both rings,
+// and the latency counters. Ends with a random run against a plain list
+// model of the same rules.
+//
+
+#include "../report_buffer.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_DEPTH              4
+#define TEST_RANDOM_DEPTH       3
+#define TEST_RANDOM_STEPS       1000000
+
+static int failures;
+
+static void
+Check(
+    _In_ const char *name,
+    _In_ long long actual,
+    _In_ long long expected)
+{
+    if (actual != expected) {
+        failures++;
+        printf("FAIL %s: got %lld, expected %lld\n", name, actual, expected);
+    }
+}
+
+static void
+PutMouse(
+    _Inout_ PREPORT_BUFFER  reportBuffer,
+    _In_ BYTE               buttons,
+    _In_ int                x,
+    _In_ int                y,
+    _In_ ULONG64            timestamp)
+{
+    HID_MOUSE_INPUT_REPORT  report = { REPORT_ID_MOUSE_INPUT, buttons, (CHAR)x, (CHAR)y };
+
+    ReportBufferPut(reportBuffer, REPORT_BUFFER_RING_MOUSE, &report, sizeof(report), timestamp);
+}
+
+static void
+PutKeyboard(
+    _Inout_ PREPORT_BUFFER  reportBuffer,
+    _In_ BYTE               key,
+    _In_ ULONG64            timestamp)
+{
+    HID_KEYBOARD_INPUT_REPORT report = { REPORT_ID_KEYBOARD_INPUT, 0, 0, { key } };
+
+    ReportBufferPut(reportBuffer, REPORT_BUFFER_RING_KEYBOARD, &report, sizeof(report), timestamp);
+}
+
+static PHID_MOUSE_INPUT_REPORT
+OldestMouse(
+    _In_ PREPORT_BUFFER     reportBuffer)
+{
+    PREPORT_BUFFER_ENTRY    oldest = ReportBufferOldest(reportBuffer);
+
+    if (oldest == NULL || oldest->buffer[0] != REPORT_ID_MOUSE_INPUT) {
+        failures++;
+        printf("FAIL expected a mouse report\n");
+        exit(1);
+    }
+    return (PHID_MOUSE_INPUT_REPORT)oldest->buffer;
+}
+
+static void
+TestDropOldest(void)
+{
+    static REPORT_BUFFER_ENTRY entries[TEST_DEPTH * REPORT_BUFFER_RING_COUNT];
+    REPORT_BUFFER           reportBuffer;
+    PREPORT_BUFFER_ENTRY    oldest;
+    int                     i;
+
+    ReportBufferInitialize(&reportBuffer, entries, TEST_DEPTH);
+    Check("empty oldest", ReportBufferOldest(&reportBuffer) == NULL, 1);
+
+    // Removing from an empty buffer does nothing
+    ReportBufferRemove(&reportBuffer, 0);
+    Check("empty remove", reportBuffer.stats.reportsRemoved, 0);
+
+    for (i = 0; i < TEST_DEPTH + 2; i++) {
+        PutKeyboard(&reportBuffer, (BYTE)(0x04 + i), 0);
+    }
+    Check("dropped", reportBuffer.stats.reportsDropped, 2);
+    Check("keyboard count", reportBuffer.rings[REPORT_BUFFER_RING_KEYBOARD].count, TEST_DEPTH);
+    Check("keyboard high water", reportBuffer.stats.ringHighWater[REPORT_BUFFER_RING_KEYBOARD], TEST_DEPTH);
+
+    // The two oldest went, the rest come out in order
+    for (i = 2; i < TEST_DEPTH + 2; i++) {
+        oldest = ReportBufferOldest(&reportBuffer);
+        Check("kept key", oldest->buffer[3], 0x04 + i);
+        Check("kept size", oldest->size, sizeof(HID_KEYBOARD_INPUT_REPORT));
+        ReportBufferRemove(&reportBuffer, 0);
+    }
+    Check("drained", ReportBufferOldest(&reportBuffer) == NULL, 1);
+
+    // A full mouse ring leaves the keyboard ring alone
+    PutKeyboard(&reportBuffer, 0x1e, 0);
+    for (i = 0; i < TEST_DEPTH + 1; i++) {
+        PutMouse(&reportBuffer, (BYTE)i, 1, 1, 0);
+    }
+    Check("mouse dropped", reportBuffer.stats.reportsDropped, 3);
+    Check("keyboard kept", reportBuffer.rings[REPORT_BUFFER_RING_KEYBOARD].count, 1);
+    Check("keyboard first", ReportBufferOldest(&reportBuffer)->buffer[0], REPORT_ID_KEYBOARD_INPUT);
+}
+
+static void
+TestCoalesce(void)
+{
+    static REPORT_BUFFER_ENTRY entries[TEST_DEPTH * REPORT_BUFFER_RING_COUNT];
+    REPORT_BUFFER           reportBuffer;
+    PHID_MOUSE_INPUT_REPORT mouse;
+
+    ReportBufferInitialize(&reportBuffer, entries, TEST_DEPTH);
+
+    // Up to 127 merges, one more does not
+    PutMouse(&reportBuffer, 0, 100, -100, 0);
+    PutMouse(&reportBuffer, 0, 27, -27, 0);
+    Check("merged to the limit", reportBuffer.stats.reportsCoalesced, 1);
+    mouse = OldestMouse(&reportBuffer);
+    Check("merged x", mouse->x, 127);
+    Check("merged y", mouse->y, -127);
+
+    PutMouse(&reportBuffer, 0, 1, 0, 0);
+    Check("x past the limit", reportBuffer.stats.reportsCoalesced, 1);
+    PutMouse(&reportBuffer, 0, 0, -1, 0);
+    Check("y past the limit", reportBuffer.stats.reportsCoalesced, 2);
+    Check("y past the limit count", reportBuffer.rings[REPORT_BUFFER_RING_MOUSE].count, 2);
+
+    ReportBufferRemove(&reportBuffer, 0);
+    mouse = OldestMouse(&reportBuffer);
+    Check("second x", mouse->x, 1);
+    Check("second y", mouse->y, -1);
+    ReportBufferRemove(&reportBuffer, 0);
+
+    // -128 fits the report but is outside the merge range
+    PutMouse(&reportBuffer, 0, -100, 0, 0);
+    PutMouse(&reportBuffer, 0, -28, 0, 0);
+    Check("-128 not merged", reportBuffer.stats.reportsCoalesced, 2);
+    ReportBufferRemove(&reportBuffer, 0);
+    ReportBufferRemove(&reportBuffer, 0);
+
+    // Motion that cancels out merges
+    PutMouse(&reportBuffer, 0, 127, 127, 0);
+    PutMouse(&reportBuffer, 0, -127, -127, 0);
+    Check("cancel merged", reportBuffer.stats.reportsCoalesced, 3);
+    Check("cancel x", OldestMouse(&reportBuffer)->x, 0);
+    ReportBufferRemove(&reportBuffer, 0);
+
+    // A button change is never merged away
+    PutMouse(&reportBuffer, 0, 1, 1, 0);
+    PutMouse(&reportBuffer, 1, 1, 1, 0);
+    PutMouse(&reportBuffer, 0, 1, 1, 0);
+    Check("buttons not merged", reportBuffer.stats.reportsCoalesced, 3);
+    Check("buttons count", reportBuffer.rings[REPORT_BUFFER_RING_MOUSE].count, 3);
+}
+
+static void
+TestOrder(void)
+{
+    static REPORT_BUFFER_ENTRY entries[TEST_DEPTH * REPORT_BUFFER_RING_COUNT];
+    static const BYTE       expected[] = { REPORT_ID_MOUSE_INPUT, REPORT_ID_KEYBOARD_INPUT, REPORT_ID_MOUSE_INPUT, REPORT_ID_KEYBOARD_INPUT, REPORT_ID_KEYBOARD_INPUT };
+    REPORT_BUFFER           reportBuffer;
+    PREPORT_BUFFER_ENTRY    oldest;
+    ULONG64                 sequence = 0;
+    unsigned                i;
+
+    ReportBufferInitialize(&reportBuffer, entries, TEST_DEPTH);
+
+    // Motion after a key press stays after it, even with the same buttons
+    PutMouse(&reportBuffer, 0, 5, 5, 10);
+    PutKeyboard(&reportBuffer, 0x04, 20);
+    PutMouse(&reportBuffer, 0, 5, 5, 30);
+    PutKeyboard(&reportBuffer, 0x05, 40);
+    PutKeyboard(&reportBuffer, 0x06, 50);
+    Check("order not merged", reportBuffer.stats.reportsCoalesced, 0);
+
+    for (i = 0; i < sizeof(expected); i++) {
+        oldest = ReportBufferOldest(&reportBuffer);
+        if (oldest == NULL) {
+            Check("order reports left", i, sizeof(expected));
+            return;
+        }
+        Check("order report id", oldest->buffer[0], expected[i]);
+        if (i != 0) {
+            Check("order sequence", oldest->sequence > sequence, 1);
+        }
+        sequence = oldest->sequence;
+        ReportBufferRemove(&reportBuffer, 100);
+    }
+
+    // Latencies 90, 80, 70, 60 and 50
+    Check("latency total", reportBuffer.stats.latencyTotal, 350);
+    Check("latency max", reportBuffer.stats.latencyMax, 90);
+    Check("removed", reportBuffer.stats.reportsRemoved, 5);
+}
+
+//
+// Model: every buffered report in one list, in the order it will be read.
+//
+typedef struct _MODEL {
+    UCHAR               reports[TEST_RANDOM_DEPTH * REPORT_BUFFER_RING_COUNT][REPORT_BUFFER_SIZE_MAX];
+    ULONG               count;
+} MODEL;
+
+static ULONG
+ModelCount(
+    _In_ const MODEL    *model,
+    _In_ UCHAR          reportId)
+{
+    ULONG               count = 0;
+    ULONG               i;
+
+    for (i = 0; i < model->count; i++) {
+        count += model->reports[i][0] == reportId;
+    }
+    return count;
+}
+
+static void
+ModelRemoveAt(
+    _Inout_ MODEL       *model,
+    _In_ ULONG          index)
+{
+    memmove(model->reports[index], model->reports[index + 1], (model->count - index - 1) * sizeof(model->reports[0]));
+    model->count--;
+}
+
+static void
+ModelPut(
+    _Inout_ MODEL       *model,
+    _In_ const UCHAR    *report,
+    _In_ size_t         size)
+{
+    UCHAR               *last = model->count != 0 ? model->reports[model->count - 1] : NULL;
+    ULONG               i;
+
+    if (report[0] == REPORT_ID_MOUSE_INPUT && last != NULL && last[0] == REPORT_ID_MOUSE_INPUT && last[1] == report[1]) {
+        int x = (CHAR)last[2] + (CHAR)report[2];
+        int y = (CHAR)last[3] + (CHAR)report[3];
+
+        if (x >= -127 && x <= 127 && y >= -127 && y <= 127) {
+            last[2] = (UCHAR)x;
+            last[3] = (UCHAR)y;
+            return;
+        }
+    }
+
+    if (ModelCount(model, report[0]) == TEST_RANDOM_DEPTH) {
+        for (i = 0; model->reports[i][0] != report[0]; i++) {
+        }
+        ModelRemoveAt(model, i);
+    }
+
+    memset(model->reports[model->count], 0, REPORT_BUFFER_SIZE_MAX);
+    memcpy(model->reports[model->count], report, size);
+    model->count++;
+}
+
+static void
+TestRandom(void)
+{
+    static REPORT_BUFFER_ENTRY entries[TEST_RANDOM_DEPTH * REPORT_BUFFER_RING_COUNT];
+    static MODEL            model;
+    REPORT_BUFFER           reportBuffer;
+    PREPORT_BUFFER_ENTRY    oldest;
+    ULONG                   mismatches = 0;
+    ULONG                   step;
+
+    ReportBufferInitialize(&reportBuffer, entries, TEST_RANDOM_DEPTH);
+    srand(1);
+
+    for (step = 0; step < TEST_RANDOM_STEPS; step++) {
+        int                 action = rand() % 8;
+
+        if (action < 4) {
+            // Small and large motion, two button states
+            int range = action < 2 ? 20 : 255;
+            HID_MOUSE_INPUT_REPORT report = { REPORT_ID_MOUSE_INPUT, (BYTE)(rand() % 4 == 0),
+                                              (CHAR)(rand() % range - range / 2), (CHAR)(rand() % range - range / 2) };
+
+            ReportBufferPut(&reportBuffer, REPORT_BUFFER_RING_MOUSE, &report, sizeof(report), step);
+            ModelPut(&model, (const UCHAR *)&report, sizeof(report));
+        } else if (action < 6) {
+            HID_KEYBOARD_INPUT_REPORT report = { REPORT_ID_KEYBOARD_INPUT, (BYTE)(rand() % 2), 0, { (BYTE)(0x04 + rand() % 26) } };
+
+            ReportBufferPut(&reportBuffer, REPORT_BUFFER_RING_KEYBOARD, &report, sizeof(report), step);
+            ModelPut(&model, (const UCHAR *)&report, sizeof(report));
+        } else {
+            oldest = ReportBufferOldest(&reportBuffer);
+            if ((oldest == NULL) != (model.count == 0)) {
+                mismatches++;
+                continue;
+            }
+            if (oldest == NULL) {
+                continue;
+            }
+            if (memcmp(oldest->buffer, model.reports[0], oldest->size) != 0) {
+                mismatches++;
+            }
+            ReportBufferRemove(&reportBuffer, step);
+            ModelRemoveAt(&model, 0);
+        }
+
+        if (reportBuffer.rings[REPORT_BUFFER_RING_MOUSE].count + reportBuffer.rings[REPORT_BUFFER_RING_KEYBOARD].count != model.count) {
+            mismatches++;
+        }
+    }
+
+    Check("random mismatches", mismatches, 0);
+    Check("random high water", reportBuffer.stats.ringHighWater[REPORT_BUFFER_RING_MOUSE], TEST_RANDOM_DEPTH);
+    printf("random run: %llu coalesced, %llu dropped, %llu removed\n",
+        (unsigned long long)reportBuffer.stats.reportsCoalesced,
+        (unsigned long long)reportBuffer.stats.reportsDropped,
+        (unsigned long long)reportBuffer.stats.reportsRemoved);
+}
+
+int
+main(void)
+{
+    TestDropOldest();
+    TestCoalesce();
+    TestOrder();
+    TestRandom();
+
+    if (failures != 0) {
+        return 1;
+    }
+
+    printf("Report buffer test passed\n");
+    return 0;
+}
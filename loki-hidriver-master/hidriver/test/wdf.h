@@ -0,0 +1,6 @@
+#pragma once
+
+//
+// Host stand-in for wdf.h: the report buffer needs nothing from the
+// framework. Host test only.
+//
@@ -767,16 +767,23 @@ Return Value:
         for (BankId = 0; BankId < GpioContext->TotalBanks; BankId += 1) {
             GpioBank = &GpioContext->Banks[BankId];
 
+            //
+            // Nothing is known about the register state left behind (e.g. by
+            // FW), so start with an empty shadow.
+            //
+
+            SimGpioBankInvalidate(GpioBank);
+
             //
             // Read the current values of the interrupt enable register.
             //
 
             EnableValue = 0;
-            Status = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
+            Status = SimGpioBankReadRegister(GpioBank, EnableRegister, &EnableValue);
             if (!NT_SUCCESS(Status)) {
                 TraceEvents(TRACE_LEVEL_ERROR,
                             TRACE_FLAG_INIT,
-                            "%s: SimGpioSpbReadByte(EnableRegister) failed! "
+                            "%s: SimGpioBankReadRegister(EnableRegister) failed! "
                             "Status = %#x\n",
                             __FUNCTION__,
                             Status);
@@ -798,11 +805,11 @@ Return Value:
             //
 
             EnableValue = 0;
-            Status = SimGpioSpbWriteByte(GpioBank, EnableRegister, EnableValue);
+            Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, EnableValue);
             if (!NT_SUCCESS(Status)) {
                 TraceEvents(TRACE_LEVEL_ERROR,
                             TRACE_FLAG_INIT,
-                            "%s: SimGpioSpbWriteByte(EnableRegister) failed! "
+                            "%s: SimGpioBankWriteRegister(EnableRegister) failed! "
                             "Status = %#x\n",
                             __FUNCTION__,
                             Status);
@@ -999,6 +1006,7 @@ Environment:
     UCHAR ModeValue;
     PIN_NUMBER PinNumber;
     UCHAR PolarityValue;
+    UCHAR RegisterValues[EnableRegister + 1];
     NTSTATUS Status;
     UCHAR StatusRegisterValue;
 
@@ -1031,44 +1039,30 @@ Environment:
 
     //
     // Read the current values of the interrupt mode register, polarity
-    // register, enable register.
+    // register, enable register. These are contiguous and read in one go
+    // (or served from the shadow).
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, ModeRegister, &ModeValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(ModeRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto EnableInterruptEnd;
-    }
+    Status = SimGpioBankReadRegisters(GpioBank,
+                                      ModeRegister,
+                                      ARRAYSIZE(RegisterValues),
+                                      RegisterValues);
 
-    Status = SimGpioSpbReadByte(GpioBank, PolarityRegister, &PolarityValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(PolarityRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegisters(ModeRegister..EnableRegister) "
+                "failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
         goto EnableInterruptEnd;
     }
 
-    Status = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(EnableRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto EnableInterruptEnd;
-    }
+    ModeValue = RegisterValues[ModeRegister];
+    PolarityValue = RegisterValues[PolarityRegister];
+    EnableValue = RegisterValues[EnableRegister];
 
     //
     // Determine the mode register value. If the interrupt is Level then set
@@ -1113,39 +1107,21 @@ Environment:
 
     //
     // Write the new values for the interrupt mode register, polarity
-    // register, status register and enable register.
+    // register and status register. They are flushed together (the current
+    // enable value fills the gap before the status register) so that the
+    // interrupt is only enabled once they have taken effect.
     //
 
-    Status = SimGpioSpbWriteByte(GpioBank, ModeRegister, ModeValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(ModeRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto EnableInterruptEnd;
-    }
-
-    Status = SimGpioSpbWriteByte(GpioBank, PolarityRegister, PolarityValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(PolarityRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto EnableInterruptEnd;
-    }
-
-    Status = SimGpioSpbWriteByte(GpioBank, StatusRegister, StatusRegisterValue);
+    SimGpioBankStageRegister(GpioBank, ModeRegister, ModeValue);
+    SimGpioBankStageRegister(GpioBank, PolarityRegister, PolarityValue);
+    SimGpioBankStageRegister(GpioBank, StatusRegister, StatusRegisterValue);
+    Status = SimGpioBankFlush(GpioBank);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(StatusRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankFlush(Mode, Polarity, Status) failed! "
+                "Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1156,12 +1132,12 @@ Environment:
     // Enable the interrupt by setting the bit in the interrupt enable register.
     //
 
-    Status = SimGpioSpbWriteByte(GpioBank, EnableRegister, EnableValue);
+    Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, EnableValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1233,12 +1209,12 @@ Environment:
     // Read the current value of the interrupt enable register.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
+    Status = SimGpioBankReadRegister(GpioBank, EnableRegister, &EnableValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1251,12 +1227,12 @@ Environment:
     //
 
     EnableValue &= ~(1 << DisableParameters->PinNumber);
-    Status = SimGpioSpbWriteByte(GpioBank, EnableRegister, EnableValue);
+    Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, EnableValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1328,40 +1304,51 @@ Environment:
 
 {
 
-    GPIO_DISABLE_INTERRUPT_PARAMETERS DisableParameters;
-    PIN_NUMBER PinIndex;
+    UCHAR EnableValue;
+    PSIM_GPIO_BANK GpioBank;
+    PSIM_GPIO_CONTEXT GpioContext;
     ULONG64 PinMask;
     NTSTATUS Status;
 
     //
     // Mask is essentially same as disable for SimGPIO controller. The primary
-    // difference is that mask callback supplies a bit-mask.
+    // difference is that mask callback supplies a bit-mask, so all the pins
+    // are masked with a single update of the enable register.
     //
 
-    Status = STATUS_SUCCESS;
+    GpioContext = (PSIM_GPIO_CONTEXT)Context;
+    GpioBank = &GpioContext->Banks[MaskParameters->BankId];
     PinMask = MaskParameters->PinMask;
-    RtlZeroMemory(&DisableParameters, sizeof(DisableParameters));
-    DisableParameters.BankId = MaskParameters->BankId;
-    while (PinMask > 0) {
-        PinIndex = RtlFindLeastSignificantBit(PinMask);
-        if (PinIndex == 0xFF) {
-
-            NT_ASSERT(FALSE);
+    Status = SimGpioBankReadRegister(GpioBank, EnableRegister, &EnableValue);
+    if (!NT_SUCCESS(Status)) {
+        TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_INIT,
+                "%s: SimGpioBankReadRegister(EnableRegister) failed! Status = %#x\n",
+                __FUNCTION__,
+                Status);
 
-            goto MaskInterruptsEnd;
-        }
+        goto MaskInterruptsEnd;
+    }
 
-        DisableParameters.PinNumber = PinIndex;
-        Status = SimGpioDisableInterrupt(Context, &DisableParameters);
-        if (!NT_SUCCESS(Status)) {
-            goto MaskInterruptsEnd;
-        }
+    EnableValue &= ~(UCHAR)PinMask;
+    Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, EnableValue);
+    if (!NT_SUCCESS(Status)) {
+        TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_INIT,
+                "%s: SimGpioBankWriteRegister(EnableRegister) failed! Status = %#x\n",
+                __FUNCTION__,
+                Status);
 
-        PinMask &= ~(1 << PinIndex);
+        goto MaskInterruptsEnd;
     }
 
+    PinMask = 0;
+
     //
     // Set the bitmask of pins that could not be successfully masked.
+    // Either all pins get masked or none does.
     //
 
 MaskInterruptsEnd:
@@ -1454,12 +1441,12 @@ Environment:
     // Read the current value of the interrupt enable register.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
+    Status = SimGpioBankReadRegister(GpioBank, EnableRegister, &EnableValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1472,12 +1459,12 @@ Environment:
     //
 
     EnableValue |= (1 << UnmaskParameters->PinNumber);
-    Status = SimGpioSpbWriteByte(GpioBank, EnableRegister, EnableValue);
+    Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, EnableValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1569,24 +1556,24 @@ Environment:
     // BEGIN: SIMGPIO HACK.
     //
 
-    ReturnStatus = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
+    ReturnStatus = SimGpioBankReadRegister(GpioBank, EnableRegister, &EnableValue);
     if (!NT_SUCCESS(ReturnStatus)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 ReturnStatus);
 
         goto QueryActiveInterruptsEnd;
     }
 
-    ReturnStatus = SimGpioSpbWriteByte(GpioBank, StatusRegister, EnableValue);
+    ReturnStatus = SimGpioBankWriteRegister(GpioBank, StatusRegister, EnableValue);
     if (!NT_SUCCESS(ReturnStatus)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(StatusRegister) failed! "
+                "%s: SimGpioBankWriteRegister(StatusRegister) failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 ReturnStatus);
@@ -1603,12 +1590,12 @@ Environment:
     // ActiveMask parameter.
     //
 
-    ReturnStatus = SimGpioSpbReadByte(GpioBank, StatusRegister, &StatusValue);
+    ReturnStatus = SimGpioBankReadRegister(GpioBank, StatusRegister, &StatusValue);
     if (!NT_SUCCESS(ReturnStatus)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(EnableRegister) failed! "
+                "%s: SimGpioBankReadRegister(StatusRegister) failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 ReturnStatus);
@@ -1690,7 +1677,7 @@ Environment:
     // EnabledMask parameter. It is strongly preferred that the true state of
     // the hardware is returned, rather than a software-cached variable, since
     // CLIENT_QueryEnabledInterrupts is used by the class extension to detect
-    // interrupt storms.
+    // interrupt storms. Hence the register shadow is bypassed here.
     //
 
     ReturnStatus = SimGpioSpbReadByte(GpioBank, EnableRegister, &EnableValue);
@@ -1785,12 +1772,12 @@ Environment:
     //
 
     StatusValue = (UCHAR)ClearParameters->ClearActiveMask;
-    ReturnStatus = SimGpioSpbWriteByte(GpioBank, StatusRegister, StatusValue);
+    ReturnStatus = SimGpioBankWriteRegister(GpioBank, StatusRegister, StatusValue);
     if (!NT_SUCCESS(ReturnStatus)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(StatusRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(StatusRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 ReturnStatus);
 
@@ -1879,6 +1866,7 @@ Environment:
     UCHAR ModeValue;
     PIN_NUMBER PinNumber;
     UCHAR PolarityValue;
+    UCHAR RegisterValues[PolarityRegister + 1];
     NTSTATUS Status;
     UCHAR StatusRegisterValue;
 
@@ -1889,34 +1877,30 @@ Environment:
     GpioBank = &GpioContext->Banks[BankId];
 
     //
-    // Read the current values of the interrupt mode register, polarity
-    // register, enable register.
+    // Read the current values of the interrupt mode register and polarity
+    // register.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, ModeRegister, &ModeValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(ModeRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto ReconfigureInterruptEnd;
-    }
+    Status = SimGpioBankReadRegisters(GpioBank,
+                                      ModeRegister,
+                                      ARRAYSIZE(RegisterValues),
+                                      RegisterValues);
 
-    Status = SimGpioSpbReadByte(GpioBank, PolarityRegister, &PolarityValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(PolarityRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegisters(ModeRegister..PolarityRegister) "
+                "failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
         goto ReconfigureInterruptEnd;
     }
 
+    ModeValue = RegisterValues[ModeRegister];
+    PolarityValue = RegisterValues[PolarityRegister];
+
     //
     // Determine the mode register value. If the interrupt is Level then set
     // the bit; otherwise, clear it (edge-triggered).
@@ -1952,12 +1936,12 @@ Environment:
     //
 
     StatusRegisterValue = (1 << PinNumber);
-    Status = SimGpioSpbWriteByte(GpioBank, StatusRegister, StatusRegisterValue);
+    Status = SimGpioBankWriteRegister(GpioBank, StatusRegister, StatusRegisterValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(StatusRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(StatusRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -1965,28 +1949,18 @@ Environment:
     }
 
     //
-    // Write the new values for the interrupt mode register, polarity
-    // register, status register and enable register.
+    // Write the new values for the interrupt mode register and polarity
+    // register in a single transfer.
     //
 
-    Status = SimGpioSpbWriteByte(GpioBank, ModeRegister, ModeValue);
-    if (!NT_SUCCESS(Status)) {
-        TraceEvents(
-                TRACE_LEVEL_ERROR,
-                TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(ModeRegister) failed! Status = %#x\n",
-                __FUNCTION__,
-                Status);
-
-        goto ReconfigureInterruptEnd;
-    }
-
-    Status = SimGpioSpbWriteByte(GpioBank, PolarityRegister, PolarityValue);
+    SimGpioBankStageRegister(GpioBank, ModeRegister, ModeValue);
+    SimGpioBankStageRegister(GpioBank, PolarityRegister, PolarityValue);
+    Status = SimGpioBankFlush(GpioBank);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(PolarityRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankFlush(Mode, Polarity) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -2090,12 +2064,12 @@ Environment:
     // Read the current direction register value.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, DirectionRegister, &PinValue);
+    Status = SimGpioBankReadRegister(GpioBank, DirectionRegister, &PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(DirectionRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankReadRegister(DirectionRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -2124,12 +2098,12 @@ Environment:
         }
     }
 
-    Status = SimGpioSpbWriteByte(GpioBank, DirectionRegister, PinValue);
+    Status = SimGpioBankWriteRegister(GpioBank, DirectionRegister, PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(DirectionRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(DirectionRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -2220,12 +2194,12 @@ Environment:
     // Read the current direction register value.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, DirectionRegister, &PinValue);
+    Status = SimGpioBankReadRegister(GpioBank, DirectionRegister, &PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(DirectionRegister) failed! "
+                "%s: SimGpioBankReadRegister(DirectionRegister) failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 Status);
@@ -2244,12 +2218,12 @@ Environment:
         PinValue &= ~(1 << PinNumber);
     }
 
-    Status = SimGpioSpbWriteByte(GpioBank, DirectionRegister, PinValue);
+    Status = SimGpioBankWriteRegister(GpioBank, DirectionRegister, PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(DirectionRegister) failed! "
+                "%s: SimGpioBankWriteRegister(DirectionRegister) failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 Status);
@@ -2334,21 +2308,23 @@ Environment:
     //
     // N.B. In case of SimGPIO, the LevelRegister holds the value for input
     //      as well as output pins. Thus the same register is read in either
-    //      case.
+    //      case. The output values are the ones last written by the driver,
+    //      so for write-configured pins the shadow of the level register is
+    //      returned without going to the controller.
     //
 
     if (ReadParameters->Flags.WriteConfiguredPins == FALSE) {
-        Status = SimGpioSpbReadByte(GpioBank, LevelRegister, &PinValue);
+        Status = SimGpioBankReadRegister(GpioBank, LevelRegister, &PinValue);
 
     } else {
-        Status = SimGpioSpbReadByte(GpioBank, LevelRegister, &PinValue);
+        Status = SimGpioBankReadOutputLevel(GpioBank, &PinValue);
     }
 
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(DirectionRegister) failed! "
+                "%s: Reading LevelRegister failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 Status);
@@ -2417,15 +2393,16 @@ Return Value:
     GpioBank = &GpioContext->Banks[WriteParameters->BankId];
 
     //
-    // Read the current level register value.
+    // Read the current level register value. Only the output pins are
+    // affected by the write, so the value last written is used.
     //
 
-    Status = SimGpioSpbReadByte(GpioBank, LevelRegister, &PinValue);
+    Status = SimGpioBankReadOutputLevel(GpioBank, &PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbReadByte(DirectionRegister) failed! "
+                "%s: SimGpioBankReadOutputLevel() failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 Status);
@@ -2445,12 +2422,12 @@ Return Value:
     // Write the updated value to the register.
     //
 
-    Status = SimGpioSpbWriteByte(GpioBank, LevelRegister, PinValue);
+    Status = SimGpioBankWriteRegister(GpioBank, LevelRegister, PinValue);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(DirectionRegister) failed! "
+                "%s: SimGpioBankWriteRegister(LevelRegister) failed! "
                 "Status = %#x\n",
                 __FUNCTION__,
                 Status);
@@ -2539,42 +2516,50 @@ Return Value:
 
 {
 
-    PUCHAR DestinationAddress;
     PSIM_GPIO_BANK GpioBank;
     PSIM_GPIO_CONTEXT GpioContext;
-    ULONG Index;
     NTSTATUS Status;
 
     GpioContext = (PSIM_GPIO_CONTEXT)Context;
     GpioBank = &GpioContext->Banks[BankId];
-    Status = STATUS_SUCCESS;
 
     //
-    // Loop through all the registers and save them. The status register can
-    // only be written to be cleared and thus isn't saved.
+    // Read all the registers in one go. The status register can only be
+    // written to be cleared and thus isn't restored, but reading it along
+    // with the others is harmless and keeps the read to a single transfer.
     //
 
-    for (Index = 0; Index < MaximumSimGpioAddress; Index += 1) {
-        if (Index == StatusRegister) {
-            continue;
-        }
+    Status = SimGpioBankReadRegisters(GpioBank,
+                                      ModeRegister,
+                                      MaximumSimGpioAddress,
+                                      GpioBank->SavedRegisterContext);
 
-        DestinationAddress = &GpioBank->SavedRegisterContext[Index];
-        Status = SimGpioSpbReadByte(GpioBank, Index, DestinationAddress);
-        if (!NT_SUCCESS(Status)) {
-            TraceEvents(
-                    TRACE_LEVEL_ERROR,
-                    TRACE_FLAG_INIT,
-                    "%s: SimGpioSpbReadByte(Register = %d) failed! "
-                    "Status = %#x\n",
-                    __FUNCTION__,
-                    Index,
-                    Status);
-
-            goto SaveBankHardwareContextEnd;
-        }
+    if (!NT_SUCCESS(Status)) {
+        TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_INIT,
+                "%s: SimGpioBankReadRegisters() failed! Status = %#x\n",
+                __FUNCTION__,
+                Status);
+
+        goto SaveBankHardwareContextEnd;
     }
 
+    TraceEvents(TRACE_LEVEL_INFORMATION,
+                TRACE_FLAG_SPB,
+                "%s: Bank %d: %lu bus reads, %lu bus writes, %lu shadow hits\n",
+                __FUNCTION__,
+                BankId,
+                GpioBank->BusReads,
+                GpioBank->BusWrites,
+                GpioBank->ShadowHits);
+
+    //
+    // The controller may lose its state while in the lower power state.
+    //
+
+    SimGpioBankInvalidate(GpioBank);
+
 SaveBankHardwareContextEnd:
     return Status;
 }
@@ -2616,15 +2601,15 @@ Return Value:
 
     GpioContext = (PSIM_GPIO_CONTEXT)Context;
     GpioBank = &GpioContext->Banks[BankId];
-    Status = STATUS_SUCCESS;
 
     //
-    // Loop through all the registers and write them. The order of restore is
+    // Stage all the registers and write them. The order of restore is
     // important. The enable and direction registers need to be programmed
     // after the (mode, polarity) and level registers have been written to.
     // Hence they are restored at the very end.
     //
 
+    SimGpioBankInvalidate(GpioBank);
     for (Index = 0; Index < MaximumSimGpioAddress; Index += 1) {
         if ((Index == EnableRegister) ||
             (Index == DirectionRegister) ||
@@ -2634,19 +2619,19 @@ Return Value:
         }
 
         Value = GpioBank->SavedRegisterContext[Index];
-        Status = SimGpioSpbWriteByte(GpioBank, Index, Value);
-        if (!NT_SUCCESS(Status)) {
-            TraceEvents(
-                    TRACE_LEVEL_ERROR,
-                    TRACE_FLAG_INIT,
-                    "%s: SimGpioSpbWriteByte(Register = %d) failed! "
-                    "Status = %#x\n",
-                    __FUNCTION__,
-                    Index,
-                    Status);
-
-            goto RestoreBankHardwareContextEnd;
-        }
+        SimGpioBankStageRegister(GpioBank, Index, Value);
+    }
+
+    Status = SimGpioBankFlush(GpioBank);
+    if (!NT_SUCCESS(Status)) {
+        TraceEvents(
+                TRACE_LEVEL_ERROR,
+                TRACE_FLAG_INIT,
+                "%s: SimGpioBankFlush() failed! Status = %#x\n",
+                __FUNCTION__,
+                Status);
+
+        goto RestoreBankHardwareContextEnd;
     }
 
     //
@@ -2654,12 +2639,12 @@ Return Value:
     //
 
     Value = GpioBank->SavedRegisterContext[DirectionRegister];
-    Status = SimGpioSpbWriteByte(GpioBank, DirectionRegister, Value);
+    Status = SimGpioBankWriteRegister(GpioBank, DirectionRegister, Value);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(DirectionRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(DirectionRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
@@ -2671,12 +2656,12 @@ Return Value:
     //
 
     Value = GpioBank->SavedRegisterContext[EnableRegister];
-    Status = SimGpioSpbWriteByte(GpioBank, EnableRegister, Value);
+    Status = SimGpioBankWriteRegister(GpioBank, EnableRegister, Value);
     if (!NT_SUCCESS(Status)) {
         TraceEvents(
                 TRACE_LEVEL_ERROR,
                 TRACE_FLAG_INIT,
-                "%s: SimGpioSpbWriteByte(EnableRegister) failed! Status = %#x\n",
+                "%s: SimGpioBankWriteRegister(EnableRegister) failed! Status = %#x\n",
                 __FUNCTION__,
                 Status);
 
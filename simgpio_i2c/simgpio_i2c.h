@@ -42,6 +42,12 @@ Environment:
 
 #define SIM_GPIO_REGISTER_ADDRESS_SIZE (sizeof(USHORT))
 
+//
+// Bit representing a bank register in the shadow valid and dirty masks.
+//
+
+#define SIM_GPIO_REGISTER_BIT(Register) ((UCHAR)(1 << (Register)))
+
 //
 // Pool tag for SimGpio allocations.
 //
@@ -97,6 +103,29 @@ typedef struct _SIM_GPIO_BANK {
     USHORT AddressBase;
     struct _SIM_GPIO_CONTEXT *GpioContext;
     UCHAR SavedRegisterContext[MaximumSimGpioAddress];
+
+    //
+    // Shadow copy of the bank registers. A shadow value is only used if the
+    // register's bit is set in ShadowValid. Writes are staged in the shadow
+    // (bit set in ShadowDirty) until SimGpioBankFlush sends them to the
+    // controller.
+    //
+    // The GPIO class extension serializes all callbacks for serially
+    // accessed controllers, so the shadow needs no lock.
+    //
+
+    UCHAR ShadowRegisters[MaximumSimGpioAddress];
+    UCHAR ShadowValid;
+    UCHAR ShadowDirty;
+
+    //
+    // Number of SPB transactions issued for this bank and of register reads
+    // served from the shadow.
+    //
+
+    ULONG BusReads;
+    ULONG BusWrites;
+    ULONG ShadowHits;
 } SIM_GPIO_BANK, *PSIM_GPIO_BANK;
 
 //
@@ -161,6 +190,51 @@ SimGpioSpbWriteByte (
     _In_ UCHAR Data
     );
 
+VOID
+SimGpioBankInvalidate (
+    _In_ PSIM_GPIO_BANK GpioBank
+    );
+
+NTSTATUS
+SimGpioBankReadRegisters (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS FirstRegister,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PUCHAR Data
+    );
+
+NTSTATUS
+SimGpioBankReadRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _Out_writes_(sizeof(UCHAR)) PUCHAR Data
+    );
+
+NTSTATUS
+SimGpioBankReadOutputLevel (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _Out_writes_(sizeof(UCHAR)) PUCHAR Data
+    );
+
+VOID
+SimGpioBankStageRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _In_ UCHAR Data
+    );
+
+NTSTATUS
+SimGpioBankFlush (
+    _In_ PSIM_GPIO_BANK GpioBank
+    );
+
+NTSTATUS
+SimGpioBankWriteRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _In_ UCHAR Data
+    );
+
 NTSTATUS
 SimGpioRestoreBankHardwareContext (
     _In_ PVOID Context,
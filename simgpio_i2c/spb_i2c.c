@@ -45,6 +45,16 @@ Environment:
 // -------------------------------------------------------------------- Defines
 //
 
+//
+// Registers whose value can change without the driver writing them. The
+// status register is set by the controller (and cleared by writing a mask
+// to it) and the level register follows the input pins. Reads of these
+// registers always go to the controller.
+//
+
+#define SIM_GPIO_VOLATILE_REGISTERS \
+    (SIM_GPIO_REGISTER_BIT(StatusRegister) | SIM_GPIO_REGISTER_BIT(LevelRegister))
+
 NTSTATUS
 SimGpioSpbRead (
     _In_ PSIM_GPIO_CONTEXT GpioContext,
@@ -300,7 +310,10 @@ Return Value:
 
     ActualAddress = GpioBank->AddressBase + (USHORT)RegisterAddress;
     GpioContext = GpioBank->GpioContext;
-    Status = SimGpioSpbRead(GpioContext, RegisterAddress, Data, sizeof(UCHAR));
+    Status = SimGpioSpbRead(GpioContext,
+                            (SIM_GPIO_REGISTER_ADDRESS)ActualAddress,
+                            Data,
+                            sizeof(UCHAR));
 
 SpbReadByteEnd:
     return Status;
@@ -428,7 +441,7 @@ Return Value:
 
     ActualAddress = GpioBank->AddressBase + (USHORT)RegisterAddress;
     GpioContext = GpioBank->GpioContext;
-    Status = SimGpioSpbWrite(GpioContext, RegisterAddress, &Data, sizeof(UCHAR));
+    Status = SimGpioSpbWrite(GpioContext, ActualAddress, &Data, sizeof(UCHAR));
 
 SpbWriteByteEnd:
     return Status;
@@ -663,4 +676,415 @@ SpbSequenceEnd:
     return Status;
 }
 
+//
+// ------------------------------------------------------ Bank register shadow
+//
+
+VOID
+SimGpioBankInvalidate (
+    _In_ PSIM_GPIO_BANK GpioBank
+    )
+
+/*++
+
+Routine Description:
+
+    This routine discards the shadow copy of the bank registers. It is called
+    whenever the controller may have lost its register state (e.g. on a
+    transition out of D0 or on the initial D0 entry).
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    NT_ASSERT(GpioBank->ShadowDirty == 0);
+
+    GpioBank->ShadowValid = 0;
+    GpioBank->ShadowDirty = 0;
+    return;
+}
+
+NTSTATUS
+SimGpioBankReadRegisters (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS FirstRegister,
+    _In_ ULONG Count,
+    _Out_writes_(Count) PUCHAR Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a contiguous range of bank registers. If every register
+    in the range is non-volatile and has a valid shadow value, the read is
+    served from the shadow. Otherwise the whole range is read from the
+    controller in a single SPB sequence and the shadow is refreshed.
+
+    N.B. This routine is called at PASSIVE_LEVEL for off-SoC GPIOs but is not
+         marked as PAGED_CODE as it could be executed late in the hibernate or
+         early in resume sequence (or the deep-idle sequence).
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank to be read from.
+
+    FirstRegister - Supplies the bank-relative address of the first register.
+
+    Count - Supplies the number of registers to read.
+
+    Data - Supplies the byte buffer to read the register values into.
+
+Return Value:
+
+    NTSTATUS code.
+
+--*/
+
+{
+
+    ULONG Index;
+    UCHAR Mask;
+    NTSTATUS Status;
+
+    if ((Count == 0) ||
+        (FirstRegister >= MaximumSimGpioAddress) ||
+        (Count > (ULONG)(MaximumSimGpioAddress - FirstRegister))) {
+
+        Status = STATUS_INVALID_PARAMETER;
+        goto BankReadRegistersEnd;
+    }
+
+    Mask = (UCHAR)(((1 << Count) - 1) << FirstRegister);
+
+    //
+    // Staged values are newer than the controller's, send them first.
+    //
+
+    if ((GpioBank->ShadowDirty & Mask) != 0) {
+        Status = SimGpioBankFlush(GpioBank);
+        if (!NT_SUCCESS(Status)) {
+            goto BankReadRegistersEnd;
+        }
+    }
+
+    if ((Mask & (SIM_GPIO_VOLATILE_REGISTERS | ~GpioBank->ShadowValid)) == 0) {
+        RtlCopyMemory(Data, &GpioBank->ShadowRegisters[FirstRegister], Count);
+        GpioBank->ShadowHits += Count;
+        Status = STATUS_SUCCESS;
+        goto BankReadRegistersEnd;
+    }
+
+    Status = SimGpioSpbRead(GpioBank->GpioContext,
+                            (SIM_GPIO_REGISTER_ADDRESS)
+                                (GpioBank->AddressBase + (USHORT)FirstRegister),
+                            Data,
+                            (USHORT)Count);
+
+    GpioBank->BusReads += 1;
+    if (!NT_SUCCESS(Status)) {
+        goto BankReadRegistersEnd;
+    }
+
+    //
+    // Refresh the shadow. Volatile registers are refreshed too (the output
+    // level is tracked in the shadow) but are not marked valid by a read.
+    //
+
+    for (Index = 0; Index < Count; Index += 1) {
+        if ((FirstRegister + Index) != StatusRegister) {
+            GpioBank->ShadowRegisters[FirstRegister + Index] = Data[Index];
+        }
+    }
+
+    GpioBank->ShadowValid |= (Mask & ~SIM_GPIO_VOLATILE_REGISTERS);
+
+BankReadRegistersEnd:
+    return Status;
+}
+
+NTSTATUS
+SimGpioBankReadRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _Out_writes_(sizeof(UCHAR)) PUCHAR Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine reads a single bank register through the shadow.
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank to be read from.
+
+    RegisterAddress - Supplies the bank-relative register address to be read.
+
+    Data - Supplies the byte buffer to read the data into.
+
+Return Value:
+
+    NTSTATUS code.
+
+--*/
+
+{
+
+    return SimGpioBankReadRegisters(GpioBank, RegisterAddress, 1, Data);
+}
+
+NTSTATUS
+SimGpioBankReadOutputLevel (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _Out_writes_(sizeof(UCHAR)) PUCHAR Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine returns the level register value last written by the driver.
+    The bits for output pins are owned by the driver, so once the level
+    register has been written (or read once) its shadow value can be used for
+    write-configured pins without going to the controller.
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank to be read from.
+
+    Data - Supplies the byte buffer to read the data into.
+
+Return Value:
+
+    NTSTATUS code.
+
+--*/
+
+{
+
+    NTSTATUS Status;
+
+    if ((GpioBank->ShadowDirty & SIM_GPIO_REGISTER_BIT(LevelRegister)) != 0) {
+        Status = SimGpioBankFlush(GpioBank);
+        if (!NT_SUCCESS(Status)) {
+            goto BankReadOutputLevelEnd;
+        }
+    }
+
+    if ((GpioBank->ShadowValid & SIM_GPIO_REGISTER_BIT(LevelRegister)) != 0) {
+        *Data = GpioBank->ShadowRegisters[LevelRegister];
+        GpioBank->ShadowHits += 1;
+        Status = STATUS_SUCCESS;
+        goto BankReadOutputLevelEnd;
+    }
+
+    Status = SimGpioBankReadRegister(GpioBank, LevelRegister, Data);
+    if (NT_SUCCESS(Status)) {
+        GpioBank->ShadowValid |= SIM_GPIO_REGISTER_BIT(LevelRegister);
+    }
+
+BankReadOutputLevelEnd:
+    return Status;
+}
+
+VOID
+SimGpioBankStageRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _In_ UCHAR Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine stages a register write in the shadow. The write is sent to
+    the controller by the next SimGpioBankFlush, coalesced with the other
+    staged writes. Callers flush between writes whose order matters.
+
+    Writes to the status register clear bits; staged status writes are
+    accumulated into a single clear mask.
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank.
+
+    RegisterAddress - Supplies the bank-relative register address.
+
+    Data - Supplies the value to be written.
+
+Return Value:
+
+    None.
+
+--*/
+
+{
+
+    UCHAR Bit;
+
+    NT_ASSERT(RegisterAddress < MaximumSimGpioAddress);
+
+    Bit = SIM_GPIO_REGISTER_BIT(RegisterAddress);
+    if (RegisterAddress == StatusRegister) {
+        if ((GpioBank->ShadowDirty & Bit) == 0) {
+            GpioBank->ShadowRegisters[StatusRegister] = 0;
+        }
+
+        GpioBank->ShadowRegisters[StatusRegister] |= Data;
+
+    } else {
+        GpioBank->ShadowRegisters[RegisterAddress] = Data;
+        GpioBank->ShadowValid |= Bit;
+    }
+
+    GpioBank->ShadowDirty |= Bit;
+    return;
+}
+
+NTSTATUS
+SimGpioBankFlush (
+    _In_ PSIM_GPIO_BANK GpioBank
+    )
+
+/*++
+
+Routine Description:
+
+    This routine sends the staged register writes to the controller. Each run
+    of staged registers with contiguous addresses is sent as one multi-byte
+    SPB write. Gaps between staged registers are filled with the shadow value
+    of non-volatile registers when it is valid (rewriting the current value
+    has no effect), so that the run is not split.
+
+    Registers are written in ascending address order within a write.
+
+    N.B. This routine is called at PASSIVE_LEVEL for off-SoC GPIOs but is not
+         marked as PAGED_CODE as it could be executed late in the hibernate or
+         early in resume sequence (or the deep-idle sequence).
+
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank.
+
+Return Value:
+
+    NTSTATUS code.
+
+--*/
+
+{
+
+    UCHAR Fillable;
+    ULONG First;
+    ULONG Last;
+    ULONG Next;
+    UCHAR RunMask;
+    NTSTATUS Status;
+
+    Status = STATUS_SUCCESS;
+    Fillable = GpioBank->ShadowValid & ~SIM_GPIO_VOLATILE_REGISTERS;
+    First = 0;
+    while ((GpioBank->ShadowDirty != 0) && (First < MaximumSimGpioAddress)) {
+        if ((GpioBank->ShadowDirty & SIM_GPIO_REGISTER_BIT(First)) == 0) {
+            First += 1;
+            continue;
+        }
+
+        //
+        // Extend the run over staged registers, and over fillable registers
+        // that are followed by a staged register.
+        //
+
+        Last = First;
+        for (Next = First + 1; Next < MaximumSimGpioAddress; Next += 1) {
+            if ((GpioBank->ShadowDirty & SIM_GPIO_REGISTER_BIT(Next)) != 0) {
+                Last = Next;
+
+            } else if ((Fillable & SIM_GPIO_REGISTER_BIT(Next)) == 0) {
+                break;
+            }
+        }
+
+        RunMask = (UCHAR)(((1 << (Last - First + 1)) - 1) << First);
+        Status = SimGpioSpbWrite(GpioBank->GpioContext,
+                                 GpioBank->AddressBase + (USHORT)First,
+                                 &GpioBank->ShadowRegisters[First],
+                                 Last - First + 1);
+
+        GpioBank->BusWrites += 1;
+        GpioBank->ShadowDirty &= ~RunMask;
+        if (!NT_SUCCESS(Status)) {
+
+            //
+            // The controller state for the run is unknown, drop the shadow
+            // for it and any writes still staged.
+            //
+
+            GpioBank->ShadowValid &= ~(RunMask | GpioBank->ShadowDirty);
+            GpioBank->ShadowDirty = 0;
+            TraceEvents(TRACE_LEVEL_ERROR,
+                        TRACE_FLAG_SPB,
+                        "%s: Writing registers %lu-%lu failed! Status:%#x\n",
+                        __FUNCTION__,
+                        First,
+                        Last,
+                        Status);
+
+            goto BankFlushEnd;
+        }
+
+        First = Last + 1;
+    }
+
+BankFlushEnd:
+    return Status;
+}
+
+NTSTATUS
+SimGpioBankWriteRegister (
+    _In_ PSIM_GPIO_BANK GpioBank,
+    _In_ SIM_GPIO_REGISTER_ADDRESS RegisterAddress,
+    _In_ UCHAR Data
+    )
+
+/*++
+
+Routine Description:
+
+    This routine writes a single bank register (together with any writes
+    already staged) and updates the shadow.
 
+Arguments:
+
+    GpioBank - Supplies a pointer to the GPIO bank to be written to.
+
+    RegisterAddress - Supplies the bank-relative register address to write to.
+
+    Data - Supplies the data to be written.
+
+Return Value:
+
+    NTSTATUS code.
+
+--*/
+
+{
+
+    if (RegisterAddress >= MaximumSimGpioAddress) {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    SimGpioBankStageRegister(GpioBank, RegisterAddress, Data);
+    return SimGpioBankFlush(GpioBank);
+}
@@ -203,25 +203,217 @@ CMyQueue::Initialize(
          FxDevice->GetDefaultIoTarget(&m_FxIoTarget);        
     }
 
+    //
+    // Pick the transform from the device's hardware key. By default the
+    // bits of the data flowing through the filter are inverted.
+    //
+
+    if (SUCCEEDED(hr)) 
+    {
+        CBufferTransform Transform;
+
+        ReadTransformSettings(FxDevice, Transform);
+
+        hr = SetTransform(Transform);
+
+        if (FAILED(hr))
+        {
+            Trace(
+                TRACE_LEVEL_WARNING, 
+                "%!FUNC!: Configured buffer transform cannot be inverted, inverting bits instead"
+                );
+
+            Transform.SetXor(0xFF);
+
+            hr = SetTransform(Transform);
+        }
+    }
+
+    return hr;
+}
+
+static
+HRESULT
+GetDwordSetting(
+    _In_ IWDFNamedPropertyStore *PropStore,
+    _In_ PCWSTR Name,
+    _Out_ ULONG *Value
+    )
+/*++
+ 
+  Routine Description:
+
+    This helper reads a REG_DWORD value from a property store. Value is
+    left untouched if the value is missing or has another type.
+
+  Arguments:
+
+    PropStore - property store to read from
+
+    Name - name of the value
+
+    Value - receives the value
+
+  Return Value:
+
+    S_OK, or an error if the value could not be read
+
+--*/
+{
+    PROPVARIANT value;
+
+    PropVariantInit(&value);
+
+    HRESULT hr = PropStore->GetNamedValue(Name, &value);
+
+    if (SUCCEEDED(hr))
+    {
+        if (VT_UI4 == value.vt)
+        {
+            *Value = value.ulVal;
+        }
+        else
+        {
+            hr = HRESULT_FROM_WIN32(ERROR_INVALID_DATA);
+        }
+
+        PropVariantClear(&value);
+    }
+
     return hr;
 }
 
 void
-CMyQueue::InvertBits(
-    _Inout_ IWDFMemory* FxMemory,
-    _In_    SIZE_T      NumBytes
+CMyQueue::ReadTransformSettings(
+    _In_ IWDFDevice *FxDevice,
+    _Out_ CBufferTransform& Transform
+    )
+/*++
+ 
+  Routine Description:
+
+    This helper builds the write transform from the values under the
+    device's hardware key (see queue.h for their names). Missing or
+    invalid values leave the default, XOR with 0xFF.
+
+  Arguments:
+
+    FxDevice - the device which this Queue is for.
+
+    Transform - receives the write transform
+
+  Return Value:
+
+    None
+
+--*/
+{
+    IWDFNamedPropertyStore *propStore = NULL;
+    ULONG type = BufferTransformXor;
+    ULONG mask = 0xFF;
+    ULONG kernel = 0;
+    PROPVARIANT table;
+    HRESULT hr;
+
+    Transform.SetXor(0xFF);
+
+    hr = FxDevice->RetrieveDevicePropertyStore(
+                        NULL,
+                        WdfPropertyStoreOpenExisting,
+                        &propStore,
+                        NULL
+                        );
+    if (FAILED(hr))
+    {
+        return;
+    }
+
+    GetDwordSetting(propStore, FILTER_TRANSFORM_TYPE_VALUE, &type);
+    GetDwordSetting(propStore, FILTER_TRANSFORM_MASK_VALUE, &mask);
+
+    switch (type)
+    {
+    case BufferTransformNone:
+        Transform = CBufferTransform();
+        break;
+
+    case BufferTransformXor:
+        Transform.SetXor((BYTE) mask);
+        break;
+
+    case BufferTransformByteSwap16:
+        Transform.SetByteSwap(2);
+        break;
+
+    case BufferTransformByteSwap32:
+        Transform.SetByteSwap(4);
+        break;
+
+    case BufferTransformTable:
+        PropVariantInit(&table);
+
+        hr = propStore->GetNamedValue(FILTER_TRANSFORM_TABLE_VALUE, &table);
+
+        if (SUCCEEDED(hr) &&
+            (VT_VECTOR | VT_UI1) == table.vt &&
+            256 == table.caub.cElems)
+        {
+            Transform.SetTable(table.caub.pElems);
+        }
+        else
+        {
+            Trace(
+                TRACE_LEVEL_WARNING, 
+                "%!FUNC!: Table transform needs a 256 byte %S value",
+                FILTER_TRANSFORM_TABLE_VALUE
+                );
+        }
+
+        PropVariantClear(&table);
+        break;
+
+    default:
+        Trace(
+            TRACE_LEVEL_WARNING, 
+            "%!FUNC!: Unknown buffer transform type %d",
+            type
+            );
+        break;
+    }
+
+    if (SUCCEEDED(GetDwordSetting(propStore, FILTER_TRANSFORM_KERNEL_VALUE, &kernel)) &&
+        FAILED(Transform.SetKernel((BUFFER_TRANSFORM_KERNEL) kernel)))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING, 
+            "%!FUNC!: Kernel %d is not supported, using kernel %d",
+            kernel,
+            Transform.GetKernel()
+            );
+    }
+
+    propStore->Release();
+}
+
+void
+CMyQueue::TransformBuffer(
+    _Inout_ IWDFMemory*       FxMemory,
+    _In_    SIZE_T            NumBytes,
+    _In_    CBufferTransform& Transform
     )
 /*++
  
   Routine Description:
 
-    This helper method inverts bits in the buffer of an FxMemory object
+    This helper method transforms the buffer of an FxMemory object in place
 
   Arguments:
 
-    FxMemory - Framework memory object whose buffer's bits are to be inverted
+    FxMemory - Framework memory object whose buffer is to be transformed
+
+    NumBytes - Number of bytes to transform
 
-    NumBytes - Number of bytes for which bits are to be inverted
+    Transform - Transform to apply
 
   Return Value:
 
@@ -229,13 +421,68 @@ CMyQueue::InvertBits(
 
 --*/
 {
+    SIZE_T BufferSize = 0;
     PBYTE Buffer = (PBYTE) 
-        FxMemory->GetDataBuffer(NULL);
+        FxMemory->GetDataBuffer(&BufferSize);
+
+    if (NumBytes > BufferSize)
+    {
+        NumBytes = BufferSize;
+    }
+
+    Transform.Apply(Buffer, NumBytes);
+}
 
-    for (SIZE_T i = 0; i < NumBytes; i++)
+HRESULT
+CMyQueue::SetTransform(
+    _In_ const CBufferTransform& WriteTransform
+    )
+/*++
+ 
+  Routine Description:
+
+    This method replaces the transform applied to the data flowing through
+    the filter. The read transform is derived as the inverse of the write
+    transform.
+
+  Arguments:
+
+    WriteTransform - Transform to apply to write buffers
+
+  Return Value:
+
+    S_OK, or E_INVALIDARG if the transform cannot be inverted
+
+--*/
+{
+    CBufferTransform ReadTransform;
+
+    HRESULT hr = ReadTransform.SetInverseOf(WriteTransform);
+
+    //
+    // Reads use the same kernel as writes, so a kernel forced from the
+    // registry applies both ways
+    //
+
+    if (SUCCEEDED(hr))
+    {
+        hr = ReadTransform.SetKernel(WriteTransform.GetKernel());
+    }
+
+    if (SUCCEEDED(hr))
     {
-        memset(Buffer + i, ~(Buffer[i]), sizeof(*Buffer));
-    }    
+        m_WriteTransform = WriteTransform;
+        m_ReadTransform = ReadTransform;
+
+        Trace(
+            TRACE_LEVEL_INFORMATION, 
+            "%!FUNC!: Buffer transform type %d using kernel %d",
+            m_WriteTransform.GetType(),
+            m_WriteTransform.GetKernel()
+            );
+    }
+
+    return hr;
 }
 
 void
@@ -249,7 +496,7 @@ CMyQueue::OnWrite(
   Routine Description:
 
     This method is called by Framework Queue object to deliver the Write request
-    This method inverts the bits in write buffer and forwards the request down the device stack
+    This method transforms the write buffer in place and forwards the request down the device stack
     In case of any failure prior to ForwardRequest, it completets the request with failure
 
   Arguments:
@@ -271,10 +518,10 @@ CMyQueue::OnWrite(
     FxRequest->GetInputMemory(&FxInputMemory);
     
     //
-    // Invert bits of the buffer to be written to device
+    // Transform the buffer to be written to device
     //
     
-    InvertBits(FxInputMemory, NumOfBytesToWrite);
+    TransformBuffer(FxInputMemory, NumOfBytesToWrite, m_WriteTransform);
 
     //
     // Forward request down the stack
@@ -416,9 +663,9 @@ CMyQueue::HandleReadRequestCompletion(
   Routine Description:
 
     This helper method is called by OnCompletion method to complete Read request 
-    We invert the bits in the read buffer
+    We apply the inverse transform to the read buffer
     This is so that the client reads back the data it wrote since
-    we inverted bits during write to device
+    we transformed it during write to device
 
   Arguments:
 
@@ -445,7 +692,7 @@ CMyQueue::HandleReadRequestCompletion(
     // Check 
     //  1. whether the lower device succeeded the Request (otherwise we will just complete
     //     the Request with failure
-    //  2. If data read is of non-zero length, for us to bother to invert its bits
+    //  2. If data read is of non-zero length, for us to bother to transform it
     //
     
     if (SUCCEEDED(hrCompletion) &&
@@ -456,7 +703,7 @@ CMyQueue::HandleReadRequestCompletion(
         
         FxRequest->GetOutputMemory(&FxOutputMemory );
 
-        InvertBits(FxOutputMemory, BytesRead);
+        TransformBuffer(FxOutputMemory, BytesRead, m_ReadTransform);
         
         FxOutputMemory->Release();
     }
@@ -504,7 +751,7 @@ CMyQueue::OnCompletion(
     UNREFERENCED_PARAMETER(Context);
 
     //
-    // If it is a read request, we invert the bits read since we inverted them during write
+    // If it is a read request, we undo the transform applied during write
     // so that application would read the same data as it wrote
     //
 
@@ -19,6 +19,21 @@ Environment:
 
 #pragma once
 
+//
+// Values under the device's hardware key that choose the transform applied
+// to the data flowing through the filter. All are optional.
+//
+//   BufferTransform        REG_DWORD   a BUFFER_TRANSFORM_TYPE, default XOR
+//   BufferTransformXorMask REG_DWORD   mask for XOR, default 0xFF
+//   BufferTransformTable   REG_BINARY  256 byte permutation for the table
+//   BufferTransformKernel  REG_DWORD   a narrower BUFFER_TRANSFORM_KERNEL
+//
+
+#define FILTER_TRANSFORM_TYPE_VALUE     L"BufferTransform"
+#define FILTER_TRANSFORM_MASK_VALUE     L"BufferTransformXorMask"
+#define FILTER_TRANSFORM_TABLE_VALUE    L"BufferTransformTable"
+#define FILTER_TRANSFORM_KERNEL_VALUE   L"BufferTransformKernel"
+
 //
 // Class for the queue callbacks.
 // It implements
@@ -58,6 +73,17 @@ private:
     
     IWDFIoTarget    *m_FxIoTarget;
 
+    //
+    // Transform applied to write buffers before they are forwarded and the
+    // transform applied to read buffers on completion. The read transform
+    // is always the inverse of the write transform so that the application
+    // reads back the data it wrote.
+    //
+
+    CBufferTransform m_WriteTransform;
+
+    CBufferTransform m_ReadTransform;
+
 //
 // Private methods.
 //
@@ -128,13 +154,24 @@ private:
         );
 
     //
-    // Helper method to inverts bits in the buffer of a framework Memory object
+    // Helper method to read the transform settings from the hardware key
     //
 
     void
-    InvertBits(
-        _Inout_ IWDFMemory* FxMemory,
-        _In_    SIZE_T      NumBytes
+    ReadTransformSettings(
+        _In_ IWDFDevice *FxDevice,
+        _Out_ CBufferTransform& Transform
+        );
+
+    //
+    // Helper method to transform the buffer of a framework Memory object in place
+    //
+
+    void
+    TransformBuffer(
+        _Inout_ IWDFMemory*       FxMemory,
+        _In_    SIZE_T            NumBytes,
+        _In_    CBufferTransform& Transform
         );
 
     //
@@ -172,6 +209,16 @@ public:
         return S_OK;
     }
 
+    //
+    // Replaces the transform applied to data flowing through the filter.
+    // The inverse is derived for the read path.
+    //
+
+    HRESULT
+    SetTransform(
+        _In_ const CBufferTransform& WriteTransform
+        );
+
 //
 // COM methods
 //
@@ -0,0 +1,315 @@
+/*++
+
+Module Name:
+
+    TransformTest.cpp
+
+Abstract:
+
+    Host test for the filter's buffer transform. Every transform type is
+    run with every kernel the processor supports. The buffers have all
+    lengths from 0 to 300 bytes and a few larger ones, and start at every
+    offset within a 32 byte line. The result must match a byte at a time
+    reference, and the bytes around the buffer must be left alone. Also
+    checks that each transform's inverse restores the data, that bad
+    settings are refused, and which kernels each type may use.
+
+    Builds with the stub headers in this directory:
+
+        c++ -O2 -mavx2 -Wall -Wextra -I test test/TransformTest.cpp transform.cpp -o TransformTest
+
+    -mavx2 only lets the vector kernels compile; the test itself runs
+    the AVX2 kernel only when the processor has it.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#include <windows.h>
+
+#include "../transform.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define TEST_GUARD      64
+#define TEST_MAX_LENGTH 8192
+
+static int failures;
+
+static const char *KernelNames[BufferTransformKernelMax] = { "byte", "word", "sse", "avx2" };
+
+static void
+Check(
+    _In_ const char *Name,
+    _In_ long long Actual,
+    _In_ long long Expected
+    )
+{
+    if (Actual != Expected)
+    {
+        failures++;
+        printf("FAIL %s: got %lld, expected %lld\n", Name, Actual, Expected);
+    }
+}
+
+static void
+Reference(
+    _In_ BUFFER_TRANSFORM_TYPE Type,
+    _In_ BYTE Mask,
+    _In_reads_(256) const BYTE *Table,
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    SIZE_T i;
+
+    switch (Type)
+    {
+    case BufferTransformXor:
+        for (i = 0; i < NumBytes; i++)
+        {
+            Buffer[i] ^= Mask;
+        }
+        break;
+
+    case BufferTransformByteSwap16:
+        for (i = 0; i + 2 <= NumBytes; i += 2)
+        {
+            BYTE b = Buffer[i];
+
+            Buffer[i] = Buffer[i + 1];
+            Buffer[i + 1] = b;
+        }
+        break;
+
+    case BufferTransformByteSwap32:
+        for (i = 0; i + 4 <= NumBytes; i += 4)
+        {
+            BYTE b0 = Buffer[i];
+            BYTE b1 = Buffer[i + 1];
+
+            Buffer[i] = Buffer[i + 3];
+            Buffer[i + 1] = Buffer[i + 2];
+            Buffer[i + 2] = b1;
+            Buffer[i + 3] = b0;
+        }
+        break;
+
+    case BufferTransformTable:
+        for (i = 0; i < NumBytes; i++)
+        {
+            Buffer[i] = Table[Buffer[i]];
+        }
+        break;
+
+    default:
+        break;
+    }
+}
+
+static void
+Configure(
+    _Inout_ CBufferTransform &Transform,
+    _In_ BUFFER_TRANSFORM_TYPE Type,
+    _In_ BYTE Mask,
+    _In_reads_(256) const BYTE *Table
+    )
+{
+    switch (Type)
+    {
+    case BufferTransformXor:
+        Transform.SetXor(Mask);
+        break;
+
+    case BufferTransformByteSwap16:
+        Transform.SetByteSwap(2);
+        break;
+
+    case BufferTransformByteSwap32:
+        Transform.SetByteSwap(4);
+        break;
+
+    case BufferTransformTable:
+        Transform.SetTable(Table);
+        break;
+
+    default:
+        Transform = CBufferTransform();
+        break;
+    }
+}
+
+static void
+TestKernels(
+    _In_reads_(256) const BYTE *Table
+    )
+{
+    static BYTE source[TEST_MAX_LENGTH + 2 * TEST_GUARD];
+    static BYTE actual[TEST_MAX_LENGTH + 2 * TEST_GUARD];
+    static BYTE expected[TEST_MAX_LENGTH + 2 * TEST_GUARD];
+    static const SIZE_T largeLengths[] = { 511, 512, 513, 1024, 4096, 4099, TEST_MAX_LENGTH - 32 };
+    char name[128];
+
+    for (SIZE_T i = 0; i < sizeof(source); i++)
+    {
+        source[i] = (BYTE) rand();
+    }
+
+    for (int type = BufferTransformNone; type <= BufferTransformTable; type++)
+    {
+        for (int kernel = BufferTransformKernelByte; kernel < BufferTransformKernelMax; kernel++)
+        {
+            CBufferTransform transform;
+            ULONG mismatches = 0;
+            ULONG overwrites = 0;
+
+            Configure(transform, (BUFFER_TRANSFORM_TYPE) type, 0x5A, Table);
+
+            if (FAILED(transform.SetKernel((BUFFER_TRANSFORM_KERNEL) kernel)))
+            {
+                continue;
+            }
+
+            for (SIZE_T n = 0; n < 300 + ARRAY_SIZE(largeLengths); n++)
+            {
+                SIZE_T length = n < 300 ? n : largeLengths[n - 300];
+
+                for (SIZE_T offset = 0; offset < 32; offset++)
+                {
+                    memcpy(actual, source, sizeof(actual));
+                    memcpy(expected, source, sizeof(expected));
+
+                    transform.Apply(actual + TEST_GUARD + offset, length);
+                    Reference((BUFFER_TRANSFORM_TYPE) type, 0x5A, Table, expected + TEST_GUARD + offset, length);
+
+                    if (0 != memcmp(actual + TEST_GUARD + offset, expected + TEST_GUARD + offset, length))
+                    {
+                        mismatches++;
+                    }
+                    if (0 != memcmp(actual, source, TEST_GUARD + offset) ||
+                        0 != memcmp(actual + TEST_GUARD + offset + length,
+                                    source + TEST_GUARD + offset + length,
+                                    sizeof(actual) - (TEST_GUARD + offset + length)))
+                    {
+                        overwrites++;
+                    }
+                }
+            }
+
+            snprintf(name, sizeof(name), "type %d %s kernel mismatches", type, KernelNames[kernel]);
+            Check(name, mismatches, 0);
+            snprintf(name, sizeof(name), "type %d %s kernel writes outside", type, KernelNames[kernel]);
+            Check(name, overwrites, 0);
+        }
+    }
+}
+
+static void
+TestInverse(
+    _In_reads_(256) const BYTE *Table
+    )
+{
+    BYTE original[1000];
+    BYTE buffer[1000];
+    char name[128];
+
+    for (SIZE_T i = 0; i < sizeof(original); i++)
+    {
+        original[i] = (BYTE) rand();
+    }
+
+    for (int type = BufferTransformXor; type <= BufferTransformTable; type++)
+    {
+        CBufferTransform forward;
+        CBufferTransform inverse;
+
+        Configure(forward, (BUFFER_TRANSFORM_TYPE) type, 0xFF, Table);
+
+        snprintf(name, sizeof(name), "type %d inverse", type);
+        Check(name, inverse.SetInverseOf(forward), S_OK);
+        Check("inverse type", inverse.GetType(), type);
+
+        memcpy(buffer, original, sizeof(buffer));
+        forward.Apply(buffer, sizeof(buffer) - 3);
+
+        // 0xFF XOR and the permutation change every byte, swaps most of them
+        snprintf(name, sizeof(name), "type %d changes data", type);
+        Check(name, 0 != memcmp(buffer, original, sizeof(buffer)), 1);
+
+        inverse.Apply(buffer, sizeof(buffer) - 3);
+        snprintf(name, sizeof(name), "type %d round trip", type);
+        Check(name, memcmp(buffer, original, sizeof(buffer)), 0);
+    }
+}
+
+static void
+TestSettings(
+    _In_reads_(256) const BYTE *Table
+    )
+{
+    CBufferTransform transform;
+    CBufferTransform inverse;
+    BYTE notPermutation[256];
+
+    Check("default type", transform.GetType(), BufferTransformNone);
+
+    Check("swap 2", transform.SetByteSwap(2), S_OK);
+    Check("swap 2 type", transform.GetType(), BufferTransformByteSwap16);
+    Check("swap 4", transform.SetByteSwap(4), S_OK);
+    Check("swap 4 type", transform.GetType(), BufferTransformByteSwap32);
+    Check("swap 3", transform.SetByteSwap(3), E_INVALIDARG);
+    Check("swap 8", transform.SetByteSwap(8), E_INVALIDARG);
+    Check("swap 3 keeps type", transform.GetType(), BufferTransformByteSwap32);
+
+    // A table has no vector kernel
+    transform.SetTable(Table);
+    Check("table kernel", transform.GetKernel() <= BufferTransformKernelWord, 1);
+    Check("table sse kernel", transform.SetKernel(BufferTransformKernelSse), E_INVALIDARG);
+    Check("table byte kernel", transform.SetKernel(BufferTransformKernelByte), S_OK);
+    Check("past last kernel", transform.SetKernel(BufferTransformKernelMax), E_INVALIDARG);
+
+    // Two bytes mapping to the same value cannot be undone
+    memcpy(notPermutation, Table, sizeof(notPermutation));
+    notPermutation[7] = notPermutation[8];
+    transform.SetTable(notPermutation);
+    Check("not a permutation", inverse.SetInverseOf(transform), E_INVALIDARG);
+
+    // XOR and swaps get the widest kernel there is
+    transform.SetXor(0xFF);
+    Check("xor kernel", transform.GetKernel() >= BufferTransformKernelSse, 1);
+    printf("widest kernel: %s\n", KernelNames[transform.GetKernel()]);
+}
+
+int
+main(
+    VOID
+    )
+{
+    BYTE table[256];
+
+    //
+    // A permutation of the byte values: i * 167 + 13 mod 256
+    //
+
+    for (ULONG i = 0; i < 256; i++)
+    {
+        table[i] = (BYTE) (i * 167 + 13);
+    }
+
+    srand(1);
+
+    TestSettings(table);
+    TestInverse(table);
+    TestKernels(table);
+
+    if (failures != 0)
+    {
+        return 1;
+    }
+
+    printf("Buffer transform test passed\n");
+    return 0;
+}
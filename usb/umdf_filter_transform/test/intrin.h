@@ -0,0 +1,54 @@
+/*++
+
+Module Name:
+
+    intrin.h
+
+Abstract:
+
+    Host stand-in for the MSVC intrinsics the buffer transform uses, on top
+    of the GCC and Clang x86 intrinsics. Build with -mavx2 so the SSE and
+    AVX2 kernels can be compiled.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <immintrin.h>
+
+static inline void
+HostCpuidex(
+    int CpuInfo[4],
+    int Leaf,
+    int SubLeaf
+    )
+{
+    __asm__ __volatile__("cpuid"
+                         : "=a"(CpuInfo[0]), "=b"(CpuInfo[1]), "=c"(CpuInfo[2]), "=d"(CpuInfo[3])
+                         : "a"(Leaf), "c"(SubLeaf));
+}
+
+static inline unsigned long long
+HostXgetbv(
+    unsigned int Register
+    )
+{
+    unsigned int low;
+    unsigned int high;
+
+    __asm__ __volatile__("xgetbv" : "=a"(low), "=d"(high) : "c"(Register));
+    return ((unsigned long long) high << 32) | low;
+}
+
+#undef __cpuid
+#undef __cpuidex
+#undef _xgetbv
+
+#define __cpuid(info, leaf)             HostCpuidex((info), (leaf), 0)
+#define __cpuidex(info, leaf, subleaf)  HostCpuidex((info), (leaf), (subleaf))
+#define _xgetbv(reg)                    HostXgetbv(reg)
+#define _byteswap_ulong(value)          __builtin_bswap32(value)
@@ -0,0 +1,54 @@
+/*++
+
+Module Name:
+
+    windows.h
+
+Abstract:
+
+    Host stand-in for the Windows types, SAL annotations and helpers the
+    buffer transform uses, so transform.cpp builds without the SDK.
+
+Environment:
+
+    User mode, host test only
+
+--*/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define _In_
+#define _Inout_
+#define _Inout_updates_bytes_(size)
+#define _In_reads_(size)
+
+#define VOID void
+
+typedef uint8_t BYTE, *PBYTE;
+typedef uint16_t USHORT;
+typedef int32_t LONG, HRESULT;
+typedef uint32_t ULONG;
+typedef uint64_t ULONGLONG;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+
+#define S_OK            ((HRESULT)0)
+#define E_INVALIDARG    ((HRESULT)0x80070057)
+#define SUCCEEDED(hr)   ((HRESULT)(hr) >= 0)
+#define FAILED(hr)      ((HRESULT)(hr) < 0)
+
+#define CopyMemory(destination, source, length)     memcpy((destination), (source), (length))
+#define ZeroMemory(destination, length)             memset((destination), 0, (length))
+
+#define InterlockedExchange(target, value)          __atomic_exchange_n((target), (value), __ATOMIC_SEQ_CST)
+
+//
+// __declspec(align(n)) becomes __attribute__((aligned(n)))
+//
+
+#define __declspec(spec)                            __declspec_##spec
+#define __declspec_align(n)                         __attribute__((aligned(n)))
@@ -0,0 +1,511 @@
+/*++
+
+Copyright (C) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+
+    Transform.cpp
+
+Abstract:
+
+    This module contains the implementation of the OSR USB Filter Sample
+    driver's in-flight buffer transform helper, shared by the UMDF and KMDF
+    function driver variants of the filter.
+
+Environment:
+
+   Windows User-Mode Driver Framework (WUDF)
+
+--*/
+
+#include <windows.h>
+#include <intrin.h>
+
+#include "transform.h"
+
+//
+// CPUID feature bits used for kernel selection
+//
+
+#define CPUID1_ECX_SSSE3        (1 << 9)
+#define CPUID1_ECX_OSXSAVE      (1 << 27)
+#define CPUID1_ECX_AVX          (1 << 28)
+#define CPUID7_EBX_AVX2         (1 << 5)
+#define XCR0_SSE_AVX_STATE      0x6
+
+//
+// pshufb control masks reversing the bytes of each 16-bit / 32-bit element.
+// The AVX2 variant shuffles within each 128-bit lane so the same pattern
+// is repeated in both lanes.
+//
+
+static const __declspec(align(32)) BYTE g_ByteSwap16Mask[32] =
+{
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14,
+    1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14
+};
+
+static const __declspec(align(32)) BYTE g_ByteSwap32Mask[32] =
+{
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12,
+    3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12
+};
+
+static
+BUFFER_TRANSFORM_KERNEL
+GetProcessorKernel(
+    VOID
+    )
+/*++
+
+  Routine Description:
+
+    This helper returns the widest kernel the processor and OS support.
+    SSE kernels need SSSE3 (for pshufb), AVX2 kernels additionally need the
+    OS to save the YMM state. The result is computed once and cached.
+
+  Arguments:
+
+    None
+
+  Return Value:
+
+    Widest supported kernel
+
+--*/
+{
+    static LONG s_Kernel = -1;
+
+    if (s_Kernel >= 0)
+    {
+        return (BUFFER_TRANSFORM_KERNEL) s_Kernel;
+    }
+
+    BUFFER_TRANSFORM_KERNEL kernel = BufferTransformKernelWord;
+    int cpuInfo[4];
+
+    __cpuid(cpuInfo, 0);
+    int maxLeaf = cpuInfo[0];
+
+    __cpuid(cpuInfo, 1);
+
+    if (0 != (cpuInfo[2] & CPUID1_ECX_SSSE3))
+    {
+        kernel = BufferTransformKernelSse;
+
+        if (maxLeaf >= 7 &&
+            (cpuInfo[2] & (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX)) ==
+                (CPUID1_ECX_OSXSAVE | CPUID1_ECX_AVX) &&
+            (_xgetbv(0) & XCR0_SSE_AVX_STATE) == XCR0_SSE_AVX_STATE)
+        {
+            __cpuidex(cpuInfo, 7, 0);
+
+            if (0 != (cpuInfo[1] & CPUID7_EBX_AVX2))
+            {
+                kernel = BufferTransformKernelAvx2;
+            }
+        }
+    }
+
+    InterlockedExchange(&s_Kernel, (LONG) kernel);
+
+    return kernel;
+}
+
+BUFFER_TRANSFORM_KERNEL
+CBufferTransform::GetBestKernel(
+    _In_ BUFFER_TRANSFORM_TYPE Type
+    )
+/*++
+
+  Routine Description:
+
+    This helper returns the widest kernel available for a transform type.
+    Table lookups have no vector kernel and top out at word width.
+
+  Arguments:
+
+    Type - transform type
+
+  Return Value:
+
+    Kernel to use
+
+--*/
+{
+    BUFFER_TRANSFORM_KERNEL kernel = GetProcessorKernel();
+
+    if (BufferTransformTable == Type && kernel > BufferTransformKernelWord)
+    {
+        kernel = BufferTransformKernelWord;
+    }
+
+    return kernel;
+}
+
+void
+CBufferTransform::SetXor(
+    _In_ BYTE Mask
+    )
+{
+    m_Type = BufferTransformXor;
+    m_XorMask = Mask;
+    m_Kernel = GetBestKernel(m_Type);
+}
+
+HRESULT
+CBufferTransform::SetByteSwap(
+    _In_ ULONG ElementSize
+    )
+{
+    if (2 != ElementSize && 4 != ElementSize)
+    {
+        return E_INVALIDARG;
+    }
+
+    m_Type = (2 == ElementSize) ? BufferTransformByteSwap16 :
+                                  BufferTransformByteSwap32;
+    m_Kernel = GetBestKernel(m_Type);
+
+    return S_OK;
+}
+
+void
+CBufferTransform::SetTable(
+    _In_reads_(256) const BYTE *Table
+    )
+{
+    m_Type = BufferTransformTable;
+    CopyMemory(m_Table, Table, sizeof(m_Table));
+    m_Kernel = GetBestKernel(m_Type);
+}
+
+HRESULT
+CBufferTransform::SetInverseOf(
+    _In_ const CBufferTransform &Other
+    )
+/*++
+
+  Routine Description:
+
+    This method configures this transform to undo Other. XOR and byte
+    swaps are their own inverse; a lookup table is inverted if it is a
+    permutation.
+
+  Arguments:
+
+    Other - transform to invert
+
+  Return Value:
+
+    S_OK, or E_INVALIDARG if Other is not invertible
+
+--*/
+{
+    if (BufferTransformTable != Other.m_Type)
+    {
+        m_Type = Other.m_Type;
+        m_XorMask = Other.m_XorMask;
+        m_Kernel = GetBestKernel(m_Type);
+        return S_OK;
+    }
+
+    BYTE inverse[256];
+    BYTE seen[256];
+
+    ZeroMemory(seen, sizeof(seen));
+
+    for (ULONG i = 0; i < ARRAY_SIZE(inverse); i++)
+    {
+        BYTE value = Other.m_Table[i];
+
+        if (0 != seen[value])
+        {
+            return E_INVALIDARG;
+        }
+
+        seen[value] = 1;
+        inverse[value] = (BYTE) i;
+    }
+
+    SetTable(inverse);
+
+    return S_OK;
+}
+
+HRESULT
+CBufferTransform::SetKernel(
+    _In_ BUFFER_TRANSFORM_KERNEL Kernel
+    )
+{
+    if (Kernel >= BufferTransformKernelMax ||
+        Kernel > GetBestKernel(m_Type))
+    {
+        return E_INVALIDARG;
+    }
+
+    m_Kernel = Kernel;
+
+    return S_OK;
+}
+
+void
+CBufferTransform::Apply(
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    switch (m_Type)
+    {
+    case BufferTransformXor:
+        ApplyXor(Buffer, NumBytes);
+        break;
+
+    case BufferTransformByteSwap16:
+        ApplyByteSwap16(Buffer, NumBytes);
+        break;
+
+    case BufferTransformByteSwap32:
+        ApplyByteSwap32(Buffer, NumBytes);
+        break;
+
+    case BufferTransformTable:
+        ApplyTable(Buffer, NumBytes);
+        break;
+
+    default:
+        break;
+    }
+}
+
+//
+// Kernels. Each kernel processes as much of the buffer as it can with its
+// own width and falls through to the narrower kernels for the remainder.
+// Vector loads and stores are unaligned since request buffers carry no
+// alignment guarantee.
+//
+
+void
+CBufferTransform::ApplyXor(
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    SIZE_T i = 0;
+
+    if (m_Kernel >= BufferTransformKernelAvx2)
+    {
+        __m256i mask = _mm256_set1_epi8((char) m_XorMask);
+
+        for (; i + 4 * sizeof(__m256i) <= NumBytes; i += 4 * sizeof(__m256i))
+        {
+            __m256i *p = (__m256i *) (Buffer + i);
+            __m256i v0 = _mm256_loadu_si256(p + 0);
+            __m256i v1 = _mm256_loadu_si256(p + 1);
+            __m256i v2 = _mm256_loadu_si256(p + 2);
+            __m256i v3 = _mm256_loadu_si256(p + 3);
+
+            _mm256_storeu_si256(p + 0, _mm256_xor_si256(v0, mask));
+            _mm256_storeu_si256(p + 1, _mm256_xor_si256(v1, mask));
+            _mm256_storeu_si256(p + 2, _mm256_xor_si256(v2, mask));
+            _mm256_storeu_si256(p + 3, _mm256_xor_si256(v3, mask));
+        }
+
+        for (; i + sizeof(__m256i) <= NumBytes; i += sizeof(__m256i))
+        {
+            __m256i *p = (__m256i *) (Buffer + i);
+
+            _mm256_storeu_si256(p, _mm256_xor_si256(_mm256_loadu_si256(p), mask));
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (m_Kernel >= BufferTransformKernelSse)
+    {
+        __m128i mask = _mm_set1_epi8((char) m_XorMask);
+
+        for (; i + sizeof(__m128i) <= NumBytes; i += sizeof(__m128i))
+        {
+            __m128i *p = (__m128i *) (Buffer + i);
+
+            _mm_storeu_si128(p, _mm_xor_si128(_mm_loadu_si128(p), mask));
+        }
+    }
+
+    if (m_Kernel >= BufferTransformKernelWord)
+    {
+        ULONG_PTR mask = ((ULONG_PTR) -1 / 0xFF) * m_XorMask;
+
+        for (; i + sizeof(ULONG_PTR) <= NumBytes; i += sizeof(ULONG_PTR))
+        {
+            ULONG_PTR word;
+
+            memcpy(&word, Buffer + i, sizeof(word));
+            word ^= mask;
+            memcpy(Buffer + i, &word, sizeof(word));
+        }
+    }
+
+    for (; i < NumBytes; i++)
+    {
+        Buffer[i] ^= m_XorMask;
+    }
+}
+
+void
+CBufferTransform::ApplyByteSwap16(
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    SIZE_T i = 0;
+
+    if (m_Kernel >= BufferTransformKernelAvx2)
+    {
+        __m256i shuffle = _mm256_load_si256((const __m256i *) g_ByteSwap16Mask);
+
+        for (; i + sizeof(__m256i) <= NumBytes; i += sizeof(__m256i))
+        {
+            __m256i *p = (__m256i *) (Buffer + i);
+
+            _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (m_Kernel >= BufferTransformKernelSse)
+    {
+        __m128i shuffle = _mm_load_si128((const __m128i *) g_ByteSwap16Mask);
+
+        for (; i + sizeof(__m128i) <= NumBytes; i += sizeof(__m128i))
+        {
+            __m128i *p = (__m128i *) (Buffer + i);
+
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), shuffle));
+        }
+    }
+
+    if (m_Kernel >= BufferTransformKernelWord)
+    {
+        const ULONG_PTR lowBytes = ((ULONG_PTR) -1 / 0xFFFF) * 0x00FF;
+
+        for (; i + sizeof(ULONG_PTR) <= NumBytes; i += sizeof(ULONG_PTR))
+        {
+            ULONG_PTR word;
+
+            memcpy(&word, Buffer + i, sizeof(word));
+            word = ((word & lowBytes) << 8) | ((word >> 8) & lowBytes);
+            memcpy(Buffer + i, &word, sizeof(word));
+        }
+    }
+
+    for (; i + sizeof(USHORT) <= NumBytes; i += sizeof(USHORT))
+    {
+        BYTE b = Buffer[i];
+
+        Buffer[i] = Buffer[i + 1];
+        Buffer[i + 1] = b;
+    }
+}
+
+void
+CBufferTransform::ApplyByteSwap32(
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    SIZE_T i = 0;
+
+    if (m_Kernel >= BufferTransformKernelAvx2)
+    {
+        __m256i shuffle = _mm256_load_si256((const __m256i *) g_ByteSwap32Mask);
+
+        for (; i + sizeof(__m256i) <= NumBytes; i += sizeof(__m256i))
+        {
+            __m256i *p = (__m256i *) (Buffer + i);
+
+            _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), shuffle));
+        }
+
+        _mm256_zeroupper();
+    }
+
+    if (m_Kernel >= BufferTransformKernelSse)
+    {
+        __m128i shuffle = _mm_load_si128((const __m128i *) g_ByteSwap32Mask);
+
+        for (; i + sizeof(__m128i) <= NumBytes; i += sizeof(__m128i))
+        {
+            __m128i *p = (__m128i *) (Buffer + i);
+
+            _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), shuffle));
+        }
+    }
+
+    if (m_Kernel >= BufferTransformKernelWord)
+    {
+        for (; i + sizeof(ULONG) <= NumBytes; i += sizeof(ULONG))
+        {
+            ULONG word;
+
+            memcpy(&word, Buffer + i, sizeof(word));
+            word = _byteswap_ulong(word);
+            memcpy(Buffer + i, &word, sizeof(word));
+        }
+    }
+
+    for (; i + sizeof(ULONG) <= NumBytes; i += sizeof(ULONG))
+    {
+        BYTE b0 = Buffer[i];
+        BYTE b1 = Buffer[i + 1];
+
+        Buffer[i] = Buffer[i + 3];
+        Buffer[i + 1] = Buffer[i + 2];
+        Buffer[i + 2] = b1;
+        Buffer[i + 3] = b0;
+    }
+}
+
+void
+CBufferTransform::ApplyTable(
+    _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+    _In_ SIZE_T NumBytes
+    )
+{
+    SIZE_T i = 0;
+
+    if (m_Kernel >= BufferTransformKernelWord)
+    {
+        //
+        // Unrolled so the independent lookups can be issued back to back
+        //
+
+        for (; i + 8 <= NumBytes; i += 8)
+        {
+            BYTE b0 = m_Table[Buffer[i + 0]];
+            BYTE b1 = m_Table[Buffer[i + 1]];
+            BYTE b2 = m_Table[Buffer[i + 2]];
+            BYTE b3 = m_Table[Buffer[i + 3]];
+            BYTE b4 = m_Table[Buffer[i + 4]];
+            BYTE b5 = m_Table[Buffer[i + 5]];
+            BYTE b6 = m_Table[Buffer[i + 6]];
+            BYTE b7 = m_Table[Buffer[i + 7]];
+
+            Buffer[i + 0] = b0;
+            Buffer[i + 1] = b1;
+            Buffer[i + 2] = b2;
+            Buffer[i + 3] = b3;
+            Buffer[i + 4] = b4;
+            Buffer[i + 5] = b5;
+            Buffer[i + 6] = b6;
+            Buffer[i + 7] = b7;
+        }
+    }
+
+    for (; i < NumBytes; i++)
+    {
+        Buffer[i] = m_Table[Buffer[i]];
+    }
+}
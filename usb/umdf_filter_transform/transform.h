@@ -0,0 +1,221 @@
+/*++
+
+Copyright (C) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+
+    Transform.h
+
+Abstract:
+
+    This module contains the type definitions for the OSR USB Filter Sample
+    driver's in-flight buffer transform helper.
+
+    A transform is applied in place to the data buffer of a request as it
+    passes through the filter (on the way down for writes, on the way up
+    for reads). Each transform is backed by a set of kernels of increasing
+    width (byte, machine word, SSE, AVX2); the widest kernel supported by
+    the processor is selected once when the transform is configured.
+
+    The helper is shared by the umdf_filter_umdf and umdf_filter_kmdf
+    samples and only depends on windows.h, so it can also be built and
+    tested on its own (see test\TransformTest.cpp).
+
+Environment:
+
+    Windows User-Mode Driver Framework (WUDF)
+
+--*/
+
+#pragma once
+
+#ifndef ARRAY_SIZE
+#define ARRAY_SIZE(x) (sizeof(x) / sizeof(x[0]))
+#endif
+
+//
+// Kind of transformation applied to the buffer
+//
+
+typedef enum _BUFFER_TRANSFORM_TYPE
+{
+    BufferTransformNone = 0,
+
+    //
+    // Every byte is XORed with an 8-bit mask. A mask of 0xFF inverts the
+    // bits, which is what the sample has always done.
+    //
+
+    BufferTransformXor,
+
+    //
+    // Every 16-bit or 32-bit element is byte-swapped. Trailing bytes that
+    // do not form a whole element are left untouched.
+    //
+
+    BufferTransformByteSwap16,
+    BufferTransformByteSwap32,
+
+    //
+    // Every byte is replaced through a 256-entry lookup table
+    //
+
+    BufferTransformTable
+
+} BUFFER_TRANSFORM_TYPE;
+
+//
+// Width of the kernel used to process the buffer
+//
+
+typedef enum _BUFFER_TRANSFORM_KERNEL
+{
+    BufferTransformKernelByte = 0,
+    BufferTransformKernelWord,
+    BufferTransformKernelSse,
+    BufferTransformKernelAvx2,
+    BufferTransformKernelMax
+
+} BUFFER_TRANSFORM_KERNEL;
+
+class CBufferTransform
+{
+
+//
+// Private data members.
+//
+private:
+
+    BUFFER_TRANSFORM_TYPE   m_Type;
+
+    BUFFER_TRANSFORM_KERNEL m_Kernel;
+
+    BYTE                    m_XorMask;
+
+    //
+    // Lookup table used by BufferTransformTable
+    //
+
+    BYTE                    m_Table[256];
+
+//
+// Private methods.
+//
+private:
+
+    static
+    BUFFER_TRANSFORM_KERNEL
+    GetBestKernel(
+        _In_ BUFFER_TRANSFORM_TYPE Type
+        );
+
+    void
+    ApplyXor(
+        _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+        _In_ SIZE_T NumBytes
+        );
+
+    void
+    ApplyByteSwap16(
+        _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+        _In_ SIZE_T NumBytes
+        );
+
+    void
+    ApplyByteSwap32(
+        _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+        _In_ SIZE_T NumBytes
+        );
+
+    void
+    ApplyTable(
+        _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+        _In_ SIZE_T NumBytes
+        );
+
+//
+// Public methods
+//
+public:
+
+    CBufferTransform(
+        VOID
+        ) :
+        m_Type(BufferTransformNone),
+        m_Kernel(BufferTransformKernelByte),
+        m_XorMask(0)
+    {
+        for (ULONG i = 0; i < ARRAY_SIZE(m_Table); i++)
+        {
+            m_Table[i] = (BYTE) i;
+        }
+    }
+
+    //
+    // Configuration methods. Each selects the widest kernel the processor
+    // supports for the transform. SetByteSwap takes an element size of 2
+    // or 4 and fails for anything else.
+    //
+
+    void
+    SetXor(
+        _In_ BYTE Mask
+        );
+
+    HRESULT
+    SetByteSwap(
+        _In_ ULONG ElementSize
+        );
+
+    void
+    SetTable(
+        _In_reads_(256) const BYTE *Table
+        );
+
+    //
+    // Builds the transform that undoes Other. Fails if Other is a lookup
+    // table that is not a permutation of the byte values.
+    //
+
+    HRESULT
+    SetInverseOf(
+        _In_ const CBufferTransform &Other
+        );
+
+    //
+    // Forces a narrower kernel than the one selected by the Set* methods
+    // (for example to compare kernels). Wider kernels than the processor
+    // supports are refused.
+    //
+
+    HRESULT
+    SetKernel(
+        _In_ BUFFER_TRANSFORM_KERNEL Kernel
+        );
+
+    BUFFER_TRANSFORM_TYPE
+    GetType(
+        VOID
+        ) const
+    {
+        return m_Type;
+    }
+
+    BUFFER_TRANSFORM_KERNEL
+    GetKernel(
+        VOID
+        ) const
+    {
+        return m_Kernel;
+    }
+
+    //
+    // Applies the transform in place
+    //
+
+    void
+    Apply(
+        _Inout_updates_bytes_(NumBytes) PBYTE Buffer,
+        _In_ SIZE_T NumBytes
+        );
+};
@@ -85,6 +85,7 @@ typedef class CMyQueue  *PCMyQueue;
 #include "comsup.h"
 #include "driver.h"
 #include "device.h"
+#include "transform.h"
 #include "queue.h"
 
 __forceinline 
@@ -1830,8 +1830,8 @@ CMyDevice::PlaybackFile(
 
   Routine Description:
 
-    This method impersonates the caller, opens the file and prints each
-    character to the seven segement display.
+    This method impersonates the caller, opens the file and plays each
+    character to the seven segement display through the playback engine.
 
   Arguments:
 
@@ -1848,6 +1848,7 @@ CMyDevice::PlaybackFile(
 {
     PLAYBACK_IMPERSONATION_CONTEXT context = {PlayInfo, NULL, S_OK};
     IWDFIoRequest2* fxRequest2;
+    CPlaybackEngine* engine = NULL;
 
     HRESULT hr;
 
@@ -1889,69 +1890,19 @@ CMyDevice::PlaybackFile(
     _Analysis_assume_(context.FileHandle != NULL);
 
     //
-    // Read from the file one character at a time until we hit
-    // EOF or the request is cancelled.
+    // Hand the file to the playback engine, which streams it to the
+    // display until we hit EOF or the request is cancelled.
     //
 
-    do
-    {
-        UCHAR c;
-        ULONG bytesRead;
-
-        //
-        // Check for cancellation.
-        //
+    #pragma prefast(suppress:__WARNING_USING_UNINIT_VAR,"Above this->Release() method does not actually free 'this'")
+    hr = CPlaybackEngine::CreateInstance(this, fxRequest2, &engine);
 
-        if (fxRequest2->IsCanceled())
-        {
-            hr = HRESULT_FROM_WIN32(ERROR_CANCELLED);
-        }
-        else
-        {
-            BOOL result;
-
-            //
-            // Read a character from the file and see if we can
-            // encode it on the display.
-            //
-
-            result = ReadFile(context.FileHandle,
-                              &c,
-                              sizeof(c),
-                              &bytesRead,
-                              NULL);
-
-            if (result)
-            {
-                SEVEN_SEGMENT segment;
-                BAR_GRAPH_STATE barGraph;
-
-                if (bytesRead > 0)
-                {
-                    #pragma prefast(suppress:__WARNING_USING_UNINIT_VAR,"Above this->Release() method does not actually free 'this'")
-                    if(EncodeSegmentValue(c, &segment) == true)
-                    {
-                        barGraph.BarsAsUChar = c;
-
-                        SetSevenSegmentDisplay(&segment);
-                        SetBarGraphDisplay(&barGraph);
-                    }
-
-                    Sleep(PlayInfo->Delay);
-                }
-                else
-                {
-                    hr = S_OK;
-                    break;
-                }
-            }
-            else
-            {
-                hr = HRESULT_FROM_WIN32(GetLastError());
-            }
-        }
+    if (SUCCEEDED(hr))
+    {
+        hr = engine->Play(context.FileHandle, PlayInfo->Delay);
 
-    } while(SUCCEEDED(hr));
+        engine->Release();
+    }
 
     CloseHandle(context.FileHandle);
 
@@ -2015,7 +1966,7 @@ CMyDevice::EncodeSegmentValue(
     _Out_ SEVEN_SEGMENT *SevenSegment
     )
 {
-    UCHAR letterMap[] = {
+    static const UCHAR letterMap[] = {
         (SS_TOP | SS_BOTTOM_LEFT | SS_RIGHT | SS_CENTER | SS_BOTTOM),   // a
         (SS_LEFT | SS_CENTER | SS_BOTTOM | SS_BOTTOM_RIGHT),            // b
         (SS_CENTER | SS_BOTTOM_LEFT | SS_BOTTOM),                       // c
@@ -2048,7 +1999,7 @@ CMyDevice::EncodeSegmentValue(
          SS_BOTTOM_LEFT),                                               // z
     };
 
-    UCHAR numberMap[] = {
+    static const UCHAR numberMap[] = {
         (SS_LEFT | SS_TOP | SS_BOTTOM | SS_RIGHT | SS_DOT),             // 0
         (SS_RIGHT | SS_DOT),                                            // 1
         (SS_TOP |
@@ -0,0 +1,623 @@
+/*++
+
+Copyright (C) Microsoft Corporation, All Rights Reserved.
+
+Module Name:
+
+    Playback.cpp
+
+Abstract:
+
+    This module contains the implementation of the UMDF OSR Fx2 driver's
+    file playback engine.
+
+Environment:
+
+   Windows User-Mode Driver Framework (WUDF)
+
+--*/
+#include "internal.h"
+
+#include "playback.tmh"
+
+CPlaybackEngine::CPlaybackEngine(
+    _In_ PCMyDevice Device,
+    _In_ IWDFIoRequest2 *FxRequest
+    ) :
+    m_Device(Device),
+    m_UsbTarget(Device->GetUsbTargetDevice()),
+    m_FxRequest(FxRequest),
+    m_InFlight(0),
+    m_TransferCompleted(NULL),
+    m_TransferError(S_OK)
+{
+    m_Device->AddRef();
+    m_FxRequest->AddRef();
+
+    ZeroMemory(m_Transfers, sizeof(m_Transfers));
+}
+
+CPlaybackEngine::~CPlaybackEngine(
+    VOID
+    )
+{
+    WUDF_TEST_DRIVER_ASSERT(0 == m_InFlight);
+
+    for (ULONG i = 0; i < ARRAYSIZE(m_Transfers); i++)
+    {
+        PPLAYBACK_TRANSFER transfer = &m_Transfers[i];
+
+        SAFE_RELEASE(transfer->Memory);
+
+        if (NULL != transfer->Request)
+        {
+            transfer->Request->DeleteWdfObject();
+        }
+
+        SAFE_RELEASE(transfer->Request);
+    }
+
+    if (NULL != m_TransferCompleted)
+    {
+        CloseHandle(m_TransferCompleted);
+    }
+
+    SAFE_RELEASE(m_FxRequest);
+    SAFE_RELEASE(m_Device);
+}
+
+HRESULT
+CPlaybackEngine::CreateInstance(
+    _In_ PCMyDevice Device,
+    _In_ IWDFIoRequest2 *FxRequest,
+    _Out_ CPlaybackEngine **Engine
+    )
+/*++
+
+  Routine Description:
+
+    This method creates and initializes an instance of the playback engine.
+
+  Arguments:
+
+    Device - the device to play back to.
+
+    FxRequest - the PLAY_FILE request, polled for cancellation.
+
+    Engine - a location to store the referenced pointer to the engine.
+
+  Return Value:
+
+    Status
+
+--*/
+{
+    CPlaybackEngine *engine;
+    HRESULT hr;
+
+    engine = new CPlaybackEngine(Device, FxRequest);
+
+    if (NULL == engine)
+    {
+        return E_OUTOFMEMORY;
+    }
+
+    hr = engine->Initialize();
+
+    if (SUCCEEDED(hr))
+    {
+        *Engine = engine;
+    }
+    else
+    {
+        engine->Release();
+    }
+
+    return hr;
+}
+
+HRESULT
+CPlaybackEngine::QueryInterface(
+    _In_ REFIID InterfaceId,
+    _Outptr_ PVOID *Object
+    )
+{
+    HRESULT hr;
+
+    if (IsEqualIID(InterfaceId, __uuidof(IRequestCallbackRequestCompletion)))
+    {
+        *Object = QueryIRequestCallbackRequestCompletion();
+        hr = S_OK;
+    }
+    else
+    {
+        hr = CUnknown::QueryInterface(InterfaceId, Object);
+    }
+
+    return hr;
+}
+
+HRESULT
+CPlaybackEngine::Initialize(
+    VOID
+    )
+/*++
+
+  Routine Description:
+
+    This method creates the pool of control transfer requests. Each request
+    is created once, bound to its own one byte transfer buffer, and reused
+    for every frame of the playback.
+
+  Arguments:
+
+    None
+
+  Return Value:
+
+    Status
+
+--*/
+{
+    IWDFDevice *fxDevice = m_Device->GetFxDevice();
+    IWDFDriver *fxDriver = NULL;
+    HRESULT hr = S_OK;
+
+    m_TransferCompleted = CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    if (NULL == m_TransferCompleted)
+    {
+        return HRESULT_FROM_WIN32(GetLastError());
+    }
+
+    fxDevice->GetDriver(&fxDriver);
+
+    for (ULONG i = 0; i < ARRAYSIZE(m_Transfers) && SUCCEEDED(hr); i++)
+    {
+        PPLAYBACK_TRANSFER transfer = &m_Transfers[i];
+        IWDFIoRequest *fxRequest = NULL;
+
+        hr = fxDevice->CreateRequest(NULL, //pCallbackInterface
+                                     NULL, //pParentObject
+                                     &fxRequest);
+
+        if (SUCCEEDED(hr))
+        {
+            hr = fxRequest->QueryInterface(IID_PPV_ARGS(&transfer->Request));
+
+            if (FAILED(hr))
+            {
+                fxRequest->DeleteWdfObject();
+            }
+
+            fxRequest->Release();
+        }
+
+        if (SUCCEEDED(hr))
+        {
+            hr = fxDriver->CreatePreallocatedWdfMemory(&transfer->Data,
+                                                       sizeof(transfer->Data),
+                                                       NULL, //pCallbackInterface
+                                                       transfer->Request, //pParentObject
+                                                       &transfer->Memory);
+        }
+    }
+
+    SAFE_RELEASE(fxDriver);
+
+    if (FAILED(hr))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            "%!FUNC!: Could not create playback transfer pool, %!hresult!",
+            hr
+            );
+    }
+
+    return hr;
+}
+
+ULONG
+CPlaybackEngine::EncodeFrames(
+    _In_reads_(Count) PUCHAR Characters,
+    _In_ ULONG Count
+    )
+/*++
+
+  Routine Description:
+
+    This method encodes a chunk of the playback file into display frames.
+
+  Arguments:
+
+    Characters - the characters read from the file.
+
+    Count - the number of characters.
+
+  Return Value:
+
+    Number of frames encoded (one per character)
+
+--*/
+{
+    for (ULONG i = 0; i < Count; i++)
+    {
+        PPLAYBACK_FRAME frame = &m_Frames[i];
+
+        frame->Visible = m_Device->EncodeSegmentValue(Characters[i],
+                                                      &frame->Segment) ? TRUE : FALSE;
+        frame->BarGraph.BarsAsUChar = Characters[i];
+    }
+
+    return Count;
+}
+
+HRESULT
+CPlaybackEngine::CheckForAbort(
+    VOID
+    )
+{
+    if (m_FxRequest->IsCanceled())
+    {
+        return HRESULT_FROM_WIN32(ERROR_CANCELLED);
+    }
+
+    return m_TransferError;
+}
+
+HRESULT
+CPlaybackEngine::WaitForDeadline(
+    _In_ ULONGLONG Deadline
+    )
+/*++
+
+  Routine Description:
+
+    This method waits until Deadline (in GetTickCount64 units), waking up
+    at least every PLAYBACK_CANCEL_POLL_MSEC to check for cancellation
+    and transfer failures.
+
+  Arguments:
+
+    Deadline - the tick count to wait for.
+
+  Return Value:
+
+    S_OK once the deadline is reached, otherwise the abort status
+
+--*/
+{
+    HRESULT hr;
+
+    for (;;)
+    {
+        ULONGLONG now;
+
+        hr = CheckForAbort();
+
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        now = GetTickCount64();
+
+        if (now >= Deadline)
+        {
+            break;
+        }
+
+        Sleep((DWORD) min(Deadline - now, PLAYBACK_CANCEL_POLL_MSEC));
+    }
+
+    return hr;
+}
+
+HRESULT
+CPlaybackEngine::AcquireTransfer(
+    _Out_ PPLAYBACK_TRANSFER *Transfer
+    )
+/*++
+
+  Routine Description:
+
+    This method returns an idle transfer from the pool, waiting for an
+    outstanding one to complete if all are in flight.
+
+  Arguments:
+
+    Transfer - a location to store the transfer.
+
+  Return Value:
+
+    S_OK, or the abort status if the playback was cancelled while waiting
+
+--*/
+{
+    HRESULT hr;
+
+    *Transfer = NULL;
+
+    for (;;)
+    {
+        hr = CheckForAbort();
+
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        for (ULONG i = 0; i < ARRAYSIZE(m_Transfers); i++)
+        {
+            if (0 == InterlockedCompareExchange(&m_Transfers[i].Busy, 1, 0))
+            {
+                *Transfer = &m_Transfers[i];
+                return S_OK;
+            }
+        }
+
+        WaitForSingleObject(m_TransferCompleted, PLAYBACK_CANCEL_POLL_MSEC);
+    }
+
+    return hr;
+}
+
+HRESULT
+CPlaybackEngine::SendTransfer(
+    _In_ UCHAR VendorCommand,
+    _In_ UCHAR Data
+    )
+/*++
+
+  Routine Description:
+
+    This method asynchronously sends a one byte host-to-device vendor
+    command using a transfer from the pool.
+
+  Arguments:
+
+    VendorCommand - the vendor command to send.
+
+    Data - the data byte for the command.
+
+  Return Value:
+
+    Status
+
+--*/
+{
+    WINUSB_CONTROL_SETUP_PACKET setupPacket;
+    IRequestCallbackRequestCompletion *completionCallback;
+    PPLAYBACK_TRANSFER transfer;
+    HRESULT hr;
+
+    hr = AcquireTransfer(&transfer);
+
+    if (FAILED(hr))
+    {
+        return hr;
+    }
+
+    transfer->Data = Data;
+
+    WINUSB_CONTROL_SETUP_PACKET_INIT( &setupPacket,
+                                      BmRequestHostToDevice,
+                                      BmRequestToDevice,
+                                      VendorCommand,
+                                      0,
+                                      0 );
+
+    hr = transfer->Request->Reuse(S_OK);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_UsbTarget->FormatRequestForControlTransfer(transfer->Request,
+                                                          &(setupPacket.WinUsb),
+                                                          transfer->Memory,
+                                                          NULL); //TransferOffset
+    }
+
+    if (SUCCEEDED(hr))
+    {
+        completionCallback = QueryIRequestCallbackRequestCompletion();
+
+        transfer->Request->SetCompletionCallback(completionCallback, transfer);
+
+        completionCallback->Release();
+
+        //
+        // The completion holds a reference on the engine until it has
+        // signaled the drain, which may return as soon as m_InFlight
+        // drops to zero.
+        //
+        this->AddRef();
+        InterlockedIncrement(&m_InFlight);
+
+        hr = transfer->Request->Send(m_UsbTarget,
+                                     0,  //flags
+                                     0); //timeout
+
+        if (FAILED(hr))
+        {
+            InterlockedDecrement(&m_InFlight);
+            this->Release();
+        }
+    }
+
+    if (FAILED(hr))
+    {
+        InterlockedExchange(&transfer->Busy, 0);
+    }
+
+    return hr;
+}
+
+VOID
+CPlaybackEngine::CancelAndDrain(
+    _In_ BOOLEAN Cancel
+    )
+/*++
+
+  Routine Description:
+
+    This method waits for all outstanding transfers to complete, optionally
+    cancelling them first.
+
+  Arguments:
+
+    Cancel - TRUE to cancel the outstanding transfers.
+
+  Return Value:
+
+    None
+
+--*/
+{
+    if (Cancel)
+    {
+        for (ULONG i = 0; i < ARRAYSIZE(m_Transfers); i++)
+        {
+            if (0 != m_Transfers[i].Busy)
+            {
+                m_Transfers[i].Request->CancelSentRequest();
+            }
+        }
+    }
+
+    while (0 != m_InFlight)
+    {
+        WaitForSingleObject(m_TransferCompleted, INFINITE);
+    }
+}
+
+HRESULT
+CPlaybackEngine::Play(
+    _In_ HANDLE FileHandle,
+    _In_ ULONG FramePeriod
+    )
+/*++
+
+  Routine Description:
+
+    This method plays the file to the seven segment and bar graph displays.
+
+    Frame N is sent at start + N * FramePeriod, so time spent reading the
+    file or waiting for transfers does not accumulate as drift. Transfers
+    are not waited on individually; up to PLAYBACK_TRANSFERS_IN_FLIGHT may
+    be outstanding.
+
+  Arguments:
+
+    FileHandle - the opened playback file.
+
+    FramePeriod - the time each character stays on the display, in
+        milliseconds.
+
+  Return Value:
+
+    Status
+
+--*/
+{
+    ULONGLONG start = GetTickCount64();
+    ULONGLONG frameNumber = 0;
+    HRESULT hr = S_OK;
+
+    while (SUCCEEDED(hr))
+    {
+        ULONG bytesRead = 0;
+        ULONG frameCount;
+
+        hr = CheckForAbort();
+
+        if (FAILED(hr))
+        {
+            break;
+        }
+
+        if (!ReadFile(FileHandle,
+                      m_ReadBuffer,
+                      sizeof(m_ReadBuffer),
+                      &bytesRead,
+                      NULL))
+        {
+            hr = HRESULT_FROM_WIN32(GetLastError());
+            break;
+        }
+
+        if (0 == bytesRead)
+        {
+            break;
+        }
+
+        frameCount = EncodeFrames(m_ReadBuffer, bytesRead);
+
+        for (ULONG i = 0; i < frameCount && SUCCEEDED(hr); i++, frameNumber++)
+        {
+            PPLAYBACK_FRAME frame = &m_Frames[i];
+
+            hr = WaitForDeadline(start + frameNumber * FramePeriod);
+
+            if (SUCCEEDED(hr) && frame->Visible)
+            {
+                hr = SendTransfer(USBFX2LK_SET_7SEGMENT_DISPLAY,
+                                  frame->Segment.Segments);
+
+                if (SUCCEEDED(hr))
+                {
+                    hr = SendTransfer(USBFX2LK_SET_BARGRAPH_DISPLAY,
+                                      frame->BarGraph.BarsAsUChar);
+                }
+            }
+        }
+    }
+
+    //
+    // Keep the last frame on the display for its whole period
+    //
+
+    if (SUCCEEDED(hr))
+    {
+        hr = WaitForDeadline(start + frameNumber * FramePeriod);
+    }
+
+    CancelAndDrain(FAILED(hr) ? TRUE : FALSE);
+
+    if (SUCCEEDED(hr))
+    {
+        hr = m_TransferError;
+    }
+
+    return hr;
+}
+
+void
+CPlaybackEngine::OnCompletion(
+    _In_ IWDFIoRequest*                 FxRequest,
+    _In_ IWDFIoTarget*                  FxIoTarget,
+    _In_ IWDFRequestCompletionParams*   CompletionParams,
+    _In_ PVOID                          Context
+    )
+{
+    PPLAYBACK_TRANSFER transfer = (PPLAYBACK_TRANSFER) Context;
+    HRESULT hr = CompletionParams->GetCompletionStatus();
+
+    UNREFERENCED_PARAMETER(FxRequest);
+    UNREFERENCED_PARAMETER(FxIoTarget);
+
+    if (FAILED(hr))
+    {
+        InterlockedCompareExchange((volatile LONG *) &m_TransferError, hr, S_OK);
+    }
+
+    InterlockedExchange(&transfer->Busy, 0);
+    InterlockedDecrement(&m_InFlight);
+
+    SetEvent(m_TransferCompleted);
+
+    //
+    // Taken in SendTransfer. This may be the last reference, so the
+    // engine must not be touched afterwards.
+    //
+    this->Release();
+}
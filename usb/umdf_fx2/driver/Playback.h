@@ -0,0 +1,274 @@
+/*++
+
+Copyright (C) Microsoft Corporation, All Rights Reserved
+
+Module Name:
+
+    Playback.h
+
+Abstract:
+
+    This module contains the type definitions for the UMDF OSR Fx2 sample
+    driver's file playback engine.
+
+    The engine reads the playback file in large chunks, encodes each chunk
+    into a batch of display frames and paces the frames against absolute
+    deadlines. Each frame is written to the device with asynchronous
+    control transfers taken from a small pool of reusable requests, so
+    several transfers can be in flight while the next frame is waited on.
+
+Environment:
+
+    Windows User-Mode Driver Framework (WUDF)
+
+--*/
+
+#pragma once
+
+//
+// Number of bytes read from the playback file at a time
+//
+
+#define PLAYBACK_READ_CHUNK_SIZE        4096
+
+//
+// Number of control transfers that may be outstanding at once. Each
+// frame uses two transfers (seven segment display and bar graph).
+//
+
+#define PLAYBACK_TRANSFERS_IN_FLIGHT    8
+
+//
+// Longest time the engine waits before checking the playback request for
+// cancellation
+//
+
+#define PLAYBACK_CANCEL_POLL_MSEC       20
+
+//
+// A pre-encoded display frame
+//
+
+typedef struct _PLAYBACK_FRAME
+{
+    SEVEN_SEGMENT   Segment;
+
+    BAR_GRAPH_STATE BarGraph;
+
+    //
+    // FALSE if the character could not be encoded. The frame still takes
+    // a frame period but nothing is sent to the device.
+    //
+
+    BOOLEAN         Visible;
+
+} PLAYBACK_FRAME, *PPLAYBACK_FRAME;
+
+//
+// A reusable control transfer. Data is the transfer buffer and must stay
+// valid until the request completes.
+//
+
+typedef struct _PLAYBACK_TRANSFER
+{
+    IWDFIoRequest2  *Request;
+
+    IWDFMemory      *Memory;
+
+    UCHAR           Data;
+
+    volatile LONG   Busy;
+
+} PLAYBACK_TRANSFER, *PPLAYBACK_TRANSFER;
+
+class CPlaybackEngine :
+    public CUnknown,
+    public IRequestCallbackRequestCompletion
+{
+
+//
+// Private data members.
+//
+private:
+
+    //
+    // Strong reference to the device callback object
+    //
+
+    PCMyDevice              m_Device;
+
+    //
+    // Weak reference to the USB target, owned by the device
+    //
+
+    IWDFUsbTargetDevice     *m_UsbTarget;
+
+    //
+    // The PLAY_FILE request, polled for cancellation
+    //
+
+    IWDFIoRequest2          *m_FxRequest;
+
+    PLAYBACK_TRANSFER       m_Transfers[PLAYBACK_TRANSFERS_IN_FLIGHT];
+
+    //
+    // Number of transfers sent and not yet completed, and an event set
+    // each time one completes.
+    //
+
+    volatile LONG           m_InFlight;
+
+    HANDLE                  m_TransferCompleted;
+
+    //
+    // First failure reported by a transfer completion
+    //
+
+    volatile HRESULT        m_TransferError;
+
+    UCHAR                   m_ReadBuffer[PLAYBACK_READ_CHUNK_SIZE];
+
+    PLAYBACK_FRAME          m_Frames[PLAYBACK_READ_CHUNK_SIZE];
+
+//
+// Private methods.
+//
+private:
+
+    CPlaybackEngine(
+        _In_ PCMyDevice Device,
+        _In_ IWDFIoRequest2 *FxRequest
+        );
+
+    virtual
+    ~CPlaybackEngine(
+        VOID
+        );
+
+    HRESULT
+    Initialize(
+        VOID
+        );
+
+    ULONG
+    EncodeFrames(
+        _In_reads_(Count) PUCHAR Characters,
+        _In_ ULONG Count
+        );
+
+    HRESULT
+    CheckForAbort(
+        VOID
+        );
+
+    HRESULT
+    WaitForDeadline(
+        _In_ ULONGLONG Deadline
+        );
+
+    HRESULT
+    AcquireTransfer(
+        _Out_ PPLAYBACK_TRANSFER *Transfer
+        );
+
+    HRESULT
+    SendTransfer(
+        _In_ UCHAR VendorCommand,
+        _In_ UCHAR Data
+        );
+
+    VOID
+    CancelAndDrain(
+        _In_ BOOLEAN Cancel
+        );
+
+    IRequestCallbackRequestCompletion *
+    QueryIRequestCallbackRequestCompletion(
+        VOID
+        )
+    {
+        AddRef();
+        return static_cast<IRequestCallbackRequestCompletion *>(this);
+    }
+
+//
+// Public methods
+//
+public:
+
+    //
+    // The factory method used to create an instance of this class
+    //
+
+    static
+    HRESULT
+    CreateInstance(
+        _In_ PCMyDevice Device,
+        _In_ IWDFIoRequest2 *FxRequest,
+        _Out_ CPlaybackEngine **Engine
+        );
+
+    //
+    // Plays FileHandle to the display, one character every FramePeriod
+    // milliseconds, until the end of the file or until the request is
+    // cancelled.
+    //
+
+    HRESULT
+    Play(
+        _In_ HANDLE FileHandle,
+        _In_ ULONG FramePeriod
+        );
+
+//
+// COM methods
+//
+public:
+
+    //
+    // IUnknown methods.
+    //
+
+    virtual
+    ULONG
+    STDMETHODCALLTYPE
+    AddRef(
+        VOID
+        )
+    {
+        return __super::AddRef();
+    }
+
+    _At_(this, __drv_freesMem(object))
+    virtual
+    ULONG
+    STDMETHODCALLTYPE
+    Release(
+        VOID
+       )
+    {
+        return __super::Release();
+    }
+
+    virtual
+    HRESULT
+    STDMETHODCALLTYPE
+    QueryInterface(
+        _In_ REFIID InterfaceId,
+        _Outptr_ PVOID *Object
+        );
+
+    //
+    // IRequestCallbackRequestCompletion
+    //
+
+    virtual
+    void
+    STDMETHODCALLTYPE
+    OnCompletion(
+        _In_ IWDFIoRequest*                 FxRequest,
+        _In_ IWDFIoTarget*                  FxIoTarget,
+        _In_ IWDFRequestCompletionParams*   CompletionParams,
+        _In_ PVOID                          Context
+        );
+};
@@ -142,6 +142,7 @@ typedef class CCancelCallback *PCCancelCallback;
 #include "queue.h"
 #include "ControlQueue.h"
 #include "ReadWriteQueue.h"
+#include "Playback.h"
 #include "list.h"
 
 __forceinline 
@@ -82,3 +82,149 @@ RequestGetHidXferPacket_ToWriteToDevice(
     RtlCopyMemory(Packet, WdfRequestWdmGetIrp(Request)->UserBuffer, sizeof(HID_XFER_PACKET));
     return STATUS_SUCCESS;
 }
+
+NTSTATUS
+CaptureMap(
+    _In_  PCUNICODE_STRING  FileName,
+    _Out_ PCAPTURE_MAPPING  Mapping
+    )
+/*++
+
+Routine Description:
+
+    Maps a capture file read-only in system space and locks the view, so
+    the replay timer can read it at DISPATCH_LEVEL.
+
+Arguments:
+
+    FileName - NT path of the capture file.
+
+    Mapping - Receives the mapping.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    NTSTATUS                    status;
+    OBJECT_ATTRIBUTES           objectAttributes;
+    IO_STATUS_BLOCK             ioStatus;
+    FILE_STANDARD_INFORMATION   fileInformation;
+    HANDLE                      file;
+    HANDLE                      section;
+    SIZE_T                      viewSize = 0;
+
+    RtlZeroMemory(Mapping, sizeof(CAPTURE_MAPPING));
+
+    InitializeObjectAttributes(&objectAttributes,
+                               (PUNICODE_STRING)FileName,
+                               OBJ_KERNEL_HANDLE | OBJ_CASE_INSENSITIVE,
+                               NULL,
+                               NULL);
+
+    status = ZwOpenFile(&file,
+                        GENERIC_READ | SYNCHRONIZE,
+                        &objectAttributes,
+                        &ioStatus,
+                        FILE_SHARE_READ,
+                        FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: ZwOpenFile failed 0x%x\n", status));
+        return status;
+    }
+
+    status = ZwQueryInformationFile(file,
+                                    &ioStatus,
+                                    &fileInformation,
+                                    sizeof(fileInformation),
+                                    FileStandardInformation);
+    if (NT_SUCCESS(status) &&
+        (fileInformation.EndOfFile.QuadPart == 0 ||
+         fileInformation.EndOfFile.QuadPart > REPLAY_MAX_CAPTURE_SIZE)) {
+        status = STATUS_INVALID_IMAGE_FORMAT;
+    }
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: bad capture file 0x%x\n", status));
+        ZwClose(file);
+        return status;
+    }
+
+    InitializeObjectAttributes(&objectAttributes, NULL, OBJ_KERNEL_HANDLE, NULL, NULL);
+
+    status = ZwCreateSection(&section,
+                             SECTION_MAP_READ | SECTION_QUERY,
+                             &objectAttributes,
+                             NULL,
+                             PAGE_READONLY,
+                             SEC_COMMIT,
+                             file);
+    ZwClose(file);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: ZwCreateSection failed 0x%x\n", status));
+        return status;
+    }
+
+    status = ObReferenceObjectByHandle(section,
+                                       SECTION_MAP_READ,
+                                       NULL,
+                                       KernelMode,
+                                       &Mapping->SectionObject,
+                                       NULL);
+    ZwClose(section);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: ObReferenceObjectByHandle failed 0x%x\n", status));
+        Mapping->SectionObject = NULL;
+        return status;
+    }
+
+    status = MmMapViewInSystemSpace(Mapping->SectionObject, &Mapping->View, &viewSize);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: MmMapViewInSystemSpace failed 0x%x\n", status));
+        Mapping->View = NULL;
+        CaptureUnmap(Mapping);
+        return status;
+    }
+
+    Mapping->Size = (SIZE_T)fileInformation.EndOfFile.QuadPart;
+
+    Mapping->Mdl = IoAllocateMdl(Mapping->View, (ULONG)Mapping->Size, FALSE, FALSE, NULL);
+    if (Mapping->Mdl == NULL) {
+        CaptureUnmap(Mapping);
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    __try {
+        MmProbeAndLockPages(Mapping->Mdl, KernelMode, IoReadAccess);
+    }
+    __except (EXCEPTION_EXECUTE_HANDLER) {
+        status = GetExceptionCode();
+    }
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("CaptureMap: MmProbeAndLockPages failed 0x%x\n", status));
+        IoFreeMdl(Mapping->Mdl);
+        Mapping->Mdl = NULL;
+        CaptureUnmap(Mapping);
+        return status;
+    }
+
+    return status;
+}
+
+VOID
+CaptureUnmap(
+    _Inout_ PCAPTURE_MAPPING Mapping
+    )
+{
+    if (Mapping->Mdl != NULL) {
+        MmUnlockPages(Mapping->Mdl);
+        IoFreeMdl(Mapping->Mdl);
+    }
+    if (Mapping->View != NULL) {
+        MmUnmapViewInSystemSpace(Mapping->View);
+    }
+    if (Mapping->SectionObject != NULL) {
+        ObDereferenceObject(Mapping->SectionObject);
+    }
+    RtlZeroMemory(Mapping, sizeof(CAPTURE_MAPPING));
+}
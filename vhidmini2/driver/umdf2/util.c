@@ -147,3 +147,92 @@ RequestGetHidXferPacket_ToWriteToDevice(
 
     return status;
 }
+
+NTSTATUS
+CaptureMap(
+    _In_  PCUNICODE_STRING  FileName,
+    _Out_ PCAPTURE_MAPPING  Mapping
+    )
+/*++
+
+Routine Description:
+
+    Maps a capture file read-only into the host process.
+
+Arguments:
+
+    FileName - Win32 path of the capture file.
+
+    Mapping - Receives the mapping.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    WCHAR                   path[REPLAY_MAX_PATH];
+    LARGE_INTEGER           fileSize;
+
+    RtlZeroMemory(Mapping, sizeof(CAPTURE_MAPPING));
+
+    if (FileName->Length == 0 || FileName->Length >= sizeof(path)) {
+        return STATUS_INVALID_PARAMETER;
+    }
+    RtlCopyMemory(path, FileName->Buffer, FileName->Length);
+    path[FileName->Length / sizeof(WCHAR)] = L'\0';
+
+    Mapping->File = CreateFileW(path,
+                                GENERIC_READ,
+                                FILE_SHARE_READ,
+                                NULL,
+                                OPEN_EXISTING,
+                                FILE_ATTRIBUTE_NORMAL,
+                                NULL);
+    if (Mapping->File == INVALID_HANDLE_VALUE) {
+        KdPrint(("CaptureMap: CreateFile failed %d\n", GetLastError()));
+        Mapping->File = NULL;
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    if (!GetFileSizeEx(Mapping->File, &fileSize) ||
+        fileSize.QuadPart == 0 ||
+        fileSize.QuadPart > REPLAY_MAX_CAPTURE_SIZE) {
+        CaptureUnmap(Mapping);
+        return STATUS_INVALID_IMAGE_FORMAT;
+    }
+
+    Mapping->Section = CreateFileMappingW(Mapping->File, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (Mapping->Section == NULL) {
+        KdPrint(("CaptureMap: CreateFileMapping failed %d\n", GetLastError()));
+        CaptureUnmap(Mapping);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Mapping->View = MapViewOfFile(Mapping->Section, FILE_MAP_READ, 0, 0, 0);
+    if (Mapping->View == NULL) {
+        KdPrint(("CaptureMap: MapViewOfFile failed %d\n", GetLastError()));
+        CaptureUnmap(Mapping);
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    Mapping->Size = (SIZE_T)fileSize.QuadPart;
+    return STATUS_SUCCESS;
+}
+
+VOID
+CaptureUnmap(
+    _Inout_ PCAPTURE_MAPPING Mapping
+    )
+{
+    if (Mapping->View != NULL) {
+        UnmapViewOfFile(Mapping->View);
+    }
+    if (Mapping->Section != NULL) {
+        CloseHandle(Mapping->Section);
+    }
+    if (Mapping->File != NULL) {
+        CloseHandle(Mapping->File);
+    }
+    RtlZeroMemory(Mapping, sizeof(CAPTURE_MAPPING));
+}
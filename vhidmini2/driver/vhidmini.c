@@ -42,6 +42,22 @@ HID_REPORT_DESCRIPTOR       G_DefaultReportDescriptor[] = {
     0x96,(OUTPUT_REPORT_SIZE_CB & 0xff), (OUTPUT_REPORT_SIZE_CB >> 8), // REPORT_COUNT
     0x91,0x00,                         // OUTPUT (Data,Ary,Abs)
     0xC0,                           // END_COLLECTION
+
+    //
+    // Load generator test collection, only reported while the generator is
+    // on (LOADGEN_REPORT_DESCRIPTOR_SIZE bytes)
+    //
+    0x06,0x00, 0xFF,                // USAGE_PAGE (Vender Defined Usage Page)
+    0x09,0x02,                      // USAGE (Vendor Usage 0x02)
+    0xA1,0x01,                      // COLLECTION (Application)
+    0x85,TEST_COLLECTION_REPORT_ID,    // REPORT_ID (2)
+    0x09,0x02,                         // USAGE (Vendor Usage 0x02)
+    0x15,0x00,                         // LOGICAL_MINIMUM(0)
+    0x26,0xff, 0x00,                   // LOGICAL_MAXIMUM(255)
+    0x75,0x08,                         // REPORT_SIZE (0x08)
+    0x96,(LOADGEN_INPUT_REPORT_SIZE_CB & 0xff), (LOADGEN_INPUT_REPORT_SIZE_CB >> 8), // REPORT_COUNT
+    0x81,0x00,                         // INPUT (Data,Ary,Abs)
+    0xC0,                           // END_COLLECTION
 };
 
 //
@@ -150,9 +166,11 @@ Return Value:
 {
     NTSTATUS                status;
     WDF_OBJECT_ATTRIBUTES   deviceAttributes;
+    WDF_PNPPOWER_EVENT_CALLBACKS pnpPowerCallbacks;
     WDFDEVICE               device;
     PDEVICE_CONTEXT         deviceContext;
     PHID_DEVICE_ATTRIBUTES  hidAttributes;
+    PMANUAL_QUEUE_CONTEXT   manualQueueContext;
     UNREFERENCED_PARAMETER  (Driver);
 
     KdPrint(("Enter EvtDeviceAdd\n"));
@@ -162,6 +180,15 @@ Return Value:
     //
     WdfFdoInitSetFilter(DeviceInit);
 
+    //
+    // Replay only runs while the device is started
+    //
+    WDF_PNPPOWER_EVENT_CALLBACKS_INIT(&pnpPowerCallbacks);
+    pnpPowerCallbacks.EvtDeviceSelfManagedIoInit    = EvtDeviceSelfManagedIoInit;
+    pnpPowerCallbacks.EvtDeviceSelfManagedIoSuspend = EvtDeviceSelfManagedIoSuspend;
+    pnpPowerCallbacks.EvtDeviceSelfManagedIoRestart = EvtDeviceSelfManagedIoRestart;
+    WdfDeviceInitSetPnpPowerEventCallbacks(DeviceInit, &pnpPowerCallbacks);
+
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
                             &deviceAttributes,
                             DEVICE_CONTEXT);
@@ -233,9 +260,138 @@ Return Value:
         status = STATUS_SUCCESS;
     }
 
+    //
+    // The test collection only exists while the load generator feeds it,
+    // otherwise clients would see an input report that is never sent.
+    //
+    manualQueueContext = GetManualQueueContext(deviceContext->ManualQueue);
+    if (deviceContext->ReportDescriptor == G_DefaultReportDescriptor &&
+        manualQueueContext->LoadGenerator.ReportsPerSecond == 0) {
+        deviceContext->HidDescriptor.DescriptorList[0].wReportLength =
+            sizeof(G_DefaultReportDescriptor) - LOADGEN_REPORT_DESCRIPTOR_SIZE;
+    }
+
+    //
+    // In replay mode the device looks like the captured one, so the report
+    // descriptor stored in the capture overrides both of the above.
+    //
+    if (manualQueueContext->Replay.Descriptor != NULL) {
+        deviceContext->ReportDescriptor = manualQueueContext->Replay.Descriptor;
+        deviceContext->HidDescriptor.DescriptorList[0].wReportLength =
+            manualQueueContext->Replay.DescriptorLength;
+        KdPrint(("Using report descriptor from replay capture\n"));
+    }
+
     return status;
 }
 
+NTSTATUS
+EvtDeviceSelfManagedIoInit(
+    _In_  WDFDEVICE         Device
+    )
+/*++
+
+Routine Description:
+
+    Called once the device is first started. Starts the replay, the captured
+    timing is measured from here.
+
+Arguments:
+
+    Device - Handle to a framework device object.
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    PMANUAL_QUEUE_CONTEXT   queueContext;
+    PREPLAY                 replay;
+
+    queueContext = GetManualQueueContext(GetDeviceContext(Device)->ManualQueue);
+    replay = &queueContext->Replay;
+
+    if (replay->Header != NULL) {
+        replay->StartTime = LoadGeneratorGetTime();
+        WdfTimerStart(replay->Timer, WDF_REL_TIMEOUT_IN_MS(1));
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+EvtDeviceSelfManagedIoSuspend(
+    _In_  WDFDEVICE         Device
+    )
+/*++
+
+Routine Description:
+
+    Called when the device leaves D0 or is stopped. Stops the replay timer,
+    parked or not.
+
+Arguments:
+
+    Device - Handle to a framework device object.
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    PMANUAL_QUEUE_CONTEXT   queueContext;
+    PREPLAY                 replay;
+
+    queueContext = GetManualQueueContext(GetDeviceContext(Device)->ManualQueue);
+    replay = &queueContext->Replay;
+
+    if (replay->Header != NULL) {
+        WdfTimerStop(replay->Timer, TRUE);
+        InterlockedExchange(&replay->Parked, FALSE);
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+EvtDeviceSelfManagedIoRestart(
+    _In_  WDFDEVICE         Device
+    )
+/*++
+
+Routine Description:
+
+    Called when the device is back in D0. Resumes an unfinished replay. The
+    record that was due is treated as waiting for a read, so the schedule is
+    shifted by the time spent suspended instead of counting it as lateness.
+
+Arguments:
+
+    Device - Handle to a framework device object.
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    PMANUAL_QUEUE_CONTEXT   queueContext;
+    PREPLAY                 replay;
+
+    queueContext = GetManualQueueContext(GetDeviceContext(Device)->ManualQueue);
+    replay = &queueContext->Replay;
+
+    if (replay->Header != NULL &&
+        replay->Index < replay->Header->RecordCount) {
+        replay->Waiting = TRUE;
+        WdfTimerStart(replay->Timer, WDF_REL_TIMEOUT_IN_MS(1));
+    }
+
+    return STATUS_SUCCESS;
+}
+
 #ifdef _KERNEL_MODE
 EVT_WDF_IO_QUEUE_IO_INTERNAL_DEVICE_CONTROL EvtIoDeviceControl;
 #else
@@ -614,6 +770,7 @@ Return Value:
     }
     else {
         *CompleteRequest = FALSE;
+        ReplayKick(GetManualQueueContext(QueueContext->DeviceContext->ManualQueue));
     }
 
     return status;
@@ -1255,6 +1412,16 @@ Routine Description:
     - Hidclass gets notified for the read request completion and return data to
       the caller.
 
+    When the load generator is enabled in the registry (see
+    ReadLoadGeneratorConfigFromRegistry), a second, fast timer completes the
+    pending requests with test collection reports at the configured rate
+    instead, and the periodic timer is not started.
+
+    Likewise, when a replay capture is configured (see
+    ReadReplayConfigFromRegistry), a replay timer completes the pending
+    requests with the captured reports at their captured times. Replay takes
+    precedence over the load generator.
+
     On the other hand, for IOCTL_HID_WRITE_REPORT request, the driver simply
     sends the request to the hardware (as simulated by storing the data at
     DeviceContext->DeviceData) and completes the request immediately. There is
@@ -1288,6 +1455,7 @@ Return Value:
     WDF_OBJECT_ATTRIBUTES_INIT_CONTEXT_TYPE(
                             &queueAttributes,
                             MANUAL_QUEUE_CONTEXT);
+    queueAttributes.EvtDestroyCallback = EvtManualQueueDestroy;
 
     status = WdfIoQueueCreate(
                             Device,
@@ -1320,7 +1488,26 @@ Return Value:
         return status;
     }
 
-    WdfTimerStart(queueContext->Timer, WDF_REL_TIMEOUT_IN_SEC(1));
+    status = ReplayCreate(queueContext);
+    if( !NT_SUCCESS(status) ) {
+        return status;
+    }
+
+    if (queueContext->Replay.Header == NULL) {
+        status = LoadGeneratorCreate(queueContext);
+        if( !NT_SUCCESS(status) ) {
+            return status;
+        }
+    }
+
+    //
+    // Without replay or load generator the periodic timer first expires
+    // after 1 s and then every timerPeriodInSeconds (5 s).
+    //
+    if (queueContext->Replay.Header == NULL &&
+        queueContext->LoadGenerator.ReportsPerSecond == 0) {
+        WdfTimerStart(queueContext->Timer, WDF_REL_TIMEOUT_IN_SEC(1));
+    }
 
     *Queue = queue;
 
@@ -1378,6 +1565,564 @@ Return Value:
     }
 }
 
+ULONGLONG
+LoadGeneratorGetTime(
+    VOID
+    )
+/*++
+
+Routine Description:
+
+    Returns the performance counter in 100ns units
+
+--*/
+{
+    ULONGLONG               counter;
+    ULONGLONG               frequency;
+
+#ifdef _KERNEL_MODE
+    LARGE_INTEGER           freq;
+
+    counter = (ULONGLONG)KeQueryPerformanceCounter(&freq).QuadPart;
+    frequency = (ULONGLONG)freq.QuadPart;
+#else
+    LARGE_INTEGER           value;
+
+    QueryPerformanceFrequency(&value);
+    frequency = (ULONGLONG)value.QuadPart;
+    QueryPerformanceCounter(&value);
+    counter = (ULONGLONG)value.QuadPart;
+#endif
+
+    return (counter / frequency) * 10000000 +
+           ((counter % frequency) * 10000000) / frequency;
+}
+
+NTSTATUS
+LoadGeneratorCreate(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    )
+/*++
+Routine Description:
+
+    Reads the load generator settings and, if the generator is enabled,
+    prebuilds its reports and creates the timer that produces them.
+
+Arguments:
+
+    QueueContext - The object context associated with the manual queue
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    NTSTATUS                status;
+    PLOAD_GENERATOR         generator = &QueueContext->LoadGenerator;
+    LOAD_GENERATOR_CONFIG   config;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+    WDF_TIMER_CONFIG        timerConfig;
+    WDFMEMORY               memory;
+    PUCHAR                  pattern = NULL;
+    size_t                  patternSize = 0;
+    ULONG                   timerPeriodInMs;
+    ULONG                   i, j;
+
+    RtlZeroMemory(generator, sizeof(LOAD_GENERATOR));
+
+    status = ReadLoadGeneratorConfigFromRegistry(QueueContext->DeviceContext->Device,
+                                                 QueueContext->Queue,
+                                                 &config);
+    if (!NT_SUCCESS(status) || config.ReportsPerSecond == 0) {
+        //
+        // The generator is off unless explicitly configured
+        //
+        return STATUS_SUCCESS;
+    }
+
+    if (config.PatternMemory != NULL) {
+        pattern = (PUCHAR)WdfMemoryGetBuffer(config.PatternMemory, &patternSize);
+        generator->ReportCount = (ULONG)min(patternSize / LOADGEN_PATTERN_SIZE_CB, LOADGEN_MAX_PATTERNS);
+    }
+    if (generator->ReportCount == 0) {
+        pattern = NULL;
+        generator->ReportCount = LOADGEN_DEFAULT_PATTERNS;
+    }
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = QueueContext->Queue;
+    status = WdfMemoryCreate(&attributes,
+                             NonPagedPool,
+                             0,
+                             generator->ReportCount * sizeof(HIDMINI_LOADGEN_INPUT_REPORT),
+                             &memory,
+                             (PVOID*)&generator->Reports);
+    if( !NT_SUCCESS(status) ) {
+        KdPrint(("WdfMemoryCreate failed 0x%x\n",status));
+        return status;
+    }
+
+    for (i = 0; i < generator->ReportCount; i++) {
+        generator->Reports[i].ReportId  = TEST_COLLECTION_REPORT_ID;
+        generator->Reports[i].Sequence  = 0;
+        generator->Reports[i].Timestamp = 0;
+        for (j = 0; j < LOADGEN_PATTERN_SIZE_CB; j++) {
+            generator->Reports[i].Pattern[j] = (pattern != NULL) ?
+                pattern[i * LOADGEN_PATTERN_SIZE_CB + j] :
+                (UCHAR)(i * LOADGEN_PATTERN_SIZE_CB + j);
+        }
+    }
+
+    if (config.PatternMemory != NULL) {
+        WdfObjectDelete(config.PatternMemory);
+    }
+
+    //
+    // A faster rate would need bursts larger than LOADGEN_MAX_BURST, and
+    // the reports beyond it would all be counted as missed.
+    //
+    C_ASSERT(LOADGEN_MAX_REPORTS_PER_SECOND * LOADGEN_MIN_TIMER_PERIOD_MS <=
+             LOADGEN_MAX_BURST * 1000);
+
+    if (config.ReportsPerSecond > LOADGEN_MAX_REPORTS_PER_SECOND) {
+        KdPrint(("Load generator: %u reports/s capped at %u\n",
+                 config.ReportsPerSecond, LOADGEN_MAX_REPORTS_PER_SECOND));
+    }
+    generator->ReportsPerSecond = min(config.ReportsPerSecond, LOADGEN_MAX_REPORTS_PER_SECOND);
+
+    //
+    // Tick once per report for low rates, otherwise as fast as the timer
+    // allows and complete the reports due since the last tick in a burst.
+    //
+    timerPeriodInMs = 1000 / generator->ReportsPerSecond;
+    if (timerPeriodInMs < LOADGEN_MIN_TIMER_PERIOD_MS) {
+        timerPeriodInMs = LOADGEN_MIN_TIMER_PERIOD_MS;
+    }
+
+    WDF_TIMER_CONFIG_INIT_PERIODIC(&timerConfig,
+                                   EvtLoadGeneratorTimerFunc,
+                                   timerPeriodInMs);
+#ifdef _KERNEL_MODE
+    timerConfig.UseHighResolutionTimer = WdfTrue;
+#endif
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = QueueContext->Queue;
+    status = WdfTimerCreate(&timerConfig,
+                            &attributes,
+                            &generator->Timer);
+    if( !NT_SUCCESS(status) ) {
+        KdPrint(("WdfTimerCreate failed 0x%x\n",status));
+        generator->ReportsPerSecond = 0;
+        return status;
+    }
+
+    KdPrint(("Load generator: %d reports/s, timer period %d ms, %d patterns\n",
+             generator->ReportsPerSecond, timerPeriodInMs, generator->ReportCount));
+
+    generator->StartTime = LoadGeneratorGetTime();
+    WdfTimerStart(generator->Timer, WDF_REL_TIMEOUT_IN_MS(timerPeriodInMs));
+
+    return status;
+}
+
+void
+EvtLoadGeneratorTimerFunc(
+    _In_  WDFTIMER          Timer
+    )
+/*++
+Routine Description:
+
+    Load generator timer callback. Works out how many reports have come due
+    since the generator started and completes that many pending read
+    requests back to back.
+
+Arguments:
+
+    Timer - Handle to a timer object that was obtained from WdfTimerCreate.
+
+Return Value:
+
+    VOID
+
+--*/
+{
+    NTSTATUS                status;
+    PMANUAL_QUEUE_CONTEXT   queueContext;
+    PLOAD_GENERATOR         generator;
+    WDFREQUEST              request;
+    HIDMINI_LOADGEN_INPUT_REPORT report;
+    ULONGLONG               now;
+    ULONGLONG               due;
+    ULONG                   pending;
+    ULONG                   completed = 0;
+
+    queueContext = GetManualQueueContext((WDFQUEUE)WdfTimerGetParentObject(Timer));
+    generator = &queueContext->LoadGenerator;
+
+    now = LoadGeneratorGetTime();
+    due = ((now - generator->StartTime) * generator->ReportsPerSecond) / 10000000;
+    if (due <= generator->ReportsDue) {
+        return;
+    }
+
+    if (due - generator->ReportsDue > LOADGEN_MAX_BURST) {
+        //
+        // The timer was held off for long; what does not fit in one burst
+        // is lost rather than delivered late.
+        //
+        generator->ReportsMissed += due - generator->ReportsDue - LOADGEN_MAX_BURST;
+        generator->Sequence += (ULONG)(due - generator->ReportsDue - LOADGEN_MAX_BURST);
+        generator->ReportsDue = due - LOADGEN_MAX_BURST;
+    }
+    pending = (ULONG)(due - generator->ReportsDue);
+    generator->ReportsDue = due;
+
+    while (pending != 0) {
+
+        status = WdfIoQueueRetrieveNextRequest(queueContext->Queue, &request);
+        if (!NT_SUCCESS(status)) {
+            break;
+        }
+
+        report = generator->Reports[generator->Sequence % generator->ReportCount];
+        report.Sequence  = generator->Sequence;
+        report.Timestamp = LoadGeneratorGetTime();
+        generator->Sequence++;
+        pending--;
+
+        status = RequestCopyFromBuffer(request, &report, sizeof(report));
+        WdfRequestComplete(request, status);
+        completed++;
+    }
+
+    //
+    // Reports still pending had no read to complete; skip their sequence
+    // numbers so the loss is visible to the client.
+    //
+    generator->Sequence += pending;
+    generator->ReportsMissed += pending;
+    generator->ReportsCompleted += completed;
+    if (completed > generator->LargestBurst) {
+        generator->LargestBurst = completed;
+    }
+}
+
+VOID
+EvtManualQueueDestroy(
+    _In_  WDFOBJECT         Object
+    )
+/*++
+Routine Description:
+
+    Releases the replay capture once the manual queue and its timers are
+    gone.
+
+Arguments:
+
+    Object - Handle to the manual queue.
+
+Return Value:
+
+    VOID
+
+--*/
+{
+    PMANUAL_QUEUE_CONTEXT   queueContext = GetManualQueueContext((WDFQUEUE)Object);
+
+    CaptureUnmap(&queueContext->Replay.Mapping);
+    queueContext->Replay.Header = NULL;
+}
+
+NTSTATUS
+ReplayCreate(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    )
+/*++
+Routine Description:
+
+    Maps the replay capture named in the registry, checks its layout once so
+    the timer can walk it without further checks, keeps a copy of its report
+    descriptor and creates the replay timer. The timer is started from
+    EvtDeviceSelfManagedIoInit once the device is running.
+
+    A capture that cannot be used is reported and ignored, the device then
+    runs in its normal mode.
+
+Arguments:
+
+    QueueContext - The object context associated with the manual queue
+
+Return Value:
+
+    NTSTATUS
+
+--*/
+{
+    NTSTATUS                status;
+    PREPLAY                 replay = &QueueContext->Replay;
+    REPLAY_CONFIG           config;
+    PHIDMINI_CAPTURE_HEADER header;
+    PHIDMINI_CAPTURE_RECORD record;
+    PUCHAR                  view;
+    PUCHAR                  cursor;
+    PUCHAR                  end;
+    ULONGLONG               previousTimestamp = 0;
+    ULONG                   i;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+    WDF_TIMER_CONFIG        timerConfig;
+    WDFMEMORY               memory;
+
+    RtlZeroMemory(replay, sizeof(REPLAY));
+
+    status = ReadReplayConfigFromRegistry(QueueContext->DeviceContext->Device, &config);
+    if (!NT_SUCCESS(status) || config.CaptureFile.Length == 0) {
+        return STATUS_SUCCESS;
+    }
+
+    status = CaptureMap(&config.CaptureFile, &replay->Mapping);
+    if (!NT_SUCCESS(status)) {
+        KdPrint(("Replay: cannot map capture file 0x%x\n", status));
+        return STATUS_SUCCESS;
+    }
+
+    view   = (PUCHAR)replay->Mapping.View;
+    end    = view + replay->Mapping.Size;
+    header = (PHIDMINI_CAPTURE_HEADER)view;
+
+    if (replay->Mapping.Size < sizeof(HIDMINI_CAPTURE_HEADER) ||
+        header->Signature != HIDMINI_CAPTURE_SIGNATURE ||
+        header->Version != HIDMINI_CAPTURE_VERSION ||
+        header->HeaderSize < sizeof(HIDMINI_CAPTURE_HEADER) ||
+        header->DescriptorLength == 0 ||
+        header->DescriptorLength > MAXUSHORT ||
+        header->DescriptorOffset > replay->Mapping.Size ||
+        header->DescriptorLength > replay->Mapping.Size - header->DescriptorOffset ||
+        header->RecordsOffset > replay->Mapping.Size ||
+        (header->RecordsOffset & 7) != 0 ||
+        header->RecordCount == 0) {
+        status = STATUS_INVALID_IMAGE_FORMAT;
+        goto Invalid;
+    }
+
+    cursor = view + header->RecordsOffset;
+    for (i = 0; i < header->RecordCount; i++) {
+        record = (PHIDMINI_CAPTURE_RECORD)cursor;
+        if ((SIZE_T)(end - cursor) < FIELD_OFFSET(HIDMINI_CAPTURE_RECORD, Report) ||
+            record->ReportLength == 0 ||
+            (SIZE_T)(end - cursor) < HIDMINI_CAPTURE_RECORD_SIZE(record->ReportLength) ||
+            record->Timestamp < previousTimestamp) {
+            status = STATUS_INVALID_IMAGE_FORMAT;
+            goto Invalid;
+        }
+        if (i == 0) {
+            replay->FirstTimestamp = record->Timestamp;
+        }
+        previousTimestamp = record->Timestamp;
+        cursor += HIDMINI_CAPTURE_RECORD_SIZE(record->ReportLength);
+    }
+    replay->LastTimestamp = previousTimestamp;
+
+    //
+    // The device keeps its own copy of the descriptor, it outlives the
+    // manual queue
+    //
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = QueueContext->DeviceContext->Device;
+    status = WdfMemoryCreate(&attributes,
+                             NonPagedPool,
+                             0,
+                             header->DescriptorLength,
+                             &memory,
+                             (PVOID*)&replay->Descriptor);
+    if( !NT_SUCCESS(status) ) {
+        KdPrint(("WdfMemoryCreate failed 0x%x\n",status));
+        goto Invalid;
+    }
+    RtlCopyMemory(replay->Descriptor, view + header->DescriptorOffset, header->DescriptorLength);
+    replay->DescriptorLength = (USHORT)header->DescriptorLength;
+
+    WDF_TIMER_CONFIG_INIT(&timerConfig, EvtReplayTimerFunc);
+#ifdef _KERNEL_MODE
+    timerConfig.UseHighResolutionTimer = WdfTrue;
+#endif
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = QueueContext->Queue;
+    status = WdfTimerCreate(&timerConfig,
+                            &attributes,
+                            &replay->Timer);
+    if( !NT_SUCCESS(status) ) {
+        KdPrint(("WdfTimerCreate failed 0x%x\n",status));
+        replay->Descriptor = NULL;
+        replay->DescriptorLength = 0;
+        WdfObjectDelete(memory);
+        goto Invalid;
+    }
+
+    replay->Header       = header;
+    replay->Records      = view + header->RecordsOffset;
+    replay->Cursor       = replay->Records;
+    replay->Index        = 0;
+    replay->SpeedPercent = config.SpeedPercent;
+    replay->Loop         = config.Loop;
+
+    KdPrint(("Replay: %d reports over %I64u ms, speed %d%%%s\n",
+             header->RecordCount,
+             (replay->LastTimestamp - replay->FirstTimestamp) / 10000,
+             replay->SpeedPercent,
+             replay->Loop ? ", looping" : ""));
+
+    return STATUS_SUCCESS;
+
+Invalid:
+    KdPrint(("Replay: capture file not usable 0x%x\n", status));
+    CaptureUnmap(&replay->Mapping);
+    return STATUS_SUCCESS;
+}
+
+void
+EvtReplayTimerFunc(
+    _In_  WDFTIMER          Timer
+    )
+/*++
+Routine Description:
+
+    Replay timer callback. Completes a pending read with every record that
+    is due, then re-arms the timer for the next record.
+
+    Due times are absolute (start of the pass plus the captured offset scaled
+    by the speed), so scheduling error does not accumulate. When a record is
+    due and no read is pending, it is held and the timer parks until
+    ReadReport forwards the next read and kicks it (see ReplayKick); once
+    delivered the schedule is shifted by the wait so the captured spacing
+    of the following records is kept.
+
+Arguments:
+
+    Timer - Handle to a timer object that was obtained from WdfTimerCreate.
+
+Return Value:
+
+    VOID
+
+--*/
+{
+    NTSTATUS                status;
+    PMANUAL_QUEUE_CONTEXT   queueContext;
+    PREPLAY                 replay;
+    PHIDMINI_CAPTURE_RECORD record;
+    WDFREQUEST              request;
+    ULONGLONG               now;
+    ULONGLONG               due;
+    ULONGLONG               lateness;
+    LONGLONG                delay;
+    ULONG                   queued;
+
+    queueContext = GetManualQueueContext((WDFQUEUE)WdfTimerGetParentObject(Timer));
+    replay = &queueContext->Replay;
+
+    now = LoadGeneratorGetTime();
+
+    for (;;) {
+
+        record = (PHIDMINI_CAPTURE_RECORD)replay->Cursor;
+        due = replay->StartTime +
+              ((record->Timestamp - replay->FirstTimestamp) * 100) / replay->SpeedPercent;
+
+        if (due > now) {
+            delay = (LONGLONG)(due - now);
+            break;
+        }
+
+        status = WdfIoQueueRetrieveNextRequest(queueContext->Queue, &request);
+        if (!NT_SUCCESS(status)) {
+            if (!replay->Waiting) {
+                replay->Waiting = TRUE;
+                replay->ReportsLate++;
+            }
+
+            //
+            // Park until a read kicks the timer. A read forwarded before the
+            // flag was set did not kick it, so look at the queue once more
+            // and take the flag back if a read is already there.
+            //
+            InterlockedExchange(&replay->Parked, TRUE);
+            WdfIoQueueGetState(queueContext->Queue, &queued, NULL);
+            if (queued != 0 && InterlockedExchange(&replay->Parked, FALSE)) {
+                continue;
+            }
+            return;
+        }
+
+        status = RequestCopyFromBuffer(request, record->Report, record->ReportLength);
+        WdfRequestComplete(request, status);
+        replay->ReportsCompleted++;
+
+        now = LoadGeneratorGetTime();
+        lateness = now - due;
+        if (replay->Waiting) {
+            replay->Waiting = FALSE;
+            replay->StartTime += lateness;
+        }
+        else {
+            replay->LatenessTotal += lateness;
+            if (lateness > replay->LatenessMax) {
+                replay->LatenessMax = lateness;
+            }
+        }
+
+        replay->Cursor += HIDMINI_CAPTURE_RECORD_SIZE(record->ReportLength);
+        replay->Index++;
+
+        if (replay->Index == replay->Header->RecordCount) {
+            replay->Passes++;
+            KdPrint(("Replay: pass %I64u done, %I64u reports, %I64u late, max lateness %I64u us\n",
+                     replay->Passes, replay->ReportsCompleted, replay->ReportsLate,
+                     replay->LatenessMax / 10));
+            if (!replay->Loop) {
+                return;
+            }
+
+            //
+            // Next pass starts where this one ended
+            //
+            replay->StartTime = now;
+            replay->Cursor    = replay->Records;
+            replay->Index     = 0;
+        }
+    }
+
+    WdfTimerStart(Timer, -delay);
+}
+
+VOID
+ReplayKick(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    )
+/*++
+Routine Description:
+
+    Called after a read was forwarded to the manual queue. If the replay
+    timer is parked with a record waiting for a read, restarts it so the
+    record goes out right away.
+
+Arguments:
+
+    QueueContext - The object context associated with the manual queue
+
+Return Value:
+
+    VOID
+
+--*/
+{
+    if (InterlockedExchange(&QueueContext->Replay.Parked, FALSE)) {
+        WdfTimerStart(QueueContext->Replay.Timer, WDF_REL_TIMEOUT_IN_US(1));
+    }
+}
+
 NTSTATUS
 CheckRegistryForDescriptor(
         WDFDEVICE Device
@@ -1500,3 +2245,162 @@ Return Value:
     return status;
 }
 
+NTSTATUS
+ReadLoadGeneratorConfigFromRegistry(
+    _In_  WDFDEVICE             Device,
+    _In_  WDFOBJECT             Parent,
+    _Out_ PLOAD_GENERATOR_CONFIG Config
+    )
+/*++
+
+Routine Description:
+
+    Read the load generator settings from device parameters in the registry:
+
+    LoadGeneratorRate    - REG_DWORD, reports per second (0 or absent: off)
+    LoadGeneratorPattern - REG_BINARY, optional payload rows of
+                           LOADGEN_PATTERN_SIZE_CB bytes
+
+Arguments:
+
+    Device - pointer to a device object.
+
+    Parent - object the pattern memory is parented to.
+
+    Config - receives the settings.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    WDFKEY          hKey = NULL;
+    NTSTATUS        status;
+    UNICODE_STRING  valueName;
+    ULONG           value;
+    WDF_OBJECT_ATTRIBUTES   attributes;
+
+    RtlZeroMemory(Config, sizeof(LOAD_GENERATOR_CONFIG));
+
+    status = WdfDeviceOpenRegistryKey(Device,
+                                  PLUGPLAY_REGKEY_DEVICE,
+                                  KEY_READ,
+                                  WDF_NO_OBJECT_ATTRIBUTES,
+                                  &hKey);
+    if (NT_SUCCESS(status)) {
+
+        RtlInitUnicodeString(&valueName, L"LoadGeneratorRate");
+
+        status = WdfRegistryQueryULong (hKey,
+                                  &valueName,
+                                  &value);
+
+        if (NT_SUCCESS (status) && value != 0) {
+
+            Config->ReportsPerSecond = value;
+
+            RtlInitUnicodeString(&valueName, L"LoadGeneratorPattern");
+
+            WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+            attributes.ParentObject = Parent;
+
+            if (!NT_SUCCESS(WdfRegistryQueryMemory (hKey,
+                                  &valueName,
+                                  NonPagedPool,
+                                  &attributes,
+                                  &Config->PatternMemory,
+                                  NULL))) {
+                Config->PatternMemory = NULL;
+            }
+        }
+
+        WdfRegistryClose(hKey);
+    }
+
+    return status;
+}
+
+NTSTATUS
+ReadReplayConfigFromRegistry(
+    _In_  WDFDEVICE             Device,
+    _Out_ PREPLAY_CONFIG        Config
+    )
+/*++
+
+Routine Description:
+
+    Read the replay settings from device parameters in the registry:
+
+    ReplayCaptureFile - REG_SZ, path of the capture file (NT path for the
+                        KMDF driver, Win32 path for the UMDF driver)
+    ReplaySpeed       - REG_DWORD, playback speed in percent (default 100)
+    ReplayLoop        - REG_DWORD, non-zero to restart at the end
+
+Arguments:
+
+    device - pointer to a device object.
+
+    Config - receives the settings.
+
+Return Value:
+
+    NT status code.
+
+--*/
+{
+    WDFKEY          hKey = NULL;
+    NTSTATUS        status;
+    UNICODE_STRING  valueName;
+    ULONG           value;
+
+    RtlZeroMemory(Config, sizeof(REPLAY_CONFIG));
+    Config->CaptureFile.Buffer        = Config->CaptureFileBuffer;
+    Config->CaptureFile.MaximumLength = sizeof(Config->CaptureFileBuffer);
+    Config->SpeedPercent              = 100;
+
+    status = WdfDeviceOpenRegistryKey(Device,
+                                  PLUGPLAY_REGKEY_DEVICE,
+                                  KEY_READ,
+                                  WDF_NO_OBJECT_ATTRIBUTES,
+                                  &hKey);
+    if (NT_SUCCESS(status)) {
+
+        RtlInitUnicodeString(&valueName, L"ReplayCaptureFile");
+
+        status = WdfRegistryQueryUnicodeString (hKey,
+                                  &valueName,
+                                  NULL,
+                                  &Config->CaptureFile);
+
+        if (NT_SUCCESS (status)) {
+
+            //
+            // Drop the terminating NUL stored with the value, if any
+            //
+            while (Config->CaptureFile.Length >= sizeof(WCHAR) &&
+                   Config->CaptureFile.Buffer[Config->CaptureFile.Length / sizeof(WCHAR) - 1] == L'\0') {
+                Config->CaptureFile.Length -= sizeof(WCHAR);
+            }
+
+            RtlInitUnicodeString(&valueName, L"ReplaySpeed");
+            if (NT_SUCCESS(WdfRegistryQueryULong (hKey, &valueName, &value)) &&
+                value != 0) {
+                Config->SpeedPercent = min(value, 10000);
+            }
+
+            RtlInitUnicodeString(&valueName, L"ReplayLoop");
+            if (NT_SUCCESS(WdfRegistryQueryULong (hKey, &valueName, &value))) {
+                Config->Loop = (value != 0);
+            }
+        }
+        else {
+            Config->CaptureFile.Length = 0;
+        }
+
+        WdfRegistryClose(hKey);
+    }
+
+    return status;
+}
+
@@ -32,7 +32,13 @@ typedef UCHAR HID_REPORT_DESCRIPTOR, *PHID_REPORT_DESCRIPTOR;
 
 DRIVER_INITIALIZE                   DriverEntry;
 EVT_WDF_DRIVER_DEVICE_ADD           EvtDeviceAdd;
+EVT_WDF_DEVICE_SELF_MANAGED_IO_INIT     EvtDeviceSelfManagedIoInit;
+EVT_WDF_DEVICE_SELF_MANAGED_IO_SUSPEND  EvtDeviceSelfManagedIoSuspend;
+EVT_WDF_DEVICE_SELF_MANAGED_IO_RESTART  EvtDeviceSelfManagedIoRestart;
 EVT_WDF_TIMER                       EvtTimerFunc;
+EVT_WDF_TIMER                       EvtLoadGeneratorTimerFunc;
+EVT_WDF_TIMER                       EvtReplayTimerFunc;
+EVT_WDF_OBJECT_CONTEXT_DESTROY      EvtManualQueueDestroy;
 
 typedef struct _DEVICE_CONTEXT
 {
@@ -65,11 +71,139 @@ QueueCreate(
     _Out_ WDFQUEUE          *Queue
     );
 
+//
+// Load generator settings, read from the device parameters in the registry
+//
+typedef struct _LOAD_GENERATOR_CONFIG
+{
+    //
+    // Reports produced per second, zero when the generator is off
+    //
+    ULONG                   ReportsPerSecond;
+
+    //
+    // Optional payload rows (LOADGEN_PATTERN_SIZE_CB bytes each), cycled
+    // through one per report
+    //
+    WDFMEMORY               PatternMemory;
+
+} LOAD_GENERATOR_CONFIG, *PLOAD_GENERATOR_CONFIG;
+
+typedef struct _LOAD_GENERATOR
+{
+    WDFTIMER                Timer;
+    ULONG                   ReportsPerSecond;
+
+    //
+    // Prebuilt reports; only Sequence and Timestamp are filled in when a
+    // read is completed
+    //
+    PHIDMINI_LOADGEN_INPUT_REPORT Reports;
+    ULONG                   ReportCount;
+
+    ULONGLONG               StartTime;
+    ULONGLONG               ReportsDue;
+    ULONG                   Sequence;
+
+    //
+    // Statistics. Missed reports were due while no read was pended (or
+    // beyond the burst limit of one tick) and show up as sequence gaps.
+    //
+    ULONGLONG               ReportsCompleted;
+    ULONGLONG               ReportsMissed;
+    ULONG                   LargestBurst;
+
+} LOAD_GENERATOR, *PLOAD_GENERATOR;
+
+//
+// Read-only mapping of a capture file. In kernel mode the view is mapped in
+// system space and locked, so it can be read from the timer DPC.
+//
+typedef struct _CAPTURE_MAPPING
+{
+    PVOID                   View;
+    SIZE_T                  Size;
+#ifdef _KERNEL_MODE
+    PVOID                   SectionObject;
+    PMDL                    Mdl;
+#else
+    HANDLE                  File;
+    HANDLE                  Section;
+#endif
+
+} CAPTURE_MAPPING, *PCAPTURE_MAPPING;
+
+#define REPLAY_MAX_PATH             260
+#define REPLAY_MAX_CAPTURE_SIZE     (64 * 1024 * 1024)
+
+//
+// Replay settings, read from the device parameters in the registry
+//
+typedef struct _REPLAY_CONFIG
+{
+    UNICODE_STRING          CaptureFile;
+    WCHAR                   CaptureFileBuffer[REPLAY_MAX_PATH];
+
+    //
+    // Playback speed in percent of the captured timing
+    //
+    ULONG                   SpeedPercent;
+    BOOLEAN                 Loop;
+
+} REPLAY_CONFIG, *PREPLAY_CONFIG;
+
+typedef struct _REPLAY
+{
+    WDFTIMER                Timer;
+    CAPTURE_MAPPING         Mapping;
+    PHIDMINI_CAPTURE_HEADER Header;
+
+    //
+    // Copy of the captured report descriptor, owned by the device
+    //
+    PHID_REPORT_DESCRIPTOR  Descriptor;
+    USHORT                  DescriptorLength;
+
+    ULONG                   SpeedPercent;
+    BOOLEAN                 Loop;
+
+    //
+    // Next record to play, and the time (performance counter, 100ns) the
+    // first record of the current pass is due
+    //
+    PUCHAR                  Records;
+    PUCHAR                  Cursor;
+    ULONG                   Index;
+    BOOLEAN                 Waiting;
+    ULONGLONG               FirstTimestamp;
+    ULONGLONG               LastTimestamp;
+    ULONGLONG               StartTime;
+
+    //
+    // Set while the timer is stopped waiting for a read, ReadReport takes
+    // it back and restarts the timer
+    //
+    LONG                    Parked;
+
+    //
+    // Statistics. A late report found no pended read when it was due and
+    // was held until one arrived. Lateness is measured against the due time.
+    //
+    ULONGLONG               ReportsCompleted;
+    ULONGLONG               ReportsLate;
+    ULONGLONG               Passes;
+    ULONGLONG               LatenessTotal;
+    ULONGLONG               LatenessMax;
+
+} REPLAY, *PREPLAY;
+
 typedef struct _MANUAL_QUEUE_CONTEXT
 {
     WDFQUEUE                Queue;
     PDEVICE_CONTEXT         DeviceContext;
     WDFTIMER                Timer;
+    LOAD_GENERATOR          LoadGenerator;
+    REPLAY                  Replay;
 
 } MANUAL_QUEUE_CONTEXT, *PMANUAL_QUEUE_CONTEXT;
 
@@ -166,11 +300,81 @@ ReadDescriptorFromRegistry(
     _In_ WDFDEVICE Device
     );
 
+NTSTATUS
+ReadLoadGeneratorConfigFromRegistry(
+    _In_  WDFDEVICE             Device,
+    _In_  WDFOBJECT             Parent,
+    _Out_ PLOAD_GENERATOR_CONFIG Config
+    );
+
+NTSTATUS
+LoadGeneratorCreate(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    );
+
+ULONGLONG
+LoadGeneratorGetTime(
+    VOID
+    );
+
+NTSTATUS
+ReadReplayConfigFromRegistry(
+    _In_  WDFDEVICE             Device,
+    _Out_ PREPLAY_CONFIG        Config
+    );
+
+NTSTATUS
+ReplayCreate(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    );
+
+VOID
+ReplayKick(
+    _In_  PMANUAL_QUEUE_CONTEXT QueueContext
+    );
+
+NTSTATUS
+CaptureMap(
+    _In_  PCUNICODE_STRING      FileName,
+    _Out_ PCAPTURE_MAPPING      Mapping
+    );
+
+VOID
+CaptureUnmap(
+    _Inout_ PCAPTURE_MAPPING    Mapping
+    );
+
 //
 // Misc definitions
 //
 #define CONTROL_FEATURE_REPORT_ID   0x01
 
+//
+// Load generator limits. Rates above one report per timer period are reached
+// by completing up to LOADGEN_MAX_BURST pended reads back to back on each
+// tick, so the rate is capped at what one burst per period can carry. In
+// kernel mode the timer is a high resolution one and can fire every
+// millisecond; a UMDF timer only fires on the system clock tick, 15.6 ms by
+// default.
+//
+#ifdef _KERNEL_MODE
+#define LOADGEN_MIN_TIMER_PERIOD_MS     1
+#define LOADGEN_MAX_REPORTS_PER_SECOND  20000
+#else
+#define LOADGEN_MIN_TIMER_PERIOD_MS     16
+#define LOADGEN_MAX_REPORTS_PER_SECOND  4000
+#endif
+#define LOADGEN_MAX_BURST               64
+
+//
+// Bytes at the end of G_DefaultReportDescriptor that describe the load
+// generator's test collection. They are left out of the reported descriptor
+// while the generator is off.
+//
+#define LOADGEN_REPORT_DESCRIPTOR_SIZE  24
+#define LOADGEN_MAX_PATTERNS            256
+#define LOADGEN_DEFAULT_PATTERNS        16
+
 //
 // These are the device attributes returned by the mini driver in response
 // to IOCTL_HID_GET_DEVICE_ATTRIBUTES.
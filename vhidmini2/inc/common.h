@@ -104,6 +104,26 @@ typedef struct _HIDMINI_OUTPUT_REPORT {
 
 } HIDMINI_OUTPUT_REPORT, *PHIDMINI_OUTPUT_REPORT;
 
+//
+// input produced by the load generator on the test collection. Sequence
+// counts every report the generator was due to produce, so a gap seen by a
+// client is a report that was lost on the way. Timestamp is the time the
+// report was completed, in 100ns units of the performance counter.
+//
+#define LOADGEN_PATTERN_SIZE_CB     16
+
+typedef struct _HIDMINI_LOADGEN_INPUT_REPORT {
+
+    UCHAR ReportId;
+
+    ULONG Sequence;
+
+    ULONGLONG Timestamp;
+
+    UCHAR Pattern[LOADGEN_PATTERN_SIZE_CB];
+
+} HIDMINI_LOADGEN_INPUT_REPORT, *PHIDMINI_LOADGEN_INPUT_REPORT;
+
 #include <poppack.h>
 
 //
@@ -115,5 +135,53 @@ typedef struct _HIDMINI_OUTPUT_REPORT {
 #define FEATURE_REPORT_SIZE_CB      ((USHORT)(sizeof(HIDMINI_CONTROL_INFO) - 1))
 #define INPUT_REPORT_SIZE_CB        ((USHORT)(sizeof(HIDMINI_INPUT_REPORT) - 1))
 #define OUTPUT_REPORT_SIZE_CB       ((USHORT)(sizeof(HIDMINI_OUTPUT_REPORT) - 1))
+#define LOADGEN_INPUT_REPORT_SIZE_CB ((USHORT)(sizeof(HIDMINI_LOADGEN_INPUT_REPORT) - 1))
+
+//
+// Capture file replayed by the minidriver in replay mode. The file starts
+// with a HIDMINI_CAPTURE_HEADER, followed by the report descriptor of the
+// captured device and by RecordCount input reports. Each record is padded
+// to a multiple of 8 bytes (see HIDMINI_CAPTURE_RECORD_SIZE) and records
+// are in increasing timestamp order.
+//
+#define HIDMINI_CAPTURE_SIGNATURE       0x50414348  // "HCAP"
+#define HIDMINI_CAPTURE_VERSION         1
+
+typedef struct _HIDMINI_CAPTURE_HEADER {
+
+    ULONG Signature;
+
+    USHORT Version;
+
+    USHORT HeaderSize;
+
+    ULONG DescriptorOffset;
+
+    ULONG DescriptorLength;
+
+    ULONG RecordsOffset;
+
+    ULONG RecordCount;
+
+} HIDMINI_CAPTURE_HEADER, *PHIDMINI_CAPTURE_HEADER;
+
+typedef struct _HIDMINI_CAPTURE_RECORD {
+
+    //
+    // Time the report was captured, in 100ns units
+    //
+    ULONGLONG Timestamp;
+
+    USHORT ReportLength;
+
+    //
+    // The report, starting with its report ID
+    //
+    UCHAR Report[1];
+
+} HIDMINI_CAPTURE_RECORD, *PHIDMINI_CAPTURE_RECORD;
+
+#define HIDMINI_CAPTURE_RECORD_SIZE(ReportLength) \
+    ((FIELD_OFFSET(HIDMINI_CAPTURE_RECORD, Report) + (ReportLength) + 7) & ~7)
 
 #endif //__VHIDMINI_COMMON_H__